@@ -22,6 +22,12 @@
 #include "io/file_manager.hpp"
 #include "utils/constants.hpp"
 #include "utils/log.hpp"
+#include "utils/string_utils.hpp"
+
+#include <iomanip>
+#include <sstream>
+#include <stdint.h>
+#include <stdio.h>
 
 #ifdef ENABLE_SOUND
 #  include <vorbis/codec.h>
@@ -35,6 +41,10 @@
 #  endif
 #endif
 
+/** Version of the decoded PCM cache files, must be increased if the format
+ *  changes. */
+static const uint32_t PCM_CACHE_VERSION = 1;
+
 //----------------------------------------------------------------------------
 /** Creates a sfx. The parameter are taken from the parameters:
  *  \param file File name of the buffer.
@@ -56,6 +66,8 @@ SFXBuffer::SFXBuffer(const std::string& file,
     m_max_dist    = max_dist;
     m_duration    = -1.0f;
     m_file        = file;
+    m_channels    = 0;
+    m_frequency   = 0;
 
     m_rolloff     = rolloff;
     m_positional  = positional;
@@ -78,6 +90,8 @@ SFXBuffer::SFXBuffer(const std::string& file,
     m_positional  = false;
     m_loaded      = false;
     m_file        = file;
+    m_channels    = 0;
+    m_frequency   = 0;
 
     node->get("rolloff",     &m_rolloff    );
     node->get("positional",  &m_positional );
@@ -86,8 +100,12 @@ SFXBuffer::SFXBuffer(const std::string& file,
     node->get("duration",    &m_duration   );
 }   // SFXBuffer(XMLNode)
 
+
 //----------------------------------------------------------------------------
 /** \brief load the buffer from file into OpenAL.
+ *  The decoded data is taken from prepare() or the PCM cache if available,
+ *  otherwise the file is decoded now. Since this is called lazily when a
+ *  sfx is used the first time, the buffers of unused sfx are never created.
  *  \note If this buffer is already loaded, this call does nothing and 
   *       returns false.
  *  \return Whether loading was successful.
@@ -99,8 +117,20 @@ bool SFXBuffer::load()
 #ifdef ENABLE_SOUND
     if (UserConfigParams::m_enable_sound)
     {
+        std::lock_guard<std::mutex> lock(m_load_mutex);
         if (m_loaded) return false;
-    
+
+        if (m_pcm.empty() && !loadPCMCache(/*read_data*/true))
+        {
+            if (!decodeVorbis(m_file))
+            {
+                Log::error("SFXBuffer", "Could not load sound effect %s",
+                           m_file.c_str());
+                return false;
+            }
+            savePCMCache();
+        }
+
         alGetError(); // clear errors from previously
     
         alGenBuffers(1, &m_buffer);
@@ -110,14 +140,29 @@ bool SFXBuffer::load()
         }
     
         assert(alIsBuffer(m_buffer));
-    
-        if (!loadVorbisBuffer(m_file, m_buffer))
+
+        alBufferData(m_buffer, (m_channels == 1) ? AL_FORMAT_MONO16
+                                                 : AL_FORMAT_STEREO16,
+                     m_pcm.data(), (ALsizei)m_pcm.size(), m_frequency);
+        if (!SFXManager::checkError("filling a buffer"))
         {
-            Log::error("SFXBuffer", "Could not load sound effect %s",
-                       m_file.c_str());
-            // TODO: free al buffer here?
+            alDeleteBuffers(1, &m_buffer);
+            m_buffer = 0;
             return false;
         }
+
+        // Allow the xml data to overwrite the duration, but if there is no
+        // duration (which is the norm), compute it (always 16 bit data):
+        if (m_duration < 0)
+        {
+            m_duration = float(m_pcm.size())
+                       / (m_frequency * m_channels * 2);
+        }
+
+        // OpenAL has its own copy of the data now
+        std::vector<char>().swap(m_pcm);
+        m_loaded = true;
+        return true;
     }
 #endif
 
@@ -133,6 +178,7 @@ bool SFXBuffer::load()
 
 void SFXBuffer::unload()
 {
+    std::lock_guard<std::mutex> lock(m_load_mutex);
 #ifdef ENABLE_SOUND
     if (UserConfigParams::m_enable_sound)
     {
@@ -147,42 +193,139 @@ void SFXBuffer::unload()
 }   // unload
 
 //----------------------------------------------------------------------------
-/** Load a vorbis file into an OpenAL buffer
+/** Makes sure that the decoded data of this sfx is available quickly once
+ *  the sfx is loaded: if there is no valid PCM cache file for this sfx, the
+ *  file is decoded and the cache file is written. The decoded data is only
+ *  kept in memory if it could not be cached. This does not use OpenAL, so
+ *  it can be called from any thread, e.g. to decode all sfx in parallel.
+ */
+void SFXBuffer::prepare()
+{
+#ifdef ENABLE_SOUND
+    if (!UserConfigParams::m_sfx || !UserConfigParams::m_enable_sound)
+        return;
+
+    std::lock_guard<std::mutex> lock(m_load_mutex);
+    if (m_loaded || !m_pcm.empty() || loadPCMCache(/*read_data*/false))
+        return;
+
+    if (decodeVorbis(m_file) && savePCMCache())
+        std::vector<char>().swap(m_pcm);
+#endif
+}   // prepare
+
+//----------------------------------------------------------------------------
+/** Returns the name of the PCM cache file for this sfx. The name contains
+ *  the hash of the sfx file, so a modified file will not use stale data.
+ *  \return The name of the cache file, or "" if the sfx file can not be read.
+ */
+std::string SFXBuffer::getPCMCacheFile() const
+{
+    uint64_t hash;
+    if (!file_manager->getFileHash(m_file, &hash))
+        return "";
+
+    std::ostringstream file;
+    file << file_manager->getCachedDataDir() << "sfx-"
+         << StringUtils::removeExtension(StringUtils::getBasename(m_file))
+         << "-" << std::hex << std::setw(16) << std::setfill('0') << hash
+         << ".bin";
+    return file.str();
+}   // getPCMCacheFile
+
+//----------------------------------------------------------------------------
+/** Loads the decoded data of this sfx from its PCM cache file.
+ *  \param read_data If false, the cache file is only checked to be valid,
+ *         but the data is not read.
+ *  \return True if a valid cache file exists (and was read).
+ */
+bool SFXBuffer::loadPCMCache(bool read_data)
+{
+    if (m_cache_file.empty())
+        m_cache_file = getPCMCacheFile();
+    if (m_cache_file.empty())
+        return false;
+
+    FILE *f = fopen(m_cache_file.c_str(), "rb");
+    if (!f) return false;
+
+    // Version, number of channels, frequency, size of the data
+    uint32_t header[4];
+    bool ok = fread(header, sizeof(uint32_t), 4, f) == 4 &&
+              header[0] == PCM_CACHE_VERSION &&
+              header[1] > 0 && header[2] > 0;
+    if (ok && read_data)
+    {
+        m_pcm.resize(header[3]);
+        ok = fread(m_pcm.data(), 1, header[3], f) == header[3] &&
+             fgetc(f) == EOF;
+        if (ok)
+        {
+            m_channels  = header[1];
+            m_frequency = header[2];
+        }
+        else
+            std::vector<char>().swap(m_pcm);
+    }
+    else if (ok)
+    {
+        ok = fseek(f, 0, SEEK_END) == 0 &&
+             ftell(f) == long(sizeof(header) + header[3]);
+    }
+    fclose(f);
+    if (!ok)
+    {
+        Log::warn("SFXBuffer", "Ignoring invalid sfx cache file '%s'.",
+                  m_cache_file.c_str());
+    }
+    return ok;
+}   // loadPCMCache
+
+//----------------------------------------------------------------------------
+/** Saves the decoded data of this sfx to its PCM cache file.
+ *  \return True if the cache file was written.
+ */
+bool SFXBuffer::savePCMCache() const
+{
+    if (m_cache_file.empty())
+        return false;
+
+    const uint32_t header[4] = { PCM_CACHE_VERSION, (uint32_t)m_channels,
+                                 (uint32_t)m_frequency,
+                                 (uint32_t)m_pcm.size() };
+    std::string data((const char*)header, sizeof(header));
+    data.append((const char*)m_pcm.data(), m_pcm.size());
+    return file_manager->writeCacheFileAtomically(m_cache_file, data);
+}   // savePCMCache
+
+//----------------------------------------------------------------------------
+/** Decodes a vorbis file into 16 bit PCM data (stored in m_pcm). This does
+ *  not use OpenAL, so it can be called from any thread.
  *  based on a routine by Peter Mulholland, used with permission (quote :
  *  "Feel free to use")
+ *  \param name Name of the vorbis file.
  */
-bool SFXBuffer::loadVorbisBuffer(const std::string &name, ALuint buffer)
+bool SFXBuffer::decodeVorbis(const std::string &name)
 {
 #ifdef ENABLE_SOUND
-    if (!UserConfigParams::m_enable_sound)
-        return false;
-        
     const int ogg_endianness = (IS_LITTLE_ENDIAN ? 0 : 1);
 
-
-    bool success = false;
     FILE *file;
     vorbis_info *info;
     OggVorbis_File oggFile;
 
-    if (alIsBuffer(buffer) == AL_FALSE)
-    {
-        Log::error("SFXBuffer", "Error, bad OpenAL buffer");
-        return false;
-    }
-
     file = fopen(name.c_str(), "rb");
 
     if(!file)
     {
-        Log::error("SFXBuffer", "LoadVorbisBuffer() - couldn't open file!");
+        Log::error("SFXBuffer", "decodeVorbis() - couldn't open file!");
         return false;
     }
 
     if (ov_open_callbacks(file, &oggFile, NULL, 0,  OV_CALLBACKS_NOCLOSE) != 0)
     {
         fclose(file);
-        Log::error("SFXBuffer", "LoadVorbisBuffer() - ov_open_callbacks() failed, "
+        Log::error("SFXBuffer", "decodeVorbis() - ov_open_callbacks() failed, "
                                 "file isn't vorbis?");
         return false;
     }
@@ -191,51 +334,28 @@ bool SFXBuffer::loadVorbisBuffer(const std::string &name, ALuint buffer)
 
     // always 16 bit data
     long len = (long)ov_pcm_total(&oggFile, -1) * info->channels * 2;
-
-    char *data = (char *) malloc(len);
-    if(!data)
-    {
-        ov_clear(&oggFile);
-        Log::error("SFXBuffer", "[SFXBuffer] Could not allocate decode buffer.");
-        return false;
-    }
+    m_pcm.resize(len > 0 ? len : 0);
 
     int bs = -1;
-    long todo = len;
-    char *bufpt = data;
+    long done = 0;
 
-    while (todo)
+    while (done < len)
     {
-        int read = ov_read(&oggFile, bufpt, todo, ogg_endianness, 2, 1, &bs);
-        todo -= read;
-        bufpt += read;
+        long read = ov_read(&oggFile, m_pcm.data() + done, int(len - done),
+                            ogg_endianness, 2, 1, &bs);
+        // Skip holes in the data, stop on errors and at the end of file
+        if (read == OV_HOLE) continue;
+        if (read <= 0) break;
+        done += read;
     }
-
-    alBufferData(buffer, (info->channels == 1) ? AL_FORMAT_MONO16
-                 : AL_FORMAT_STEREO16,
-                 data, len, info->rate);
-    success = true;
-
-    free(data);
+    m_pcm.resize(done);
+    m_channels  = info->channels;
+    m_frequency = (int)info->rate;
 
     ov_clear(&oggFile);
     fclose(file);
-
-    // Allow the xml data to overwrite the duration, but if there is no
-    // duration (which is the norm), compute it:
-    if(m_duration < 0)
-    {
-        ALint buffer_size, frequency, bits_per_sample, channels;
-        alGetBufferi(buffer, AL_SIZE,      &buffer_size    );
-        alGetBufferi(buffer, AL_FREQUENCY, &frequency      );
-        alGetBufferi(buffer, AL_CHANNELS,  &channels       );
-        alGetBufferi(buffer, AL_BITS,      &bits_per_sample);
-        m_duration = float(buffer_size) 
-                   / (frequency*channels*(bits_per_sample / 8));
-    }
-    return success;
+    return true;
 #else
     return false;
 #endif
-}   // loadVorbisBuffer
-
+}   // decodeVorbis
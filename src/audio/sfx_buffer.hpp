@@ -33,7 +33,9 @@ typedef unsigned int ALuint;
 #include "utils/vec3.hpp"
 #include "utils/leak_check.hpp"
 
+#include <mutex>
 #include <string>
+#include <vector>
 
 class SFXBase;
 class XMLNode;
@@ -72,7 +74,28 @@ private:
     /** Duration of the sfx. */
     float    m_duration;
 
-    bool loadVorbisBuffer(const std::string &name, ALuint buffer);
+    /** Name of the file with the cached decoded data of this sfx, empty
+     *  if it was not determined yet. */
+    std::string m_cache_file;
+
+    /** The decoded 16 bit PCM data. It is only kept till the OpenAL
+     *  buffer is created, and only if it could not be cached. */
+    std::vector<char> m_pcm;
+
+    /** Number of channels of the PCM data. */
+    int      m_channels;
+
+    /** Sample rate of the PCM data. */
+    int      m_frequency;
+
+    /** Buffers are loaded lazily from different threads, and decoded in
+     *  parallel at startup, so this protects all loading. */
+    std::mutex m_load_mutex;
+
+    std::string getPCMCacheFile() const;
+    bool loadPCMCache(bool read_data);
+    bool savePCMCache() const;
+    bool decodeVorbis(const std::string &name);
 
 public:
 
@@ -91,6 +114,7 @@ public:
 
     bool load();
     void unload();
+    void prepare();
 
     // ------------------------------------------------------------------------
     /** \return whether this buffer was loaded from disk */
@@ -26,6 +26,7 @@
 #include "race/race_manager.hpp"
 #include "utils/profiler.hpp"
 #include "utils/vs.hpp"
+#include "utils/worker_pool.hpp"
 
 #include <pthread.h>
 #include <stdexcept>
@@ -510,16 +511,9 @@ void* SFXManager::mainLoop(void *obj)
  */
 void SFXManager::toggleSound(const bool on)
 {
-    // When activating SFX, load all buffers
+    // When activating SFX, the buffers are loaded lazily once they are used
     if (on)
     {
-        std::map<std::string, SFXBuffer*>::iterator i = m_all_sfx_types.begin();
-        for (; i != m_all_sfx_types.end(); i++)
-        {
-            SFXBuffer* buffer = (*i).second;
-            buffer->load();
-        }
-
         reallyResumeAllNow();
         m_all_sfx.lock();
         const int sfx_amount = (int)m_all_sfx.getData().size();
@@ -592,24 +586,26 @@ void SFXManager::loadSfx()
 
     delete root;
 
-    // Now load them in parallel
-    const int max = (int)m_all_sfx_types.size();
-    SFXBuffer **array = new SFXBuffer *[max];
-    i = 0;
+    if (!m_initialized)
+        return;
 
+    // Now decode them in parallel (or check that their decoded data is
+    // cached). The OpenAL buffers are created lazily when a sfx is used.
+    std::vector<SFXBuffer*> buffers;
+    buffers.reserve(m_all_sfx_types.size());
     for (std::map<std::string, SFXBuffer*>::iterator it = m_all_sfx_types.begin();
          it != m_all_sfx_types.end(); it++)
     {
-        SFXBuffer* const buffer = (*it).second;
-        array[i++] = buffer;
-    }
-
-    for (i = 0; i < max; i++)
-    {
-        array[i]->load();
+        buffers.push_back((*it).second);
     }
 
-    delete [] array;
+    uint64_t start = StkTime::getRealTimeMs();
+    WorkerPool pool(WorkerPool::getDefaultNumThreads(), "SFXDecode");
+    pool.run((unsigned)buffers.size(),
+             [&buffers](unsigned n) { buffers[n]->prepare(); });
+    Log::info("SFXManager", "Prepared %d sfx in %d ms using %d threads.",
+              (int)buffers.size(), (int)(StkTime::getRealTimeMs() - start),
+              pool.getNumThreads());
 }   // loadSfx
 
 // -----------------------------------------------------------------------------
@@ -87,6 +87,11 @@ bool SFXOpenAL::init()
 {
     m_status = SFX_UNKNOWN;
 
+    // Buffers are only loaded once they are used
+    m_sound_buffer->load();
+    if (!m_sound_buffer->isLoaded())
+        return false;
+
     alGenSources(1, &m_sound_source );
     if (!SFXManager::checkError("generating a source"))
         return false;
@@ -383,6 +388,7 @@ void SFXOpenAL::reallyPlayNow(SFXBuffer* buffer)
             reallyStopNow();
 
         m_sound_buffer = buffer;
+        m_sound_buffer->load();
         alSourcei(m_sound_source, AL_BUFFER, m_sound_buffer->getBufferID());
 
         if (!SFXManager::checkError("attaching the buffer to the source"))
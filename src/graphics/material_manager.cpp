@@ -19,6 +19,7 @@
 
 #include "graphics/material_manager.hpp"
 
+#include <algorithm>
 #include <stdexcept>
 #include <sstream>
 
@@ -67,6 +68,8 @@ MaterialManager::~MaterialManager()
         delete m_materials[i];
     }
     m_materials.clear();
+    m_full_path_index.clear();
+    m_name_index.clear();
 
     for (std::map<std::string, Material*> ::iterator it =
          m_default_sp_materials.begin(); it != m_default_sp_materials.end();
@@ -97,51 +100,26 @@ Material* MaterialManager::getMaterialSPM(std::string lay_one_tex_lc,
     lc = lay_two_tex_lc.c_str();
     lc.make_lower();
     lay_two_tex_lc = lc.c_str();
-    if (!lay_one_tex_lc.empty() &&
-        (lay_one_tex_lc.find('/') != std::string::npos ||
-        lay_one_tex_lc.find('\\') != std::string::npos))
+    if (!lay_one_tex_lc.empty())
     {
-        // Search backward so that temporary (track) textures are found first
-        for (int i = (int)m_materials.size() - 1; i >= 0; i--)
+        const bool has_path = lay_one_tex_lc.find('/') != std::string::npos ||
+                              lay_one_tex_lc.find('\\') != std::string::npos;
+        const auto &index = has_path ? m_full_path_index : m_name_index;
+        auto it = index.find(lay_one_tex_lc);
+        if (it != index.end())
         {
-            if (m_materials[i]->getTexFullPath() == lay_one_tex_lc)
+            // Search backward so that temporary (track) textures are
+            // found first
+            const std::vector<Material*> &materials = it->second;
+            for (int i = (int)materials.size() - 1; i >= 0; i--)
             {
-                const std::string& mat_lay_two = m_materials[i]->getUVTwoTexture();
-                if (mat_lay_two.empty() && lay_two_tex_lc.empty())
-                {
-                    return m_materials[i];
-                }
-                else if (!mat_lay_two.empty() && !lay_two_tex_lc.empty())
-                {
-                    if (mat_lay_two == lay_two_tex_lc)
-                    {
-                        return m_materials[i];
-                    }
-                }
+                const std::string& mat_lay_two =
+                    materials[i]->getUVTwoTexture();
+                if (mat_lay_two == lay_two_tex_lc)
+                    return materials[i];
             }
         }
     }
-    else if (!lay_one_tex_lc.empty())
-    {
-        for (int i = (int)m_materials.size() - 1; i >= 0; i--)
-        {
-            if (m_materials[i]->getTexFname() == lay_one_tex_lc)
-            {
-                const std::string& mat_lay_two = m_materials[i]->getUVTwoTexture();
-                if (mat_lay_two.empty() && lay_two_tex_lc.empty())
-                {
-                    return m_materials[i];
-                }
-                else if (!mat_lay_two.empty() && !lay_two_tex_lc.empty())
-                {
-                    if (mat_lay_two == lay_two_tex_lc)
-                    {
-                        return m_materials[i];
-                    }
-                }
-            }
-        }   // for i
-    }
     return getDefaultSPMaterial(def_shader_name,
         StringUtils::getBasename(orignal_layer_one));
 }
@@ -153,30 +131,15 @@ Material* MaterialManager::getMaterialFor(video::ITexture* t)
 
     if (!img_path.empty() && (img_path.findFirst('/') != -1 || img_path.findFirst('\\') != -1))
     {
-        // Search backward so that temporary (track) textures are found first
-        for (int i = (int)m_materials.size() - 1; i >= 0; i--)
-        {
-            if (m_materials[i]->getTexFullPath() == img_path.c_str())
-            {
-                return m_materials[i];
-            }
-        }
+        return findMaterial(m_full_path_index, img_path.c_str());
     }
     else
     {
         core::stringc image(StringUtils::getBasename(img_path.c_str()).c_str());
         image.make_lower();
-
-        for (int i = (int)m_materials.size() - 1; i >= 0; i--)
-        {
-            if (m_materials[i]->getTexFname() == image.c_str())
-            {
-                return m_materials[i];
-            }
-        }   // for i
+        return findMaterial(m_name_index, image.c_str());
     }
-    return NULL;
-}
+}   // getMaterialFor
 
 //-----------------------------------------------------------------------------
 Material* MaterialManager::getMaterialFor(video::ITexture* t,
@@ -245,11 +208,86 @@ void MaterialManager::setAllUntexturedMaterialFlags(scene::IMeshBuffer *mb)
 }
 
 //-----------------------------------------------------------------------------
+/** Returns the material that was added last for the given key of an index,
+ *  which is the same material a backward search through m_materials would
+ *  find first.
+ *  \param index The index to use (full path or texture name).
+ *  \param key The full path or texture name to search for.
+ */
+Material* MaterialManager::findMaterial(const MaterialIndex &index,
+                                        const std::string &key) const
+{
+    auto it = index.find(key);
+    if (it == index.end() || it->second.empty())
+        return NULL;
+    return it->second.back();
+}   // findMaterial
+
+//-----------------------------------------------------------------------------
+/** Removes a material from an index.
+ *  \param index The index to update.
+ *  \param key The key the material is stored under.
+ *  \param m The material to remove.
+ */
+void MaterialManager::removeFromIndex(MaterialIndex *index,
+                                      const std::string &key, Material *m)
+{
+    // Materials are only removed from the end of m_materials, so they are
+    // the last entry for their key, too
+    auto it = index->find(key);
+    if (it != index->end() && !it->second.empty() && it->second.back() == m)
+    {
+        it->second.pop_back();
+        if (it->second.empty())
+            index->erase(it);
+    }
+}   // removeFromIndex
+
+//-----------------------------------------------------------------------------
+/** Adds a material and updates the lookup indices.
+ *  \param m The material to add.
+ *  \return The index of the material.
+ */
 int MaterialManager::addEntity(Material *m)
 {
     m_materials.push_back(m);
+    m_full_path_index[m->getTexFullPath()].push_back(m);
+    m_name_index[m->getTexFname()].push_back(m);
     return (int)m_materials.size()-1;
-}
+}   // addEntity
+
+//-----------------------------------------------------------------------------
+/** Moves a material to its new name in the name index. This is called by
+ *  Material::install(), which changes the texture name to its lower case
+ *  basename once the texture is loaded.
+ *  \param m The material that was renamed.
+ *  \param old_name The texture name the material was added with.
+ */
+void MaterialManager::updateTexFname(Material *m, const std::string &old_name)
+{
+    // Materials installed in their constructor are renamed before they
+    // are added
+    auto it = m_name_index.find(old_name);
+    if (it == m_name_index.end())
+        return;
+    auto found = std::find(it->second.begin(), it->second.end(), m);
+    if (found == it->second.end())
+        return;
+    it->second.erase(found);
+    if (it->second.empty())
+        m_name_index.erase(it);
+
+    // Keep the materials of the new name in the order in which they were
+    // added, so that temporary (track) materials are still found first
+    std::vector<Material*> &materials = m_name_index[m->getTexFname()];
+    auto m_pos = std::find(m_materials.begin(), m_materials.end(), m);
+    auto insert = materials.end();
+    while (insert != materials.begin() &&
+           std::find(m_pos, m_materials.end(), *(insert - 1)) !=
+           m_materials.end())
+        insert--;
+    materials.insert(insert, m);
+}   // updateTexFname
 
 //-----------------------------------------------------------------------------
 void MaterialManager::loadMaterial()
@@ -318,7 +356,7 @@ bool MaterialManager::pushTempMaterial(const XMLNode *root,
         }
         try
         {
-            m_materials.push_back(new Material(node, deprecated));
+            addEntity(new Material(node, deprecated));
         }
         catch(std::exception& e)
         {
@@ -335,7 +373,10 @@ void MaterialManager::popTempMaterial()
 {
     for(int i=(int)m_materials.size()-1; i>=this->m_shared_material_index; i--)
     {
-        delete m_materials[i];
+        Material *m = m_materials[i];
+        removeFromIndex(&m_full_path_index, m->getTexFullPath(), m);
+        removeFromIndex(&m_name_index, m->getTexFname(), m);
+        delete m;
         m_materials.pop_back();
     }   // for i6
 }   // popTempMaterial
@@ -381,16 +422,14 @@ Material *MaterialManager::getMaterial(const std::string& fname,
     core::stringc basename_lower(basename.c_str());
     basename_lower.make_lower();
 
-    // Search backward so that temporary (track) textures are found first
-    for (int i = (int)m_materials.size()-1; i>=0; i-- )
-    {
-        if (m_materials[i]->getTexFname() == basename_lower.c_str())
-            return m_materials[i];
-    }
+    // The index returns temporary (track) textures first
+    Material *existing = findMaterial(m_name_index, basename_lower.c_str());
+    if (existing)
+        return existing;
 
     // Add the new material
     Material* m = new Material(fname, is_full_path, complain_if_not_found, install);
-    m_materials.push_back(m);
+    addEntity(m);
     if(make_permanent)
     {
         assert(m_shared_material_index==(int)m_materials.size()-1);
@@ -436,11 +475,5 @@ void MaterialManager::unloadAllTextures()
 bool MaterialManager::hasMaterial(const std::string& fname)
 {
     std::string basename=StringUtils::getBasename(fname);
-
-    // Search backward so that temporary (track) textures are found first
-    for(int i = (int)m_materials.size()-1; i>=0; i-- )
-    {
-        if(m_materials[i]->getTexFname()==basename) return true;
-    }
-    return false;
+    return findMaterial(m_name_index, basename) != NULL;
 }
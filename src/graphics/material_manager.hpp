@@ -31,6 +31,7 @@ using namespace irr;
 
 #include <irrlicht.h>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include <map>
 
@@ -50,8 +51,26 @@ private:
 
     std::vector<Material*> m_materials;
 
+    /** Maps a texture name or path to all materials using it. */
+    typedef std::unordered_map<std::string, std::vector<Material*> >
+                           MaterialIndex;
+
+    /** Maps the (lower case) full path of a texture to all materials using
+     *  it, in the order in which they were added, so the last entry is the
+     *  one that would be found first when searching m_materials backwards
+     *  (i.e. temporary track materials are preferred). */
+    MaterialIndex          m_full_path_index;
+
+    /** Same as m_full_path_index, but using the texture name. */
+    MaterialIndex          m_name_index;
+
     std::map<std::string, Material*> m_default_sp_materials;
 
+    Material* findMaterial(const MaterialIndex &index,
+                           const std::string &key) const;
+    void      removeFromIndex(MaterialIndex *index, const std::string &key,
+                              Material *m);
+
 public:
               MaterialManager();
              ~MaterialManager();
@@ -69,6 +88,7 @@ public:
     void      setAllUntexturedMaterialFlags(scene::IMeshBuffer *mb);
 
     int       addEntity        (Material *m);
+    void      updateTexFname   (Material *m, const std::string &old_name);
     Material *getMaterial      (const std::string& t,
                                 bool is_full_path=false,
                                 bool make_permanent=false,
@@ -0,0 +1,438 @@
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2018 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "graphics/sp/sp_animation.hpp"
+
+#include "utils/string_utils.hpp"
+#include "utils/time.hpp"
+#include "utils/worker_pool.hpp"
+
+#include <cmath>
+#include <random>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  include <emmintrin.h>
+#  define SP_ANIMATION_USE_SSE
+#endif
+
+namespace SP
+{
+
+namespace
+{
+    // ------------------------------------------------------------------------
+    /* Four floats, which are processed with SSE if available. Otherwise
+     * plain loops are used, which compilers can vectorize as well. */
+#ifdef SP_ANIMATION_USE_SSE
+    typedef __m128 Float4;
+    inline Float4 load4(const float* p)      { return _mm_loadu_ps(p);     }
+    inline void   store4(float* p, Float4 v) { _mm_storeu_ps(p, v);        }
+    inline Float4 set4(float f)              { return _mm_set1_ps(f);      }
+    inline Float4 add4(Float4 a, Float4 b)   { return _mm_add_ps(a, b);    }
+    inline Float4 sub4(Float4 a, Float4 b)   { return _mm_sub_ps(a, b);    }
+    inline Float4 mul4(Float4 a, Float4 b)   { return _mm_mul_ps(a, b);    }
+#else
+    struct Float4 { float v[4]; };
+    inline Float4 load4(const float* p)
+    {
+        Float4 r;
+        for (int i = 0; i < 4; i++) r.v[i] = p[i];
+        return r;
+    }
+    inline void store4(float* p, Float4 v)
+    {
+        for (int i = 0; i < 4; i++) p[i] = v.v[i];
+    }
+    inline Float4 set4(float f)
+    {
+        Float4 r;
+        for (int i = 0; i < 4; i++) r.v[i] = f;
+        return r;
+    }
+    inline Float4 add4(Float4 a, Float4 b)
+    {
+        for (int i = 0; i < 4; i++) a.v[i] += b.v[i];
+        return a;
+    }
+    inline Float4 sub4(Float4 a, Float4 b)
+    {
+        for (int i = 0; i < 4; i++) a.v[i] -= b.v[i];
+        return a;
+    }
+    inline Float4 mul4(Float4 a, Float4 b)
+    {
+        for (int i = 0; i < 4; i++) a.v[i] *= b.v[i];
+        return a;
+    }
+#endif
+
+    // ------------------------------------------------------------------------
+    /** Multiplies two column major 4x4 matrices the same way as
+     *  core::matrix4 does. Since each column of the result only depends on
+     *  the same column of b, out can be the same as a or b. */
+    inline void multiplyMatrices(const float* a, const float* b, float* out)
+    {
+        const Float4 c0 = load4(a);
+        const Float4 c1 = load4(a + 4);
+        const Float4 c2 = load4(a + 8);
+        const Float4 c3 = load4(a + 12);
+        for (int i = 0; i < 16; i += 4)
+        {
+            Float4 r = add4(mul4(c0, set4(b[i])), mul4(c1, set4(b[i + 1])));
+            r = add4(r, mul4(c2, set4(b[i + 2])));
+            r = add4(r, mul4(c3, set4(b[i + 3])));
+            store4(out + i, r);
+        }
+    }   // multiplyMatrices
+
+}   // namespace
+
+// ----------------------------------------------------------------------------
+/** Creates the data used by computePose() from m_frame_pose_matrices. This
+ *  must be called after all keyframes are loaded.
+ */
+void Armature::prepareKeyframes()
+{
+    const unsigned joints = (unsigned)m_joint_names.size();
+    const unsigned frames = (unsigned)m_frame_pose_matrices.size();
+    m_padded_joints = (joints + 3) & ~3u;
+    const unsigned n = m_padded_joints;
+
+    m_keyframe_numbers.resize(frames);
+    m_keyframe_data.assign(frames * 10 * n, 0.0f);
+    for (unsigned k = 0; k < frames; k++)
+    {
+        m_keyframe_numbers[k] = float(m_frame_pose_matrices[k].first);
+        const std::vector<LocRotScale>& pose = m_frame_pose_matrices[k].second;
+        float* data = &m_keyframe_data[k * 10 * n];
+        for (unsigned j = 0; j < n; j++)
+        {
+            if (j >= joints)
+            {
+                // Padding, which gives identity matrices
+                data[6 * n + j] = 1.0f;
+                data[7 * n + j] = data[8 * n + j] = data[9 * n + j] = 1.0f;
+                continue;
+            }
+            data[0 * n + j] = pose[j].m_loc.X;
+            data[1 * n + j] = pose[j].m_loc.Y;
+            data[2 * n + j] = pose[j].m_loc.Z;
+            data[3 * n + j] = pose[j].m_rot.X;
+            data[4 * n + j] = pose[j].m_rot.Y;
+            data[5 * n + j] = pose[j].m_rot.Z;
+            data[6 * n + j] = pose[j].m_rot.W;
+            data[7 * n + j] = pose[j].m_scale.X;
+            data[8 * n + j] = pose[j].m_scale.Y;
+            data[9 * n + j] = pose[j].m_scale.Z;
+        }
+    }
+
+    // Add joints once their parent was added, so that computePose() can
+    // concatenate the matrices in one pass.
+    std::vector<bool> added(joints, false);
+    m_joint_order.clear();
+    while (m_joint_order.size() < joints)
+    {
+        const size_t old_size = m_joint_order.size();
+        for (unsigned j = 0; j < joints; j++)
+        {
+            const int parent = m_parent_infos[j];
+            if (!added[j] && (parent == -1 || added[parent]))
+            {
+                m_joint_order.push_back(j);
+                added[j] = true;
+            }
+        }
+        if (m_joint_order.size() == old_size)
+        {
+            Log::fatal("SPAnimation", "Armature has cyclic parent joints.");
+        }
+    }
+}   // prepareKeyframes
+
+// ----------------------------------------------------------------------------
+/** Computes the skinning matrices of the armature for a frame. In contrast
+ *  to getPose() this does not modify the armature, so it can be called for
+ *  different nodes using the same mesh in parallel. Four joints are
+ *  interpolated at once, and prepareKeyframes() must have been called.
+ *  \param frame The frame to compute.
+ *  \param dest On return the skinning matrices of the m_joint_used joints.
+ *  \param world On return the world matrices of all joints.
+ *  \param tmp Temporary memory used by this function.
+ */
+void Armature::computePose(float frame, std::array<float, 16>* dest,
+                           std::array<float, 16>* world,
+                           std::vector<float>* tmp) const
+{
+    assert(!m_keyframe_numbers.empty());
+    const unsigned joints = (unsigned)m_joint_names.size();
+    const unsigned n = m_padded_joints;
+
+    // Find the keyframes to interpolate with a binary search, frames
+    // outside of the animation use the first or last keyframe.
+    unsigned frame_1 = 0;
+    unsigned frame_2 = 0;
+    float interpolation = 0.0f;
+    if (frame >= m_keyframe_numbers.back())
+    {
+        frame_1 = frame_2 = (unsigned)m_keyframe_numbers.size() - 1;
+    }
+    else if (frame >= m_keyframe_numbers.front())
+    {
+        frame_2 = (unsigned)(std::upper_bound(m_keyframe_numbers.begin(),
+            m_keyframe_numbers.end(), frame) - m_keyframe_numbers.begin());
+        frame_1 = frame_2 - 1;
+        interpolation = (frame - m_keyframe_numbers[frame_1]) /
+            (m_keyframe_numbers[frame_2] - m_keyframe_numbers[frame_1]);
+    }
+    const float* d1 = &m_keyframe_data[frame_1 * 10 * n];
+    const float* d2 = &m_keyframe_data[frame_2 * 10 * n];
+
+    // The weights of the rotations of both keyframes, computed like
+    // core::quaternion::slerp does
+    tmp->resize(2 * n);
+    float* rot_weight_1 = tmp->data();
+    float* rot_weight_2 = rot_weight_1 + n;
+    for (unsigned j = 0; j < n; j += 4)
+    {
+        Float4 dot = mul4(load4(d1 + 3 * n + j), load4(d2 + 3 * n + j));
+        for (unsigned c = 4; c < 7; c++)
+        {
+            dot = add4(dot,
+                mul4(load4(d1 + c * n + j), load4(d2 + c * n + j)));
+        }
+        store4(rot_weight_1 + j, dot);
+    }
+    for (unsigned j = 0; j < n; j++)
+    {
+        float angle = rot_weight_1[j];
+        // Make sure to use the short rotation
+        const float sign = angle < 0.0f ? -1.0f : 1.0f;
+        angle *= sign;
+        if (angle <= 1.0f - 0.05f)
+        {
+            const float theta = acosf(angle);
+            const float inv_sin_theta = 1.0f / sinf(theta);
+            rot_weight_1[j] =
+                sign * sinf(theta * (1.0f - interpolation)) * inv_sin_theta;
+            rot_weight_2[j] = sinf(theta * interpolation) * inv_sin_theta;
+        }
+        else
+        {
+            rot_weight_1[j] = sign * (1.0f - interpolation);
+            rot_weight_2[j] = interpolation;
+        }
+    }
+
+    // Interpolate location, rotation and scale, and compute the local
+    // matrices (location * rotation * scale) of 4 joints at once
+    const Float4 t = set4(interpolation);
+    const Float4 inv_t = set4(1.0f - interpolation);
+    const Float4 one = set4(1.0f);
+    const Float4 two = set4(2.0f);
+    float local[16][4];
+    store4(local[3], set4(0.0f));
+    store4(local[7], set4(0.0f));
+    store4(local[11], set4(0.0f));
+    store4(local[15], one);
+    for (unsigned j = 0; j < n; j += 4)
+    {
+        Float4 v[10];
+        for (unsigned c = 0; c < 10; c++)
+        {
+            const Float4 w1 = c >= 3 && c < 7 ? load4(rot_weight_1 + j)
+                                              : inv_t;
+            const Float4 w2 = c >= 3 && c < 7 ? load4(rot_weight_2 + j) : t;
+            v[c] = add4(mul4(load4(d1 + c * n + j), w1),
+                        mul4(load4(d2 + c * n + j), w2));
+        }
+        const Float4 x2 = mul4(two, v[3]);
+        const Float4 y2 = mul4(two, v[4]);
+        const Float4 z2 = mul4(two, v[5]);
+        // Same as core::quaternion::getMatrix, with the columns multiplied
+        // by the scale
+        store4(local[0], mul4(sub4(sub4(one, mul4(y2, v[4])),
+            mul4(z2, v[5])), v[7]));
+        store4(local[1], mul4(add4(mul4(x2, v[4]), mul4(z2, v[6])), v[7]));
+        store4(local[2], mul4(sub4(mul4(x2, v[5]), mul4(y2, v[6])), v[7]));
+        store4(local[4], mul4(sub4(mul4(x2, v[4]), mul4(z2, v[6])), v[8]));
+        store4(local[5], mul4(sub4(sub4(one, mul4(x2, v[3])),
+            mul4(z2, v[5])), v[8]));
+        store4(local[6], mul4(add4(mul4(z2, v[4]), mul4(x2, v[6])), v[8]));
+        store4(local[8], mul4(add4(mul4(x2, v[5]), mul4(y2, v[6])), v[9]));
+        store4(local[9], mul4(sub4(mul4(z2, v[4]), mul4(x2, v[6])), v[9]));
+        store4(local[10], mul4(sub4(sub4(one, mul4(x2, v[3])),
+            mul4(y2, v[4])), v[9]));
+        store4(local[12], v[0]);
+        store4(local[13], v[1]);
+        store4(local[14], v[2]);
+        for (unsigned l = 0; l < 4 && j + l < joints; l++)
+        {
+            float* m = world[j + l].data();
+            for (unsigned c = 0; c < 16; c++)
+                m[c] = local[c][l];
+        }
+    }
+
+    // Concatenate with the parent matrices, parents are computed first
+    for (unsigned j : m_joint_order)
+    {
+        const int parent = m_parent_infos[j];
+        if (parent != -1)
+        {
+            multiplyMatrices(world[parent].data(), world[j].data(),
+                             world[j].data());
+        }
+    }
+    for (unsigned j = 0; j < m_joint_used; j++)
+    {
+        multiplyMatrices(world[j].data(), m_joint_matrices[j].pointer(),
+                         dest[j].data());
+    }
+}   // computePose
+
+// ----------------------------------------------------------------------------
+/** Compares the time to compute the skinning matrices of a number of
+ *  animated meshes with getPose(), computePose() and computePose() run in
+ *  parallel, using a random armature. This only uses the CPU, so it can be
+ *  run without a graphics context.
+ */
+void Armature::benchmarkPoses()
+{
+    const unsigned num_joints = 64;
+    const unsigned num_keyframes = 60;
+    const unsigned num_meshes = 16;
+    const unsigned num_frames = 500;
+
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    Armature arm;
+    arm.m_joint_used = num_joints;
+    arm.m_joint_names.resize(num_joints);
+    arm.m_joint_matrices.resize(num_joints);
+    arm.m_interpolated_matrices.resize(num_joints);
+    arm.m_world_matrices.resize(num_joints,
+        std::make_pair(core::matrix4(), false));
+    arm.m_parent_infos.resize(num_joints);
+    for (unsigned j = 0; j < num_joints; j++)
+    {
+        arm.m_joint_names[j] = "joint" + StringUtils::toString(j);
+        // A tree with long and short parent chains
+        arm.m_parent_infos[j] = j == 0 ? -1 : int(random() % j);
+    }
+    arm.m_frame_pose_matrices.resize(num_keyframes);
+    for (unsigned k = 0; k < num_keyframes; k++)
+    {
+        arm.m_frame_pose_matrices[k].first = k * 2;
+        arm.m_frame_pose_matrices[k].second.resize(num_joints);
+        for (LocRotScale& lrs : arm.m_frame_pose_matrices[k].second)
+        {
+            lrs.m_loc = core::vector3df(dist(random), dist(random),
+                                        dist(random));
+            lrs.m_rot = core::quaternion(dist(random), dist(random),
+                                         dist(random), dist(random));
+            lrs.m_rot.normalize();
+            lrs.m_scale = core::vector3df(1.0f + 0.1f * dist(random),
+                                          1.0f + 0.1f * dist(random),
+                                          1.0f + 0.1f * dist(random));
+        }
+    }
+    // Bind pose as done in SPMesh::finalize
+    arm.getInterpolatedMatrices(0.0f);
+    for (unsigned j = 0; j < num_joints; j++)
+    {
+        arm.getWorldMatrix(arm.m_interpolated_matrices, j)
+            .getInverse(arm.m_joint_matrices[j]);
+    }
+    arm.prepareKeyframes();
+
+    struct MeshData
+    {
+        std::vector<std::array<float, 16> > m_reference;
+        std::vector<std::array<float, 16> > m_skinning;
+        std::vector<std::array<float, 16> > m_world;
+        std::vector<float> m_tmp;
+    };
+    std::vector<MeshData> meshes(num_meshes);
+    for (MeshData& md : meshes)
+    {
+        md.m_reference.resize(num_joints);
+        md.m_skinning.resize(num_joints);
+        md.m_world.resize(num_joints);
+    }
+    const float last_frame = float(arm.m_keyframe_numbers.back());
+    auto get_frame = [last_frame](unsigned frame, unsigned mesh)
+    {
+        return fmodf(frame * 0.37f + mesh * 3.1f, last_frame + 2.0f) - 1.0f;
+    };
+
+    double start = StkTime::getRealTime();
+    for (unsigned f = 0; f < num_frames; f++)
+    {
+        for (unsigned m = 0; m < num_meshes; m++)
+            arm.getPose(get_frame(f, m), meshes[m].m_reference.data());
+    }
+    const double reference_time = StkTime::getRealTime() - start;
+
+    start = StkTime::getRealTime();
+    for (unsigned f = 0; f < num_frames; f++)
+    {
+        for (unsigned m = 0; m < num_meshes; m++)
+        {
+            arm.computePose(get_frame(f, m), meshes[m].m_skinning.data(),
+                            meshes[m].m_world.data(), &meshes[m].m_tmp);
+        }
+    }
+    const double serial_time = StkTime::getRealTime() - start;
+
+    WorkerPool pool(WorkerPool::getDefaultNumThreads(), "SPBenchmark");
+    start = StkTime::getRealTime();
+    for (unsigned f = 0; f < num_frames; f++)
+    {
+        pool.run(num_meshes, [&arm, &meshes, &get_frame, f](unsigned m)
+            {
+                arm.computePose(get_frame(f, m), meshes[m].m_skinning.data(),
+                                meshes[m].m_world.data(), &meshes[m].m_tmp);
+            });
+    }
+    const double parallel_time = StkTime::getRealTime() - start;
+
+    // Both computations used the same frames last, so compare the results
+    float max_difference = 0.0f;
+    for (const MeshData& md : meshes)
+    {
+        for (unsigned j = 0; j < num_joints; j++)
+        {
+            for (unsigned c = 0; c < 16; c++)
+            {
+                max_difference = std::max(max_difference,
+                    fabsf(md.m_reference[j][c] - md.m_skinning[j][c]));
+            }
+        }
+    }
+
+    Log::info("SPAnimation", "Computed %d frames of %d meshes with %d "
+        "joints:", num_frames, num_meshes, num_joints);
+    Log::info("SPAnimation", "getPose:              %f s.", reference_time);
+    Log::info("SPAnimation", "computePose:          %f s.", serial_time);
+    Log::info("SPAnimation", "computePose parallel: %f s (%d threads).",
+        parallel_time, pool.getNumThreads());
+    Log::info("SPAnimation", "Maximum difference:   %g.", max_difference);
+}   // benchmarkPoses
+
+}
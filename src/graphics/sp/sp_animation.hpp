@@ -25,6 +25,7 @@
 #include <matrix4.h>
 #include <quaternion.h>
 
+#include <algorithm>
 #include <array>
 #include <cassert>
 #include <vector>
@@ -80,6 +81,36 @@ struct Armature
     std::vector<std::pair<int, std::vector<LocRotScale> > >
         m_frame_pose_matrices;
 
+    /** Frame numbers of all keyframes, to find the keyframes of a frame
+     *  with a binary search in computePose(). */
+    std::vector<float> m_keyframe_numbers;
+
+    /** Number of joints rounded up to a multiple of 4. */
+    unsigned m_padded_joints;
+
+    /** Location, rotation and scale of all joints in all keyframes in SoA
+     *  layout, so 4 joints can be interpolated at once: the values of
+     *  component c (0-2 location, 3-6 rotation, 7-9 scale) of keyframe k
+     *  start at (k * 10 + c) * m_padded_joints. */
+    std::vector<float> m_keyframe_data;
+
+    /** All joints ordered so that each parent comes before its children. */
+    std::vector<unsigned> m_joint_order;
+
+    // ------------------------------------------------------------------------
+    Armature()
+    {
+        m_joint_used = 0;
+        m_padded_joints = 0;
+    }
+    // ------------------------------------------------------------------------
+    void prepareKeyframes();
+    // ------------------------------------------------------------------------
+    void computePose(float frame, std::array<float, 16>* dest,
+                     std::array<float, 16>* world,
+                     std::vector<float>* tmp) const;
+    // ------------------------------------------------------------------------
+    static void benchmarkPoses();
     // ------------------------------------------------------------------------
     void read(irr::io::IReadFile* spm)
     {
@@ -183,26 +214,21 @@ struct Armature
             }
             return;
         }
-        int frame_1 = -1;
-        int frame_2 = -1;
-        float interpolation = 0.0f;
-        for (unsigned i = 0; i < m_frame_pose_matrices.size(); i++)
-        {
-            assert(i + 1 < m_frame_pose_matrices.size());
-            if (frame >= float(m_frame_pose_matrices[i].first) &&
-                frame < float(m_frame_pose_matrices[i + 1].first))
+        // Binary search for the last keyframe not after frame
+        auto it = std::upper_bound(m_frame_pose_matrices.begin(),
+            m_frame_pose_matrices.end(), frame,
+            [](float f, const std::pair<int, std::vector<LocRotScale> >& p)
             {
-                frame_1 = i;
-                frame_2 = i + 1;
-                interpolation =
-                    (frame - float(m_frame_pose_matrices[i].first)) /
-                    float(m_frame_pose_matrices[i + 1].first -
-                    m_frame_pose_matrices[i].first);
-                break;
-            }
-        }
-        assert(frame_1 != -1);
-        assert(frame_2 != -1);
+                return f < float(p.first);
+            });
+        assert(it != m_frame_pose_matrices.begin() &&
+            it != m_frame_pose_matrices.end());
+        int frame_2 = int(it - m_frame_pose_matrices.begin());
+        int frame_1 = frame_2 - 1;
+        float interpolation =
+            (frame - float(m_frame_pose_matrices[frame_1].first)) /
+            float(m_frame_pose_matrices[frame_2].first -
+            m_frame_pose_matrices[frame_1].first);
         for (unsigned i = 0; i < m_interpolated_matrices.size(); i++)
         {
             LocRotScale interpolated;
@@ -48,6 +48,7 @@
 #include "utils/helpers.hpp"
 #include "utils/profiler.hpp"
 #include "utils/string_utils.hpp"
+#include "utils/worker_pool.hpp"
 
 #include <algorithm>
 #include <array>
@@ -115,6 +116,9 @@ unsigned g_skinning_offset = 0;
 // ----------------------------------------------------------------------------
 std::vector<SPMeshNode*> g_skinning_mesh;
 // ----------------------------------------------------------------------------
+/** Threads used to compute the skinning matrices of all visible meshes. */
+WorkerPool* g_skinning_workers = NULL;
+// ----------------------------------------------------------------------------
 int sp_cur_shadow_cascade = 0;
 // ----------------------------------------------------------------------------
 void initSTKRenderer(ShaderBasedRenderer* sbr)
@@ -429,6 +433,8 @@ void init()
     }
 
     initSkinning();
+    g_skinning_workers = new WorkerPool(WorkerPool::getDefaultNumThreads(),
+        "SPSkinning");
     for (unsigned i = 0; i < MAX_PLAYER_COUNT; i++)
     {
         for (int j = 0; j < 3; j++)
@@ -586,6 +592,8 @@ void init()
 void destroy()
 {
     g_dy_dc.clear();
+    delete g_skinning_workers;
+    g_skinning_workers = NULL;
     SPTextureManager::get()->stopThreads();
     SPShaderManager::destroy();
     g_glow_shader = NULL;
@@ -1171,6 +1179,13 @@ void uploadSkinningMatrices()
         return;
     }
 
+    // The skinning matrices of each node are independent, so compute all
+    // outdated ones in parallel before uploading
+    g_skinning_workers->run((unsigned)g_skinning_mesh.size(), [](unsigned i)
+        {
+            g_skinning_mesh[i]->updateSkinningMatrices();
+        });
+
     unsigned buffer_offset = 0;
 #ifndef USE_GLES2
     if (CVS->isARBTextureBufferObjectUsable() && 
@@ -1309,7 +1324,7 @@ void draw(RenderPass rp, DrawCallType dct)
 {
     std::stringstream profiler_name;
     profiler_name << "SP::Draw " << dct << " with " << rp;
-    PROFILER_PUSH_CPU_MARKER(profiler_name.str().c_str(),
+    PROFILER_PUSH_CPU_DYNAMIC_MARKER(profiler_name.str().c_str(),
         (uint8_t)(float(dct + rp + 2) / float(DCT_FOR_VAO + RP_COUNT) * 255.0f),
         (uint8_t)(float(dct + 1) / (float)DCT_FOR_VAO * 255.0f) ,
         (uint8_t)(float(rp + 1) / (float)RP_COUNT * 255.0f));
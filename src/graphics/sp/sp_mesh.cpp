@@ -119,13 +119,28 @@ s32 SPMesh::getJointIDWithArm(const c8* name, unsigned* arm_id) const
 }   // getJointIDWithArm
 
 // ----------------------------------------------------------------------------
-void SPMesh::getSkinningMatrices(f32 frame, std::array<float, 16>* dest)
+/** Computes the skinning matrices of all armatures for a frame. This only
+ *  uses the given memory, so it can be called for different nodes of the
+ *  same mesh in parallel.
+ *  \param frame The frame to compute.
+ *  \param dest On return the skinning matrices of all used joints.
+ *  \param world On return the world matrices of all joints of all
+ *         armatures.
+ *  \param tmp Temporary memory used by the computation.
+ */
+void SPMesh::getSkinningMatrices(f32 frame, std::array<float, 16>* dest,
+                                 std::array<float, 16>* world,
+                                 std::vector<float>* tmp) const
 {
     unsigned accumulated_joints = 0;
+    unsigned accumulated_world = 0;
     for (unsigned i = 0; i < m_all_armatures.size(); i++)
     {
-        m_all_armatures[i].getPose(frame, &dest[accumulated_joints]);
+        m_all_armatures[i].computePose(frame, &dest[accumulated_joints],
+            &world[accumulated_world], tmp);
         accumulated_joints += m_all_armatures[i].m_joint_used;
+        accumulated_world +=
+            (unsigned)m_all_armatures[i].m_joint_names.size();
     }
 
 }   // getSkinningMatrices
@@ -158,6 +173,7 @@ void SPMesh::finalize()
             arm.getWorldMatrix(arm.m_interpolated_matrices, i).getInverse(m);
             arm.m_joint_matrices[i] = m;
         }
+        arm.prepareKeyframes();
     }
     m_bounding_box.reset(0.0f, 0.0f, 0.0f);
     // Sort with same shader name
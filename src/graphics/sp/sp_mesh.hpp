@@ -152,7 +152,9 @@ public:
     // ------------------------------------------------------------------------
     std::vector<Armature>& getArmatures() { return m_all_armatures; }
     // ------------------------------------------------------------------------
-    void getSkinningMatrices(f32 frame, std::array<float, 16>* dest);
+    void getSkinningMatrices(f32 frame, std::array<float, 16>* dest,
+                             std::array<float, 16>* world,
+                             std::vector<float>* tmp) const;
     // ------------------------------------------------------------------------
     s32 getJointIDWithArm(const c8* name, unsigned* arm_id) const;
     // ------------------------------------------------------------------------
@@ -48,6 +48,8 @@ SPMeshNode::SPMeshNode(IAnimatedMesh* mesh, ISceneNode* parent,
     m_first_render_info = render_info;
     m_animated = false;
     m_skinning_offset = -32768;
+    m_skinning_frame = 0.0f;
+    m_skinning_outdated = false;
     m_is_in_shadowpass = true;
 }   // SPMeshNode
 
@@ -112,6 +114,7 @@ void SPMeshNode::setMesh(irr::scene::IAnimatedMesh* mesh)
                     m_joint_nodes.at(bone_name)->setSkinningSpace(EBSS_GLOBAL);
                 }
             }
+            m_world_matrices.resize(bone_idx);
         }
         if (m_first_render_info)
         {
@@ -167,20 +170,58 @@ IMesh* SPMeshNode::getMeshForCurrentFrame()
     {
         return m_mesh;
     }
-    m_mesh->getSkinningMatrices(getFrameNr(), m_skinning_matrices.data());
+    m_skinning_frame = getFrameNr();
+    m_skinning_outdated = true;
     updateAbsolutePosition();
 
+    // Only objects attached to joints need the joint transformations now,
+    // otherwise the skinning matrices are computed later for all visible
+    // nodes in parallel (see SP::uploadSkinningMatrices)
+    bool has_attached_objects = false;
+    for (auto& p : m_joint_nodes)
+    {
+        if (!p.second->getChildren().empty())
+        {
+            has_attached_objects = true;
+            break;
+        }
+    }
+    if (!has_attached_objects)
+    {
+        return m_mesh;
+    }
+
+    updateSkinningMatrices();
+    unsigned world_id = 0;
     for (Armature& arm : m_mesh->getArmatures())
     {
         for (unsigned i = 0; i < arm.m_joint_names.size(); i++)
         {
+            core::matrix4 m;
+            m.setM(m_world_matrices[world_id++].data());
             m_joint_nodes.at(arm.m_joint_names[i])->setAbsoluteTransformation
-                (AbsoluteTransformation * arm.m_world_matrices[i].first);
+                (AbsoluteTransformation * m);
         }
     }
     return m_mesh;
 }   // getMeshForCurrentFrame
 
+// ----------------------------------------------------------------------------
+/** Computes the skinning matrices if they are not computed for the current
+ *  frame yet. This only changes data of this node, so it can be called for
+ *  different nodes in parallel.
+ */
+void SPMeshNode::updateSkinningMatrices()
+{
+    if (!m_skinning_outdated)
+    {
+        return;
+    }
+    m_mesh->getSkinningMatrices(m_skinning_frame, m_skinning_matrices.data(),
+        m_world_matrices.data(), &m_skinning_tmp);
+    m_skinning_outdated = false;
+}   // updateSkinningMatrices
+
 // ----------------------------------------------------------------------------
 int SPMeshNode::getTotalJoints() const
 {
@@ -54,6 +54,20 @@ private:
 
     std::vector<std::array<float, 16> > m_skinning_matrices;
 
+    /** The world matrices of all joints, computed together with the
+     *  skinning matrices. */
+    std::vector<std::array<float, 16> > m_world_matrices;
+
+    /** Temporary memory used to compute the skinning matrices. */
+    std::vector<float> m_skinning_tmp;
+
+    /** The frame the skinning matrices must be computed for. */
+    float m_skinning_frame;
+
+    /** True if the skinning matrices are not computed for the current
+     *  frame yet. */
+    bool m_skinning_outdated;
+
     video::SColorf m_glow_color;
 
     std::vector<std::array<float, 2> > m_texture_matrices;
@@ -69,6 +83,8 @@ private:
         }
         m_joint_nodes.clear();
         m_skinning_matrices.clear();
+        m_world_matrices.clear();
+        m_skinning_outdated = false;
     }
 
 public:
@@ -129,6 +145,8 @@ public:
     const std::array<float, 16>* getSkinningMatrices() const 
                                          { return m_skinning_matrices.data(); }
     // ------------------------------------------------------------------------
+    void updateSkinningMatrices();
+    // ------------------------------------------------------------------------
     RenderInfo* getRenderInfo(unsigned mb_id) const
     {
         if (m_render_info.size() > mb_id && m_render_info[mb_id].get())
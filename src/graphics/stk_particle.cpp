@@ -322,7 +322,7 @@ void STKParticle::stimulateHeightMap(float dt, unsigned int active_count,
             (particle_position.X - m_hm->m_x) / m_hm->m_x_len), 0, 255);
         const int py = core::clamp((int)(256.0f *
             (particle_position.Z - m_hm->m_z) / m_hm->m_z_len), 0, 255);
-        const float h = particle_position.Y - m_hm->m_array[px][py];
+        const float h = particle_position.Y - m_hm->m_array[px * 256 + py];
         reset = h < 0.0f;
 
         core::vector3df initial_position, initial_new_position;
@@ -35,16 +35,17 @@ private:
     // ------------------------------------------------------------------------
     struct HeightMapData
     {
-        const std::vector<std::vector<float> > m_array;
+        /** Heights, HEIGHT_MAP_RESOLUTION values per row. */
+        const std::vector<float> m_array;
         const float m_x;
         const float m_z;
         const float m_x_len;
         const float m_z_len;
         // --------------------------------------------------------------------
-        HeightMapData(std::vector<std::vector<float> >& array,
+        HeightMapData(const std::vector<float>& array,
                       float track_x, float track_z, float track_x_len,
                       float track_z_len)
-            : m_array(std::move(array)), m_x(track_x), m_z(track_z),
+            : m_array(array), m_x(track_x), m_z(track_z),
               m_x_len(track_x_len), m_z_len(track_z_len) {}
     };
     // ------------------------------------------------------------------------
@@ -120,7 +121,7 @@ public:
     // ------------------------------------------------------------------------
     void setIncreaseFactor(float val)         { m_size_increase_factor = val; }
     // ------------------------------------------------------------------------
-    void setHeightmap(std::vector<std::vector<float> >& array, float track_x,
+    void setHeightmap(const std::vector<float>& array, float track_x,
                       float track_z, float track_x_len, float track_z_len)
     {
         m_hm = new HeightMapData(array, track_x, track_z, track_x_len,
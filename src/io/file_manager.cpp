@@ -40,6 +40,7 @@
 #include <sstream>
 #include <sys/stat.h>
 #include <iostream>
+#include <random>
 #include <string>
 
 namespace irr {
@@ -151,6 +152,7 @@ FileManager::FileManager()
 #endif
 
     m_file_system = irr::io::createFileSystem();
+    m_num_indexed_lookups.store(0);
 
 #ifdef ANDROID
     AssetsAndroid android_assets(this);
@@ -247,6 +249,7 @@ FileManager::FileManager()
     checkAndCreateScreenshotDir();
     checkAndCreateReplayDir();
     checkAndCreateCachedTexturesDir();
+    checkAndCreateCachedDataDir();
     checkAndCreateGPDir();
 
     redirectOutput();
@@ -521,6 +524,7 @@ void FileManager::pushModelSearchPath(const std::string& path)
     std::lock_guard<std::mutex> lock(m_file_system_lock);
 
     m_model_search_path.push_back(path);
+    m_model_search_index.push_back(createDirectoryIndex(path));
     const int n=m_file_system->getFileArchiveCount();
     m_file_system->addFileArchive(createAbsoluteFilename(path),
                                   /*ignoreCase*/false,
@@ -549,7 +553,8 @@ void FileManager::pushTextureSearchPath(const std::string& path, const std::stri
 {
     std::lock_guard<std::mutex> lock(m_file_system_lock);
 
-    m_texture_search_path.push_back(TextureSearchPath(path, container_id));
+    m_texture_search_path.push_back(TextureSearchPath(path, container_id,
+                                              createDirectoryIndex(path)));
     const int n=m_file_system->getFileArchiveCount();
     m_file_system->addFileArchive(createAbsoluteFilename(path),
                                   /*ignoreCase*/false,
@@ -595,6 +600,7 @@ void FileManager::popModelSearchPath()
         std::lock_guard<std::mutex> lock(m_file_system_lock);
         std::string dir = m_model_search_path.back();
         m_model_search_path.pop_back();
+        m_model_search_index.pop_back();
         m_file_system->removeFileArchive(createAbsoluteFilename(dir));
     }
 }   // popModelSearchPath
@@ -649,13 +655,71 @@ bool FileManager::findFile(std::string& full_path,
         i = search_path.rbegin();
         i != search_path.rend(); ++i)
     {
-        full_path = i->m_texture_search_path + file_name;
-        if (m_file_system->existFile(full_path.c_str())) return true;
+        if (existsInSearchPath(i->m_texture_search_path, i->m_index.get(),
+                               file_name))
+        {
+            full_path = i->m_texture_search_path + file_name;
+            return true;
+        }
     }
     full_path = "";
     return false;
 }   // findFile
 
+//-----------------------------------------------------------------------------
+/** Lists the content of a search path directory, so that files in this
+ *  directory can be found without querying the file system. Only
+ *  directories ending with a separator are indexed, since otherwise the
+ *  file name is not simply appended to the directory.
+ *  \param dir The directory to index.
+ *  \return The index, or NULL if the directory is not indexed.
+ */
+std::shared_ptr<const DirectoryIndex>
+    FileManager::createDirectoryIndex(const std::string &dir) const
+{
+    if (dir.empty() || (dir.back() != '/' && dir.back() != '\\'))
+        return nullptr;
+
+    std::shared_ptr<DirectoryIndex> index =
+        std::make_shared<DirectoryIndex>();
+    io::IFileList* files = m_file_system->createFileList(dir.c_str());
+    for (unsigned int n = 0; n < files->getFileCount(); n++)
+    {
+#if defined(WIN32) || defined(__APPLE__)
+        // The file systems are usually case insensitive
+        index->insert(StringUtils::toLowerCase(files->getFileName(n).c_str()));
+#else
+        index->insert(files->getFileName(n).c_str());
+#endif
+    }
+    files->drop();
+    return index;
+}   // createDirectoryIndex
+
+//-----------------------------------------------------------------------------
+/** Checks if a file exists in a search path directory. If the directory
+ *  is indexed, this is a hash lookup, otherwise the file system is queried.
+ *  \param dir The search path directory.
+ *  \param index Index of the directory, or NULL if it is not indexed.
+ *  \param file_name Name of the file, relative to dir.
+ */
+bool FileManager::existsInSearchPath(const std::string &dir,
+                                     const DirectoryIndex *index,
+                                     const std::string &file_name) const
+{
+    // The index only contains the entries of the directory itself
+    if (!index || file_name.empty() ||
+        file_name.find_first_of("/\\") != std::string::npos)
+        return m_file_system->existFile((dir + file_name).c_str());
+
+    m_num_indexed_lookups++;
+#if defined(WIN32) || defined(__APPLE__)
+    return index->count(StringUtils::toLowerCase(file_name)) > 0;
+#else
+    return index->count(file_name) > 0;
+#endif
+}   // existsInSearchPath
+
 //-----------------------------------------------------------------------------
 std::string FileManager::getAssetChecked(FileManager::AssetType type,
                                          const std::string& name,
@@ -723,6 +787,14 @@ std::string FileManager::getCachedTexturesDir() const
     return m_cached_textures_dir;
 }   // getCachedTexturesDir
 
+//-----------------------------------------------------------------------------
+/** Returns the directory in which data computed from tracks can be cached.
+ */
+std::string FileManager::getCachedDataDir() const
+{
+    return m_cached_data_dir;
+}   // getCachedDataDir
+
 //-----------------------------------------------------------------------------
 /** Returns the directory in which user-defined grand prix should be stored.
  */
@@ -753,19 +825,17 @@ std::string FileManager::searchTexture(const std::string& file_name) const
 bool FileManager::searchTextureContainerId(std::string& container_id,
     const std::string& file_name) const
 {
-    std::string full_path;
     for (std::vector<TextureSearchPath>::const_reverse_iterator
         i = m_texture_search_path.rbegin();
         i != m_texture_search_path.rend(); ++i)
     {
-        full_path = i->m_texture_search_path + file_name;
-        if (m_file_system->existFile(full_path.c_str()))
+        if (existsInSearchPath(i->m_texture_search_path, i->m_index.get(),
+                               file_name))
         {
             container_id = i->m_container_id;
             return true;
         }
     }
-    full_path = "";
     return false;
 }   // findFile
 
@@ -1061,6 +1131,31 @@ void FileManager::checkAndCreateCachedTexturesDir()
 
 }   // checkAndCreateCachedTexturesDir
 
+// ----------------------------------------------------------------------------
+/** Creates the directory for cached data computed from tracks. This will set
+ *  m_cached_data_dir with the appropriate path.
+ */
+void FileManager::checkAndCreateCachedDataDir()
+{
+#if defined(WIN32) || defined(__CYGWIN__)
+    m_cached_data_dir = m_user_config_dir + "cached-data/";
+#elif defined(__APPLE__)
+    m_cached_data_dir = getenv("HOME");
+    m_cached_data_dir += "/Library/Application Support/SuperTuxKart/CachedData/";
+#else
+    m_cached_data_dir = checkAndCreateLinuxDir("XDG_CACHE_HOME", "supertuxkart", ".cache/", ".");
+    m_cached_data_dir += "cached-data/";
+#endif
+
+    if (!checkAndCreateDirectory(m_cached_data_dir))
+    {
+        Log::error("FileManager", "Can not create cached data directory '%s', "
+            "falling back to '.'.", m_cached_data_dir.c_str());
+        m_cached_data_dir = ".";
+    }
+
+}   // checkAndCreateCachedDataDir
+
 // ----------------------------------------------------------------------------
 /** Creates the directories for user-defined grand prix. This will set m_gp_dir
  *  with the appropriate path.
@@ -1290,7 +1385,17 @@ std::string FileManager::searchMusic(const std::string& file_name) const
 std::string FileManager::searchModel(const std::string& file_name) const
 {
     std::string path;
-    bool success = findFile(path, file_name, m_model_search_path);
+    bool success = false;
+    for (int i = (int)m_model_search_path.size() - 1; i >= 0; i--)
+    {
+        if (existsInSearchPath(m_model_search_path[i],
+                               m_model_search_index[i].get(), file_name))
+        {
+            path = m_model_search_path[i] + file_name;
+            success = true;
+            break;
+        }
+    }
     if (!success)
     {
         throw std::runtime_error(
@@ -1471,6 +1576,68 @@ bool FileManager::copyFile(const std::string &source, const std::string &dest)
     fclose(f_dest);
     return true;
 }   // copyFile
+
+// ----------------------------------------------------------------------------
+/** Computes a 64-bit FNV-1a hash of the content of a file, which can be used
+ *  to check if data cached for this file is still up to date.
+ *  \param path Full path of the file.
+ *  \param hash On return contains the hash.
+ *  \return False if the file could not be read.
+ */
+bool FileManager::getFileHash(const std::string &path, uint64_t *hash) const
+{
+    FILE *f = fopen(path.c_str(), "rb");
+    if (!f) return false;
+
+    uint64_t result = 14695981039346656037ULL;
+    unsigned char buffer[32768];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            result ^= buffer[i];
+            result *= 1099511628211ULL;
+        }
+    }
+    fclose(f);
+    *hash = result;
+    return true;
+}   // getFileHash
+
+// ----------------------------------------------------------------------------
+/** Writes a file in the cache directory. The data is written to a temporary
+ *  file first which is then renamed, so another process using the same
+ *  cache file (e.g. a second server started at the same time) never reads
+ *  a partly written file.
+ *  \param name Full path of the cache file.
+ *  \param data The content of the file.
+ *  \return True if the file was written.
+ */
+bool FileManager::writeCacheFileAtomically(const std::string &name,
+                                           const std::string &data) const
+{
+    std::random_device random;
+    const std::string tmp_file =
+        name + "." + StringUtils::toString(random()) + ".tmp";
+    FILE *f = fopen(tmp_file.c_str(), "wb");
+    if (!f)
+    {
+        Log::warn("FileManager", "Can not write cache file '%s'.",
+                  tmp_file.c_str());
+        return false;
+    }
+    bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(tmp_file.c_str(), name.c_str()) != 0)
+    {
+        Log::warn("FileManager", "Can not write cache file '%s'.",
+                  name.c_str());
+        removeFile(tmp_file);
+        return false;
+    }
+    return true;
+}   // writeCacheFileAtomically
 // ----------------------------------------------------------------------------
 /** Returns true if the first file is newer than the second. The comparison is
 *   based on the modification time of the two files.
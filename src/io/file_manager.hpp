@@ -25,8 +25,11 @@
  * Contains generic utility classes for file I/O (especially XML handling).
  */
 
+#include <atomic>
+#include <memory>
 #include <mutex>
 #include <string>
+#include <unordered_set>
 #include <vector>
 #include <set>
 
@@ -37,14 +40,23 @@ using namespace irr;
 
 #include "io/xml_node.hpp"
 #include "utils/no_copy.hpp"
+#include "utils/types.hpp"
+
+/** The names of all entries of a search path directory, so that searching
+ *  a file in the search path does not need to query the file system. */
+typedef std::unordered_set<std::string> DirectoryIndex;
 
 struct TextureSearchPath
 {
     std::string m_texture_search_path;
     std::string m_container_id;
+    /** Content of the directory, or NULL if it is not indexed. */
+    std::shared_ptr<const DirectoryIndex> m_index;
 
-    TextureSearchPath(std::string path, std::string container_id) :
-        m_texture_search_path(path), m_container_id(container_id)
+    TextureSearchPath(std::string path, std::string container_id,
+                      std::shared_ptr<const DirectoryIndex> index) :
+        m_texture_search_path(path), m_container_id(container_id),
+        m_index(index)
     {
     }
 };
@@ -99,6 +111,10 @@ private:
     /** Directory where resized textures are cached. */
     std::string       m_cached_textures_dir;
 
+    /** Directory where data computed from tracks (like navmesh paths) is
+     *  cached. */
+    std::string       m_cached_data_dir;
+
     /** Directory where user-defined grand prix are stored. */
     std::string       m_gp_dir;
 
@@ -109,6 +125,21 @@ private:
     std::vector<std::string>
                       m_model_search_path,
                       m_music_search_path;
+
+    /** The content of each directory in m_model_search_path (NULL if a
+     *  directory is not indexed). */
+    std::vector<std::shared_ptr<const DirectoryIndex> > m_model_search_index;
+
+    /** Number of file system queries that were answered by the index of
+     *  a search path. */
+    mutable std::atomic<uint64_t> m_num_indexed_lookups;
+
+    std::shared_ptr<const DirectoryIndex>
+                      createDirectoryIndex(const std::string &dir) const;
+    bool              existsInSearchPath(const std::string &dir,
+                                         const DirectoryIndex *index,
+                                         const std::string &file_name)
+                                         const;
     bool              findFile(std::string& full_path,
                                const std::string& fname,
                                const std::vector<std::string>& search_path)
@@ -125,6 +156,7 @@ private:
     void              checkAndCreateScreenshotDir();
     void              checkAndCreateReplayDir();
     void              checkAndCreateCachedTexturesDir();
+    void              checkAndCreateCachedDataDir();
     void              checkAndCreateGPDir();
     void              discoverPaths();
 #if !defined(WIN32) && !defined(__CYGWIN__) && !defined(__APPLE__)
@@ -148,6 +180,7 @@ public:
     std::string       getScreenshotDir() const;
     std::string       getReplayDir() const;
     std::string       getCachedTexturesDir() const;
+    std::string       getCachedDataDir() const;
     std::string       getGPDir() const;
     bool              checkAndCreateDirectory(const std::string &path);
     bool              checkAndCreateDirectoryP(const std::string &path);
@@ -158,6 +191,9 @@ public:
     bool removeFile(const std::string &name) const;
     bool removeDirectory(const std::string &name) const;
     bool copyFile(const std::string &source, const std::string &dest);
+    bool getFileHash(const std::string &path, uint64_t *hash) const;
+    bool writeCacheFileAtomically(const std::string &name,
+                                  const std::string &data) const;
     std::vector<std::string>getMusicDirs() const;
     std::string getAssetChecked(AssetType type, const std::string& name,
                                 bool abort_on_error=false) const;
@@ -187,6 +223,13 @@ public:
     bool searchTextureContainerId(std::string& container_id,
         const std::string& file_name) const;
     // ------------------------------------------------------------------------
+    /** Returns the number of file system queries that were avoided by
+     *  using the indices of the texture and model search paths. */
+    uint64_t getNumIndexedLookups() const
+    {
+        return m_num_indexed_lookups.load();
+    }   // getNumIndexedLookups
+    // ------------------------------------------------------------------------
     /** Returns the name of the stdout file for log messages. */
     static const std::string& getStdoutName() { return m_stdout_filename; }
     // ------------------------------------------------------------------------
@@ -0,0 +1,154 @@
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2019 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "io/mapped_file.hpp"
+
+#include "utils/log.hpp"
+
+#include <stdio.h>
+
+#ifdef WIN32
+#  include <windows.h>
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+// ----------------------------------------------------------------------------
+/** Maps the specified file into memory.
+ *  \param filename Full path of the file.
+ */
+MappedFile::MappedFile(const std::string &filename)
+{
+    m_data  = NULL;
+    m_size  = 0;
+    m_valid = false;
+#ifdef WIN32
+    m_file_handle    = NULL;
+    m_mapping_handle = NULL;
+    HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ,
+                              FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+    {
+        CloseHandle(file);
+        m_valid = size.QuadPart == 0;
+        return;
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0,
+                                        NULL);
+    if (mapping)
+    {
+        m_data = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0,
+                                               0);
+    }
+    if (!m_data)
+    {
+        if (mapping)
+            CloseHandle(mapping);
+        CloseHandle(file);
+        m_valid = readIntoBuffer(filename);
+        return;
+    }
+    m_file_handle    = file;
+    m_mapping_handle = mapping;
+    m_size           = (size_t)size.QuadPart;
+    m_valid          = true;
+#else
+    m_mapped = false;
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1)
+        return;
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return;
+    }
+    if (st.st_size == 0)
+    {
+        close(fd);
+        m_valid = true;
+        return;
+    }
+    void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping stays valid after closing the file descriptor
+    close(fd);
+    if (p == MAP_FAILED)
+    {
+        m_valid = readIntoBuffer(filename);
+        return;
+    }
+    m_data   = (const uint8_t*)p;
+    m_size   = (size_t)st.st_size;
+    m_mapped = true;
+    m_valid  = true;
+#endif
+}   // MappedFile
+
+// ----------------------------------------------------------------------------
+MappedFile::~MappedFile()
+{
+#ifdef WIN32
+    if (m_mapping_handle)
+    {
+        UnmapViewOfFile(m_data);
+        CloseHandle((HANDLE)m_mapping_handle);
+        CloseHandle((HANDLE)m_file_handle);
+    }
+#else
+    if (m_mapped)
+        munmap((void*)m_data, m_size);
+#endif
+}   // ~MappedFile
+
+// ----------------------------------------------------------------------------
+/** Fallback if a file can not be mapped: reads the whole file into memory.
+ *  \param filename Full path of the file.
+ *  \return True if the file was read successfully.
+ */
+bool MappedFile::readIntoBuffer(const std::string &filename)
+{
+    FILE *fd = fopen(filename.c_str(), "rb");
+    if (!fd)
+        return false;
+    fseek(fd, 0, SEEK_END);
+    long size = ftell(fd);
+    fseek(fd, 0, SEEK_SET);
+    if (size <= 0)
+    {
+        fclose(fd);
+        return size == 0;
+    }
+    m_buffer.resize((size_t)size);
+    if (fread(m_buffer.data(), 1, m_buffer.size(), fd) != m_buffer.size())
+    {
+        Log::warn("MappedFile", "Could not read '%s'.", filename.c_str());
+        m_buffer.clear();
+        fclose(fd);
+        return false;
+    }
+    fclose(fd);
+    m_data = m_buffer.data();
+    m_size = m_buffer.size();
+    return true;
+}   // readIntoBuffer
@@ -0,0 +1,73 @@
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2019 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_MAPPED_FILE_HPP
+#define HEADER_MAPPED_FILE_HPP
+
+#include "utils/no_copy.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/** Gives read-only access to the content of a file by mapping it into
+ *  memory. If the file can not be mapped (e.g. on platforms without
+ *  support), the content is read into memory instead, so callers don't
+ *  need to care.
+ *  \ingroup io
+ */
+class MappedFile : public NoCopy
+{
+private:
+    /** Pointer to the content of the file. */
+    const uint8_t *m_data;
+
+    /** Size of the file. */
+    size_t m_size;
+
+    /** Used if the file could not be mapped. */
+    std::vector<uint8_t> m_buffer;
+
+    /** True if the file could be opened. */
+    bool m_valid;
+
+#ifdef WIN32
+    void *m_file_handle;
+    void *m_mapping_handle;
+#else
+    /** True if m_data points to a memory mapping. */
+    bool m_mapped;
+#endif
+
+    bool readIntoBuffer(const std::string &filename);
+
+public:
+             MappedFile(const std::string &filename);
+            ~MappedFile();
+    // ------------------------------------------------------------------------
+    /** Returns true if the file was opened successfully. */
+    bool           isValid() const { return m_valid; }
+    // ------------------------------------------------------------------------
+    /** Returns a pointer to the content of the file. */
+    const uint8_t* getData() const { return m_data; }
+    // ------------------------------------------------------------------------
+    /** Returns the size of the file. */
+    size_t         getSize() const { return m_size; }
+};   // MappedFile
+
+#endif
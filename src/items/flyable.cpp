@@ -607,12 +607,12 @@ void Flyable::moveToInfinity()
 }   // moveToInfinity
 
 // ----------------------------------------------------------------------------
-BareNetworkString* Flyable::saveState(std::vector<std::string>* ru)
+BareNetworkString* Flyable::saveState(std::vector<uint16_t>* ru)
 {
     if (m_has_hit_something)
         return NULL;
 
-    ru->push_back(getUniqueIdentity());
+    ru->push_back(getRewinderId());
     BareNetworkString *buffer = new BareNetworkString();
     CompressNetworkBody::compress(m_body->getWorldTransform(),
         m_body->getLinearVelocity(), m_body->getAngularVelocity(), buffer,
@@ -184,6 +184,13 @@ public:
         return false;
     }   // hitKart
 
+    // -----------------------------------------------------------------------
+    virtual float getMaxHitDistance() const
+    {
+        Log::fatal("ItemState", "getMaxHitDistance() called for ItemState.");
+        return 0;
+    }   // getMaxHitDistance
+
     // -----------------------------------------------------------------------
     virtual int getGraphNode() const 
     {
@@ -422,6 +429,14 @@ public:
         return lc.length2() < m_distance_2;
     }   // hitKart
     // ------------------------------------------------------------------------
+    /** Returns an upper bound for the distance between the item and a kart
+     *  that hits it. Since hitKart halves the vertical component, a kart
+     *  can be up to twice the hit distance away from the item. */
+    virtual float getMaxHitDistance() const OVERRIDE
+    {
+        return 2.0f * sqrtf(m_distance_2);
+    }   // getMaxHitDistance
+    // ------------------------------------------------------------------------
     bool rotating() const
            { return getType() != ITEM_BUBBLEGUM && getType() != ITEM_TRIGGER; }
 
@@ -38,6 +38,7 @@
 #include <IMesh.h>
 #include <IAnimatedMesh.h>
 
+#include <algorithm>
 #include <assert.h>
 #include <stdexcept>
 #include <sstream>
@@ -50,6 +51,7 @@ std::vector<video::SColorf>  ItemManager::m_glow_color;
 bool                         ItemManager::m_disable_item_collection = false;
 std::shared_ptr<ItemManager> ItemManager::m_item_manager;
 std::mt19937                 ItemManager::m_random_engine;
+const float                  ItemManager::ITEM_CELL_SIZE = 5.0f;
 
 //-----------------------------------------------------------------------------
 /** Creates one instance of the item manager. */
@@ -249,9 +251,97 @@ unsigned int ItemManager::insertItem(Item *item)
         else  // otherwise store it in the 'outside' index
             (*m_items_in_quads)[m_items_in_quads->size()-1].push_back(item);
     }   // if m_items_in_quads
+    addItemToCells(item);
     return index;
 }   // insertItem
 
+//-----------------------------------------------------------------------------
+/** Adds an item to all cells of the item grid that are within the maximum
+ *  hit distance of the item. The cell lists are kept sorted by item id.
+ *  \param item The item to add.
+ */
+void ItemManager::addItemToCells(ItemState *item)
+{
+    const Vec3 &xyz = item->getXYZ();
+    const float r   = item->getMaxHitDistance();
+    const int min_x = getCellIndex(xyz.getX() - r);
+    const int max_x = getCellIndex(xyz.getX() + r);
+    const int min_z = getCellIndex(xyz.getZ() - r);
+    const int max_z = getCellIndex(xyz.getZ() + r);
+    for (int x = min_x; x <= max_x; x++)
+    {
+        for (int z = min_z; z <= max_z; z++)
+        {
+            AllItemTypes &items = m_items_in_cells[getCellKey(x, z)];
+            AllItemTypes::iterator it =
+                std::upper_bound(items.begin(), items.end(), item,
+                                 [](const ItemState *a, const ItemState *b)
+                                 {
+                                     return a->getItemId() < b->getItemId();
+                                 });
+            items.insert(it, item);
+        }
+    }
+}   // addItemToCells
+
+//-----------------------------------------------------------------------------
+/** Removes an item from all cells of the item grid. Normally only the cells
+ *  around the item's position need to be checked, but a rewind can move an
+ *  item before the grid is rebuilt, so all cells are searched if the item
+ *  was not found there.
+ *  \param item The item to remove.
+ */
+void ItemManager::removeItemFromCells(ItemState *item)
+{
+    const Vec3 &xyz = item->getXYZ();
+    const float r   = item->getMaxHitDistance();
+    const int min_x = getCellIndex(xyz.getX() - r);
+    const int max_x = getCellIndex(xyz.getX() + r);
+    const int min_z = getCellIndex(xyz.getZ() - r);
+    const int max_z = getCellIndex(xyz.getZ() + r);
+    bool found = false;
+    for (int x = min_x; x <= max_x; x++)
+    {
+        for (int z = min_z; z <= max_z; z++)
+        {
+            auto cell = m_items_in_cells.find(getCellKey(x, z));
+            if (cell == m_items_in_cells.end())
+                continue;
+            AllItemTypes &items = cell->second;
+            AllItemTypes::iterator it = std::find(items.begin(), items.end(),
+                                                  item);
+            if (it != items.end())
+            {
+                items.erase(it);
+                found = true;
+            }
+        }
+    }
+    if (found)
+        return;
+
+    for (auto &cell : m_items_in_cells)
+    {
+        AllItemTypes &items = cell.second;
+        items.erase(std::remove(items.begin(), items.end(), item),
+                    items.end());
+    }
+}   // removeItemFromCells
+
+//-----------------------------------------------------------------------------
+/** Recreates the item grid from scratch. This is necessary after a rewind,
+ *  which can change the position and ids of items.
+ */
+void ItemManager::rebuildItemCells()
+{
+    m_items_in_cells.clear();
+    for (ItemState *item : m_all_items)
+    {
+        if (item)
+            addItemToCells(item);
+    }
+}   // rebuildItemCells
+
 //-----------------------------------------------------------------------------
 /** Creates a new item at the location of the kart (e.g. kart drops a
  *  bubblegum).
@@ -384,14 +474,10 @@ void ItemManager::collectedItem(ItemState *item, AbstractKart *kart)
  */
 void  ItemManager::checkItemHit(AbstractKart* kart)
 {
-    // We could use m_items_in_quads to to check for item hits: take the quad
-    // of the graph node of the kart, and only check items in that quad. But
-    // then we also need to check for any adjacent quads (since an item just
-    // on the order of one quad might get hit from an adjacent quad). Then
-    // it is possible that a quad is that short that we need to test adjacent
-    // of adjacent quads. And check for items outside of the track.
-    // Since at this stace item detection is by far not a bottle neck,
-    // the original, simple and stable algorithm is left in place.
+    // Only the items in the grid cell of the kart need to be tested: each
+    // item is stored in all cells within its maximum hit distance. Since
+    // the cell lists are sorted by item id, items are collected in the same
+    // order as when testing all items in m_all_items.
 
     /** Disable item collection detection for debug purposes. */
     if(m_disable_item_collection) return;
@@ -399,16 +485,23 @@ void  ItemManager::checkItemHit(AbstractKart* kart)
     // Spare tire karts don't collect items
     if ( dynamic_cast<SpareTireAI*>(kart->getController()) ) return;
 
-    for(AllItemTypes::iterator i =m_all_items.begin();
-                               i!=m_all_items.end();  i++)
+    const Vec3 &xyz = kart->getXYZ();
+    auto cell = m_items_in_cells.find(getCellKey(getCellIndex(xyz.getX()),
+                                                 getCellIndex(xyz.getZ())));
+    if (cell == m_items_in_cells.end()) return;
+
+    // Use an index, collecting an item might add new items to the cell
+    const AllItemTypes &items = cell->second;
+    for(unsigned int i = 0; i < items.size(); i++)
     {
+        ItemState *item = items[i];
         // Ignore items that have been collected or are not available atm
-        if ((!*i) || !(*i)->isAvailable() || (*i)->isUsedUp()) continue;
+        if (!item->isAvailable() || item->isUsedUp()) continue;
 
         // Shielded karts can simply drive over bubble gums without any effect
         if ( kart->isShielded() &&
-             ( (*i)->getType() == ItemState::ITEM_BUBBLEGUM      ||
-               (*i)->getType() == ItemState::ITEM_BUBBLEGUM_NOLOK  ) )
+             ( item->getType() == ItemState::ITEM_BUBBLEGUM      ||
+               item->getType() == ItemState::ITEM_BUBBLEGUM_NOLOK  ) )
         {
             continue;
         }
@@ -416,11 +509,11 @@ void  ItemManager::checkItemHit(AbstractKart* kart)
 
         // To allow inlining and avoid including kart.hpp in item.hpp,
         // we pass the kart and the position separately.
-        if((*i)->hitKart(kart->getXYZ(), kart))
+        if(item->hitKart(xyz, kart))
         {
-            collectedItem(*i, kart);
+            collectedItem(item, kart);
         }   // if hit
-    }   // for m_all_items
+    }   // for items
 }   // checkItemHit
 
 //-----------------------------------------------------------------------------
@@ -535,6 +628,7 @@ void ItemManager::deleteItem(ItemState *item)
         assert(it!=items.end());
         items.erase(it);
     }   // if m_items_in_quads
+    removeItemFromCells(item);
 
     int index = item->getItemId();
     m_all_items[index] = NULL;
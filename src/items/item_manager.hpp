@@ -24,15 +24,18 @@
 #include "items/item.hpp"
 #include "utils/aligned_array.hpp"
 #include "utils/no_copy.hpp"
+#include "utils/types.hpp"
 #include "utils/vec3.hpp"
 
 #include <SColor.h>
 
 #include <assert.h>
+#include <cmath>
 #include <map>
 #include <memory>
 #include <random>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 class Kart;
@@ -110,6 +113,13 @@ private:
      *  field is undefined if no Graph exist, e.g. arena without navmesh. */
     std::vector< AllItemTypes > *m_items_in_quads;
 
+    /** A uniform grid in the x/z plane over all items, used to quickly find
+     *  the items a kart can hit. Each item is stored in all cells that are
+     *  within its maximum hit distance, and each cell list is sorted by
+     *  item id, so items are tested in the same order as in m_all_items.
+     *  The key is computed by getCellKey. */
+    std::unordered_map<uint64_t, AllItemTypes> m_items_in_cells;
+
     /** Stores all item models. */
     static std::vector<scene::IMesh *> m_item_mesh;
 
@@ -117,11 +127,17 @@ private:
     static std::vector<scene::IMesh *> m_item_lowres_mesh;
 
 protected:
+    /** Size of a cell in m_items_in_cells. */
+    static const float ITEM_CELL_SIZE;
+
     /** Remaining time that items should remain switched. If the
      *  value is <0, it indicates that the items are not switched atm. */
     int m_switch_ticks;
 
     void deleteItem(ItemState *item);
+    void addItemToCells(ItemState *item);
+    void removeItemFromCells(ItemState *item);
+    void rebuildItemCells();
     virtual unsigned int insertItem(Item *item);
     void switchItemsInternal(std::vector < ItemState*> &all_items);
     void setSwitchItems(const std::vector<int> &switch_items);
@@ -157,6 +173,19 @@ public:
         assert(false);
     }
     // ------------------------------------------------------------------------
+    /** Returns the index of the grid cell containing the given coordinate.
+     */
+    static int getCellIndex(float f)
+    {
+        return (int)floorf(f / ITEM_CELL_SIZE);
+    }   // getCellIndex
+    // ------------------------------------------------------------------------
+    /** Returns the key used in m_items_in_cells for the given cell. */
+    static uint64_t getCellKey(int x, int z)
+    {
+        return ((uint64_t)(uint32_t)x << 32) | (uint64_t)(uint32_t)z;
+    }   // getCellKey
+    // ------------------------------------------------------------------------
     /** Returns the number of items. */
     unsigned int   getNumberOfItems() const
     {
@@ -228,9 +228,9 @@ void NetworkItemManager::setItemConfirmationTime(std::weak_ptr<STKPeer> peer,
  *  to save the initial state, which is the first confirmed state by all
  *  clients.
  */
-BareNetworkString* NetworkItemManager::saveState(std::vector<std::string>* ru)
+BareNetworkString* NetworkItemManager::saveState(std::vector<uint16_t>* ru)
 {
-    ru->push_back(getUniqueIdentity());
+    ru->push_back(getRewinderId());
     // On the server:
     // ==============
     m_item_events.lock();
@@ -526,6 +526,9 @@ void NetworkItemManager::restoreState(BareNetworkString *buffer, int count)
         }
     }   // for i < max_index
 
+    // Items can have been moved or got new ids, so update the item grid
+    rebuildItemCells();
+
     // Now set the clock back to the 'rewindto' time:
     world->setTicksForRewind(rewind_to_time);
 
@@ -251,7 +251,7 @@ void Plunger::hideNodeWhenUndoDestruction()
 }   // hideNodeWhenUndoDestruction
 
 // ----------------------------------------------------------------------------
-BareNetworkString* Plunger::saveState(std::vector<std::string>* ru)
+BareNetworkString* Plunger::saveState(std::vector<uint16_t>* ru)
 {
     BareNetworkString* buffer = Flyable::saveState(ru);
     if (!buffer)
@@ -1902,27 +1902,15 @@ void SkiddingAI::computeNearestKarts()
 
     float target_overall_distance = 0.0f;
     float own_overall_distance = m_world->getOverallDistance(m_kart->getWorldKartId());
-    m_num_players_ahead = 0;
 
     unsigned int n = ProfileWorld::isProfileMode()
                    ? 0 : race_manager->getNumPlayers();
 
-    std::vector<float> overall_distance;
-    // Get the players distances
-    for(unsigned int i=0; i<n; i++)
-    {
-        unsigned int kart_id = m_world->getPlayerKart(i)->getWorldKartId();
-        overall_distance.push_back(m_world->getOverallDistance(kart_id));
-    }
-   
-    // Sort the list
-    std::sort(overall_distance.begin(), overall_distance.end());
-
-    for(unsigned int i=0; i<n; i++)
-    {
-        if(overall_distance[i]>own_overall_distance)
-            m_num_players_ahead++;
-    }
+    // The world keeps the player distances sorted, so there is no need
+    // to collect and sort them for each AI.
+    m_num_players_ahead = n > 0
+                        ? m_world->getNumPlayersAhead(own_overall_distance)
+                        : 0;
 
     // Force best driving when profiling and for FTL leaders
     if(ProfileWorld::isProfileMode() ||
@@ -1934,7 +1922,8 @@ void SkiddingAI::computeNearestKarts()
     else if (race_manager->getDifficulty() == RaceManager::DIFFICULTY_HARD ||
              race_manager->getDifficulty() == RaceManager::DIFFICULTY_BEST)
     {
-        target_overall_distance = overall_distance[n-1]; // Highest player distance
+        // Highest player distance
+        target_overall_distance = m_world->getSortedPlayerDistance(n-1);
     }
     // Distribute the AIs to players
     else
@@ -1955,7 +1944,7 @@ void SkiddingAI::computeNearestKarts()
         // as the highest possible ideal_target is n
         int target_index = (int) (ideal_target - 0.5f);
         assert(target_index >= 0 && target_index <= (int)n-1);
-        target_overall_distance = overall_distance[target_index];
+        target_overall_distance = m_world->getSortedPlayerDistance(target_index);
     }
     // Now convert 'maximum overall distance' to distance to player.
     m_distance_to_player = own_overall_distance - target_overall_distance;
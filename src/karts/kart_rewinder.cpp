@@ -106,15 +106,15 @@ void KartRewinder::computeError()
 /** Saves all state information for a kart in a memory buffer. The memory
  *  is allocated here and the address returned. It will then be managed
  *  by the RewindManager.
- *  \param[out] ru The unique identity of rewinder writing to.
+ *  \param[out] ru The rewinder id of rewinder writing to.
  *  \return The address of the memory buffer with the state.
  */
-BareNetworkString* KartRewinder::saveState(std::vector<std::string>* ru)
+BareNetworkString* KartRewinder::saveState(std::vector<uint16_t>* ru)
 {
     if (m_eliminated)
         return nullptr;
 
-    ru->push_back(getUniqueIdentity());
+    ru->push_back(getRewinderId());
     const int MEMSIZE = 17*sizeof(float) + 9+3;
 
     BareNetworkString *buffer = new BareNetworkString(MEMSIZE);
@@ -191,6 +191,7 @@
 #include "graphics/material_manager.hpp"
 #include "graphics/particle_kind_manager.hpp"
 #include "graphics/referee.hpp"
+#include "graphics/sp/sp_animation.hpp"
 #include "graphics/sp/sp_base.hpp"
 #include "graphics/sp/sp_shader.hpp"
 #include "guiengine/engine.hpp"
@@ -216,6 +217,7 @@
 #include "modes/profile_world.hpp"
 #include "network/protocols/connect_to_server.hpp"
 #include "network/protocols/client_lobby.hpp"
+#include "network/protocols/game_protocol.hpp"
 #include "network/protocols/server_lobby.hpp"
 #include "network/network_config.hpp"
 #include "network/network_string.hpp"
@@ -244,6 +246,7 @@
 #include "tracks/arena_graph.hpp"
 #include "tracks/track.hpp"
 #include "tracks/track_manager.hpp"
+#include "tracks/track_object_manager.hpp"
 #include "utils/command_line.hpp"
 #include "utils/constants.hpp"
 #include "utils/crash_reporting.hpp"
@@ -584,6 +587,13 @@ void cmdLineHelp()
                               "laps.\n"
     "       --profile-time=n   Enable automatic driven profile mode for n "
                               "seconds.\n"
+    "       --profiler-trace=n Write a trace of all profiler markers for n seconds\n"
+    "                          (Chrome trace event format, viewable in Perfetto).\n"
+    "       --benchmark=file   In profile mode: write time step statistics of all\n"
+    "                          profiler markers and the race result to file (JSON).\n"
+    "       --benchmark-result=hash In profile mode: exit with an error if the race\n"
+    "                          result does not match hash (see --benchmark).\n"
+    "       --convert-replay=file Convert a replay file to the binary format.\n"
     "       --unlock-all       Permanently unlock all karts and tracks for testing.\n"
     "       --no-unlock-all    Disable unlock-all (i.e. base unlocking on player achievement).\n"
     "       --no-graphics      Do not display the actual race.\n"
@@ -601,6 +611,16 @@ void cmdLineHelp()
     // "    --disable-item-collection Disable item collection. Useful for\n"
     // "                          debugging client/server item management.\n"
     // "    --network-item-debugging Print item handling debug information.\n"
+    // "    --graph-benchmark  Compare graph lookups with and without spatial\n"
+    // "                          index each time a track is loaded.\n"
+    // "    --raycast-benchmark Compare single and batched raycasts each\n"
+    // "                          time a track is loaded.\n"
+    // "    --animation-benchmark Compare the old and new evaluation of\n"
+    // "                          skeletal animation poses and exit.\n"
+    // "    --track-object-benchmark Compare scheduled track object updates\n"
+    // "                          and indexed raycasts with updating and\n"
+    // "                          testing all objects each time a track is\n"
+    // "                          loaded.\n"
     "       --server-config=file Specify the server_config.xml for server hosting, it will create\n"
     "                            one if not found.\n"
     "       --network-console  Enable network console.\n"
@@ -1193,6 +1213,15 @@ int handleCmdLine(bool has_server_config, bool has_parent_process)
 
     if (CommandLine::has("--network-item-debugging"))
         NetworkItemManager::m_network_item_debugging = true;
+
+    if (CommandLine::has("--graph-benchmark"))
+        Graph::enableLookupBenchmark();
+
+    if (CommandLine::has("--raycast-benchmark"))
+        Track::enableRaycastBenchmark();
+
+    if (CommandLine::has("--track-object-benchmark"))
+        TrackObjectManager::enableBenchmark();
     
     std::string server_password;
     if (CommandLine::has("--server-password", &s))
@@ -1578,6 +1607,23 @@ int handleCmdLine(bool has_server_config, bool has_parent_process)
         race_manager->setNumLaps(999999); // profile end depends on time
     }   // --profile-time
 
+    if(CommandLine::has("--profiler-trace", &n))
+    {
+        // Works without graphics, so it can be used on servers, too
+        profiler.startTrace((float)n);
+    }   // --profiler-trace
+
+    if(CommandLine::has("--benchmark", &s))
+    {
+        if (!ProfileWorld::isProfileMode())
+            Log::warn("main", "--benchmark requires --profile-laps or "
+                              "--profile-time.");
+        ProfileWorld::setBenchmarkFile(s);
+    }   // --benchmark
+
+    if(CommandLine::has("--benchmark-result", &s))
+        ProfileWorld::setExpectedResult(s);
+
     if(CommandLine::has("--history"))
     {
         history->setReplayHistory(true);
@@ -1587,6 +1633,27 @@ int handleCmdLine(bool has_server_config, bool has_parent_process)
             UserConfigParams::m_no_start_screen = true;
     }   // --history
 
+    if(CommandLine::has("--convert-replay", &s))
+    {
+        // Convert a text replay file to the binary format and exit
+        ReplayPlay::convertReplay(s);
+        return 0;
+    }   // --convert-replay
+
+    // Undocumented: compare loading times of text and binary replays
+    if(CommandLine::has("--replay-benchmark", &s))
+    {
+        ReplayPlay::benchmarkReplays(s);
+        return 0;
+    }   // --replay-benchmark
+
+    // Undocumented: compare old and new skeletal animation pose evaluation
+    if(CommandLine::has("--animation-benchmark"))
+    {
+        SP::Armature::benchmarkPoses();
+        return 0;
+    }   // --animation-benchmark
+
     // Demo mode
     if(CommandLine::has("--demo-mode", &s))
     {
@@ -2297,7 +2364,8 @@ int main(int argc, char *argv[] )
 
     delete file_manager;
 
-    return 0 ;
+    // Allow scripts to detect benchmarks with a changed race result
+    return ProfileWorld::hasBenchmarkFailed() ? 1 : 0;
 }   // main
 
 // ============================================================================
@@ -2431,6 +2499,8 @@ void runUnitTests()
     GraphicsRestrictions::unitTesting();
     Log::info("UnitTest", "NetworkString");
     NetworkString::unitTesting();
+    Log::info("UnitTest", "State delta encoding");
+    GameProtocol::unitTesting();
     Log::info("UnitTest", "TransportAddress");
     TransportAddress::unitTesting();
 
@@ -2480,6 +2550,9 @@ void runUnitTests()
     Log::info("UnitTest", "RewindQueue");
     RewindQueue::unitTesting();
 
+    Log::info("UnitTest", "Binary replay");
+    ReplayBase::unitTesting();
+
     Log::info("UnitTest", "IP ban");
     NetworkConfig::get()->unsetNetworking();
     ServerLobby sl;
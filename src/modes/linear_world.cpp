@@ -43,6 +43,7 @@
 #include "utils/string_utils.hpp"
 #include "utils/translation.hpp"
 
+#include <algorithm>
 #include <climits>
 #include <iostream>
 
@@ -105,6 +106,9 @@ void LinearWorld::reset(bool restart)
     {
         m_kart_info[i].reset();
     }   // next kart
+    // Force a full sort of the ranking, the karts were moved
+    m_kart_ranking.clear();
+    updatePlayerDistances();
 
     // At the moment the last kart would be the one that is furthest away
     // from the start line, i.e. it would determine the amount by which
@@ -259,8 +263,27 @@ void LinearWorld::updateTrackSectors()
                                      * Track::getCurrentTrack()->getTrackLength()
                         + getDistanceDownTrackForKart(kart->getWorldKartId(), true);
     }   // for n
+    updatePlayerDistances();
 }   // updateTrackSectors
 
+//-----------------------------------------------------------------------------
+/** Collects and sorts the overall distances of all player karts. This is
+ *  done once per time step after the distances were updated, so that the
+ *  AIs can use the sorted list instead of each building their own.
+ */
+void LinearWorld::updatePlayerDistances()
+{
+    m_player_distances.clear();
+    const unsigned int num_players = race_manager->getNumPlayers();
+    for (unsigned int i = 0; i < m_karts.size() &&
+                             m_player_distances.size() < num_players; i++)
+    {
+        if (m_karts[i]->getController()->isPlayerController())
+            m_player_distances.push_back(m_kart_info[i].m_overall_distance);
+    }
+    std::sort(m_player_distances.begin(), m_player_distances.end());
+}   // updatePlayerDistances
+
 //-----------------------------------------------------------------------------
 /** This updates all only graphical elements.It is only called once per
 *  rendered frame, not once per time step.
@@ -799,9 +822,65 @@ btTransform LinearWorld::getRescueTransform(unsigned int index) const
 }   // getRescueTransform
 
 //-----------------------------------------------------------------------------
-/** Find the position (rank) of every kart. ATM it uses a stable O(n^2)
- *  algorithm by counting for each kart how many other karts are ahead of
- *  it.
+/** Returns true if kart a is ahead of kart b, i.e. it has driven further,
+ *  or it has the same distance (very unlikely) but started earlier.
+ *  \param a World kart id of the first kart.
+ *  \param b World kart id of the second kart.
+ */
+bool LinearWorld::isKartAhead(unsigned int a, unsigned int b) const
+{
+    const float dist_a = m_kart_info[a].m_overall_distance;
+    const float dist_b = m_kart_info[b].m_overall_distance;
+    return dist_a > dist_b ||
+          (dist_a == dist_b &&
+           m_karts[a]->getInitialPosition() < m_karts[b]->getInitialPosition());
+}   // isKartAhead
+
+//-----------------------------------------------------------------------------
+/** Sorts m_kart_ranking by overall distance. Since positions rarely change
+ *  from one time step to the next, the ranking of the previous step is
+ *  nearly sorted, so an insertion sort is usually linear. If too many karts
+ *  moved (e.g. after a rescue), it falls back to a full sort.
+ */
+void LinearWorld::updateKartRanking()
+{
+    const unsigned int kart_amount = (unsigned int)m_karts.size();
+    auto compare = [this](unsigned int a, unsigned int b)
+                   { return isKartAhead(a, b); };
+    if (m_kart_ranking.size() != kart_amount)
+    {
+        m_kart_ranking.resize(kart_amount);
+        for (unsigned int i = 0; i < kart_amount; i++)
+            m_kart_ranking[i] = i;
+        std::sort(m_kart_ranking.begin(), m_kart_ranking.end(), compare);
+        return;
+    }
+
+    const unsigned int max_moves = 8 * kart_amount;
+    unsigned int moves = 0;
+    for (unsigned int i = 1; i < kart_amount; i++)
+    {
+        const unsigned int kart_id = m_kart_ranking[i];
+        unsigned int j = i;
+        while (j > 0 && isKartAhead(kart_id, m_kart_ranking[j - 1]))
+        {
+            m_kart_ranking[j] = m_kart_ranking[j - 1];
+            j--;
+            moves++;
+        }
+        m_kart_ranking[j] = kart_id;
+        if (moves > max_moves)
+        {
+            std::sort(m_kart_ranking.begin(), m_kart_ranking.end(), compare);
+            return;
+        }
+    }
+}   // updateKartRanking
+
+//-----------------------------------------------------------------------------
+/** Find the position (rank) of every kart. The karts are sorted by their
+ *  overall distance (see updateKartRanking), and each kart that is still
+ *  racing is ranked behind all karts that have already finished.
  */
 void LinearWorld::updateRacePosition()
 {
@@ -813,11 +892,24 @@ void LinearWorld::updateRacePosition()
     bool rank_changed = false;
 #endif
 
+    updateKartRanking();
+
+    // All karts that have finished the race are ahead of the karts
+    // that are still racing.
+    int num_finished = 0;
+    for (unsigned int i=0; i<kart_amount; i++)
+    {
+        if (!m_karts[i]->isEliminated() && m_karts[i]->hasFinishedRace())
+            num_finished++;
+    }
+
     // NOTE: if you do any changes to this loop, the next loop (see
     // DEBUG_KART_RANK below) needs to have the same changes applied
     // so that debug output is still correct!!!!!!!!!!!
-    for (unsigned int i=0; i<kart_amount; i++)
+    int p = num_finished;
+    for (unsigned int r=0; r<kart_amount; r++)
     {
+        const unsigned int i = m_kart_ranking[r];
         AbstractKart* kart = m_karts[i].get();
         // Karts that are either eliminated or have finished the
         // race already have their (final) position assigned. If
@@ -833,33 +925,9 @@ void LinearWorld::updateRacePosition()
         }
         KartInfo& kart_info = m_kart_info[i];
 
-        int p = 1 ;
-
-        const unsigned int my_id = kart->getWorldKartId();
-        const float my_distance  = m_kart_info[my_id].m_overall_distance;
-
-        // Count karts ahead of the current kart, i.e. kart that are
-        // already finished or have covered a larger overall distance.
-        for (unsigned int j = 0 ; j < kart_amount ; j++)
-        {
-            // don't compare a kart with itself and ignore eliminated karts
-            if(j == my_id || m_karts[j]->isEliminated())
-                continue;
-
-            // If the other kart has:
-            // - finished the race (but this kart hasn't)
-            // - or is ahead
-            // - or has the same distance (very unlikely) but started earlier
-            // it is ahead --> increase position
-            if((!kart->hasFinishedRace() && m_karts[j]->hasFinishedRace()) ||
-                m_kart_info[j].m_overall_distance > my_distance            ||
-               (m_kart_info[j].m_overall_distance == my_distance &&
-                m_karts[j]->getInitialPosition()<kart->getInitialPosition() ) )
-            {
-                p++;
-            }
-
-        } //next kart
+        // All karts earlier in the ranking that are still racing are
+        // ahead of this kart.
+        p++;
 
 #ifndef DEBUG
         setKartPosition(i, p);
@@ -882,10 +950,11 @@ void LinearWorld::updateRacePosition()
             }
 
             Log::debug("[LinearWorld]", "Who has each ranking so far :");
-            for (unsigned int d=0; d<i; d++)
+            for (unsigned int d=0; d<r; d++)
             {
-                Log::debug("[LinearWorld]", "%s has rank %d", m_karts[d]->getIdent().c_str(),
-                            m_karts[d]->getPosition());
+                Log::debug("[LinearWorld]", "%s has rank %d",
+                           m_karts[m_kart_ranking[d]]->getIdent().c_str(),
+                           m_karts[m_kart_ranking[d]]->getPosition());
             }
 
             Log::debug("[LinearWorld]", "    --> And %s is being set at rank %d",
@@ -905,7 +974,7 @@ void LinearWorld::updateRacePosition()
             music_manager->switchToFastMusic();
             m_faster_music_active=true;
         }
-    }   // for i<kart_amount
+    }   // for r<kart_amount
 
     // Define this to get a detailled analyses each time a race position
     // changes.
@@ -21,6 +21,7 @@
 #include "modes/world_with_rank.hpp"
 #include "utils/aligned_array.hpp"
 
+#include <algorithm>
 #include <climits>
 #include <vector>
 
@@ -72,6 +73,19 @@ private:
      */
     void  updateLiveDifference();
 
+    /** World kart ids of all karts, sorted by overall distance (largest
+     *  first, ties broken by the initial position). The order is kept
+     *  between updates, so it is nearly sorted and cheap to update. */
+    std::vector<unsigned int> m_kart_ranking;
+
+    /** The overall distance of all player karts, sorted in increasing
+     *  order. Updated once per time step and shared by all AIs. */
+    std::vector<float> m_player_distances;
+
+    bool  isKartAhead(unsigned int a, unsigned int b) const;
+    void  updateKartRanking();
+    void  updatePlayerDistances();
+
     // ------------------------------------------------------------------------
     /** Some additional info that needs to be kept for each kart
      * in this kind of race.
@@ -184,6 +198,26 @@ public:
         return m_kart_info[kart_index].m_overall_distance;
     }   // getOverallDistance
     // ------------------------------------------------------------------------
+    /** Returns the number of player karts that have driven further than
+     *  the specified distance.
+     *  \param distance The overall distance to compare with. */
+    unsigned int getNumPlayersAhead(float distance) const
+    {
+        return (unsigned int)(m_player_distances.end() -
+                              std::upper_bound(m_player_distances.begin(),
+                                               m_player_distances.end(),
+                                               distance));
+    }   // getNumPlayersAhead
+    // ------------------------------------------------------------------------
+    /** Returns the overall distance of a player kart, where the player
+     *  karts are sorted by increasing distance.
+     *  \param index Index of the player in the sorted list. */
+    float getSortedPlayerDistance(unsigned int index) const
+    {
+        assert(index < m_player_distances.size());
+        return m_player_distances[index];
+    }   // getSortedPlayerDistance
+    // ------------------------------------------------------------------------
     /** Returns time for the fastest laps */
     float getFastestLap() const
     {
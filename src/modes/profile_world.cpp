@@ -24,16 +24,23 @@
 #include "karts/kart_with_stats.hpp"
 #include "karts/controller/controller.hpp"
 #include "tracks/track.hpp"
+#include "utils/profiler.hpp"
+#include "utils/string_utils.hpp"
 
 #include <ISceneManager.h>
 
+#include <algorithm>
 #include <iomanip>
 #include <iostream>
+#include <stdio.h>
 
 ProfileWorld::ProfileType ProfileWorld::m_profile_mode=PROFILE_NONE;
 int   ProfileWorld::m_num_laps    = 0;
 float ProfileWorld::m_time        = 0.0f;
 bool  ProfileWorld::m_no_graphics = false;
+std::string ProfileWorld::m_benchmark_file;
+std::string ProfileWorld::m_expected_result;
+bool  ProfileWorld::m_benchmark_failed = false;
 
 //-----------------------------------------------------------------------------
 /** The constructor sets the number of (local) players to 0, since only AI
@@ -92,6 +99,18 @@ void ProfileWorld::setProfileModeLaps(int laps)
     m_num_laps     = laps;
 }   // setProfileModeLaps
 
+//-----------------------------------------------------------------------------
+/** Writes benchmark results to the specified file at the end of the race:
+ *  statistics of the time spent per time step in each profiler marker, and
+ *  the race result. This also starts recording the profiler statistics.
+ *  \param filename Name of the JSON file to write.
+ */
+void ProfileWorld::setBenchmarkFile(const std::string &filename)
+{
+    m_benchmark_file = filename;
+    profiler.startTickStats();
+}   // setBenchmarkFile
+
 //-----------------------------------------------------------------------------
 /** Creates a kart, having a certain position, starting location, and local
  *  and global player id (if applicable).
@@ -203,6 +222,11 @@ void ProfileWorld::enterRaceOverState()
     float runtime = (irr_driver->getRealTime()-m_start_time)*0.001f;
     Log::verbose("profile", "Number of frames: %d time %f, Average FPS: %f",
                  m_frame_count, runtime, (float)m_frame_count/runtime);
+    // Time spent in kart and AI updates
+    Log::verbose("profile", "Kart updates: %d, time %f s, %f ms per update",
+                 getKartUpdateCount(), getKartUpdateTime(),
+                 getKartUpdateCount() > 0
+                 ? 1000.0 * getKartUpdateTime() / getKartUpdateCount() : 0.0);
 
     // Print geometry statistics if we're not in no-graphics mode
     if(!m_no_graphics)
@@ -345,6 +369,108 @@ void ProfileWorld::enterRaceOverState()
                off_track_count, energy);
         Log::verbose("profile", "");
     }   // for it !=all_groups.end
+
+    if (!m_benchmark_file.empty() || !m_expected_result.empty())
+        writeBenchmarkResults(runtime);
+
     delete this;
     main_loop->abort();
 }   // enterRaceOverState
+
+//-----------------------------------------------------------------------------
+/** Computes a hash of the race result, i.e. the order in which the karts
+ *  finished and their finish times. Since profile mode runs with a fixed
+ *  time step, the same race (same seed, track, karts and difficulty) must
+ *  always give the same result, so this can be used to detect changes in
+ *  behaviour when optimising code.
+ */
+std::string ProfileWorld::computeResultHash() const
+{
+    // FNV-1a hash
+    uint32_t hash = 2166136261u;
+    for (unsigned int i = 0; i < m_karts.size(); i++)
+    {
+        const AbstractKart *kart = m_karts[i].get();
+        // Round the time to ms to ignore float printing differences
+        std::string s = kart->getIdent() + " "
+                      + StringUtils::toString(kart->getPosition()) + " "
+                      + StringUtils::toString(
+                          (int)(kart->getFinishTime() * 1000.0f + 0.5f))
+                      + ";";
+        for (char c : s)
+        {
+            hash ^= (uint8_t)c;
+            hash *= 16777619u;
+        }
+    }
+    char buffer[16];
+    sprintf(buffer, "%08x", hash);
+    return buffer;
+}   // computeResultHash
+
+//-----------------------------------------------------------------------------
+/** Writes the benchmark results as JSON (see setBenchmarkFile), and checks
+ *  if the race result matches the expected result.
+ *  \param runtime Real time the race took.
+ */
+void ProfileWorld::writeBenchmarkResults(float runtime)
+{
+    const std::string hash = computeResultHash();
+    const bool matches = m_expected_result.empty() ||
+                         m_expected_result == hash;
+    if (!matches)
+    {
+        Log::error("profile", "Race result %s does not match the expected "
+                   "result %s.", hash.c_str(), m_expected_result.c_str());
+        m_benchmark_failed = true;
+    }
+
+    if (m_benchmark_file.empty())
+        return;
+    FILE *f = fopen(m_benchmark_file.c_str(), "w");
+    if (!f)
+    {
+        Log::error("profile", "Can't open '%s' for writing.",
+                   m_benchmark_file.c_str());
+        m_benchmark_failed = true;
+        return;
+    }
+
+    fprintf(f, "{\n  \"track\": \"%s\",\n  \"karts\": %d,\n"
+            "  \"difficulty\": \"%s\",\n  \"laps\": %d,\n"
+            "  \"ticks\": %d,\n"
+            "  \"runtime\": %.3f,\n",
+            race_manager->getTrackName().c_str(), (int)m_karts.size(),
+            race_manager->getDifficultyAsString(
+                race_manager->getDifficulty()).c_str(),
+            race_manager->getNumLaps(), m_frame_count, runtime);
+
+    std::vector<AbstractKart*> karts;
+    for (unsigned int i = 0; i < m_karts.size(); i++)
+        karts.push_back(m_karts[i].get());
+    std::sort(karts.begin(), karts.end(),
+              [](const AbstractKart *a, const AbstractKart *b)
+              { return a->getPosition() < b->getPosition(); });
+    fprintf(f, "  \"result\": [");
+    for (unsigned int i = 0; i < karts.size(); i++)
+    {
+        fprintf(f, "%s\n    {\"kart\": \"%s\", \"start\": %d, "
+                "\"position\": %d, \"time\": %.3f}", i == 0 ? "" : ",",
+                karts[i]->getIdent().c_str(),
+                karts[i]->getInitialPosition(), karts[i]->getPosition(),
+                karts[i]->getFinishTime());
+    }
+    fprintf(f, "\n  ],\n  \"result_hash\": \"%s\",\n", hash.c_str());
+    if (!m_expected_result.empty())
+    {
+        fprintf(f, "  \"expected_result_hash\": \"%s\",\n"
+                "  \"result_matches\": %s,\n",
+                m_expected_result.c_str(), matches ? "true" : "false");
+    }
+    fprintf(f, "  \"tick_stats\": ");
+    profiler.writeTickStats(f);
+    fprintf(f, "\n}\n");
+    fclose(f);
+    Log::info("profile", "Benchmark results written to '%s'.",
+              m_benchmark_file.c_str());
+}   // writeBenchmarkResults
@@ -21,6 +21,8 @@
 
 #include "modes/standard_race.hpp"
 
+#include <string>
+
 class Kart;
 
 /**
@@ -67,6 +69,19 @@ private:
     /** Number of calls to draw. */
     long long    m_num_calls;
 
+    /** If not empty, the name of the file the benchmark results (tick
+     *  statistics and race result) are written to as JSON. */
+    static std::string m_benchmark_file;
+
+    /** If not empty, the hash the race result must match. */
+    static std::string m_expected_result;
+
+    /** True if the race result did not match the expected result. */
+    static bool  m_benchmark_failed;
+
+    std::string computeResultHash() const;
+    void        writeBenchmarkResults(float runtime);
+
 protected:
     /** In laps based profiling: number of laps to run. Also
      *  used by DemoWorld. */
@@ -88,6 +103,17 @@ public:
 
     static   void setProfileModeTime(float time);
     static   void setProfileModeLaps(int laps);
+    static   void setBenchmarkFile(const std::string &filename);
+    // ------------------------------------------------------------------------
+    /** Sets the hash the race result of a benchmark must match.
+     *  \param hash The expected hash as written by a previous run. */
+    static   void setExpectedResult(const std::string &hash)
+    {
+        m_expected_result = hash;
+    }   // setExpectedResult
+    // ------------------------------------------------------------------------
+    /** Returns true if the race result did not match the expected result. */
+    static   bool hasBenchmarkFailed() { return m_benchmark_failed; }
     // ------------------------------------------------------------------------
     /** Returns true if profile mode was selected. */
     static   bool isProfileMode() {return m_profile_mode!=PROFILE_NONE; }
@@ -37,6 +37,7 @@
 #include "network/rewind_manager.hpp"
 #include "network/stk_host.hpp"
 #include "physics/physics.hpp"
+#include "scriptengine/script_engine.hpp"
 #include "states_screens/race_gui_base.hpp"
 #include "tracks/graph.hpp"
 #include "tracks/quad.hpp"
@@ -686,6 +687,7 @@ void SoccerWorld::enterRaceOverState()
     {
         Log::verbose("Soccer AI profiling", "Total frames elapsed for a team"
             " to win with 30 goals: %d", m_frame_count);
+        Scripting::ScriptEngine::getInstance()->logStatistics();
 
         // Goal time statistics
         std::sort(m_goal_frame.begin(), m_goal_frame.end());
@@ -30,6 +30,7 @@
 #include "karts/kart_properties.hpp"
 #include "karts/kart_properties_manager.hpp"
 #include "physics/physics.hpp"
+#include "scriptengine/script_engine.hpp"
 #include "states_screens/race_gui_base.hpp"
 #include "tracks/arena_graph.hpp"
 #include "tracks/arena_node.hpp"
@@ -580,6 +581,7 @@ void ThreeStrikesBattle::enterRaceOverState()
             m_frame_count, (float)m_frame_count/runtime);
         Log::verbose("Battle AI profiling", "Total rescue: %d , hits %d in %f seconds",
             m_total_rescue, m_total_hit, runtime);
+        Scripting::ScriptEngine::getInstance()->logStatistics();
         delete this;
         main_loop->abort();
     }
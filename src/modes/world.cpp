@@ -77,6 +77,7 @@
 #include "utils/profiler.hpp"
 #include "utils/translation.hpp"
 #include "utils/string_utils.hpp"
+#include "utils/time.hpp"
 
 #include <algorithm>
 #include <assert.h>
@@ -136,6 +137,8 @@ World::World() : WorldStatus()
     m_schedule_exit_race = false;
     m_schedule_tutorial  = false;
     m_is_network_world   = false;
+    m_kart_update_time   = 0.0;
+    m_kart_update_count  = 0;
 
     m_stop_music_when_dialog_open = true;
 
@@ -1038,6 +1041,11 @@ void World::update(int ticks)
     // Update all the karts. This in turn will also update the controller,
     // which causes all AI steering commands set. So in the following 
     // physics update the new steering is taken into account.
+    // The karts are updated one after another on purpose: a kart update can
+    // change other karts (e.g. swatter, parachute, bomb explosions), and an
+    // AI sees the karts updated before it, so rewind and replays depend on
+    // this order.
+    double start_time = StkTime::getRealTime();
     const int kart_amount = (int)m_karts.size();
     for (int i = 0 ; i < kart_amount; ++i)
     {
@@ -1049,6 +1057,8 @@ void World::update(int ticks)
         if (isStartPhase())
             m_karts[i]->makeKartRest();
     }
+    m_kart_update_time += StkTime::getRealTime() - start_time;
+    m_kart_update_count++;
     PROFILER_POP_CPU_MARKER();
     if(race_manager->isRecordingRace()) ReplayRecorder::get()->update(ticks);
 
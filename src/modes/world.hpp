@@ -176,6 +176,11 @@ protected:
 
     /** Set when the world is online and counts network players. */
     bool m_is_network_world;
+
+    /** Real time spent updating karts, and the number of updates, which
+     *  are printed in profile mode. */
+    double m_kart_update_time;
+    int    m_kart_update_count;
     
     virtual void  onGo() OVERRIDE;
     /** Returns true if the race is over. Must be defined by all modes. */
@@ -319,6 +324,12 @@ public:
     /** Returns all karts. */
     const KartList & getKarts() const { return m_karts; }
     // ------------------------------------------------------------------------
+    /** Returns the real time in seconds spent updating karts so far. */
+    double          getKartUpdateTime() const { return m_kart_update_time; }
+    // ------------------------------------------------------------------------
+    /** Returns how often the karts were updated so far. */
+    int             getKartUpdateCount() const { return m_kart_update_count; }
+    // ------------------------------------------------------------------------
     /** Returns the number of currently active (i.e.non-elikminated) karts. */
     unsigned int    getCurrentNumKarts() const { return (int)m_karts.size() -
                                                          m_eliminated_karts; }
@@ -130,10 +130,18 @@ ENetPacket* Crypto::encryptSend(BareNetworkString& ns, bool reliable)
 }   // encryptSend
 
 // ----------------------------------------------------------------------------
-NetworkString* Crypto::decryptRecieve(ENetPacket* p)
+/** Decrypts a received packet.
+ *  \param p The packet.
+ *  \param ns The network string to store the decrypted message in, it will
+ *         be resized as needed (which allows reusing its memory).
+ */
+void Crypto::decryptRecieve(ENetPacket* p, NetworkString& ns)
 {
+    if (p->dataLength < 8)
+        throw std::runtime_error("Packet too short.");
     int clen = (int)(p->dataLength - 8);
-    auto ns = std::unique_ptr<NetworkString>(new NetworkString(p->data, clen));
+    ns.m_buffer.resize(clen);
+    ns.m_current_offset = 1;   // ignore type
 
     std::array<uint8_t, 12> iv = {};
     if (NetworkConfig::get()->isClient())
@@ -145,15 +153,13 @@ NetworkString* Crypto::decryptRecieve(ENetPacket* p)
     uint8_t* tag = p->data + 4;
     std::array<uint8_t, 4> tag_after = {};
 
+    std::unique_lock<std::mutex> ul(m_decrypt_mutex);
     gcm_aes128_set_iv(&m_aes_decrypt_context, 12, iv.data());
-    gcm_aes128_decrypt(&m_aes_decrypt_context, clen, ns->m_buffer.data(),
+    gcm_aes128_decrypt(&m_aes_decrypt_context, clen, ns.m_buffer.data(),
         packet_start);
     gcm_aes128_digest(&m_aes_decrypt_context, 4, tag_after.data());
+    ul.unlock();
     handleAuthentication(tag, tag_after);
-
-    NetworkString* result = ns.get();
-    ns.release();
-    return result;
 }   // decryptRecieve
 
 #endif
@@ -54,6 +54,10 @@ private:
 
     std::mutex m_crypto_mutex;
 
+    /** Packets of one peer can be decrypted by different STKHost worker
+     *  threads, which share the decrypt context. */
+    std::mutex m_decrypt_mutex;
+
     // ------------------------------------------------------------------------
     static size_t calcDecodeLength(const std::string& input)
     {
@@ -144,7 +148,7 @@ public:
     // ------------------------------------------------------------------------
     ENetPacket* encryptSend(BareNetworkString& ns, bool reliable);
     // ------------------------------------------------------------------------
-    NetworkString* decryptRecieve(ENetPacket* p);
+    void decryptRecieve(ENetPacket* p, NetworkString& ns);
 
 };
 
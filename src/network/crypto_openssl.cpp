@@ -181,10 +181,18 @@ ENetPacket* Crypto::encryptSend(BareNetworkString& ns, bool reliable)
 }   // encryptSend
 
 // ----------------------------------------------------------------------------
-NetworkString* Crypto::decryptRecieve(ENetPacket* p)
+/** Decrypts a received packet.
+ *  \param p The packet.
+ *  \param ns The network string to store the decrypted message in, it will
+ *         be resized as needed (which allows reusing its memory).
+ */
+void Crypto::decryptRecieve(ENetPacket* p, NetworkString& ns)
 {
+    if (p->dataLength < 8)
+        throw std::runtime_error("Packet too short.");
     int clen = (int)(p->dataLength - 8);
-    auto ns = std::unique_ptr<NetworkString>(new NetworkString(p->data, clen));
+    ns.m_buffer.resize(clen);
+    ns.m_current_offset = 1;   // ignore type
 
     std::array<uint8_t, 12> iv = {};
     if (NetworkConfig::get()->isClient())
@@ -194,6 +202,7 @@ NetworkString* Crypto::decryptRecieve(ENetPacket* p)
 
     uint8_t* packet_start = p->data + 8;
     uint8_t* tag = p->data + 4;
+    std::lock_guard<std::mutex> lock(m_decrypt_mutex);
     if (EVP_DecryptInit_ex(m_decrypt, NULL, NULL, NULL, iv.data()) != 1)
     {
         throw std::runtime_error("Failed to set IV.");
@@ -204,7 +213,7 @@ NetworkString* Crypto::decryptRecieve(ENetPacket* p)
     }
 
     int dlen;
-    if (EVP_DecryptUpdate(m_decrypt, ns->m_buffer.data(), &dlen,
+    if (EVP_DecryptUpdate(m_decrypt, ns.m_buffer.data(), &dlen,
         packet_start, clen) != 1)
     {
         throw std::runtime_error("Failed to decrypt.");
@@ -212,9 +221,7 @@ NetworkString* Crypto::decryptRecieve(ENetPacket* p)
     if (EVP_DecryptFinal_ex(m_decrypt, unused_16_blocks.data(), &dlen) > 0)
     {
         assert(dlen == 0);
-        NetworkString* result = ns.get();
-        ns.release();
-        return result;
+        return;
     }
     throw std::runtime_error("Failed to finalize decryption.");
 }   // decryptRecieve
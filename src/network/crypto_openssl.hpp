@@ -57,6 +57,10 @@ private:
 
     std::mutex m_crypto_mutex;
 
+    /** Packets of one peer can be decrypted by different STKHost worker
+     *  threads, which share the decrypt context. */
+    std::mutex m_decrypt_mutex;
+
     // ------------------------------------------------------------------------
     static size_t calcDecodeLength(const std::string& input)
     {
@@ -151,7 +155,7 @@ public:
     // ------------------------------------------------------------------------
     ENetPacket* encryptSend(BareNetworkString& ns, bool reliable);
     // ------------------------------------------------------------------------
-    NetworkString* decryptRecieve(ENetPacket* p);
+    void decryptRecieve(ENetPacket* p, NetworkString& ns);
 
 };
 
@@ -24,11 +24,17 @@
 #include "utils/log.hpp"
 #include "utils/time.hpp"
 
+#include <assert.h>
 #include <string.h>
 
-/** \brief Constructor
- *  \param event : The event that needs to be translated.
- */
+/** Maximum number of unused buffers and events kept in the pools. */
+static const unsigned MAX_POOL_SIZE = 1024;
+/** Buffers larger than this (e.g. from a large server list) are freed
+ *  instead of being kept in the pool. */
+static const size_t MAX_POOLED_BUFFER_SIZE = 65536;
+
+Synchronised<std::vector<NetworkString*> > Event::m_data_pool;
+Synchronised<std::vector<void*> > Event::m_event_pool;
 
 // ============================================================================
 constexpr bool isConnectionRequestPacket(unsigned char* data, size_t length)
@@ -44,6 +50,7 @@ Event::Event(ENetEvent* event, std::shared_ptr<STKPeer> peer)
     m_arrival_time = (double)StkTime::getTimeSinceEpoch();
     m_pdi = PDI_TIMEOUT;
     m_peer = peer;
+    m_data = NULL;
 
     switch (event->type)
     {
@@ -75,13 +82,23 @@ Event::Event(ENetEvent* event, std::shared_ptr<STKPeer> peer)
         {
             throw std::runtime_error("Unencrypted content at wrong state.");
         }
+        m_data = getDataBuffer();
         if (m_peer->getCrypto() && event->channelID == EVENT_CHANNEL_NORMAL)
         {
-            m_data = m_peer->getCrypto()->decryptRecieve(event->packet);
+            try
+            {
+                m_peer->getCrypto()->decryptRecieve(event->packet, *m_data);
+            }
+            catch (std::exception&)
+            {
+                freeDataBuffer(m_data);
+                m_data = NULL;
+                throw;
+            }
         }
         else
         {
-            m_data = new NetworkString(event->packet->data, 
+            m_data->setReceivedData(event->packet->data,
                 (int)event->packet->dataLength);
         }
     }
@@ -101,6 +118,101 @@ Event::Event(ENetEvent* event, std::shared_ptr<STKPeer> peer)
  */
 Event::~Event()
 {
-    delete m_data;
+    if (m_data)
+        freeDataBuffer(m_data);
 }   // ~Event
 
+// ----------------------------------------------------------------------------
+/** Returns an empty network string to store a received message in. Buffers
+ *  of freed events are reused, so their memory does not need to be
+ *  allocated again. This function is thread-safe.
+ */
+NetworkString* Event::getDataBuffer()
+{
+    NetworkString* ns = NULL;
+    m_data_pool.lock();
+    if (!m_data_pool.getData().empty())
+    {
+        ns = m_data_pool.getData().back();
+        m_data_pool.getData().pop_back();
+    }
+    m_data_pool.unlock();
+
+    if (!ns)
+        ns = new NetworkString(PROTOCOL_NONE);
+    ns->getBuffer().clear();
+    ns->reset();
+    return ns;
+}   // getDataBuffer
+
+// ----------------------------------------------------------------------------
+/** Puts a buffer back into the pool, or frees it if the pool is full.
+ *  \param ns The buffer to free.
+ */
+void Event::freeDataBuffer(NetworkString* ns)
+{
+    if (ns->getBuffer().capacity() <= MAX_POOLED_BUFFER_SIZE)
+    {
+        m_data_pool.lock();
+        if (m_data_pool.getData().size() < MAX_POOL_SIZE)
+        {
+            m_data_pool.getData().push_back(ns);
+            ns = NULL;
+        }
+        m_data_pool.unlock();
+    }
+    delete ns;
+}   // freeDataBuffer
+
+// ----------------------------------------------------------------------------
+/** Events are allocated for each received packet, so the memory of freed
+ *  events is reused.
+ */
+void* Event::operator new(size_t size)
+{
+    assert(size == sizeof(Event));
+    void* p = NULL;
+    m_event_pool.lock();
+    if (!m_event_pool.getData().empty())
+    {
+        p = m_event_pool.getData().back();
+        m_event_pool.getData().pop_back();
+    }
+    m_event_pool.unlock();
+    return p ? p : ::operator new(size);
+}   // operator new
+
+// ----------------------------------------------------------------------------
+void Event::operator delete(void* p)
+{
+    if (!p)
+        return;
+    m_event_pool.lock();
+    if (m_event_pool.getData().size() < MAX_POOL_SIZE)
+    {
+        m_event_pool.getData().push_back(p);
+        p = NULL;
+    }
+    m_event_pool.unlock();
+    ::operator delete(p);
+}   // operator delete
+
+// ----------------------------------------------------------------------------
+/** Frees all pooled buffers and events. Called when the network is shut
+ *  down.
+ */
+void Event::clearPools()
+{
+    m_data_pool.lock();
+    for (NetworkString* ns : m_data_pool.getData())
+        delete ns;
+    m_data_pool.getData().clear();
+    m_data_pool.unlock();
+
+    m_event_pool.lock();
+    for (void* p : m_event_pool.getData())
+        ::operator delete(p);
+    m_event_pool.getData().clear();
+    m_event_pool.unlock();
+}   // clearPools
+
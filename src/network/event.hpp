@@ -26,11 +26,13 @@
 
 #include "network/network_string.hpp"
 #include "utils/leak_check.hpp"
+#include "utils/synchronised.hpp"
 #include "utils/types.hpp"
 
 #include "enet/enet.h"
 
 #include <memory>
+#include <vector>
 
 class STKPeer;
 
@@ -88,9 +90,22 @@ private:
     /** For disconnection event, a bit more info is provided. */
     PeerDisconnectInfo m_pdi;
 
+    /** Unused message buffers and event objects, which are reused instead
+     *  of allocating new ones for each received packet. Events are created
+     *  by the listening thread and freed by the protocol manager threads,
+     *  so they need to be synchronised. */
+    static Synchronised<std::vector<NetworkString*> > m_data_pool;
+    static Synchronised<std::vector<void*> > m_event_pool;
+
+    static NetworkString* getDataBuffer();
+    static void freeDataBuffer(NetworkString* ns);
+
 public:
          Event(ENetEvent* event, std::shared_ptr<STKPeer> peer);
         ~Event();
+    static void* operator new(size_t size);
+    static void  operator delete(void* p);
+    static void  clearPools();
 
     // ------------------------------------------------------------------------
     /** Returns the type of this event. */
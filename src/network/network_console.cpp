@@ -42,6 +42,8 @@ void showHelp()
     std::cout << "kickban #, kick and ban # peer of STKHost." << std::endl;
     std::cout << "listpeers, List all peers with host ID and IP." << std::endl;
     std::cout << "listban, List IP ban list of server." << std::endl;
+    std::cout << "cryptostats, Print encrypted and decrypted packet rates."
+        << std::endl;
 }   // showHelp
 
 // ----------------------------------------------------------------------------
@@ -128,6 +130,10 @@ void mainLoop(STKHost* host)
                     ban.second << std::endl;
             }
         }
+        else if (str == "cryptostats")
+        {
+            host->logCryptoStats();
+        }
         else
         {
             std::cout << "Unknown command: " << str << std::endl;
@@ -37,6 +37,24 @@ void NetworkString::unitTesting()
     s.setSynchronous(false);
     assert(!s.isSynchronous());
 
+    // Check that a received message is parsed from after the type byte,
+    // also when a previously used buffer is reused for it
+    NetworkString send(PROTOCOL_LOBBY_ROOM);
+    send.addUInt8(42).addUInt32(123456).encodeString(std::string("stk"));
+    NetworkString received(PROTOCOL_NONE);
+    received.addUInt32(0xffffffff).addUInt8(7);
+    received.getUInt8();
+    received.setReceivedData((const uint8_t*)send.getData(),
+                             send.getTotalSize());
+    assert(received.getProtocolType() == PROTOCOL_LOBBY_ROOM);
+    assert(received.size() == send.getTotalSize() - 1);
+    assert(received.getUInt8() == 42);
+    assert(received.getUInt32() == 123456);
+    std::string str;
+    received.decodeString(&str);
+    assert(str == "stk");
+    assert(received.size() == 0);
+
     // Check log message format
     BareNetworkString slog(28);
     for(unsigned int i=0; i<28; i++)
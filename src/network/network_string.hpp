@@ -437,6 +437,16 @@ public:
         m_current_offset = 1;   // ignore type
     }   // NetworkString
 
+    // ------------------------------------------------------------------------
+    /** Copies a received message into this string, reusing its memory.
+     *  Like the constructor for received messages it ignores the type
+     *  byte. */
+    void setReceivedData(const uint8_t *data, int len)
+    {
+        m_buffer.assign(data, data + len);
+        m_current_offset = 1;   // ignore type
+    }   // setReceivedData
+
     // ------------------------------------------------------------------------
     /** Empties the string, but does not reset the pre-allocated size. */
     void clear()
@@ -35,6 +35,10 @@
 
 // ============================================================================
 std::weak_ptr<ProtocolManager> ProtocolManager::m_protocol_manager;
+/** Maximum time the asynchronous thread waits for new work. Protocols also
+ *  do time based work in their asynchronous update (e.g. timeouts), so it
+ *  can't wait forever. */
+static const int MAX_ASYNC_WAIT_MS = 10;
 // ============================================================================
 std::shared_ptr<ProtocolManager> ProtocolManager::createInstance()
 {
@@ -52,7 +56,7 @@ std::shared_ptr<ProtocolManager> ProtocolManager::createInstance()
             {
                 pm->asynchronousUpdate();
                 PROFILER_PUSH_CPU_MARKER("sleep", 0, 255, 255);
-                StkTime::sleep(2);
+                pm->waitForWork();
                 PROFILER_POP_CPU_MARKER();
             }
         });
@@ -64,6 +68,7 @@ std::shared_ptr<ProtocolManager> ProtocolManager::createInstance()
 ProtocolManager::ProtocolManager()
 {
     m_exit.store(false);
+    m_wakeup_pending = false;
     m_all_protocols.resize(PROTOCOL_MAX);
 }   // ProtocolManager
 
@@ -108,6 +113,7 @@ void ProtocolManager::OneProtocolType::abort()
 void ProtocolManager::abort()
 {
     m_exit.store(true);
+    wakeUp();
     // wait the thread to finish
     m_asynchronous_update_thread.join();
 }   // abort
@@ -130,10 +136,36 @@ void ProtocolManager::propagateEvent(Event* event)
         m_async_events_to_process.lock();
         m_async_events_to_process.getData().push_back(event);
         m_async_events_to_process.unlock();
+        wakeUp();
     }
     return;
 }   // propagateEvent
 
+// ----------------------------------------------------------------------------
+/** Wakes up the asynchronous update thread, so that new events or requests
+ *  are handled immediately.
+ */
+void ProtocolManager::wakeUp()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_wakeup_mutex);
+        m_wakeup_pending = true;
+    }
+    m_wakeup_cv.notify_one();
+}   // wakeUp
+
+// ----------------------------------------------------------------------------
+/** Called from the asynchronous update thread: waits till new work is
+ *  queued, the manager is exiting, or at most MAX_ASYNC_WAIT_MS.
+ */
+void ProtocolManager::waitForWork()
+{
+    std::unique_lock<std::mutex> ul(m_wakeup_mutex);
+    m_wakeup_cv.wait_for(ul, std::chrono::milliseconds(MAX_ASYNC_WAIT_MS),
+        [this] { return m_wakeup_pending || m_exit.load(); });
+    m_wakeup_pending = false;
+}   // waitForWork
+
 // ----------------------------------------------------------------------------
 /** \brief Asks the manager to start a protocol.
  * This function will store the request, and process it at a time when it is
@@ -149,6 +181,7 @@ void ProtocolManager::requestStart(std::shared_ptr<Protocol> protocol)
     m_requests.lock();
     m_requests.getData().push_back(req);
     m_requests.unlock();
+    wakeUp();
 }   // requestStart
 
 // ----------------------------------------------------------------------------
@@ -167,6 +200,7 @@ void ProtocolManager::requestPause(std::shared_ptr<Protocol> protocol)
     m_requests.lock();
     m_requests.getData().push_back(req);
     m_requests.unlock();
+    wakeUp();
 }   // requestPause
 
 // ----------------------------------------------------------------------------
@@ -185,6 +219,7 @@ void ProtocolManager::requestUnpause(std::shared_ptr<Protocol> protocol)
     m_requests.lock();
     m_requests.getData().push_back(req);
     m_requests.unlock();
+    wakeUp();
 }   // requestUnpause
 
 // ----------------------------------------------------------------------------
@@ -212,6 +247,7 @@ void ProtocolManager::requestTerminate(std::shared_ptr<Protocol> protocol)
     }
     m_requests.getData().push_back(req);
     m_requests.unlock();
+    wakeUp();
 }   // requestTerminate
 
 // ----------------------------------------------------------------------------
@@ -31,8 +31,10 @@
 #include "utils/types.hpp"
 
 #include <atomic>
+#include <condition_variable>
 #include <list>
 #include <memory>
+#include <mutex>
 #include <vector>
 #include <thread>
 
@@ -215,6 +217,16 @@ private:
     /** When set to true, the main thread will exit. */
     std::atomic_bool m_exit;
 
+    /** Protects m_wakeup_pending, used with m_wakeup_cv. */
+    std::mutex m_wakeup_mutex;
+
+    /** Used to wake up the asynchronous update thread when there is new
+     *  work (events or requests). */
+    std::condition_variable m_wakeup_cv;
+
+    /** Set when new work was queued since the last asynchronous update. */
+    bool m_wakeup_pending;
+
     /*! Asynchronous update thread.*/
     std::thread m_asynchronous_update_thread;
 
@@ -222,6 +234,7 @@ private:
     static std::weak_ptr<ProtocolManager> m_protocol_manager;
 
     bool         sendEvent(Event* event);
+    void         waitForWork();
 
     virtual void startProtocol(std::shared_ptr<Protocol> protocol);
     virtual void terminateProtocol(std::shared_ptr<Protocol> protocol);
@@ -243,6 +256,7 @@ public:
     void      requestTerminate(std::shared_ptr<Protocol> protocol);
     void      findAndTerminate(ProtocolType type);
     void      update(int ticks);
+    void      wakeUp();
     // ------------------------------------------------------------------------
     bool isExiting() const                            { return m_exit.load(); }
     // ------------------------------------------------------------------------
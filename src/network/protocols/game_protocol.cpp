@@ -30,12 +30,16 @@
 #include "network/protocol_manager.hpp"
 #include "network/rewind_info.hpp"
 #include "network/rewind_manager.hpp"
+#include "network/server_config.hpp"
 #include "network/stk_host.hpp"
 #include "network/stk_peer.hpp"
 #include "utils/log.hpp"
 #include "utils/time.hpp"
 #include "main_loop.hpp"
 
+#include <algorithm>
+#include <random>
+
 // ============================================================================
 std::weak_ptr<GameProtocol> GameProtocol::m_game_protocol;
 // ============================================================================
@@ -57,13 +61,34 @@ GameProtocol::GameProtocol()
             : Protocol( PROTOCOL_CONTROLLER_EVENTS)
 {
     m_data_to_send = getNetworkString();
-
+    m_state_ticks = 0;
+    m_full_state_bytes = 0;
+    m_sent_state_bytes = 0;
+    m_first_state_time = 0;
+
+    // Acknowledgements from a previous race refer to states which no longer
+    // exist, so start without any base state for delta encoding
+    if (NetworkConfig::get()->isServer() && STKHost::existHost())
+    {
+        for (auto& peer : STKHost::get()->getPeers())
+            peer->resetLastAckedStateTicks();
+    }
 }   // GameProtocol
 
 //-----------------------------------------------------------------------------
 GameProtocol::~GameProtocol()
 {
     delete m_data_to_send;
+    if (m_full_state_bytes > 0)
+    {
+        const float seconds = std::max(0.001f,
+            float(StkTime::getRealTimeMs() - m_first_state_time) / 1000.0f);
+        Log::info("GameProtocol", "State bandwidth: full states %.1f "
+            "bytes/s, sent %.1f bytes/s (%.1f%%).",
+            float(m_full_state_bytes) / seconds,
+            float(m_sent_state_bytes) / seconds,
+            float(m_sent_state_bytes) * 100.0f / float(m_full_state_bytes));
+    }
 }   // ~GameProtocol
 
 //-----------------------------------------------------------------------------
@@ -121,6 +146,8 @@ bool GameProtocol::notifyEventAsynchronous(Event* event)
     {
     case GP_CONTROLLER_ACTION: handleControllerAction(event); break;
     case GP_STATE:             handleState(event);            break;
+    case GP_STATE_DELTA:       handleStateDelta(event);       break;
+    case GP_STATE_ACK:         handleStateAck(event);         break;
     case GP_ADJUST_TIME:       handleAdjustTime(event);       break;
     //case GP_ITEM_UPDATE:       handleItemUpdate(event);       break;
     case GP_ITEM_CONFIRMATION: handleItemEventConfirmation(event); break;
@@ -157,7 +184,7 @@ void GameProtocol::controllerAction(int kart_id, PlayerAction action,
     const auto& c = compressAction(a);
     // Store the event in the rewind manager, which is responsible
     // for freeing the allocated memory
-    BareNetworkString *s = new BareNetworkString(4);
+    BareNetworkString *s = RewindManager::get()->getEventBuffer();
     s->addUInt8(kart_id).addUInt8(std::get<0>(c)).addUInt16(std::get<1>(c))
         .addUInt16(std::get<2>(c)).addUInt16(std::get<3>(c));
 
@@ -212,7 +239,7 @@ void GameProtocol::handleControllerAction(Event *event)
                 cur_ticks, kart_id, std::get<0>(a), std::get<1>(a),
                 std::get<2>(a), std::get<3>(a));
         }
-        BareNetworkString *s = new BareNetworkString(3);
+        BareNetworkString *s = RewindManager::get()->getEventBuffer();
         s->addUInt8(kart_id).addUInt8(w).addUInt16(x).addUInt16(y)
             .addUInt16(z);
         RewindManager::get()->addNetworkEvent(this, s, cur_ticks);
@@ -337,9 +364,9 @@ void GameProtocol::handleItemEventConfirmation(Event *event)
 void GameProtocol::startNewState()
 {
     assert(NetworkConfig::get()->isServer());
+    m_state_ticks = World::getWorld()->getTicksSinceStart();
     m_data_to_send->clear();
-    m_data_to_send->addUInt8(GP_STATE)
-        .addUInt32(World::getWorld()->getTicksSinceStart());
+    m_data_to_send->addUInt8(GP_STATE).addUInt32(m_state_ticks);
 }   // startNewState
 
 // ----------------------------------------------------------------------------
@@ -356,10 +383,14 @@ void GameProtocol::addState(BareNetworkString *buffer)
 
 // ----------------------------------------------------------------------------
 /** Called by a server to finalize the current state, which add updated
- *  names of rewinder using to the beginning of state buffer
+ *  ids of rewinder using to the beginning of state buffer, preceded by the
+ *  unique identity of new rewinders not yet known by all clients.
+ *  \param declared_rewinder Ids of rewinders whose unique identity is sent.
  *  \param cur_rewinder List of current rewinder using.
  */
-void GameProtocol::finalizeState(std::vector<std::string>& cur_rewinder)
+void GameProtocol::finalizeState(
+                              const std::vector<uint16_t>& declared_rewinder,
+                              const std::vector<uint16_t>& cur_rewinder)
 {
     assert(NetworkConfig::get()->isServer());
     auto& buffer = m_data_to_send->getBuffer();
@@ -367,25 +398,93 @@ void GameProtocol::finalizeState(std::vector<std::string>& cur_rewinder)
         4/*time*/;
 
     m_data_to_send->reset();
-    std::vector<uint8_t> names;
-    names.push_back((uint8_t)cur_rewinder.size());
-    for (std::string& name : cur_rewinder)
+    BareNetworkString ids;
+    ids.addUInt16((uint16_t)declared_rewinder.size());
+    for (uint16_t id : declared_rewinder)
     {
-        names.push_back((uint8_t)name.size());
-        std::vector<uint8_t> rewinder(name.begin(), name.end());
-        names.insert(names.end(), rewinder.begin(), rewinder.end());
+        ids.addUInt16(id).encodeString(
+            RewindManager::get()->getRewinderById(id)->getUniqueIdentity());
     }
-    buffer.insert(pos, names.begin(), names.end());
+    ids.addUInt8((uint8_t)cur_rewinder.size());
+    for (uint16_t id : cur_rewinder)
+        ids.addUInt16(id);
+    buffer.insert(pos, ids.getBuffer().begin(), ids.getBuffer().end());
 }   // finalizeState
 
+// ----------------------------------------------------------------------------
+/** Returns the latest state ticks acknowledged by all clients in game, or
+ *  -1 if a client has not acknowledged any state yet.
+ */
+int GameProtocol::getMinAckedStateTicks() const
+{
+    int acked_ticks = -1;
+    bool first = true;
+    for (auto& peer : STKHost::get()->getPeers())
+    {
+        if (!peer->isValidated() || peer->isWaitingForGame())
+            continue;
+        if (first || peer->getLastAckedStateTicks() < acked_ticks)
+            acked_ticks = peer->getLastAckedStateTicks();
+        first = false;
+    }
+    return acked_ticks;
+}   // getMinAckedStateTicks
+
 // ----------------------------------------------------------------------------
 /** Called when the last state information has been added and the message
- *  can be sent to the clients.
+ *  can be sent to the clients. If enabled, each client which has
+ *  acknowledged a state still kept in the history receives the new state
+ *  as delta against that state, all other clients get the full state.
  */
 void GameProtocol::sendState()
 {
     assert(NetworkConfig::get()->isServer());
-    sendMessageToPeers(m_data_to_send, /*reliable*/false);
+    if (m_first_state_time == 0)
+        m_first_state_time = StkTime::getRealTimeMs();
+
+    // Skip protocol type, gp event type and ticks
+    const unsigned header_size = 1 + 1 + 4;
+    const uint8_t* state = m_data_to_send->getBuffer().data() + header_size;
+    const unsigned state_size =
+        m_data_to_send->getTotalSize() - header_size;
+
+    // Delta encoded states by the base ticks, peers which acknowledged the
+    // same state share the message
+    std::map<int, NetworkString*> deltas;
+    for (auto& peer : STKHost::get()->getPeers())
+    {
+        if (!peer->isValidated() || peer->isWaitingForGame())
+            continue;
+        m_full_state_bytes += m_data_to_send->getTotalSize();
+
+        NetworkString* message = m_data_to_send;
+        auto base = m_state_history.find(peer->getLastAckedStateTicks());
+        if (ServerConfig::m_state_delta_compression &&
+            base != m_state_history.end())
+        {
+            auto it = deltas.find(base->first);
+            if (it == deltas.end())
+            {
+                NetworkString* delta = getNetworkString();
+                delta->addUInt8(GP_STATE_DELTA).addUInt32(m_state_ticks)
+                    .addUInt32(base->first).addUInt32(state_size);
+                encodeDelta(base->second, state, state_size,
+                    &delta->getBuffer());
+                it = deltas.emplace(base->first, delta).first;
+            }
+            // A delta can be larger than the state if (nearly) everything
+            // changed, in which case the full state is sent
+            if (it->second->getTotalSize() < m_data_to_send->getTotalSize())
+                message = it->second;
+        }
+        m_sent_state_bytes += message->getTotalSize();
+        peer->sendPacket(message, /*reliable*/false);
+    }
+
+    for (auto& delta : deltas)
+        delete delta.second;
+    addStateHistory(m_state_history, m_state_ticks,
+        std::vector<uint8_t>(state, state + state_size));
 }   // sendState
 
 // ----------------------------------------------------------------------------
@@ -401,21 +500,268 @@ void GameProtocol::handleState(Event *event)
     NetworkString &data = event->data();
     int ticks          = data.getUInt32();
 
-    // Check for updated rewinder using
-    unsigned rewinder_size = data.getUInt8();
-    std::vector<std::string> rewinder_using;
-    for (unsigned i = 0; i < rewinder_size; i++)
+    const uint8_t* state = (const uint8_t*)data.getCurrentData();
+    addStateHistory(m_state_history, ticks,
+        std::vector<uint8_t>(state, state + data.size()));
+    addNetworkState(ticks, data);
+}   // handleState
+
+// ----------------------------------------------------------------------------
+/** Called when a delta encoded state is received from the server. The full
+ *  state is rebuilt from the acknowledged base state, and then handled like
+ *  a full state.
+ */
+void GameProtocol::handleStateDelta(Event *event)
+{
+    if (!World::getWorld())
+        return;
+
+    assert(NetworkConfig::get()->isClient());
+    NetworkString &data = event->data();
+    if (!checkDataSize(event, 12)) return;
+    int ticks = data.getUInt32();
+    int base_ticks = data.getUInt32();
+    unsigned state_size = data.getUInt32();
+
+    auto base = m_state_history.find(base_ticks);
+    if (base == m_state_history.end())
+    {
+        // Can happen if the base state was dropped from the history, the
+        // server will send the next state against a newer acknowledgement
+        Log::warn("GameProtocol", "Missing base state %d for state %d.",
+            base_ticks, ticks);
+        return;
+    }
+
+    std::vector<uint8_t> state;
+    if (!decodeDelta(base->second, (const uint8_t*)data.getCurrentData(),
+        data.size(), state_size, &state))
     {
+        Log::warn("GameProtocol", "Invalid delta state %d against %d.",
+            ticks, base_ticks);
+        return;
+    }
+
+    BareNetworkString full_state((const char*)state.data(),
+        (int)state.size());
+    addStateHistory(m_state_history, ticks, std::move(state));
+    addNetworkState(ticks, full_state);
+}   // handleStateDelta
+
+// ----------------------------------------------------------------------------
+/** Adds a full state to the rewind queue and acknowledges it to the server,
+ *  so that it can be used as base for the following delta encoded states.
+ *  \param ticks Time of the state.
+ *  \param data The state starting with the list of rewinder using, the
+ *         buffer will be taken over by the RewindInfoState.
+ */
+void GameProtocol::addNetworkState(int ticks, BareNetworkString& data)
+{
+    NetworkString* ack = getNetworkString(5);
+    ack->addUInt8(GP_STATE_ACK).addUInt32(ticks);
+    sendToServer(ack, /*reliable*/false);
+    delete ack;
+
+    // Unique identities of new rewinders in the server
+    unsigned declared_size = data.getUInt16();
+    for (unsigned i = 0; i < declared_size; i++)
+    {
+        uint16_t id = data.getUInt16();
         std::string name;
         data.decodeString(&name);
-        rewinder_using.push_back(name);
+        RewindManager::get()->addServerRewinderName(id, name);
     }
 
+    // Check for updated rewinder using
+    unsigned rewinder_size = data.getUInt8();
+    std::vector<uint16_t> rewinder_using;
+    for (unsigned i = 0; i < rewinder_size; i++)
+        rewinder_using.push_back(data.getUInt16());
+
     // The memory for bns will be handled in the RewindInfoState object
     RewindInfoState* ris = new RewindInfoState(ticks, data.getCurrentOffset(),
         rewinder_using, data.getBuffer());
     RewindManager::get()->addNetworkRewindInfo(ris);
-}   // handleState
+}   // addNetworkState
+
+// ----------------------------------------------------------------------------
+/** Handles the acknowledgement of a state by a client (in server).
+ */
+void GameProtocol::handleStateAck(Event *event)
+{
+    assert(NetworkConfig::get()->isServer());
+    if (!checkDataSize(event, 4)) return;
+    event->getPeer()->setLastAckedStateTicks(event->data().getUInt32());
+}   // handleStateAck
+
+// ----------------------------------------------------------------------------
+/** Adds a state to the history which can be used for delta encoding, the
+ *  oldest states are removed if the history is full.
+ */
+void GameProtocol::addStateHistory(
+                           std::map<int, std::vector<uint8_t> >& history,
+                           int ticks, std::vector<uint8_t>&& state)
+{
+    history[ticks] = std::move(state);
+    while (history.size() > m_max_state_history)
+        history.erase(history.begin());
+}   // addStateHistory
+
+// ----------------------------------------------------------------------------
+static void addVarInt(std::vector<uint8_t>* out, unsigned value)
+{
+    while (value >= 0x80)
+    {
+        out->push_back(uint8_t(value | 0x80));
+        value >>= 7;
+    }
+    out->push_back(uint8_t(value));
+}   // addVarInt
+
+// ----------------------------------------------------------------------------
+static bool getVarInt(const uint8_t* data, unsigned size, unsigned* offset,
+                      unsigned* value)
+{
+    *value = 0;
+    for (unsigned shift = 0; shift < 32; shift += 7)
+    {
+        if (*offset >= size)
+            return false;
+        uint8_t b = data[(*offset)++];
+        *value |= unsigned(b & 0x7f) << shift;
+        if ((b & 0x80) == 0)
+            return true;
+    }
+    return false;
+}   // getVarInt
+
+// ----------------------------------------------------------------------------
+/** Encodes a state as delta against a base state. The delta is a sequence
+ *  of (number of unchanged bytes, number of changed bytes, changed bytes),
+ *  bytes beyond the end of the base state compare against 0.
+ *  \param base The base state known by the receiver.
+ *  \param state The state to encode.
+ *  \param state_size Size of the state.
+ *  \param out The delta is appended to this buffer.
+ */
+void GameProtocol::encodeDelta(const std::vector<uint8_t>& base,
+                               const uint8_t* state, unsigned state_size,
+                               std::vector<uint8_t>* out)
+{
+    auto same = [&base, state](unsigned i)
+        {
+            return state[i] == (i < base.size() ? base[i] : 0);
+        };
+    unsigned i = 0;
+    while (i < state_size)
+    {
+        const unsigned same_start = i;
+        while (i < state_size && same(i))
+            i++;
+        const unsigned changed_start = i;
+        // Unchanged runs shorter than 3 bytes cost more to encode than
+        // adding them to the changed bytes
+        while (i < state_size)
+        {
+            if (!same(i))
+            {
+                i++;
+                continue;
+            }
+            unsigned j = i;
+            while (j < state_size && j - i < 3 && same(j))
+                j++;
+            if (j - i == 3 || j == state_size)
+                break;
+            i = j;
+        }
+        addVarInt(out, changed_start - same_start);
+        addVarInt(out, i - changed_start);
+        out->insert(out->end(), state + changed_start, state + i);
+    }
+}   // encodeDelta
+
+// ----------------------------------------------------------------------------
+/** Rebuilds a state from a base state and a delta created by encodeDelta.
+ *  \return False if the delta is invalid.
+ */
+bool GameProtocol::decodeDelta(const std::vector<uint8_t>& base,
+                               const uint8_t* delta, unsigned delta_size,
+                               unsigned state_size, std::vector<uint8_t>* out)
+{
+    out->clear();
+    out->reserve(state_size);
+    unsigned offset = 0;
+    while (out->size() < state_size)
+    {
+        unsigned same_size, changed_size;
+        if (!getVarInt(delta, delta_size, &offset, &same_size) ||
+            !getVarInt(delta, delta_size, &offset, &changed_size) ||
+            (uint64_t)same_size + changed_size > state_size - out->size() ||
+            changed_size > delta_size - offset)
+            return false;
+        for (unsigned i = 0; i < same_size; i++)
+        {
+            const size_t idx = out->size();
+            out->push_back(idx < base.size() ? base[idx] : 0);
+        }
+        out->insert(out->end(), delta + offset, delta + offset + changed_size);
+        offset += changed_size;
+    }
+    return offset == delta_size;
+}   // decodeDelta
+
+// ----------------------------------------------------------------------------
+/** Unit testing function for the delta encoding of states.
+ */
+void GameProtocol::unitTesting()
+{
+    std::mt19937 random(42);
+    std::vector<uint8_t> base(200);
+    for (uint8_t &b : base)
+        b = (uint8_t)random();
+
+    // States that are equal to, shorter and longer than the base state,
+    // with different amounts of changes (including none and all bytes)
+    const unsigned sizes[] = { 0, 1, 2, 50, 199, 200, 201, 300, 1000 };
+    const unsigned change_every[] = { 0, 1, 2, 3, 4, 7, 50 };
+    for (unsigned size : sizes)
+    {
+        for (unsigned every : change_every)
+        {
+            std::vector<uint8_t> state(size);
+            for (unsigned i = 0; i < size; i++)
+            {
+                state[i] = i < base.size() ? base[i] : 0;
+                if (every > 0 && random() % every == 0)
+                    state[i] = (uint8_t)random();
+            }
+            std::vector<uint8_t> delta;
+            encodeDelta(base, state.data(), size, &delta);
+            if (every == 0 && size > 0)
+            {
+                // Only the number of unchanged bytes needs to be sent
+                assert(delta.size() <= 4);
+            }
+
+            std::vector<uint8_t> decoded;
+            assert(decodeDelta(base, delta.data(), (unsigned)delta.size(),
+                               size, &decoded));
+            assert(decoded == state);
+
+            // Truncated or too long deltas must be rejected
+            if (!delta.empty())
+            {
+                assert(!decodeDelta(base, delta.data(),
+                                    (unsigned)delta.size() - 1, size,
+                                    &decoded));
+            }
+            delta.push_back(0);
+            assert(!decodeDelta(base, delta.data(), (unsigned)delta.size(),
+                                size, &decoded));
+        }
+    }
+}   // unitTesting
 
 // ----------------------------------------------------------------------------
 /** Called from the RewindManager when rolling back.
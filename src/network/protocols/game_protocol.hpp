@@ -45,9 +45,15 @@ private:
            GP_STATE,
            GP_ITEM_UPDATE,
            GP_ITEM_CONFIRMATION,
-           GP_ADJUST_TIME
+           GP_ADJUST_TIME,
+           GP_STATE_DELTA,
+           GP_STATE_ACK
     };
 
+    /** Maximum number of full states kept (by server and client) which can
+     *  be used as base for a delta encoded state. */
+    static const unsigned m_max_state_history = 32;
+
     /** A network string that collects all information from the server to be sent
      *  next. */
     NetworkString *m_data_to_send;
@@ -74,9 +80,34 @@ private:
     void handleState(Event *event);
     void handleAdjustTime(Event *event);
     void handleItemEventConfirmation(Event *event);
+    void handleStateDelta(Event *event);
+    void handleStateAck(Event *event);
+    void addNetworkState(int ticks, BareNetworkString& data);
+    void addStateHistory(std::map<int, std::vector<uint8_t> >& history,
+                         int ticks, std::vector<uint8_t>&& state);
+    static void encodeDelta(const std::vector<uint8_t>& base,
+                            const uint8_t* state, unsigned state_size,
+                            std::vector<uint8_t>* out);
+    static bool decodeDelta(const std::vector<uint8_t>& base,
+                            const uint8_t* delta, unsigned delta_size,
+                            unsigned state_size, std::vector<uint8_t>* out);
     static std::weak_ptr<GameProtocol> m_game_protocol;
     std::map<STKPeer*, int> m_initial_ticks;
     std::map<STKPeer*, double> m_last_adjustments;
+
+    /** Ticks of the state currently assembled by the server. */
+    int m_state_ticks;
+
+    /** Server: recently sent full states (without header) by ticks, client:
+     *  recently received (or rebuilt) full states by ticks. */
+    std::map<int, std::vector<uint8_t> > m_state_history;
+
+    /** Bytes of state which would have been sent without delta encoding,
+     *  and bytes actually sent, for bandwidth statistics. */
+    uint64_t m_full_state_bytes, m_sent_state_bytes;
+
+    /** Real time in ms when the first state was sent. */
+    uint64_t m_first_state_time;
     // Maximum value of values are only 32768
     std::tuple<uint8_t, uint16_t, uint16_t, uint16_t>
                                                 compressAction(const Action& a)
@@ -100,6 +131,7 @@ private:
         return std::make_tuple(a, b, c, d);
     }
 public:
+    static void unitTesting();
              GameProtocol();
     virtual ~GameProtocol();
 
@@ -111,7 +143,9 @@ public:
     void startNewState();
     void addState(BareNetworkString *buffer);
     void sendState();
-    void finalizeState(std::vector<std::string>& cur_rewinder);
+    void finalizeState(const std::vector<uint16_t>& declared_rewinder,
+                       const std::vector<uint16_t>& cur_rewinder);
+    int getMinAckedStateTicks() const;
     void adjustTimeForClient(STKPeer *peer, int ticks);
     void sendItemEventConfirmation(int ticks);
 
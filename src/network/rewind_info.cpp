@@ -21,7 +21,6 @@
 #include "network/network_config.hpp"
 #include "network/rewinder.hpp"
 #include "network/rewind_manager.hpp"
-#include "items/projectile_manager.hpp"
 
 /** Constructor for a state: it only takes the size, and allocates a buffer
  *  for all state info.
@@ -47,7 +46,7 @@ void RewindInfo::setTicks(int ticks)
 
 // ============================================================================
 RewindInfoState::RewindInfoState(int ticks, int start_offset,
-                                 std::vector<std::string>& rewinder_using,
+                                 std::vector<uint16_t>& rewinder_using,
                                  std::vector<uint8_t>& buffer)
                : RewindInfo(ticks, true/*is_confirmed*/)
 {
@@ -77,23 +76,16 @@ void RewindInfoState::restore()
 {
     m_buffer->reset();
     m_buffer->skip(m_start_offset);
-    for (const std::string& name : m_rewinder_using)
+    for (uint16_t id : m_rewinder_using)
     {
         const uint16_t data_size = m_buffer->getUInt16();
         const unsigned current_offset_now = m_buffer->getCurrentOffset();
         std::shared_ptr<Rewinder> r =
-            RewindManager::get()->getRewinder(name);
+            RewindManager::get()->getServerRewinder(id);
 
         if (!r)
         {
-            // For now we only need to get missing rewinder from
-            // projectile_manager
-            r = projectile_manager->addRewinderFromNetworkState(name);
-        }
-        if (!r)
-        {
-            Log::error("RewindInfoState", "Missing rewinder %s",
-                name.c_str());
+            Log::error("RewindInfoState", "Missing rewinder %d", id);
             m_buffer->skip(data_size);
             continue;
         }
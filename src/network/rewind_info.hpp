@@ -54,6 +54,15 @@ private:
      *  object.  */
     bool m_is_confirmed;
 
+protected:
+    // ------------------------------------------------------------------------
+    /** Reinitialises the time and confirmation of a reused RewindInfo. */
+    void reinit(int ticks, bool is_confirmed)
+    {
+        m_ticks        = ticks;
+        m_is_confirmed = is_confirmed;
+    }   // reinit
+
 public:
     RewindInfo(int ticks, bool is_confirmed);
 
@@ -92,7 +101,8 @@ public:
 class RewindInfoState: public RewindInfo
 {
 private:
-    std::vector<std::string> m_rewinder_using;
+    /** Rewinder ids (in the server) of all states in the buffer. */
+    std::vector<uint16_t> m_rewinder_using;
 
     int m_start_offset;
 
@@ -102,7 +112,7 @@ private:
 public:
     // ------------------------------------------------------------------------
     RewindInfoState(int ticks, int start_offset,
-                    std::vector<std::string>& rewinder_using,
+                    std::vector<uint16_t>& rewinder_using,
                     std::vector<uint8_t>& buffer);
     // ------------------------------------------------------------------------
     RewindInfoState(int ticks, BareNetworkString *buffer, bool is_confirmed);
@@ -174,6 +184,26 @@ public:
     // ------------------------------------------------------------------------
     /** Returns the buffer with the event information in it. */
     BareNetworkString *getBuffer() { return m_buffer; }
+    // ------------------------------------------------------------------------
+    /** Reuses this object for a new event, used by the RewindQueue to avoid
+     *  allocating a new object for each event. */
+    void reuse(int ticks, EventRewinder *event_rewinder,
+               BareNetworkString *buffer, bool is_confirmed)
+    {
+        assert(m_buffer == NULL);
+        reinit(ticks, is_confirmed);
+        m_event_rewinder = event_rewinder;
+        m_buffer         = buffer;
+    }   // reuse
+    // ------------------------------------------------------------------------
+    /** Returns the buffer and removes it from this event, so that it can be
+     *  reused by the caller. */
+    BareNetworkString *releaseBuffer()
+    {
+        BareNetworkString *buffer = m_buffer;
+        m_buffer = NULL;
+        return buffer;
+    }   // releaseBuffer
 };   // class RewindIndoEvent
 
 
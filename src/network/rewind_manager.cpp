@@ -19,6 +19,7 @@
 #include "network/rewind_manager.hpp"
 
 #include "graphics/irr_driver.hpp"
+#include "items/projectile_manager.hpp"
 #include "modes/world.hpp"
 #include "network/network_config.hpp"
 #include "network/network_string.hpp"
@@ -57,6 +58,7 @@ void RewindManager::destroy()
  */
 RewindManager::RewindManager()
 {
+    m_item_manager_rewinder_id = -1;
     reset();
 }   // RewindManager
 
@@ -85,7 +87,6 @@ void RewindManager::reset()
 
     if (!m_enable_rewind_manager) return;
 
-    clearExpiredRewinder();
     m_rewind_queue.reset();
 }   // reset
 
@@ -153,15 +154,18 @@ void RewindManager::saveState()
     gp->startNewState();
 
     m_overall_state_size = 0;
-    std::vector<std::string> rewinder_using;
+    std::vector<uint16_t> rewinder_using;
 
     // We must save the item state first (so that it is restored first),
     // otherwise state updates for a kart could be overwritten by
     // e.g. simulating the item collection later (which resets bubblegum
     // counter).
     BareNetworkString* buffer = NULL;
-    if(auto r = m_all_rewinder["N"].lock())
-        buffer = r->saveState(&rewinder_using);
+    if (m_item_manager_rewinder_id != -1)
+    {
+        if (auto r = m_all_rewinder[m_item_manager_rewinder_id].lock())
+            buffer = r->saveState(&rewinder_using);
+    }
     if (buffer)
     {
         m_overall_state_size += buffer->size();
@@ -169,16 +173,16 @@ void RewindManager::saveState()
     }
     delete buffer;    // buffer can be freed
 
-    for (auto& p : m_all_rewinder)
+    for (unsigned id = 0; id < m_all_rewinder.size(); id++)
     {
         // The Network ItemManager was saved first before this loop,
         // so skip it here.
-        if(p.first=="N") continue;
+        if ((int)id == m_item_manager_rewinder_id) continue;
 
         // TODO: check if it's worth passing in a sufficiently large buffer from
         // GameProtocol - this would save the copy operation.
         BareNetworkString* buffer = NULL;
-        if (auto r = p.second.lock())
+        if (auto r = m_all_rewinder[id].lock())
             buffer = r->saveState(&rewinder_using);
         if (buffer != NULL)
         {
@@ -187,7 +191,27 @@ void RewindManager::saveState()
         }
         delete buffer;    // buffer can be freed
     }
-    gp->finalizeState(rewinder_using);
+
+    // Send the unique identity of new rewinders until all clients have
+    // acknowledged a state which included it
+    const int ticks = World::getWorld()->getTicksSinceStart();
+    const int acked_ticks = gp->getMinAckedStateTicks();
+    std::vector<uint16_t> rewinder_declared;
+    for (auto it = m_unconfirmed_rewinder.begin();
+         it != m_unconfirmed_rewinder.end();)
+    {
+        if (m_all_rewinder[it->first].expired() ||
+            (it->second != -1 && it->second <= acked_ticks))
+        {
+            it = m_unconfirmed_rewinder.erase(it);
+            continue;
+        }
+        if (it->second == -1)
+            it->second = ticks;
+        rewinder_declared.push_back(it->first);
+        it++;
+    }
+    gp->finalizeState(rewinder_declared, rewinder_using);
     PROFILER_POP_CPU_MARKER();
 }   // saveState
 
@@ -210,14 +234,13 @@ void RewindManager::update(int ticks_not_used)
     if (ticks - m_last_saved_state < m_state_frequency)
         return;
 
-    // Save state, remove expired rewinder first
-    clearExpiredRewinder();
+    // Save state
     if (NetworkConfig::get()->isClient())
     {
         auto& ret = m_local_state[ticks];
         for (auto& p : m_all_rewinder)
         {
-            if (auto r = p.second.lock())
+            if (auto r = p.lock())
                 ret.push_back(r->getLocalStateRestoreFunction());
         }
     }
@@ -283,10 +306,34 @@ void RewindManager::playEventsTill(int world_ticks, int *ticks)
 bool RewindManager::addRewinder(std::shared_ptr<Rewinder> rewinder)
 {
     if (!m_enable_rewind_manager) return false;
-    // Maximum 1 bit to store no of rewinder used
-    if (m_all_rewinder.size() == 255)
+    // Ids are sent as 16 bit, and maximum 1 byte to store no of rewinder
+    // used
+    if (m_all_rewinder.size() == 65535)
+        return false;
+    unsigned live_rewinder = 0;
+    for (auto& r : m_all_rewinder)
+    {
+        if (!r.expired())
+            live_rewinder++;
+    }
+    if (live_rewinder >= 255)
         return false;
-    m_all_rewinder[rewinder->getUniqueIdentity()] = rewinder;
+
+    const std::string& name = rewinder->getUniqueIdentity();
+    const uint16_t id = (uint16_t)m_all_rewinder.size();
+    auto it = m_rewinder_ids.find(name);
+    if (it != m_rewinder_ids.end())
+    {
+        // Replaces a rewinder with the same unique identity
+        m_all_rewinder[it->second].reset();
+    }
+    m_all_rewinder.push_back(rewinder);
+    m_rewinder_ids[name] = id;
+    rewinder->setRewinderId(id);
+    if (name == "N")
+        m_item_manager_rewinder_id = id;
+    if (NetworkConfig::get()->isServer())
+        m_unconfirmed_rewinder.emplace_back(id, -1);
     return true;
 }   // addRewinder
 
@@ -310,7 +357,7 @@ void RewindManager::rewindTo(int rewind_ticks, int now_ticks)
     // the rewind.
     for (auto& p : m_all_rewinder)
     {
-        if (auto r = p.second.lock())
+        if (auto r = p.lock())
             r->saveTransform();
     }
 
@@ -387,7 +434,7 @@ void RewindManager::rewindTo(int rewind_ticks, int now_ticks)
     // Now compute the errors which need to be visually smoothed
     for (auto& p : m_all_rewinder)
     {
-        if (auto r = p.second.lock())
+        if (auto r = p.lock())
             r->computeError();
     }
 
@@ -410,3 +457,56 @@ void RewindManager::mergeRewindInfoEventFunction()
         m_rewind_queue.insertRewindInfo(rief);
     m_pending_rief.clear();
 }   // mergeRewindInfoEventFunction
+
+// ----------------------------------------------------------------------------
+/** Stores the unique identity of a rewinder id of the server (in client).
+ *  This function is threadsafe so can be called by the network thread.
+ *  \param id Rewinder id in the server.
+ *  \param name Unique identity of the rewinder.
+ */
+void RewindManager::addServerRewinderName(uint16_t id,
+                                          const std::string& name)
+{
+    m_server_rewinder_names.lock();
+    m_server_rewinder_names.getData()[id] = name;
+    m_server_rewinder_names.unlock();
+}   // addServerRewinderName
+
+// ----------------------------------------------------------------------------
+/** Returns the local rewinder for a rewinder id of the server (in client).
+ *  The unique identity is only looked up the first time, or if the local
+ *  rewinder was deleted in the meantime.
+ *  \param id Rewinder id in the server.
+ */
+std::shared_ptr<Rewinder> RewindManager::getServerRewinder(uint16_t id)
+{
+    if (id < m_server_rewinder.size())
+    {
+        if (auto r = m_server_rewinder[id].lock())
+            return r;
+    }
+
+    std::string name;
+    m_server_rewinder_names.lock();
+    auto it = m_server_rewinder_names.getData().find(id);
+    if (it != m_server_rewinder_names.getData().end())
+        name = it->second;
+    m_server_rewinder_names.unlock();
+    if (name.empty())
+        return nullptr;
+
+    std::shared_ptr<Rewinder> r = getRewinder(name);
+    if (!r)
+    {
+        // For now we only need to get missing rewinder from
+        // projectile_manager
+        r = projectile_manager->addRewinderFromNetworkState(name);
+    }
+    if (r)
+    {
+        if (id >= m_server_rewinder.size())
+            m_server_rewinder.resize(id + 1);
+        m_server_rewinder[id] = r;
+    }
+    return r;
+}   // getServerRewinder
@@ -52,7 +52,7 @@ class EventRewinder;
  *  declared (usually inside of the object it can rewind). This instance
  *  is automatically registered with the RewindManager.
  *  All states and events are stored in a RewindInfo object. All RewindInfo
- *  objects are stored in a list sorted by time.
+ *  objects are stored in a ring buffer indexed by time (see RewindQueue).
  *  When a rewind to time T is requested, the following takes place:
  *  1. Go back in time:
  *     Determine the latest time t_min < T so that each rewindable objects
@@ -94,8 +94,31 @@ private:
 
     std::map<int, std::vector<std::function<void()> > > m_local_state;
 
-    /** A list of all objects that can be rewound. */
-    std::map<std::string, std::weak_ptr<Rewinder> > m_all_rewinder;
+    /** All objects that can be rewound, indexed by their rewinder id. Ids
+     *  are never reused during a race, so that they can be sent to clients
+     *  instead of the unique identity, expired rewinders stay as empty
+     *  entries. */
+    std::vector<std::weak_ptr<Rewinder> > m_all_rewinder;
+
+    /** The rewinder id of each unique identity. */
+    std::map<std::string, uint16_t> m_rewinder_ids;
+
+    /** The id of the network item manager, whose state is saved first. */
+    int m_item_manager_rewinder_id;
+
+    /** Server only: ids of rewinders whose unique identity must be sent to
+     *  clients, together with the ticks of the first state which included
+     *  it (-1 if not sent yet). They are sent in every state until all
+     *  clients acknowledged a state including them. */
+    std::vector<std::pair<uint16_t, int> > m_unconfirmed_rewinder;
+
+    /** Client only: unique identity of each rewinder id of the server, set
+     *  by the network thread when receiving states. */
+    Synchronised<std::map<uint16_t, std::string> > m_server_rewinder_names;
+
+    /** Client only: local rewinder of each rewinder id of the server, a
+     *  cache of m_server_rewinder_names only used in main thread. */
+    std::vector<std::weak_ptr<Rewinder> > m_server_rewinder;
 
     /** The queue that stores all rewind infos. */
     RewindQueue m_rewind_queue;
@@ -121,19 +144,6 @@ private:
 
     RewindManager();
    ~RewindManager();
-    // ------------------------------------------------------------------------
-    void clearExpiredRewinder()
-    {
-        for (auto it = m_all_rewinder.begin(); it != m_all_rewinder.end();)
-        {
-            if (it->second.expired())
-            {
-                it = m_all_rewinder.erase(it);
-                continue;
-            }
-            it++;
-        }
-    }
     // ------------------------------------------------------------------------
     void mergeRewindInfoEventFunction();
 
@@ -170,17 +180,30 @@ public:
     void addNetworkState(BareNetworkString *buffer, int ticks);
     void saveState();
     // ------------------------------------------------------------------------
+    /** Returns an empty (possibly reused) buffer for the data of an event
+     *  passed to addEvent or addNetworkEvent. This function is threadsafe. */
+    BareNetworkString* getEventBuffer()
+                                   { return m_rewind_queue.getEventBuffer(); }
+    // ------------------------------------------------------------------------
     std::shared_ptr<Rewinder> getRewinder(const std::string& name)
     {
-        auto it = m_all_rewinder.find(name);
-        if (it != m_all_rewinder.end())
-        {
-            if (auto r = it->second.lock())
-                return r;
-        }
+        auto it = m_rewinder_ids.find(name);
+        if (it != m_rewinder_ids.end())
+            return m_all_rewinder[it->second].lock();
         return nullptr;
     }
     // ------------------------------------------------------------------------
+    std::shared_ptr<Rewinder> getRewinderById(uint16_t id)
+    {
+        if (id < m_all_rewinder.size())
+            return m_all_rewinder[id].lock();
+        return nullptr;
+    }
+    // ------------------------------------------------------------------------
+    std::shared_ptr<Rewinder> getServerRewinder(uint16_t id);
+    // ------------------------------------------------------------------------
+    void addServerRewinderName(uint16_t id, const std::string& name);
+    // ------------------------------------------------------------------------
     bool addRewinder(std::shared_ptr<Rewinder> rewinder);
     // ------------------------------------------------------------------------
     /** Returns true if currently a rewind is happening. */
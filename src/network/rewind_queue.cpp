@@ -25,6 +25,7 @@
 #include "network/rewinder.hpp"
 #include "network/rewind_info.hpp"
 #include "network/rewind_manager.hpp"
+#include "utils/time.hpp"
 
 #include <algorithm>
 
@@ -44,6 +45,9 @@
  */
 RewindQueue::RewindQueue()
 {
+    // Enough for a few seconds of rewind infos, will grow if necessary
+    m_all_ticks.resize(512);
+    m_num_rewind_info = 0;
     reset();
 }   // RewindQueue
 
@@ -55,6 +59,11 @@ RewindQueue::~RewindQueue()
 {
     // This frees all current data
     reset();
+
+    for (RewindInfoEvent* rie : m_event_pool.getData())
+        delete rie;
+    for (BareNetworkString* buffer : m_buffer_pool.getData())
+        delete buffer;
 }   // ~RewindQueue
 
 // ----------------------------------------------------------------------------
@@ -73,45 +82,166 @@ void RewindQueue::reset()
     m_network_events.getData().clear();
     m_network_events.unlock();
 
-    AllRewindInfo::const_iterator i;
-    for (i = m_all_rewind_info.begin(); i != m_all_rewind_info.end(); ++i)
-        delete *i;
+    if (m_num_rewind_info > 0)
+    {
+        for (int t = m_first_ticks; t <= m_last_ticks; t++)
+        {
+            TickInfo& ti = getTickInfo(t);
+            for (RewindInfo* ri : ti.m_all_rewind_info)
+                freeRewindInfo(ri);
+            ti.m_all_rewind_info.clear();
+            ti.m_num_states = 0;
+        }
+    }
 
-    m_all_rewind_info.clear();
-    m_current = m_all_rewind_info.end();
+    m_num_rewind_info = 0;
+    m_first_ticks = 0;
+    m_last_ticks = -1;
+    m_current_ticks = 0;
+    m_current_index = 0;
     m_latest_confirmed_state_time = -1;
 }   // reset
 
+// ----------------------------------------------------------------------------
+/** Increases the size of the ring buffer so that at least the specified
+ *  number of time steps can be stored.
+ *  \param size Minimum number of time steps.
+ */
+void RewindQueue::growRingBuffer(unsigned size)
+{
+    unsigned new_size = (unsigned)m_all_ticks.size();
+    while (new_size < size)
+        new_size *= 2;
+
+    std::vector<TickInfo> all_ticks(new_size);
+    for (int t = m_first_ticks; t <= m_last_ticks; t++)
+        std::swap(all_ticks[t & (new_size - 1)], getTickInfo(t));
+    std::swap(m_all_ticks, all_ticks);
+}   // growRingBuffer
+
 // ----------------------------------------------------------------------------
 /** Inserts a RewindInfo object in the list of all events at the correct time.
  *  If there are several RewindInfo at the exact same time, state RewindInfo
  *  will be insert at the front, and event info at the end of the RewindInfo
  *  with the same time.
  *  \param ri The RewindInfo object to insert.
- *  \param update_current If set, the current pointer will be updated if
- *         necessary to point to the new event
  */
 void RewindQueue::insertRewindInfo(RewindInfo *ri)
 {
-    AllRewindInfo::iterator i = m_all_rewind_info.end();
+    const int ticks = ri->getTicks();
+    const bool at_end = !hasMoreRewindInfo();
+    if (m_num_rewind_info == 0)
+    {
+        m_first_ticks = ticks;
+        m_last_ticks = ticks;
+    }
+    else
+    {
+        const int first = std::min(m_first_ticks, ticks);
+        const int last = std::max(m_last_ticks, ticks);
+        if (unsigned(last - first + 1) > m_all_ticks.size())
+            growRingBuffer(last - first + 1);
+        m_first_ticks = first;
+        m_last_ticks = last;
+    }
 
-    while (i != m_all_rewind_info.begin())
+    TickInfo& ti = getTickInfo(ticks);
+    unsigned index;
+    if (ri->isEvent())
     {
-        AllRewindInfo::iterator i_prev = i;
-        i_prev--;
-        // Now test if 'ri' needs to be inserted after the
-        // previous element, i.e. before the current element:
-        if ((*i_prev)->getTicks() < ri->getTicks()) break;
-        if ((*i_prev)->getTicks() == ri->getTicks() &&
-            ri->isEvent()                              ) break;
-        i = i_prev;
+        index = (unsigned)ti.m_all_rewind_info.size();
     }
-    if(m_current == m_all_rewind_info.end())
-        m_current = m_all_rewind_info.insert(i, ri);
     else
-        m_all_rewind_info.insert(i, ri);  
+    {
+        index = 0;
+        ti.m_num_states++;
+    }
+    ti.m_all_rewind_info.insert(ti.m_all_rewind_info.begin() + index, ri);
+    m_num_rewind_info++;
+
+    if (at_end)
+    {
+        m_current_ticks = ticks;
+        m_current_index = index;
+    }
+    else if (m_current_ticks == ticks && m_current_index >= index)
+    {
+        // Keep the current pointer at the same rewind info
+        m_current_index++;
+    }
 }   // insertRewindInfo
 
+// ----------------------------------------------------------------------------
+/** Returns a new or reused event rewind info.
+ */
+RewindInfoEvent* RewindQueue::createEvent(int ticks,
+                                          EventRewinder *event_rewinder,
+                                          BareNetworkString *buffer,
+                                          bool confirmed)
+{
+    RewindInfoEvent* rie = NULL;
+    m_event_pool.lock();
+    if (!m_event_pool.getData().empty())
+    {
+        rie = m_event_pool.getData().back();
+        m_event_pool.getData().pop_back();
+    }
+    m_event_pool.unlock();
+
+    if (rie)
+        rie->reuse(ticks, event_rewinder, buffer, confirmed);
+    else
+        rie = new RewindInfoEvent(ticks, event_rewinder, buffer, confirmed);
+    return rie;
+}   // createEvent
+
+// ----------------------------------------------------------------------------
+/** Frees a rewind info. Events and their buffers are kept in a pool to be
+ *  reused by createEvent and getEventBuffer.
+ */
+void RewindQueue::freeRewindInfo(RewindInfo *ri)
+{
+    RewindInfoEvent* rie = dynamic_cast<RewindInfoEvent*>(ri);
+    if (!rie)
+    {
+        delete ri;
+        return;
+    }
+    BareNetworkString* buffer = rie->releaseBuffer();
+    if (buffer)
+    {
+        m_buffer_pool.lock();
+        m_buffer_pool.getData().push_back(buffer);
+        m_buffer_pool.unlock();
+    }
+    m_event_pool.lock();
+    m_event_pool.getData().push_back(rie);
+    m_event_pool.unlock();
+}   // freeRewindInfo
+
+// ----------------------------------------------------------------------------
+/** Returns an empty buffer to store event data in, which must be passed to
+ *  addLocalEvent or addNetworkEvent. Buffers of freed events are reused.
+ *  This function is thread-safe.
+ */
+BareNetworkString* RewindQueue::getEventBuffer()
+{
+    BareNetworkString* buffer = NULL;
+    m_buffer_pool.lock();
+    if (!m_buffer_pool.getData().empty())
+    {
+        buffer = m_buffer_pool.getData().back();
+        m_buffer_pool.getData().pop_back();
+    }
+    m_buffer_pool.unlock();
+
+    if (!buffer)
+        return new BareNetworkString();
+    buffer->getBuffer().clear();
+    buffer->reset();
+    return buffer;
+}   // getEventBuffer
+
 // ----------------------------------------------------------------------------
 /** Adds an event to the rewind data. The data to be stored must be allocated
  *  and not freed by the caller!
@@ -122,8 +252,7 @@ void RewindQueue::addLocalEvent(EventRewinder *event_rewinder,
                                 BareNetworkString *buffer, bool confirmed,
                                 int ticks                                  )
 {
-    RewindInfo *ri = new RewindInfoEvent(ticks, event_rewinder,
-                                         buffer, confirmed);
+    RewindInfo *ri = createEvent(ticks, event_rewinder, buffer, confirmed);
     insertRewindInfo(ri);
 }   // addLocalEvent
 
@@ -161,8 +290,8 @@ void RewindQueue::addLocalState(BareNetworkString *buffer,
 void RewindQueue::addNetworkEvent(EventRewinder *event_rewinder,
                                   BareNetworkString *buffer, int ticks)
 {
-    RewindInfo *ri = new RewindInfoEvent(ticks, event_rewinder,
-                                         buffer, /*confirmed*/true);
+    RewindInfo *ri = createEvent(ticks, event_rewinder, buffer,
+                                 /*confirmed*/true);
 
     m_network_events.lock();
     m_network_events.getData().push_back(ri);
@@ -201,6 +330,12 @@ void RewindQueue::mergeNetworkData(int world_ticks, bool *needs_rewind,
                                    int *rewind_ticks)
 {
     *needs_rewind = false;
+
+    // A server never rewinds, so all rewind infos before the current time
+    // have been replayed and are not needed anymore
+    if (NetworkConfig::get()->isServer())
+        cleanupOldRewindInfo(world_ticks);
+
     m_network_events.lock();
     if(m_network_events.getData().empty())
     {
@@ -235,7 +370,7 @@ void RewindQueue::mergeNetworkData(int world_ticks, bool *needs_rewind,
                       (*i)->isEvent() ? "event" : "state",
                       (*i)->getTicks(),
                       m_latest_confirmed_state_time);
-            delete *i;
+            freeRewindInfo(*i);
             i = m_network_events.getData().erase(i);
             continue;
         }
@@ -319,21 +454,39 @@ void RewindQueue::mergeNetworkData(int world_ticks, bool *needs_rewind,
  */
 void RewindQueue::cleanupOldRewindInfo(int ticks)
 {
-    auto i = m_all_rewind_info.begin();
+    if (m_num_rewind_info == 0)
+        return;
 
-    while ( (*i)->getTicks() < ticks)
+    while (m_first_ticks < ticks && m_first_ticks <= m_last_ticks)
     {
-        if (m_current == i) next();
-        delete *i;
-        i = m_all_rewind_info.erase(i);
+        TickInfo& ti = getTickInfo(m_first_ticks);
+        for (RewindInfo* ri : ti.m_all_rewind_info)
+            freeRewindInfo(ri);
+        m_num_rewind_info -= (unsigned)ti.m_all_rewind_info.size();
+        ti.m_all_rewind_info.clear();
+        ti.m_num_states = 0;
+        m_first_ticks++;
     }
 
+    if (m_current_ticks < m_first_ticks)
+    {
+        m_current_ticks = m_first_ticks;
+        m_current_index = 0;
+        skipEmptyTicks();
+    }
+
+    if (m_num_rewind_info == 0)
+    {
+        // Keep the (empty) current pointer after the deleted time steps
+        m_first_ticks = m_current_ticks;
+        m_last_ticks = m_current_ticks - 1;
+    }
 }   // cleanupOldRewindInfo
 
 // ----------------------------------------------------------------------------
 bool RewindQueue::isEmpty() const
 {
-    return m_current == m_all_rewind_info.end();
+    return !hasMoreRewindInfo();
 }   // isEmpty
 
 // ----------------------------------------------------------------------------
@@ -341,7 +494,7 @@ bool RewindQueue::isEmpty() const
  */
 bool RewindQueue::hasMoreRewindInfo() const
 {
-    return m_current != m_all_rewind_info.end();
+    return m_current_ticks <= m_last_ticks;
 }   // hasMoreRewindInfo
 
 // ----------------------------------------------------------------------------
@@ -355,27 +508,46 @@ int RewindQueue::undoUntil(int undo_ticks)
 {
     // A rewind is done after a state in the past is inserted. This function
     // makes sure that m_current is not end()
-    //assert(m_current != m_all_rewind_info.end());
-    assert(!m_all_rewind_info.empty());
-    m_current = m_all_rewind_info.end();
-    m_current--;
-    while((*m_current)->getTicks() > undo_ticks ||
-        (*m_current)->isEvent() || !(*m_current)->isConfirmed())
+    assert(m_num_rewind_info > 0);
+    int ticks = m_last_ticks;
+    while (getTickInfo(ticks).m_all_rewind_info.empty())
+        ticks--;
+    unsigned index = (unsigned)getTickInfo(ticks).m_all_rewind_info.size() - 1;
+
+    while (true)
     {
+        RewindInfo* ri = getTickInfo(ticks).m_all_rewind_info[index];
+        if (ri->getTicks() <= undo_ticks && ri->isState() &&
+            ri->isConfirmed())
+            break;
+
         // Undo all events and states from the current time
-        (*m_current)->undo();
-        if(m_current == m_all_rewind_info.begin())
+        ri->undo();
+        if (index > 0)
+        {
+            index--;
+            continue;
+        }
+        int prev_ticks = ticks - 1;
+        while (prev_ticks >= m_first_ticks &&
+               getTickInfo(prev_ticks).m_all_rewind_info.empty())
+            prev_ticks--;
+        if (prev_ticks < m_first_ticks)
         {
             // This shouldn't happen, but add some debug info just in case
             Log::error("undoUntil",
                        "At %d rewinding to %d current = %d = begin",
                        World::getWorld()->getTicksSinceStart(), undo_ticks, 
-                       (*m_current)->getTicks());
+                       ri->getTicks());
+            break;
         }
-        m_current--;
+        ticks = prev_ticks;
+        index = (unsigned)getTickInfo(ticks).m_all_rewind_info.size() - 1;
     }
 
-    return (*m_current)->getTicks();
+    m_current_ticks = ticks;
+    m_current_index = index;
+    return ticks;
 }   // undoUntil
 
 // ----------------------------------------------------------------------------
@@ -385,15 +557,32 @@ int RewindQueue::undoUntil(int undo_ticks)
 void RewindQueue::replayAllEvents(int ticks)
 {
     // Replay all events that happened at the current time step
-    while ( hasMoreRewindInfo() && (*m_current)->getTicks() == ticks )
+    while ( hasMoreRewindInfo() && m_current_ticks == ticks )
     {
-        if ((*m_current)->isEvent())
-            (*m_current)->replay();
-        m_current++;
+        RewindInfo* ri = getCurrent();
+        if (ri->isEvent())
+            ri->replay();
+        next();
     }   // while current->getTIcks == ticks
 
 }   // replayAllEvents
 
+// ----------------------------------------------------------------------------
+/** Returns all rewind infos in the order in which they are handled, only
+ *  used in unit testing.
+ */
+std::vector<RewindInfo*> RewindQueue::getAllRewindInfo() const
+{
+    std::vector<RewindInfo*> all_info;
+    for (int t = m_first_ticks; t <= m_last_ticks; t++)
+    {
+        const TickInfo& ti = getTickInfo(t);
+        all_info.insert(all_info.end(), ti.m_all_rewind_info.begin(),
+                        ti.m_all_rewind_info.end());
+    }
+    return all_info;
+}   // getAllRewindInfo
+
 // ----------------------------------------------------------------------------
 /** Unit tests for RewindQueue. It tests:
  *  - Sorting order of RewindInfos at the same time (i.e. state before time
@@ -415,57 +604,51 @@ void RewindQueue::unitTesting()
     assert(!q0.hasMoreRewindInfo());
 
     q0.addLocalState(NULL, /*confirmed*/true, 0);
-    assert(q0.m_all_rewind_info.front()->isState());
-    assert(!q0.m_all_rewind_info.front()->isEvent());
+    assert(q0.getAllRewindInfo().front()->isState());
+    assert(!q0.getAllRewindInfo().front()->isEvent());
     assert(q0.hasMoreRewindInfo());
     assert(q0.undoUntil(0) == 0);
 
     q0.addNetworkEvent(dummy_rewinder.get(), NULL, 0);
     // Network events are not immediately merged
-    assert(q0.m_all_rewind_info.size() == 1);
+    assert(q0.getAllRewindInfo().size() == 1);
 
     bool needs_rewind;
     int rewind_ticks;
     int world_ticks = 0;
     q0.mergeNetworkData(world_ticks, &needs_rewind, &rewind_ticks);
     assert(q0.hasMoreRewindInfo());
-    assert(q0.m_all_rewind_info.size() == 2);
-    AllRewindInfo::iterator rii = q0.m_all_rewind_info.begin();
-    assert((*rii)->isState());
-    rii++;
-    assert((*rii)->isEvent());
+    std::vector<RewindInfo*> all_info = q0.getAllRewindInfo();
+    assert(all_info.size() == 2);
+    assert(all_info[0]->isState());
+    assert(all_info[1]->isEvent());
 
     // Another state must be sorted before the event:
     q0.addNetworkState(NULL, 0);
     assert(q0.hasMoreRewindInfo());
     q0.mergeNetworkData(world_ticks, &needs_rewind, &rewind_ticks);
-    assert(q0.m_all_rewind_info.size() == 3);
-    rii = q0.m_all_rewind_info.begin();
-    assert((*rii)->isState());
-    rii++;
-    assert((*rii)->isState());
-    rii++;
-    assert((*rii)->isEvent());
+    all_info = q0.getAllRewindInfo();
+    assert(all_info.size() == 3);
+    assert(all_info[0]->isState());
+    assert(all_info[1]->isState());
+    assert(all_info[2]->isEvent());
 
     // Test time base comparisons: adding an event to the end
     q0.addLocalEvent(dummy_rewinder.get(), NULL, true, 4);
     // Then adding an earlier event
     q0.addLocalEvent(dummy_rewinder.get(), NULL, false, 1);
-    // rii points to the 3rd element, the ones added just now
-    // should be elements4 and 5:
-    rii++;
-    assert((*rii)->getTicks()==1);
-    rii++;
-    assert((*rii)->getTicks()==4);
+    // The ones added just now should be elements 4 and 5:
+    all_info = q0.getAllRewindInfo();
+    assert(all_info[3]->getTicks()==1);
+    assert(all_info[4]->getTicks()==4);
 
     // Now test inserting an event first, then the state
     RewindQueue q1;
     q1.addLocalEvent(NULL, NULL, true, 5);
     q1.addLocalState(NULL, true, 5);
-    rii = q1.m_all_rewind_info.begin();
-    assert((*rii)->isState());
-    rii++;
-    assert((*rii)->isEvent());
+    all_info = q1.getAllRewindInfo();
+    assert(all_info[0]->isState());
+    assert(all_info[1]->isEvent());
 
     // Bugs seen before
     // ----------------
@@ -484,11 +667,11 @@ void RewindQueue::unitTesting()
     //    event, that m_current pooints to the first event, otherwise
     //    events with same time stamp will not be handled correctly.
     //    At this stage current points to the event at time 2 from above
-    AllRewindInfo::iterator current_old = b1.m_current;
+    RewindInfo *current_old = b1.getCurrent();
     b1.addLocalEvent(NULL, NULL, true, 2);
     // Make sure that current was not modified, i.e. the new event at time
     // 2 was added at the end of the list:
-    if (current_old != b1.m_current)
+    if (current_old != b1.getCurrent())
         Log::fatal("RewindQueue", "current_old != b1.m_current");
 
     // This should not trigger an exception, now current points to the
@@ -497,7 +680,7 @@ void RewindQueue::unitTesting()
     assert(ri->getTicks() == 2);
     assert(ri->isEvent());
     b1.next();
-    assert(b1.m_current == b1.m_all_rewind_info.end());
+    assert(!b1.hasMoreRewindInfo());
 
     // 3) Test that if cleanupOldRewindInfo is called, it will if necessary
     //    adjust m_current to point to the latest confirmed state.
@@ -506,7 +689,99 @@ void RewindQueue::unitTesting()
     b2.addNetworkState(NULL, 2);
     b2.addNetworkState(NULL, 3);
     b2.mergeNetworkData(4, &needs_rewind, &rewind_ticks);
-    assert((*b2.m_current)->getTicks() == 3);
-
+    assert(b2.getCurrent()->getTicks() == 3);
+
+    // 4) Inserting a state at the same time as the current event must keep
+    //    the current pointer at that event.
+    RewindQueue b3;
+    b3.addLocalEvent(NULL, NULL, true, 7);
+    current_old = b3.getCurrent();
+    b3.addLocalState(NULL, /*confirmed*/false, 7);
+    assert(b3.getCurrent() == current_old);
+
+    // The ring buffer must grow if more time steps are stored than it has
+    // space for, and keep the order of all rewind infos
+    RewindQueue g1;
+    const int num_grow_ticks = (int)g1.m_all_ticks.size() * 3;
+    for (int t = num_grow_ticks - 1; t >= 0; t -= 2)
+        g1.addLocalEvent(NULL, NULL, true, t);
+    all_info = g1.getAllRewindInfo();
+    assert((int)all_info.size() == num_grow_ticks / 2);
+    for (unsigned i = 1; i < all_info.size(); i++)
+        assert(all_info[i - 1]->getTicks() < all_info[i]->getTicks());
+
+    // Micro benchmark of insert, merge and undo/replay as used in rewinds
+    // -------------------------------------------------------------------
+    const int num_ticks = 100000;
+    const int events_per_tick = 4;
+    const int state_frequency = 12;
+    RewindQueue bench;
+    double start = StkTime::getRealTime();
+    for (int t = 0; t < num_ticks; t++)
+    {
+        if (t % state_frequency == 0)
+            bench.addLocalState(NULL, /*confirmed*/false, t);
+        for (int e = 0; e < events_per_tick; e++)
+        {
+            BareNetworkString *buffer = bench.getEventBuffer();
+            buffer->addUInt8(e).addUInt16(t);
+            bench.addLocalEvent(dummy_rewinder.get(), buffer, true, t);
+        }
+        bench.replayAllEvents(t);
+    }
+    double insert_time = StkTime::getRealTime() - start;
 
+    start = StkTime::getRealTime();
+    for (int t = num_ticks; t < num_ticks * 2; t++)
+    {
+        for (int e = 0; e < events_per_tick; e++)
+        {
+            BareNetworkString *buffer = bench.getEventBuffer();
+            buffer->addUInt8(e).addUInt16(t);
+            bench.addNetworkEvent(dummy_rewinder.get(), buffer, t);
+        }
+        if (t % state_frequency == 0)
+            bench.addNetworkState(NULL, t);
+        bench.mergeNetworkData(t, &needs_rewind, &rewind_ticks);
+        bench.replayAllEvents(t);
+    }
+    double merge_time = StkTime::getRealTime() - start;
+
+    // Receive a confirmed state from 60 ticks ago regularly, which
+    // triggers a rewind to it and a replay of all events till 'now'
+    const int rewind_ticks_count = 60;
+    int num_replayed = 0;
+    start = StkTime::getRealTime();
+    for (int t = num_ticks * 2; t < num_ticks * 3; t++)
+    {
+        for (int e = 0; e < events_per_tick; e++)
+        {
+            BareNetworkString *buffer = bench.getEventBuffer();
+            buffer->addUInt8(e).addUInt16(t);
+            bench.addLocalEvent(dummy_rewinder.get(), buffer, true, t);
+        }
+        if (t % state_frequency == 0)
+        {
+            bench.addNetworkState(NULL, t - rewind_ticks_count);
+            bench.mergeNetworkData(t, &needs_rewind, &rewind_ticks);
+            int exact = bench.undoUntil(t - rewind_ticks_count);
+            assert(exact == t - rewind_ticks_count);
+            while (bench.hasMoreRewindInfo() &&
+                   bench.getCurrent()->getTicks() == exact &&
+                   bench.getCurrent()->isState())
+                bench.next();
+            for (int r = exact; r < t; r++)
+                bench.replayAllEvents(r);
+            num_replayed += t - exact;
+        }
+        bench.replayAllEvents(t);
+    }
+    double rewind_time = StkTime::getRealTime() - start;
+
+    const double num_events = double(num_ticks * events_per_tick);
+    Log::info("RewindQueue", "Benchmark: insert %.0f events/s, "
+        "merge %.0f events/s, undo and replay %.0f ticks/s.",
+        num_events / std::max(insert_time, 0.000001),
+        num_events / std::max(merge_time, 0.000001),
+        num_replayed / std::max(rewind_time, 0.000001));
 }   // unitTesting
@@ -22,12 +22,12 @@
 #include "utils/synchronised.hpp"
 
 #include <assert.h>
-#include <list>
 #include <vector>
 
 class BareNetworkString;
 class EventRewinder;
 class RewindInfo;
+class RewindInfoEvent;
 class TimeStepInfo;
 
 /** \ingroup network
@@ -37,9 +37,28 @@ class RewindQueue
 {
 private:
 
-    typedef std::list<RewindInfo*> AllRewindInfo;
+    /** All rewind infos at one time step. States are stored first (the
+     *  latest added state at the front), followed by the events in the
+     *  order in which they were added. */
+    struct TickInfo
+    {
+        std::vector<RewindInfo*> m_all_rewind_info;
+        unsigned m_num_states;
+        TickInfo() : m_num_states(0) {}
+    };
+
+    /** Ring buffer of all time steps between m_first_ticks and m_last_ticks,
+     *  the time step t is stored at index t & (size-1). The size is always a
+     *  power of 2, and the vectors of each TickInfo keep their capacity when
+     *  being cleared, so that no memory is allocated once the ring buffer
+     *  has been used for a few time steps. */
+    std::vector<TickInfo> m_all_ticks;
+
+    /** First and last time step stored in m_all_ticks. */
+    int m_first_ticks, m_last_ticks;
 
-    AllRewindInfo m_all_rewind_info;
+    /** Number of rewind infos stored in m_all_ticks. */
+    unsigned m_num_rewind_info;
 
     /** The list of all events received from the network. They are stored
      *  in a separate thread (so this data structure is thread-save), and
@@ -49,14 +68,50 @@ private:
     typedef std::vector<RewindInfo*> AllNetworkRewindInfo;
     Synchronised<AllNetworkRewindInfo> m_network_events;
 
-    /** Iterator to the curren time step info to be handled. */
-    AllRewindInfo::iterator m_current;
+    /** Unused event rewind infos and event buffers, which are reused instead
+     *  of allocating new ones. They are used by the network thread, so they
+     *  need to be synchronised. */
+    Synchronised<std::vector<RewindInfoEvent*> > m_event_pool;
+    Synchronised<std::vector<BareNetworkString*> > m_buffer_pool;
+
+    /** The current time step info to be handled, and the index of the
+     *  current rewind info in that time step. If m_current_ticks is larger
+     *  than m_last_ticks there is no current rewind info. */
+    int m_current_ticks;
+    unsigned m_current_index;
 
     /** Time at which the latest confirmed state is at. */
     int m_latest_confirmed_state_time;
 
-
     void cleanupOldRewindInfo(int ticks);
+    void growRingBuffer(unsigned size);
+    RewindInfoEvent* createEvent(int ticks, EventRewinder *event_rewinder,
+                                 BareNetworkString *buffer, bool confirmed);
+    void freeRewindInfo(RewindInfo *ri);
+    std::vector<RewindInfo*> getAllRewindInfo() const;
+    // ------------------------------------------------------------------------
+    TickInfo& getTickInfo(int ticks)
+    {
+        return m_all_ticks[ticks & (m_all_ticks.size() - 1)];
+    }   // getTickInfo
+    // ------------------------------------------------------------------------
+    const TickInfo& getTickInfo(int ticks) const
+    {
+        return m_all_ticks[ticks & (m_all_ticks.size() - 1)];
+    }   // getTickInfo
+    // ------------------------------------------------------------------------
+    /** Moves the current pointer forward to the next rewind info, skipping
+     *  time steps without any rewind info. */
+    void skipEmptyTicks()
+    {
+        while (m_current_ticks <= m_last_ticks &&
+               m_current_index >=
+               getTickInfo(m_current_ticks).m_all_rewind_info.size())
+        {
+            m_current_ticks++;
+            m_current_index = 0;
+        }
+    }   // skipEmptyTicks
 
 public:
         static void unitTesting();
@@ -83,6 +138,7 @@ public:
     bool hasMoreRewindInfo() const;
     int  undoUntil(int undo_ticks);
     void insertRewindInfo(RewindInfo *ri);
+    BareNetworkString* getEventBuffer();
 
     // ------------------------------------------------------------------------
     /** Returns the time of the latest confirmed state. */
@@ -95,8 +151,9 @@ public:
      *  RewindInfo element. */
     void next()
     {
-        assert(m_current != m_all_rewind_info.end());
-        m_current++;
+        assert(hasMoreRewindInfo());
+        m_current_index++;
+        skipEmptyTicks();
         return;
     }   // operator++
 
@@ -105,7 +162,10 @@ public:
      *  least one more RewindInfo (see hasMoreRewindInfo()). */
     RewindInfo* getCurrent()
     {
-        return (m_current != m_all_rewind_info.end() ) ? *m_current : NULL;
+        if (!hasMoreRewindInfo())
+            return NULL;
+        return getTickInfo(m_current_ticks)
+            .m_all_rewind_info[m_current_index];
     }   // getNext
 
 };   // RewindQueue
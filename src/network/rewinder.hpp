@@ -20,6 +20,7 @@
 #define HEADER_REWINDER_HPP
 
 #include <cassert>
+#include <cstdint>
 #include <functional>
 #include <string>
 #include <memory>
@@ -34,8 +35,16 @@ protected:
 private:
     std::string m_unique_identity;
 
+    /** Dense id of this rewinder assigned by the RewindManager when it is
+     *  added, -1 if not added. */
+    int m_rewinder_id;
+
 public:
-    Rewinder(const std::string& ui = "")             { m_unique_identity = ui; }
+    Rewinder(const std::string& ui = "")
+    {
+        m_unique_identity = ui;
+        m_rewinder_id = -1;
+    }
 
     virtual ~Rewinder() {}
 
@@ -50,10 +59,10 @@ public:
 
     /** Provides a copy of the state of the object in one memory buffer.
      *  The memory is managed by the RewindManager.
-     *  \param[out] ru The unique identity of rewinder writing to.
+     *  \param[out] ru The rewinder id of rewinder writing to.
      *  \return The address of the memory buffer with the state.
      */
-    virtual BareNetworkString* saveState(std::vector<std::string>* ru) = 0;
+    virtual BareNetworkString* saveState(std::vector<uint16_t>* ru) = 0;
 
     /** Called when an event needs to be undone. This is called while going
      *  backwards for rewinding - all stored events will get an 'undo' call.
@@ -90,6 +99,16 @@ public:
         return m_unique_identity;
     }
     // -------------------------------------------------------------------------
+    /** Returns the id of this rewinder, which is used instead of the unique
+     *  identity in saved states. */
+    uint16_t getRewinderId() const
+    {
+        assert(m_rewinder_id >= 0);
+        return (uint16_t)m_rewinder_id;
+    }
+    // -------------------------------------------------------------------------
+    void setRewinderId(uint16_t id)                      { m_rewinder_id = id; }
+    // -------------------------------------------------------------------------
     bool rewinderAdd();
     // -------------------------------------------------------------------------
     template<typename T> std::shared_ptr<T> getShared()
@@ -258,6 +258,13 @@ namespace ServerConfig
         SERVER_CFG_DEFAULT(IntServerConfigParam(100, "jitter-tolerance",
         "Tolerance of jitter in network allowed (in ms)."));
 
+    SERVER_CFG_PREFIX BoolServerConfigParam m_state_delta_compression
+        SERVER_CFG_DEFAULT(BoolServerConfigParam(true,
+        "state-delta-compression",
+        "Send game states to clients as a delta against the latest state "
+        "acknowledged by each client, which reduces upload bandwidth. Clients "
+        "which never acknowledge a state always receive full states."));
+
     SERVER_CFG_PREFIX BoolServerConfigParam m_kick_high_ping_players
         SERVER_CFG_DEFAULT(BoolServerConfigParam(false,
         "kick-high-ping-players",
@@ -281,7 +288,7 @@ namespace ServerConfig
 
     // ========================================================================
     /** Server version, will be advanced if there are protocol changes. */
-    static const uint32_t m_server_version = 4;
+    static const uint32_t m_server_version = 5;
     // ========================================================================
     void loadServerConfig(const std::string& path = "");
     // ------------------------------------------------------------------------
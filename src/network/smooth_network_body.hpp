@@ -88,6 +88,8 @@ public:
     // ------------------------------------------------------------------------
     void setEnable(bool val)                               { m_enabled = val; }
     // ------------------------------------------------------------------------
+    bool isSmoothingEnabled() const                      { return m_enabled; }
+    // ------------------------------------------------------------------------
     void setSmoothRotation(bool val)               { m_smooth_rotation = val; }
     // ------------------------------------------------------------------------
     void setAdjustVerticalOffset(bool val)  { m_adjust_vertical_offset = val; }
@@ -36,6 +36,7 @@
 #include "utils/separate_process.hpp"
 #include "utils/time.hpp"
 #include "utils/vs.hpp"
+#include "utils/worker_pool.hpp"
 
 #include <string.h>
 #if defined(WIN32)
@@ -297,7 +298,11 @@ STKHost::STKHost(bool server)
     }
     setPrivatePort();
     if (server)
+    {
         Log::info("STKHost", "Server port is %d", m_private_port);
+        m_crypto_pool.reset(new WorkerPool(
+            WorkerPool::getDefaultNumThreads(), "Crypto"));
+    }
 }   // STKHost
 
 // ----------------------------------------------------------------------------
@@ -312,6 +317,13 @@ void STKHost::init()
     m_network          = NULL;
     m_exit_timeout.store(std::numeric_limits<uint64_t>::max());
     m_client_ping.store(0);
+    m_wakeup_socket = ENET_SOCKET_NULL;
+    m_wakeup_pending.store(false);
+    m_encrypted_packets.store(0);
+    m_encrypt_time.store(0);
+    m_decrypted_packets.store(0);
+    m_decrypt_time.store(0);
+    m_crypto_stats_start = StkTime::getRealTimeMs();
 
     // Start with initialising ENet
     // ============================
@@ -320,6 +332,7 @@ void STKHost::init()
         Log::error("STKHost", "Could not initialize enet.");
         return;
     }
+    createWakeupSocket();
 
     Log::info("STKHost", "Host initialized.");
     Network::openLog();  // Open packet log file
@@ -346,7 +359,12 @@ STKHost::~STKHost()
     disconnectAllPeers(true/*timeout_waiting*/);
     Network::closeLog();
     stopListening();
+    if (m_encrypted_packets.load() > 0 || m_decrypted_packets.load() > 0)
+        logCryptoStats();
+    Event::clearPools();
 
+    if (m_wakeup_socket != ENET_SOCKET_NULL)
+        enet_socket_destroy(m_wakeup_socket);
     delete m_network;
     enet_deinitialize();
     delete m_separate_process;
@@ -680,10 +698,95 @@ void STKHost::stopListening()
 {
     if (m_exit_timeout.load() == std::numeric_limits<uint64_t>::max())
         m_exit_timeout.store(0);
+    wakeUpListeningThread();
     if (m_listening_thread.joinable())
         m_listening_thread.join();
 }   // stopListening
 
+// ----------------------------------------------------------------------------
+/** Creates a UDP socket bound to the loopback interface. The listening
+ *  thread waits for packets on this socket and on the enet socket at the
+ *  same time, so sending a datagram to it wakes up the listening thread.
+ *  If it can't be created, the listening thread uses a fixed timeout.
+ */
+void STKHost::createWakeupSocket()
+{
+    m_wakeup_socket = enet_socket_create(ENET_SOCKET_TYPE_DATAGRAM);
+    if (m_wakeup_socket == ENET_SOCKET_NULL)
+        return;
+    ENetAddress address;
+    address.host = ENET_HOST_TO_NET_32(0x7f000001);   // 127.0.0.1
+    address.port = 0;
+    if (enet_socket_bind(m_wakeup_socket, &address) != 0 ||
+        enet_socket_get_address(m_wakeup_socket, &m_wakeup_address) != 0 ||
+        enet_socket_set_option(m_wakeup_socket, ENET_SOCKOPT_NONBLOCK, 1)
+        != 0)
+    {
+        Log::warn("STKHost", "Can not create wake up socket.");
+        enet_socket_destroy(m_wakeup_socket);
+        m_wakeup_socket = ENET_SOCKET_NULL;
+        return;
+    }
+    m_wakeup_address.host = address.host;
+}   // createWakeupSocket
+
+// ----------------------------------------------------------------------------
+/** Wakes up the listening thread if it is waiting for network packets, so
+ *  that queued enet commands are executed immediately. Can be called from
+ *  any thread.
+ */
+void STKHost::wakeUpListeningThread()
+{
+    if (m_wakeup_socket == ENET_SOCKET_NULL ||
+        m_wakeup_pending.exchange(true))
+        return;
+    uint8_t data = 0;
+    ENetBuffer buffer;
+    buffer.data       = &data;
+    buffer.dataLength = 1;
+    enet_socket_send(m_wakeup_socket, &m_wakeup_address, &buffer, 1);
+}   // wakeUpListeningThread
+
+// ----------------------------------------------------------------------------
+/** Waits till a packet arrives at the enet host, the listening thread is
+ *  woken up, or the timeout is reached.
+ *  \param host The enet host to wait for.
+ *  \param timeout Maximum time to wait in ms.
+ */
+void STKHost::waitForNetworkEvents(ENetHost* host, uint32_t timeout)
+{
+    if (m_wakeup_socket == ENET_SOCKET_NULL)
+    {
+        enet_uint32 condition = ENET_SOCKET_WAIT_RECEIVE;
+        enet_socket_wait(host->socket, &condition, timeout);
+        return;
+    }
+    ENetSocketSet read_set;
+    ENET_SOCKETSET_EMPTY(read_set);
+    ENET_SOCKETSET_ADD(read_set, host->socket);
+    ENET_SOCKETSET_ADD(read_set, m_wakeup_socket);
+    if (enet_socketset_select(std::max(host->socket, m_wakeup_socket),
+                              &read_set, NULL, timeout) <= 0)
+        return;
+    if (ENET_SOCKETSET_CHECK(read_set, m_wakeup_socket))
+    {
+        uint8_t data[16];
+        ENetBuffer buffer;
+        buffer.data       = data;
+        buffer.dataLength = sizeof(data);
+        ENetAddress sender;
+        while (enet_socket_receive(m_wakeup_socket, &sender, &buffer, 1) > 0)
+        {
+        }
+        // Only clear the flag once the socket is drained, otherwise the
+        // datagram of a wake up in between is read here while the flag
+        // stays set, and no later wake up would send a datagram anymore.
+        // A wake up skipped before the clear is handled anyway, since the
+        // caller executes the queued commands after this returns.
+        m_wakeup_pending.store(false);
+    }
+}   // waitForNetworkEvents
+
 // ----------------------------------------------------------------------------
 /** \brief Thread function checking if data is received.
  *  This function tries to get data from network low-level functions as
@@ -719,6 +822,7 @@ void STKHost::mainLoop()
     uint64_t last_ping_time = StkTime::getRealTimeMs();
     uint64_t last_ping_time_update_for_client = StkTime::getRealTimeMs();
     std::map<std::string, uint64_t> ctp;
+    std::vector<std::pair<ENetEvent, std::shared_ptr<STKPeer> > > received;
     while (m_exit_timeout.load() > StkTime::getRealTimeMs())
     {
         // Clear outdated connect to peer list every 15 seconds
@@ -858,8 +962,10 @@ void STKHost::mainLoop()
             }
         }
 
+        // enet_host_service sends all queued packets before handling
+        // incoming events, so queued commands are sent immediately.
         bool need_ping_update = false;
-        while (enet_host_service(host, &event, 10) != 0)
+        while (enet_host_service(host, &event, 0) != 0)
         {
             if (!is_server &&
                 last_ping_time_update_for_client < StkTime::getRealTimeMs())
@@ -886,6 +992,8 @@ void STKHost::mainLoop()
             Event* stk_event = NULL;
             if (event.type == ENET_EVENT_TYPE_CONNECT)
             {
+                // Keep the order of events
+                handleReceivedEvents(received);
                 auto stk_peer = std::make_shared<STKPeer>
                     (event.peer, this, m_next_unique_host_id++);
                 std::unique_lock<std::mutex> lock(m_peers_mutex);
@@ -902,6 +1010,7 @@ void STKHost::mainLoop()
             else if (event.type == ENET_EVENT_TYPE_DISCONNECT)
             {
                 Log::flushBuffers();
+                handleReceivedEvents(received);
 
                 // If used a timeout waiting disconnect, exit now
                 if (m_exit_timeout.load() !=
@@ -963,48 +1072,117 @@ void STKHost::mainLoop()
                     enet_packet_destroy(event.packet);
                     continue;
                 }
-                try
-                {
-                    stk_event = new Event(&event, peer);
-                }
-                catch (std::exception& e)
-                {
-                    Log::warn("STKHost", "%s", e.what());
-                    enet_packet_destroy(event.packet);
-                    continue;
-                }
+                // Messages are decrypted in parallel once all pending
+                // events are received
+                received.emplace_back(event, peer);
+                continue;
             }
             else if (!stk_event)
             {
                 enet_packet_destroy(event.packet);
                 continue;
             }
-            if (stk_event->getType() == EVENT_TYPE_MESSAGE)
-            {
-                Network::logPacket(stk_event->data(), true);
-#ifdef DEBUG_MESSAGE_CONTENT
-                Log::verbose("NetworkManager",
-                             "Message, Sender : %s time %f message:",
-                             stk_event->getPeer()->getAddress()
-                             .toString(/*show port*/false).c_str(),
-                             StkTime::getRealTime());
-                Log::verbose("NetworkManager", "%s",
-                             stk_event->data().getLogMessage().c_str());
-#endif
-            }   // if message event
-
-            // notify for the event now.
-            auto pm = ProtocolManager::lock();
-            if (pm && !pm->isExiting())
-                pm->propagateEvent(stk_event);
-            else
-                delete stk_event;
+            propagateEvent(stk_event);
         }   // while enet_host_service
+        handleReceivedEvents(received);
+
+        // Wait for new packets or commands. The timeout is needed for
+        // pings and enet's resend timers.
+        waitForNetworkEvents(host, 10);
     }   // while m_exit_timeout.load() > StkTime::getRealTimeMs()
     delete direct_socket;
     Log::info("STKHost", "Listening has been stopped.");
 }   // mainLoop
 
+// ----------------------------------------------------------------------------
+/** Creates the events for all messages received in one iteration of the
+ *  listening thread and passes them to the protocol manager. Decrypting is
+ *  done in parallel (packets of the same peer are serialised by its crypto
+ *  object), but the events are propagated in the order they were received.
+ *  \param received The received enet events with their peers, cleared
+ *         afterwards.
+ */
+void STKHost::handleReceivedEvents(
+    std::vector<std::pair<ENetEvent, std::shared_ptr<STKPeer> > >& received)
+{
+    if (received.empty())
+        return;
+
+    std::vector<Event*> events(received.size(), NULL);
+    std::function<void(unsigned)> create_event = [this, &received, &events]
+        (unsigned i)
+        {
+            ENetEvent& event = received[i].first;
+            std::shared_ptr<STKPeer>& peer = received[i].second;
+            const bool encrypted = peer->getCrypto() &&
+                event.channelID == EVENT_CHANNEL_NORMAL;
+            const double start = StkTime::getRealTime();
+            try
+            {
+                events[i] = new Event(&event, peer);
+            }
+            catch (std::exception& e)
+            {
+                Log::warn("STKHost", "%s", e.what());
+                enet_packet_destroy(event.packet);
+                return;
+            }
+            if (encrypted)
+            {
+                updateCryptoStats(/*encrypt*/false,
+                                  StkTime::getRealTime() - start);
+            }
+        };
+
+    std::unique_lock<std::mutex> ul(m_crypto_pool_mutex, std::try_to_lock);
+    if (m_crypto_pool && ul.owns_lock())
+    {
+        m_crypto_pool->run((unsigned)received.size(), create_event);
+        ul.unlock();
+    }
+    else
+    {
+        for (unsigned i = 0; i < received.size(); i++)
+            create_event(i);
+    }
+    received.clear();
+
+    for (Event* stk_event : events)
+    {
+        if (stk_event)
+            propagateEvent(stk_event);
+    }
+}   // handleReceivedEvents
+
+// ----------------------------------------------------------------------------
+/** Logs the event if it is a message and passes it to the protocol
+ *  manager, which takes ownership of it.
+ *  \param stk_event The event to propagate.
+ */
+void STKHost::propagateEvent(Event* stk_event)
+{
+    if (stk_event->getType() == EVENT_TYPE_MESSAGE)
+    {
+        Network::logPacket(stk_event->data(), true);
+#ifdef DEBUG_MESSAGE_CONTENT
+        Log::verbose("NetworkManager",
+                     "Message, Sender : %s time %f message:",
+                     stk_event->getPeer()->getAddress()
+                     .toString(/*show port*/false).c_str(),
+                     StkTime::getRealTime());
+        Log::verbose("NetworkManager", "%s",
+                     stk_event->data().getLogMessage().c_str());
+#endif
+    }   // if message event
+
+    // notify for the event now.
+    auto pm = ProtocolManager::lock();
+    if (pm && !pm->isExiting())
+        pm->propagateEvent(stk_event);
+    else
+        delete stk_event;
+}   // propagateEvent
+
 // ----------------------------------------------------------------------------
 /** Handles a direct request given to a socket. This is typically a LAN 
  *  request, but can also be used if the server is public (i.e. not behind
@@ -1140,11 +1318,13 @@ bool STKHost::isConnectedTo(const TransportAddress& peer)
 void STKHost::sendPacketToAllPeersInServer(NetworkString *data, bool reliable)
 {
     std::lock_guard<std::mutex> lock(m_peers_mutex);
+    std::vector<STKPeer*> peers;
     for (auto p : m_peers)
     {
         if (p.second->isValidated())
-            p.second->sendPacket(data, reliable);
+            peers.push_back(p.second.get());
     }
+    sendPacketToPeers(peers, data, reliable);
 }   // sendPacketToAllPeersInServer
 
 //-----------------------------------------------------------------------------
@@ -1155,11 +1335,13 @@ void STKHost::sendPacketToAllPeersInServer(NetworkString *data, bool reliable)
 void STKHost::sendPacketToAllPeers(NetworkString *data, bool reliable)
 {
     std::lock_guard<std::mutex> lock(m_peers_mutex);
+    std::vector<STKPeer*> peers;
     for (auto p : m_peers)
     {
         if (p.second->isValidated() && !p.second->isWaitingForGame())
-            p.second->sendPacket(data, reliable);
+            peers.push_back(p.second.get());
     }
+    sendPacketToPeers(peers, data, reliable);
 }   // sendPacketToAllPeers
 
 //-----------------------------------------------------------------------------
@@ -1172,15 +1354,17 @@ void STKHost::sendPacketExcept(STKPeer* peer, NetworkString *data,
                                bool reliable)
 {
     std::lock_guard<std::mutex> lock(m_peers_mutex);
+    std::vector<STKPeer*> peers;
     for (auto p : m_peers)
     {
         STKPeer* stk_peer = p.second.get();
         if (!stk_peer->isSamePeer(peer) && p.second->isValidated() &&
             !p.second->isWaitingForGame())
         {
-            stk_peer->sendPacket(data, reliable);
+            peers.push_back(stk_peer);
         }
     }
+    sendPacketToPeers(peers, data, reliable);
 }   // sendPacketExcept
 
 //-----------------------------------------------------------------------------
@@ -1193,14 +1377,72 @@ void STKHost::sendPacketToAllPeersWith(std::function<bool(STKPeer*)> predicate,
                                        NetworkString* data, bool reliable)
 {
     std::lock_guard<std::mutex> lock(m_peers_mutex);
+    std::vector<STKPeer*> peers;
     for (auto p : m_peers)
     {
         STKPeer* stk_peer = p.second.get();
         if (predicate(stk_peer))
-            stk_peer->sendPacket(data, reliable);
+            peers.push_back(stk_peer);
     }
+    sendPacketToPeers(peers, data, reliable);
 }   // sendPacketToAllPeersWith
 
+//-----------------------------------------------------------------------------
+/** Sends the same data encrypted to a list of peers. Each peer has its own
+ *  key and nonce counter, so the packets are encrypted in parallel first,
+ *  and then queued in the same order as before.
+ *  \param peers The peers to send the data to.
+ *  \param data Data to sent.
+ *  \param reliable If the data should be sent reliable or now.
+ */
+void STKHost::sendPacketToPeers(const std::vector<STKPeer*>& peers,
+                                NetworkString* data, bool reliable)
+{
+    std::vector<ENetPacket*> packets(peers.size(), NULL);
+    std::function<void(unsigned)> create_packet =
+        [&peers, &packets, data, reliable](unsigned i)
+        {
+            packets[i] = peers[i]->createPacket(data, reliable,
+                                                /*encrypted*/true);
+        };
+
+    std::unique_lock<std::mutex> ul(m_crypto_pool_mutex, std::try_to_lock);
+    if (m_crypto_pool && ul.owns_lock())
+    {
+        m_crypto_pool->run((unsigned)peers.size(), create_packet);
+        ul.unlock();
+    }
+    else
+    {
+        for (unsigned i = 0; i < peers.size(); i++)
+            create_packet(i);
+    }
+
+    for (unsigned i = 0; i < peers.size(); i++)
+    {
+        if (packets[i])
+            peers[i]->sendENetPacket(packets[i], /*encrypted*/true);
+    }
+}   // sendPacketToPeers
+
+//-----------------------------------------------------------------------------
+/** Prints the number of packets encrypted and decrypted per second since
+ *  the host was started, and the average time needed per packet.
+ */
+void STKHost::logCryptoStats() const
+{
+    const double seconds = std::max(1.0,
+        (double)(StkTime::getRealTimeMs() - m_crypto_stats_start) / 1000.0);
+    const uint64_t encrypted = m_encrypted_packets.load();
+    const uint64_t decrypted = m_decrypted_packets.load();
+    Log::info("STKHost", "Encrypted %lu packets (%.1f pps, %.2f us/packet), "
+        "decrypted %lu packets (%.1f pps, %.2f us/packet).",
+        (unsigned long)encrypted, (double)encrypted / seconds,
+        encrypted ? (double)m_encrypt_time.load() / encrypted : 0.0,
+        (unsigned long)decrypted, (double)decrypted / seconds,
+        decrypted ? (double)m_decrypt_time.load() / decrypted : 0.0);
+}   // logCryptoStats
+
 //-----------------------------------------------------------------------------
 /** Sends a message from a client to the server. */
 void STKHost::sendToServer(NetworkString *data, bool reliable)
@@ -44,7 +44,9 @@
 #include <mutex>
 #include <thread>
 #include <tuple>
+#include <vector>
 
+class Event;
 class GameSetup;
 class LobbyProtocol;
 class NetworkPlayerProfile;
@@ -52,6 +54,7 @@ class NetworkTimerSynchronizer;
 class Server;
 class ServerLobby;
 class SeparateProcess;
+class WorkerPool;
 
 enum ENetCommandType : unsigned int
 {
@@ -98,6 +101,17 @@ private:
     /** Protect \ref m_enet_cmd from multiple threads usage. */
     std::mutex m_enet_cmd_mutex;
 
+    /** A local UDP socket used to wake up the listening thread when it is
+     *  waiting for network packets, e.g. when an enet command is queued.
+     *  ENET_SOCKET_NULL if it could not be created. */
+    ENetSocket m_wakeup_socket;
+
+    /** The address of m_wakeup_socket. */
+    ENetAddress m_wakeup_address;
+
+    /** True if a wake up datagram was sent and not yet received. */
+    std::atomic_bool m_wakeup_pending;
+
     /** The list of peers connected to this instance. */
     std::map<ENetPeer*, std::shared_ptr<STKPeer> > m_peers;
 
@@ -144,6 +158,23 @@ private:
 
     std::unique_ptr<NetworkTimerSynchronizer> m_nts;
 
+    /** Worker threads to encrypt broadcast packets and decrypt received
+     *  packets of different peers in parallel, only used by servers. */
+    std::unique_ptr<WorkerPool> m_crypto_pool;
+
+    /** The pool can only run one job at a time. If it is busy (e.g. the
+     *  listening thread decrypts while another thread broadcasts), the
+     *  work is done in the calling thread instead. */
+    std::mutex m_crypto_pool_mutex;
+
+    /** Number of encrypted and decrypted packets and the total time in
+     *  microseconds spent on them, to report the crypto throughput. */
+    std::atomic<uint64_t> m_encrypted_packets, m_encrypt_time;
+    std::atomic<uint64_t> m_decrypted_packets, m_decrypt_time;
+
+    /** Time in ms when the crypto statistics were started. */
+    uint64_t m_crypto_stats_start;
+
     // ------------------------------------------------------------------------
     STKHost(bool server);
     // ------------------------------------------------------------------------
@@ -156,6 +187,19 @@ private:
                                    std::map<std::string, uint64_t>& ctp);
     // ------------------------------------------------------------------------
     void mainLoop();
+    // ------------------------------------------------------------------------
+    void createWakeupSocket();
+    // ------------------------------------------------------------------------
+    void waitForNetworkEvents(ENetHost* host, uint32_t timeout);
+    // ------------------------------------------------------------------------
+    void sendPacketToPeers(const std::vector<STKPeer*>& peers,
+                           NetworkString* data, bool reliable);
+    // ------------------------------------------------------------------------
+    void handleReceivedEvents(
+        std::vector<std::pair<ENetEvent, std::shared_ptr<STKPeer> > >&
+        received);
+    // ------------------------------------------------------------------------
+    void propagateEvent(Event* stk_event);
 
 public:
     /** If a network console should be started. */
@@ -220,6 +264,27 @@ public:
     void sendPacketToAllPeersWith(std::function<bool(STKPeer*)> predicate,
                                   NetworkString* data, bool reliable = true);
     // ------------------------------------------------------------------------
+    /** Adds the time needed to encrypt or decrypt one packet to the crypto
+     *  statistics. Can be called from any thread.
+     *  \param encrypt True if the packet was encrypted, false if decrypted.
+     *  \param seconds The time needed. */
+    void updateCryptoStats(bool encrypt, double seconds)
+    {
+        const uint64_t us = (uint64_t)(seconds * 1000000.0);
+        if (encrypt)
+        {
+            m_encrypted_packets.fetch_add(1, std::memory_order_relaxed);
+            m_encrypt_time.fetch_add(us, std::memory_order_relaxed);
+        }
+        else
+        {
+            m_decrypted_packets.fetch_add(1, std::memory_order_relaxed);
+            m_decrypt_time.fetch_add(us, std::memory_order_relaxed);
+        }
+    }   // updateCryptoStats
+    // ------------------------------------------------------------------------
+    void logCryptoStats() const;
+    // ------------------------------------------------------------------------
     /** Returns true if this client instance is allowed to control the server.
      *  It will auto transfer ownership if previous server owner disconnected.
      */
@@ -256,10 +321,15 @@ public:
     void addEnetCommand(ENetPeer* peer, ENetPacket* packet, uint32_t i,
                         ENetCommandType ect)
     {
-        std::lock_guard<std::mutex> lock(m_enet_cmd_mutex);
-        m_enet_cmd.emplace_back(peer, packet, i, ect);
+        {
+            std::lock_guard<std::mutex> lock(m_enet_cmd_mutex);
+            m_enet_cmd.emplace_back(peer, packet, i, ect);
+        }
+        wakeUpListeningThread();
     }
     // ------------------------------------------------------------------------
+    void wakeUpListeningThread();
+    // ------------------------------------------------------------------------
     /** Returns the last error (or "" if no error has happened). */
     const irr::core::stringw& getErrorMessage() const
                                                     { return m_error_message; }
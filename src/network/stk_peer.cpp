@@ -42,6 +42,7 @@ STKPeer::STKPeer(ENetPeer *enet_peer, STKHost* host, uint32_t host_id)
     m_average_ping.store(0);
     m_waiting_for_game.store(true);
     m_disconnected.store(false);
+    m_last_acked_state_ticks.store(-1);
 }   // STKPeer
 
 //-----------------------------------------------------------------------------
@@ -93,41 +94,63 @@ void STKPeer::reset()
  *  \param encrypted If the data is sent encrypted or not.
  */
 void STKPeer::sendPacket(NetworkString *data, bool reliable, bool encrypted)
+{
+    ENetPacket* packet = createPacket(data, reliable, encrypted);
+    if (packet)
+        sendENetPacket(packet, encrypted);
+}   // sendPacket
+
+//-----------------------------------------------------------------------------
+/** Creates (and encrypts if needed) the enet packet for the given data
+ *  without sending it. This can be called from any thread, which allows
+ *  STKHost to encrypt broadcast messages for all peers in parallel.
+ *  \param data The data to send.
+ *  \param reliable If the data is sent reliable or not.
+ *  \param encrypted If the data is sent encrypted or not.
+ *  \return The packet, or NULL if this peer is not connected anymore.
+ */
+ENetPacket* STKPeer::createPacket(NetworkString *data, bool reliable,
+                                  bool encrypted)
 {
     TransportAddress a(m_enet_peer->address);
     // Enet will reuse a disconnected peer so we check here to avoid sending
     // to wrong peer
     if (m_enet_peer->state != ENET_PEER_STATE_CONNECTED ||
         a != m_peer_address)
-        return;
+        return NULL;
 
-    ENetPacket* packet = NULL;
     if (m_crypto && encrypted)
     {
-        packet = m_crypto->encryptSend(*data, reliable);
-    }
-    else
-    {
-        packet = enet_packet_create(data->getData(),
-            data->getTotalSize(), (reliable ?
-            ENET_PACKET_FLAG_RELIABLE :
-            (ENET_PACKET_FLAG_UNSEQUENCED |
-            ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT)));
+        const double start = StkTime::getRealTime();
+        ENetPacket* packet = m_crypto->encryptSend(*data, reliable);
+        m_host->updateCryptoStats(/*encrypt*/true,
+                                  StkTime::getRealTime() - start);
+        return packet;
     }
+    return enet_packet_create(data->getData(), data->getTotalSize(),
+        (reliable ? ENET_PACKET_FLAG_RELIABLE :
+        (ENET_PACKET_FLAG_UNSEQUENCED | ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT)));
+}   // createPacket
 
-    if (packet)
+//-----------------------------------------------------------------------------
+/** Queues a packet created by createPacket() to be sent by the listening
+ *  thread. Packets of one peer must be queued in the order they were
+ *  created, so that the nonce counters are sent in increasing order.
+ *  \param packet The packet to send.
+ *  \param encrypted If the packet was encrypted.
+ */
+void STKPeer::sendENetPacket(ENetPacket* packet, bool encrypted)
+{
+    if (Network::m_connection_debug)
     {
-        if (Network::m_connection_debug)
-        {
-            Log::verbose("STKPeer", "sending packet of size %d to %s at %lf",
-                packet->dataLength, a.toString().c_str(),
-                StkTime::getRealTime());
-        }
-        m_host->addEnetCommand(m_enet_peer, packet,
-                encrypted ? EVENT_CHANNEL_NORMAL : EVENT_CHANNEL_UNENCRYPTED,
-                ECT_SEND_PACKET);
+        Log::verbose("STKPeer", "sending packet of size %d to %s at %lf",
+            packet->dataLength, m_peer_address.toString().c_str(),
+            StkTime::getRealTime());
     }
-}   // sendPacket
+    m_host->addEnetCommand(m_enet_peer, packet,
+            encrypted ? EVENT_CHANNEL_NORMAL : EVENT_CHANNEL_UNENCRYPTED,
+            ECT_SEND_PACKET);
+}   // sendENetPacket
 
 //-----------------------------------------------------------------------------
 /** Returns if the peer is connected or not.
@@ -94,6 +94,10 @@ protected:
 
     std::string m_user_version;
 
+    /** Ticks of the latest game state this peer acknowledged, -1 if none
+     *  yet. Used by the server to send states as delta against it. */
+    std::atomic<int> m_last_acked_state_ticks;
+
 public:
     STKPeer(ENetPeer *enet_peer, STKHost* host, uint32_t host_id);
     // ------------------------------------------------------------------------
@@ -102,6 +106,11 @@ public:
     void sendPacket(NetworkString *data, bool reliable = true,
                     bool encrypted = true);
     // ------------------------------------------------------------------------
+    ENetPacket* createPacket(NetworkString *data, bool reliable,
+                             bool encrypted);
+    // ------------------------------------------------------------------------
+    void sendENetPacket(ENetPacket* packet, bool encrypted);
+    // ------------------------------------------------------------------------
     void disconnect();
     // ------------------------------------------------------------------------
     void kick();
@@ -197,6 +206,20 @@ public:
     void setUserVersion(const std::string& uv)         { m_user_version = uv; }
     // ------------------------------------------------------------------------
     const std::string& getUserVersion() const        { return m_user_version; }
+    // ------------------------------------------------------------------------
+    /** Updates the latest acknowledged state, acknowledgements can arrive out
+     *  of order (states are sent unreliable), so only newer ticks are kept. */
+    void setLastAckedStateTicks(int ticks)
+    {
+        int cur = m_last_acked_state_ticks.load();
+        while (ticks > cur &&
+            !m_last_acked_state_ticks.compare_exchange_weak(cur, ticks)) {}
+    }   // setLastAckedStateTicks
+    // ------------------------------------------------------------------------
+    int getLastAckedStateTicks() const
+                                    { return m_last_acked_state_ticks.load(); }
+    // ------------------------------------------------------------------------
+    void resetLastAckedStateTicks()     { m_last_acked_state_ticks.store(-1); }
 
 };   // STKPeer
 
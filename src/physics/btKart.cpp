@@ -42,7 +42,7 @@ btRigidBody& btKart::getFixedBody()
 }
 
 // ============================================================================
-btKart::btKart(btRigidBody* chassis, btVehicleRaycaster* raycaster,
+btKart::btKart(btRigidBody* chassis, btKartRaycaster* raycaster,
                Kart *kart)
       : m_vehicleRaycaster(raycaster)
 {
@@ -230,9 +230,9 @@ void btKart::updateAllWheelTransformsWS()
 
     m_num_wheels_on_ground       = 0;
     m_visual_wheels_touch_ground = true;
+    rayCastAllWheels();
     for (int i=0;i<m_wheelInfo.size();i++)
     {
-        rayCast( i);
         if(m_wheelInfo[i].m_raycastInfo.m_isInContact)
             m_num_wheels_on_ground++;
         else
@@ -248,13 +248,56 @@ void btKart::updateAllWheelTransformsWS()
     }
 }   // updateAllWheelTransformsWS
 
+// ----------------------------------------------------------------------------
+/** Casts the rays of all wheels at once, which is faster than casting each
+ *  ray individually (see btKartRaycaster::castRays).
+ */
+void btKart::rayCastAllWheels()
+{
+    // Work around a bullet problem: when using a convex hull the raycast
+    // would sometimes hit the chassis (which does not happen when using a
+    // box shape). Therefore set the collision mask in the chassis body so
+    // that it is not hit anymore.
+    short int old_group=0;
+    if(m_chassisBody->getBroadphaseHandle())
+    {
+        old_group = m_chassisBody->getBroadphaseHandle()
+                                 ->m_collisionFilterGroup;
+        m_chassisBody->getBroadphaseHandle()->m_collisionFilterGroup = 0;
+    }
+
+    const unsigned int num_wheels = m_wheelInfo.size();
+    btAssert(num_wheels <= 4);
+    btVector3 sources[4], targets[4];
+    btScalar  ray_lengths[4];
+    void*     objects[4];
+    btVehicleRaycaster::btVehicleRaycasterResult ray_results[4];
+    for (unsigned int i = 0; i < num_wheels; i++)
+    {
+        ray_lengths[i] = setupWheelRay(i, 1.0f);
+        sources[i] = m_wheelInfo[i].m_raycastInfo.m_hardPointWS;
+        targets[i] = m_wheelInfo[i].m_raycastInfo.m_contactPointWS;
+    }
+
+    btAssert(m_vehicleRaycaster);
+    m_vehicleRaycaster->castRays(num_wheels, sources, targets, ray_results,
+                                 objects);
+
+    for (unsigned int i = 0; i < num_wheels; i++)
+        updateWheelContact(i, ray_lengths[i], objects[i], ray_results[i]);
+
+    if(m_chassisBody->getBroadphaseHandle())
+    {
+        m_chassisBody->getBroadphaseHandle()->m_collisionFilterGroup
+            = old_group;
+    }
+}   // rayCastAllWheels
+
 // ----------------------------------------------------------------------------
 /**
  */
 btScalar btKart::rayCast(unsigned int index, float fraction)
 {
-    btWheelInfo &wheel = m_wheelInfo[index];
-
     // Work around a bullet problem: when using a convex hull the raycast
     // would sometimes hit the chassis (which does not happen when using a
     // box shape). Therefore set the collision mask in the chassis body so
@@ -267,6 +310,41 @@ btScalar btKart::rayCast(unsigned int index, float fraction)
         m_chassisBody->getBroadphaseHandle()->m_collisionFilterGroup = 0;
     }
 
+    btScalar raylen = setupWheelRay(index, fraction);
+
+    btWheelInfo &wheel = m_wheelInfo[index];
+    const btVector3& source = wheel.m_raycastInfo.m_hardPointWS;
+    const btVector3& target = wheel.m_raycastInfo.m_contactPointWS;
+
+    btVehicleRaycaster::btVehicleRaycasterResult rayResults;
+
+    btAssert(m_vehicleRaycaster);
+
+    void* object = m_vehicleRaycaster->castRay(source,target,rayResults);
+
+    btScalar depth = updateWheelContact(index, raylen, object, rayResults);
+
+    if(m_chassisBody->getBroadphaseHandle())
+    {
+        m_chassisBody->getBroadphaseHandle()->m_collisionFilterGroup
+            = old_group;
+    }
+
+    return depth;
+
+}   // rayCast
+
+// ----------------------------------------------------------------------------
+/** Updates the world transform of a wheel and sets its contact point to the
+ *  end of the suspension ray.
+ *  \param index Index of the wheel.
+ *  \param fraction Fraction of the chassis connection point to use (which
+ *         allows to move the wheel closer to the centre of the chassis).
+ *  \return The length of the ray to cast.
+ */
+btScalar btKart::setupWheelRay(unsigned int index, float fraction)
+{
+    btWheelInfo &wheel = m_wheelInfo[index];
     updateWheelTransformsWS(wheel, getChassisWorldTransform(), false, fraction);
 
     btScalar max_susp_len = wheel.getSuspensionRestLength()
@@ -278,18 +356,29 @@ btScalar btKart::rayCast(unsigned int index, float fraction)
     btScalar raylen = max_susp_len + 0.5f;
 
     btVector3 rayvector = wheel.m_raycastInfo.m_wheelDirectionWS * (raylen);
-    const btVector3& source = wheel.m_raycastInfo.m_hardPointWS;
-    wheel.m_raycastInfo.m_contactPointWS = source + rayvector;
-    const btVector3& target = wheel.m_raycastInfo.m_contactPointWS;
-
-    btVehicleRaycaster::btVehicleRaycasterResult rayResults;
+    wheel.m_raycastInfo.m_contactPointWS =
+        wheel.m_raycastInfo.m_hardPointWS + rayvector;
+    return raylen;
+}   // setupWheelRay
 
-    btAssert(m_vehicleRaycaster);
-
-    void* object = m_vehicleRaycaster->castRay(source,target,rayResults);
+// ----------------------------------------------------------------------------
+/** Updates the suspension and contact information of a wheel from the result
+ *  of its raycast.
+ *  \param index Index of the wheel.
+ *  \param raylen Length of the ray that was cast.
+ *  \param object The object hit by the ray, or NULL.
+ *  \param rayResults The result of the raycast.
+ *  \return The suspension depth, or -1 if the wheel is not in contact.
+ */
+btScalar btKart::updateWheelContact(unsigned int index, btScalar raylen,
+                                    void *object,
+           const btVehicleRaycaster::btVehicleRaycasterResult &rayResults)
+{
+    btWheelInfo &wheel = m_wheelInfo[index];
+    btScalar max_susp_len = wheel.getSuspensionRestLength()
+                          + wheel.m_maxSuspensionTravel;
 
     wheel.m_raycastInfo.m_groundObject = 0;
-
     btScalar depth =  raylen * rayResults.m_distFraction;
     if (object &&  depth < max_susp_len)
     {
@@ -354,15 +443,8 @@ btScalar btKart::rayCast(unsigned int index, float fraction)
         wheel.m_clippedInvContactDotSuspension = btScalar(1.0);
     }
 
-    if(m_chassisBody->getBroadphaseHandle())
-    {
-        m_chassisBody->getBroadphaseHandle()->m_collisionFilterGroup
-            = old_group;
-    }
-
     return depth;
-
-}   // rayCast
+}   // updateWheelContact
 
 // ----------------------------------------------------------------------------
 /** Returns the contact point of a visual wheel.
@@ -383,6 +465,7 @@ void btKart::getVisualContactPoint(const btTransform& chassis_trans,
                   ->m_collisionFilterGroup;
         m_chassisBody->getBroadphaseHandle()->m_collisionFilterGroup = 0;
     }
+    btVector3 sources[2], targets[2];
     for (int index = 2; index <= 3; index++)
     {
         // Map index 0-1 to wheel 2-3 (which are the rear wheels)
@@ -398,16 +481,17 @@ void btKart::getVisualContactPoint(const btTransform& chassis_trans,
         btVector3 rayvector = wheel.m_raycastInfo.m_wheelDirectionWS * (raylen);
         btVector3 pos = m_kart->getKartModel()->getWheelGraphicsPosition(index);
         pos.setZ(pos.getZ()*0.9f);
-        btVector3 source = chassis_trans(pos);
-        btVector3 target = source + rayvector;
-        btVehicleRaycaster::btVehicleRaycasterResult rayResults;
-
-        void* object = m_vehicleRaycaster->castRay(source, target, rayResults);
-        if(index == 2) *left  = rayResults.m_hitPointInWorld;
-        else           *right = rayResults.m_hitPointInWorld;
-        m_visual_wheels_touch_ground &= (object != NULL);
+        sources[index-2] = chassis_trans(pos);
+        targets[index-2] = sources[index-2] + rayvector;
     }   // for index in [2,3]
 
+    btVehicleRaycaster::btVehicleRaycasterResult rayResults[2];
+    void* objects[2];
+    m_vehicleRaycaster->castRays(2, sources, targets, rayResults, objects);
+    *left  = rayResults[0].m_hitPointInWorld;
+    *right = rayResults[1].m_hitPointInWorld;
+    m_visual_wheels_touch_ground = objects[0] != NULL && objects[1] != NULL;
+
     if (m_chassisBody->getBroadphaseHandle())
     {
         m_chassisBody->getBroadphaseHandle()->m_collisionFilterGroup = old_group;
@@ -19,23 +19,35 @@
 #include "physics/triangle_mesh.hpp"
 #include "tracks/track.hpp"
 
-void* btKartRaycaster::castRay(const btVector3& from, const btVector3& to,
-                               btVehicleRaycasterResult& result)
+namespace
 {
     // ========================================================================
     class ClosestWithNormal : public btCollisionWorld::ClosestRayResultCallback
     {
     private:
         int m_triangle_index;
+        /** An object that is not tested, or NULL. */
+        const btCollisionObject *m_ignored_object;
     public:
         /** Constructor, initialises the triangle index. */
         ClosestWithNormal(const btVector3 &from,
-                          const btVector3 &to)
+                          const btVector3 &to,
+                          const btCollisionObject *ignored_object=NULL)
                           : btCollisionWorld::ClosestRayResultCallback(from,to)
         {
             m_triangle_index = -1;
+            m_ignored_object = ignored_object;
         }   // CloestWithNormal
         // --------------------------------------------------------------------
+        /** Skips the ignored object. */
+        virtual bool needsCollision(btBroadphaseProxy* proxy) const
+        {
+            if(m_ignored_object && proxy->m_clientObject == m_ignored_object)
+                return false;
+            return btCollisionWorld::ClosestRayResultCallback
+                                   ::needsCollision(proxy);
+        }   // needsCollision
+        // --------------------------------------------------------------------
         /** Stores the index of the triangle hit. */
         virtual    btScalar addSingleResult(btCollisionWorld::LocalRayResult& rayResult,
                                          bool normalInWorldSpace)
@@ -55,55 +67,145 @@ void* btKartRaycaster::castRay(const btVector3& from, const btVector3& to,
         int getTriangleIndex() const { return m_triangle_index; }
 
     };   // CloestWithNormal
-    // ========================================================================
 
-    ClosestWithNormal rayCallback(from,to);
-
-    m_dynamicsWorld->rayTest(from, to, rayCallback);
-
-    if (rayCallback.hasHit())
+    // ------------------------------------------------------------------------
+    /** Converts the hit of a ray into the vehicle raycaster result.
+     *  \param ray_callback The callback of the ray, which must have a hit.
+     *  \param smooth_normals If the normal should be smoothed.
+     *  \param result On return the raycaster result.
+     *  \return The body that was hit, or NULL if the body has no contact
+     *          response.
+     */
+    void* getRayResult(const ClosestWithNormal &rayCallback,
+                       bool smooth_normals,
+                       btVehicleRaycaster::btVehicleRaycasterResult &result)
     {
-        btRigidBody* body = btRigidBody::upcast(rayCallback.m_collisionObject);
-        if (body && body->hasContactResponse())
+        const btRigidBody* body =
+            btRigidBody::upcast(rayCallback.m_collisionObject);
+        if (!body || !body->hasContactResponse())
+            return 0;
+
+        result.m_hitPointInWorld = rayCallback.m_hitPointWorld;
+        result.m_hitNormalInWorld = rayCallback.m_hitNormalWorld;
+        result.m_hitNormalInWorld.normalize();
+        result.m_distFraction = rayCallback.m_closestHitFraction;
+        result.m_triangle_index = -1;
+        // FIXME: this code assumes atm that the object the kart is
+        // driving on is the main track (and not e.g. a physical object).
+        // If this should not be the case (i.e. the object hit by the
+        // raycast is not the object of the main track mesh, don't smooth
+        // the normals (since the index of the triangle is meant for a
+        // different triangle mesh). TODO: Add a mapping from bullet
+        // objects back to triangle meshes, so that it's easy to pick up
+        // the right triangle mesh for smoothing
+        const TriangleMesh::RigidBodyTriangleMesh *rbtm =
+            dynamic_cast<const TriangleMesh::RigidBodyTriangleMesh*>(body);
+        if(smooth_normals &&
+            rayCallback.getTriangleIndex()>-1 &&
+            rbtm != NULL                         )
         {
-            result.m_hitPointInWorld = rayCallback.m_hitPointWorld;
-            result.m_hitNormalInWorld = rayCallback.m_hitNormalWorld;
-            result.m_hitNormalInWorld.normalize();
-            result.m_distFraction = rayCallback.m_closestHitFraction;
-            result.m_triangle_index = -1;
-            // FIXME: this code assumes atm that the object the kart is
-            // driving on is the main track (and not e.g. a physical object).
-            // If this should not be the case (i.e. the object hit by the
-            // raycast is not the object of the main track mesh, don't smooth
-            // the normals (since the index of the triangle is meant for a
-            // different triangle mesh). TODO: Add a mapping from bullet
-            // objects back to triangle meshes, so that it's easy to pick up
-            // the right triangle mesh for smoothing
-            TriangleMesh::RigidBodyTriangleMesh *rbtm =
-                dynamic_cast<TriangleMesh::RigidBodyTriangleMesh*>(body);
-            if(m_smooth_normals &&
-                rayCallback.getTriangleIndex()>-1 &&
-                rbtm != NULL                         )
-            {
 #undef DEBUG_NORMALS
 #ifdef DEBUG_NORMALS
-                btVector3 n=result.m_hitNormalInWorld;
+            btVector3 n=result.m_hitNormalInWorld;
 #endif
-                result.m_triangle_index = rayCallback.getTriangleIndex();
-                result.m_hitNormalInWorld =
-                    rbtm->m_triangle_mesh->getInterpolatedNormal(rayCallback.getTriangleIndex(),
-                                             result.m_hitPointInWorld);
+            result.m_triangle_index = rayCallback.getTriangleIndex();
+            result.m_hitNormalInWorld =
+                rbtm->m_triangle_mesh->getInterpolatedNormal(rayCallback.getTriangleIndex(),
+                                         result.m_hitPointInWorld);
 #ifdef DEBUG_NORMALS
-                printf("old %f %f %f new %f %f %f\n",
-                    n.getX(), n.getY(), n.getZ(),
-                    result.m_hitNormalInWorld.getX(),
-                    result.m_hitNormalInWorld.getY(),
-                    result.m_hitNormalInWorld.getZ());
+            printf("old %f %f %f new %f %f %f\n",
+                n.getX(), n.getY(), n.getZ(),
+                result.m_hitNormalInWorld.getX(),
+                result.m_hitNormalInWorld.getY(),
+                result.m_hitNormalInWorld.getZ());
 #endif
-            }
-            return body;
         }
-    }
+        return const_cast<btRigidBody*>(body);
+    }   // getRayResult
+}   // namespace
+
+// ----------------------------------------------------------------------------
+void* btKartRaycaster::castRay(const btVector3& from, const btVector3& to,
+                               btVehicleRaycasterResult& result)
+{
+    ClosestWithNormal rayCallback(from,to);
+
+    m_dynamicsWorld->rayTest(from, to, rayCallback);
+
+    if (rayCallback.hasHit())
+        return getRayResult(rayCallback, m_smooth_normals, result);
     return 0;
-}
+}   // castRay
+
+// ----------------------------------------------------------------------------
+/** Casts a set of rays that are close to each other (e.g. the rays of the
+ *  wheels of a kart). The result of each ray is identical to castRay(), but
+ *  the main track mesh is tested for all rays at once, and then excluded
+ *  from the test against the rest of the world (which only needs to find
+ *  objects closer than the track).
+ *  \param count Number of rays.
+ *  \param from, to Start and end point of each ray.
+ *  \param results On return the raycaster result of each ray.
+ *  \param objects On return the object hit by each ray, or NULL.
+ */
+void btKartRaycaster::castRays(unsigned int count, const btVector3 *from,
+                               const btVector3 *to,
+                               btVehicleRaycasterResult *results,
+                               void **objects)
+{
+    Track *track = Track::getCurrentTrack();
+    TriangleMesh *tm = track ? track->getPtrTriangleMesh() : NULL;
+    btRigidBody *track_body = tm ? tm->getBody() : NULL;
+    if (!track_body)
+    {
+        for (unsigned int i = 0; i < count; i++)
+            objects[i] = castRay(from[i], to[i], results[i]);
+        return;
+    }
 
+    const unsigned int MAX_RAYS = 8;
+    if (count > MAX_RAYS)
+    {
+        castRays(MAX_RAYS, from, to, results, objects);
+        castRays(count - MAX_RAYS, from + MAX_RAYS, to + MAX_RAYS,
+                 results + MAX_RAYS, objects + MAX_RAYS);
+        return;
+    }
+
+    TriangleMesh::Ray    rays[MAX_RAYS];
+    TriangleMesh::RayHit hits[MAX_RAYS];
+    for (unsigned int i = 0; i < count; i++)
+    {
+        rays[i].m_from = from[i];
+        rays[i].m_to   = to[i];
+    }
+    tm->castRays(rays, hits, count, /*interpolate_normal*/m_smooth_normals);
+
+    for (unsigned int i = 0; i < count; i++)
+    {
+        const TriangleMesh::RayHit &hit = hits[i];
+        ClosestWithNormal rayCallback(from[i], to[i], track_body);
+        // Only objects closer than the track can change the result
+        if (hit.hasHit())
+            rayCallback.m_closestHitFraction = hit.m_fraction;
+        m_dynamicsWorld->rayTest(from[i], to[i], rayCallback);
+
+        if (rayCallback.hasHit())
+        {
+            objects[i] = getRayResult(rayCallback, m_smooth_normals,
+                                      results[i]);
+        }
+        else if (hit.hasHit() && track_body->hasContactResponse())
+        {
+            btVehicleRaycasterResult &result = results[i];
+            result.m_hitPointInWorld  = hit.m_xyz;
+            result.m_hitNormalInWorld = hit.m_normal;
+            result.m_distFraction     = hit.m_fraction;
+            result.m_triangle_index   = m_smooth_normals
+                                      ? hit.m_triangle_index : -1;
+            objects[i] = track_body;
+        }
+        else
+            objects[i] = 0;
+    }
+}   // castRays
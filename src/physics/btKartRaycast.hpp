@@ -35,6 +35,10 @@ public:
 
     virtual void* castRay(const btVector3& from,const btVector3& to,
                           btVehicleRaycasterResult& result);
+    void          castRays(unsigned int count, const btVector3 *from,
+                           const btVector3 *to,
+                           btVehicleRaycasterResult *results,
+                           void **objects);
 
 };
 
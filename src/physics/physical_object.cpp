@@ -164,12 +164,24 @@ PhysicalObject::PhysicalObject(bool is_dynamic,
     m_reset_height       = settings.m_reset_height;
     m_on_kart_collision  = settings.m_on_kart_collision;
     m_on_item_collision  = settings.m_on_item_collision;
+    if (!m_on_kart_collision.empty())
+    {
+        m_on_kart_collision_script = Scripting::ScriptFunction("void " +
+            m_on_kart_collision + "(int, const string, const string)");
+    }
+    if (!m_on_item_collision.empty())
+    {
+        m_on_item_collision_script = Scripting::ScriptFunction("void " +
+            m_on_item_collision + "(int, int, const string)");
+    }
     m_current_transform.setOrigin(Vec3());
     m_current_transform.setRotation(
         btQuaternion(0.0f, 0.0f, 0.0f, 1.0f));
 
     m_last_transform = m_current_transform;
     m_no_server_state = false;
+    m_updated_while_sleeping = false;
+    m_graphics_updated_while_sleeping = false;
 
     m_body_added = false;
 
@@ -605,6 +617,9 @@ void PhysicalObject::updateGraphics(float dt)
     if (!m_is_dynamic)
         return;
 
+    // Without smoothing the graphical position only depends on the body
+    m_graphics_updated_while_sleeping = isSleeping() &&
+                                        !isSmoothingEnabled();
     SmoothNetworkBody::updateSmoothedGraphics(m_body->getWorldTransform(),
         m_body->getLinearVelocity(), dt);
     Vec3 xyz = SmoothNetworkBody::getSmoothedTrans().getOrigin();
@@ -631,6 +646,7 @@ void PhysicalObject::update(float dt)
     if (!m_is_dynamic) return;
 
     m_current_transform = m_body->getWorldTransform();
+    m_updated_while_sleeping = isSleeping();
 
     const Vec3 &xyz = m_current_transform.getOrigin();
     if(m_reset_when_too_low && xyz.getY()<m_reset_height)
@@ -638,6 +654,8 @@ void PhysicalObject::update(float dt)
         m_body->setCenterOfMassTransform(m_init_pos);
         m_body->setLinearVelocity (btVector3(0,0,0));
         m_body->setAngularVelocity(btVector3(0,0,0));
+        m_updated_while_sleeping = false;
+        m_graphics_updated_while_sleeping = false;
     }
 
 }   // update
@@ -801,7 +819,7 @@ void PhysicalObject::computeError()
 }   // computeError
 
 // ----------------------------------------------------------------------------
-BareNetworkString* PhysicalObject::saveState(std::vector<std::string>* ru)
+BareNetworkString* PhysicalObject::saveState(std::vector<uint16_t>* ru)
 {
     btTransform cur_transform = m_body->getWorldTransform();
     if ((cur_transform.getOrigin() - m_last_transform.getOrigin())
@@ -810,7 +828,7 @@ BareNetworkString* PhysicalObject::saveState(std::vector<std::string>* ru)
         (m_body->getLinearVelocity() - m_last_av).length() < 0.01f)
         return nullptr;
 
-    ru->push_back(getUniqueIdentity());
+    ru->push_back(getRewinderId());
     BareNetworkString *buffer = new BareNetworkString();
     m_last_transform = cur_transform;
     m_last_lv = m_body->getLinearVelocity();
@@ -26,6 +26,7 @@
 #include "network/rewinder.hpp"
 #include "network/smooth_network_body.hpp"
 #include "physics/user_pointer.hpp"
+#include "scriptengine/script_function.hpp"
 #include "utils/vec3.hpp"
 #include "utils/leak_check.hpp"
 
@@ -180,6 +181,9 @@ private:
     * when a (flyable) item collides with this object
     */
     std::string           m_on_item_collision;
+    /** The script functions called on collisions, resolved only once. */
+    Scripting::ScriptFunction m_on_kart_collision_script;
+    Scripting::ScriptFunction m_on_item_collision_script;
     /** If this body is a bullet dynamic body, i.e. affected by physics
      *  or not (static (not moving) or kinematic (animated outside
      *  of physics). */
@@ -193,6 +197,14 @@ private:
     Vec3                  m_last_av;
     bool                  m_no_server_state;
 
+    /** True if update() was called after the body fell asleep. Bullet does
+     *  not move a sleeping body, so further updates can be skipped until
+     *  the body is woken up again. */
+    bool                  m_updated_while_sleeping;
+
+    /** True if updateGraphics() was called after the body fell asleep. */
+    bool                  m_graphics_updated_while_sleeping;
+
 public:
                     PhysicalObject(bool is_dynamic, const Settings& settings,
                                    TrackObject* object);
@@ -217,6 +229,27 @@ public:
     // ------------------------------------------------------------------------
     bool isDynamic() const { return m_is_dynamic; }
     // ------------------------------------------------------------------------
+    /** Returns true if the body is asleep, i.e. bullet does not move it
+     *  until it is woken up by a collision, an explosion or a reset. */
+    bool isSleeping() const
+    {
+        return m_body->getActivationState() == ISLAND_SLEEPING;
+    }   // isSleeping
+    // ------------------------------------------------------------------------
+    /** Returns true if update() would not change anything, since the body
+     *  did not move since the last call. */
+    bool canSkipUpdate() const
+    {
+        return !m_is_dynamic || (m_updated_while_sleeping && isSleeping());
+    }   // canSkipUpdate
+    // ------------------------------------------------------------------------
+    /** Returns true if updateGraphics() would not change anything. */
+    bool canSkipUpdateGraphics() const
+    {
+        return !m_is_dynamic ||
+               (m_graphics_updated_while_sleeping && isSleeping());
+    }   // canSkipUpdateGraphics
+    // ------------------------------------------------------------------------
     /** Returns the ID of this physical object. */
     std::string getID()          { return m_id; }
     // ------------------------------------------------------------------------
@@ -247,6 +280,12 @@ public:
     // ------------------------------------------------------------------------
     const std::string& getOnItemCollisionFunction() const { return m_on_item_collision; }
     // ------------------------------------------------------------------------
+    Scripting::ScriptFunction& getOnKartCollisionScript()
+                                         { return m_on_kart_collision_script; }
+    // ------------------------------------------------------------------------
+    Scripting::ScriptFunction& getOnItemCollisionScript()
+                                         { return m_on_item_collision_script; }
+    // ------------------------------------------------------------------------
     TrackObject* getTrackObject() { return m_object; }
 
     // Methods usable by scripts
@@ -280,7 +319,7 @@ public:
     void addForRewind();
     virtual void saveTransform();
     virtual void computeError();
-    virtual BareNetworkString* saveState(std::vector<std::string>* ru);
+    virtual BareNetworkString* saveState(std::vector<uint16_t>* ru);
     virtual void undoEvent(BareNetworkString *buffer) {}
     virtual void rewindToEvent(BareNetworkString *buffer) {}
     virtual void restoreState(BareNetworkString *buffer, int count);
@@ -49,6 +49,8 @@
  *  Create the bullet dynamics world.
  */
 Physics::Physics() : btSequentialImpulseConstraintSolver()
+                   , m_kart_kart_collision_script(
+                                          "void onKartKartCollision(int, int)")
 {
     m_collision_conf      = new btDefaultCollisionConfiguration();
     m_dispatcher          = new btCollisionDispatcher(m_collision_conf);
@@ -196,7 +198,7 @@ void Physics::update(int ticks)
                                             Scripting::ScriptEngine::getInstance();
             int kartid1 = p->getUserPointer(0)->getPointerKart()->getWorldKartId();
             int kartid2 = p->getUserPointer(1)->getPointerKart()->getWorldKartId();
-            script_engine->runFunction(false, "void onKartKartCollision(int, int)",
+            script_engine->runFunction(false, m_kart_kart_collision_script,
                 [=](asIScriptContext* ctx) {
                     ctx->SetArgDWord(0, kartid1);
                     ctx->SetArgDWord(1, kartid2);
@@ -213,7 +215,8 @@ void Physics::update(int ticks)
             int kartId = kart->getWorldKartId();
             PhysicalObject* obj = p->getUserPointer(0)->getPointerPhysicalObject();
             std::string obj_id = obj->getID();
-            std::string scripting_function = obj->getOnKartCollisionFunction();
+            Scripting::ScriptFunction& scripting_function =
+                obj->getOnKartCollisionScript();
 
             TrackObject* to = obj->getTrackObject();
             TrackObject* library = to->getParentLibrary();
@@ -223,9 +226,9 @@ void Physics::update(int ticks)
                 lib_id = library->getID();
             lib_id_ptr = &lib_id;
 
-            if (scripting_function.size() > 0)
+            if (!scripting_function.empty())
             {
-                script_engine->runFunction(true, "void " + scripting_function + "(int, const string, const string)",
+                script_engine->runFunction(true, scripting_function,
                     [&](asIScriptContext* ctx) {
                         ctx->SetArgDWord(0, kartId);
                         ctx->SetArgObject(1, lib_id_ptr);
@@ -315,10 +318,11 @@ void Physics::update(int ticks)
             Flyable* flyable = p->getUserPointer(0)->getPointerFlyable();
             PhysicalObject* obj = p->getUserPointer(1)->getPointerPhysicalObject();
             std::string obj_id = obj->getID();
-            std::string scripting_function = obj->getOnItemCollisionFunction();
-            if (scripting_function.size() > 0)
+            Scripting::ScriptFunction& scripting_function =
+                obj->getOnItemCollisionScript();
+            if (!scripting_function.empty())
             {
-                script_engine->runFunction(true, "void " + scripting_function + "(int, int, const string)",
+                script_engine->runFunction(true, scripting_function,
                         [&](asIScriptContext* ctx) {
                         ctx->SetArgDWord(0, (int)flyable->getType());
                         ctx->SetArgDWord(1, flyable->getOwnerId());
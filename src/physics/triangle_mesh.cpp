@@ -19,13 +19,22 @@
 #include "physics/triangle_mesh.hpp"
 
 #include "config/stk_config.hpp"
+#include "io/file_manager.hpp"
 #include "physics/physics.hpp"
 #include "utils/constants.hpp"
 #include "utils/time.hpp"
 
 #include "btBulletDynamicsCommon.h"
+#include "BulletCollision/NarrowPhaseCollision/btRaycastCallback.h"
+#include "LinearMath/btAabbUtil2.h"
 
 #include <fstream>
+#include <iomanip>
+#include <sstream>
+
+/** Version of the BVH cache files, must be increased if the format or
+ *  the way the BVH is built changes. */
+static const uint32_t BVH_CACHE_VERSION = 1;
 
 // -----------------------------------------------------------------------------
 /** Constructor: Initialises all data structures with zero.
@@ -43,6 +52,8 @@ TriangleMesh::TriangleMesh(bool can_be_transformed) : m_mesh()
     // (and m_mesh->m_weldingThreshold at m_normals
     m_collision_shape  = NULL;
     m_collision_object = NULL;
+    m_bvh_buffer       = NULL;
+    m_bvh_from_cache   = false;
     m_user_pointer.set(this);
 }   // TriangleMesh
 
@@ -85,14 +96,131 @@ void TriangleMesh::addTriangle(const btVector3 &t1, const btVector3 &t2,
     m_p1p2p3.push_back(edge1.cross(edge2).length2());
 }   // addTriangle
 
+// -----------------------------------------------------------------------------
+/** Returns a hash of all vertices and indices of this mesh, which is used to
+ *  detect if a cached BVH matches this mesh.
+ */
+uint64_t TriangleMesh::getMeshHash() const
+{
+    uint64_t hash = 14695981039346656037ULL;
+    const IndexedMeshArray &all_meshes =
+        const_cast<btTriangleMesh&>(m_mesh).getIndexedMeshArray();
+    for (int i = 0; i < all_meshes.size(); i++)
+    {
+        const btIndexedMesh &mesh = all_meshes[i];
+        const size_t vertex_bytes = size_t(mesh.m_numVertices) *
+                                    mesh.m_vertexStride;
+        const size_t index_bytes  = size_t(mesh.m_numTriangles) *
+                                    mesh.m_triangleIndexStride;
+        // The data consists of 32 bit floats and integers
+        const uint32_t *data = (const uint32_t*)mesh.m_vertexBase;
+        for (size_t j = 0; j < vertex_bytes / 4; j++)
+        {
+            hash ^= data[j];
+            hash *= 1099511628211ULL;
+        }
+        data = (const uint32_t*)mesh.m_triangleIndexBase;
+        for (size_t j = 0; j < index_bytes / 4; j++)
+        {
+            hash ^= data[j];
+            hash *= 1099511628211ULL;
+        }
+    }
+    return hash;
+}   // getMeshHash
+
+// -----------------------------------------------------------------------------
+/** Returns the name of the file to cache the BVH of this mesh in. It depends
+ *  on the content of the mesh, so a modified track will use a new file.
+ *  \param name Prefix for the file name (e.g. the track name).
+ */
+std::string TriangleMesh::getBvhCacheFile(const std::string &name) const
+{
+    std::ostringstream file;
+    file << file_manager->getCachedDataDir() << "bvh-" << name << "-"
+         << std::hex << std::setw(16) << std::setfill('0') << getMeshHash()
+         << ".bin";
+    return file.str();
+}   // getBvhCacheFile
+
+// -----------------------------------------------------------------------------
+/** Loads a serialized BVH from a cache file.
+ *  \param cache_file Name of the cache file.
+ *  \return The BVH, or NULL if the file does not exist or does not match
+ *          this mesh or this version of bullet.
+ */
+btOptimizedBvh* TriangleMesh::loadBvh(const std::string &cache_file)
+{
+    FILE *f = fopen(cache_file.c_str(), "rb");
+    if (!f) return NULL;
+
+    // Version, bullet version, size of btScalar, number of triangles, size
+    uint32_t header[5];
+    bool ok = fread(header, sizeof(uint32_t), 5, f) == 5 &&
+              header[0] == BVH_CACHE_VERSION &&
+              header[1] == BT_BULLET_VERSION &&
+              header[2] == sizeof(btScalar) &&
+              header[3] == (uint32_t)m_mesh.getNumTriangles();
+    btOptimizedBvh *bvh = NULL;
+    if (ok)
+    {
+        // The BVH is created in place, so it needs an aligned buffer
+        m_bvh_buffer = btAlignedAlloc(header[4], 16);
+        ok = fread(m_bvh_buffer, 1, header[4], f) == header[4] &&
+             fgetc(f) == EOF;
+        if (ok)
+        {
+            // The cache is only used on this machine, so no endian swap
+            bvh = btOptimizedBvh::deSerializeInPlace(m_bvh_buffer, header[4],
+                                                     /*swap_endian*/false);
+        }
+    }
+    fclose(f);
+    if (!bvh)
+    {
+        Log::warn("TriangleMesh", "Ignoring invalid BVH cache file '%s'.",
+                  cache_file.c_str());
+        if (m_bvh_buffer)
+            btAlignedFree(m_bvh_buffer);
+        m_bvh_buffer = NULL;
+    }
+    return bvh;
+}   // loadBvh
+
+// -----------------------------------------------------------------------------
+/** Saves a BVH to a cache file.
+ *  \param cache_file Name of the cache file.
+ *  \param bvh The BVH to save.
+ */
+void TriangleMesh::saveBvh(const std::string &cache_file,
+                           const btOptimizedBvh *bvh) const
+{
+    const unsigned int size = bvh->calculateSerializeBufferSize();
+    const uint32_t header[5] = { BVH_CACHE_VERSION, BT_BULLET_VERSION,
+                                 (uint32_t)sizeof(btScalar),
+                                 (uint32_t)m_mesh.getNumTriangles(), size };
+    std::string data((const char*)header, sizeof(header));
+    // The serialized BVH must be aligned, so it is copied into the string
+    void *buffer = btAlignedAlloc(size, 16);
+    if (bvh->serializeInPlace(buffer, size, /*swap_endian*/false))
+    {
+        data.append((const char*)buffer, size);
+        file_manager->writeCacheFileAtomically(cache_file, data);
+    }
+    btAlignedFree(buffer);
+}   // saveBvh
+
 // -----------------------------------------------------------------------------
 /** Creates a collision body only, which can be used for raycasting, but
  *  has no physical properties.
- *  @param serialized_bhv if non-null, load the serialized bhv from file instead
- *                        of builing it on the fly
+ *  \param bvh_cache_name If non-NULL, the BVH is loaded from a cache file
+ *         whose name starts with this name. If there is no matching cache
+ *         file, the BVH is built and saved in the cache.
  */
-void TriangleMesh::createCollisionShape(bool create_collision_object, const char* serialized_bhv)
+void TriangleMesh::createCollisionShape(bool create_collision_object,
+                                        const char* bvh_cache_name)
 {
+    m_bvh_from_cache = false;
     if(m_triangleIndex2Material.size()==0)
     {
         m_collision_shape  = NULL;
@@ -104,53 +232,26 @@ void TriangleMesh::createCollisionShape(bool create_collision_object, const char
     // Now convert the triangle mesh into a static rigid body
     btBvhTriangleMeshShape* bhv_triangle_mesh;
 
-    if (serialized_bhv != NULL)
+    std::string cache_file;
+    btOptimizedBvh* bvh = NULL;
+    if (bvh_cache_name != NULL)
     {
-        FILE *f = fopen(serialized_bhv, "rb");
-        fseek(f, 0, SEEK_END);
-        long pos = ftell(f);
-        assert(pos != -1L);
-        fseek(f, 0, SEEK_SET);
-
-        void* bytes = btAlignedAlloc(pos, 16);
-        fread(bytes, pos, 1, f);
-        fclose(f);
-
-        btOptimizedBvh* bhv = btOptimizedBvh::deSerializeInPlace(bytes, pos, !IS_LITTLE_ENDIAN);
-        if (bhv == NULL)
-        {
-            Log::warn("TriangleMesh", "Failed to load serialized BHV");
-            bhv_triangle_mesh = new btBvhTriangleMeshShape(&m_mesh, false /* useQuantizedAabbCompression */);
-        }
-        else
-        {
-            bhv_triangle_mesh = new btBvhTriangleMeshShape(&m_mesh, false /* useQuantizedAabbCompression */,
-                                                           false /* buildBvh */);
-            bhv_triangle_mesh->setOptimizedBvh( bhv );
-        }
-        // Do *NOT* free the bytes, 'deSerializeInPlace' makes the btOptimizedBvh object
-        // directly at this memory location
-        //free(bytes);
+        cache_file = getBvhCacheFile(bvh_cache_name);
+        bvh = loadBvh(cache_file);
+    }
 
+    if (bvh)
+    {
+        bhv_triangle_mesh = new btBvhTriangleMeshShape(&m_mesh, false /* useQuantizedAabbCompression */,
+                                                       false /* buildBvh */);
+        bhv_triangle_mesh->setOptimizedBvh(bvh);
+        m_bvh_from_cache = true;
     }
     else
     {
         bhv_triangle_mesh = new btBvhTriangleMeshShape(&m_mesh, false /* useQuantizedAabbCompression */);
-
-        /*
-         // code to serialize triangle mesh
-        btOptimizedBvh* bvh = bhv_triangle_mesh->getOptimizedBvh();
-        unsigned int ssize = bvh->calculateSerializeBufferSize();
-        char* buffer = (char*)btAlignedAlloc(ssize, 16);
-        bool success = bvh->serialize(buffer, ssize, !IS_LITTLE_ENDIAN);
-        printf("serialization success = %i\n", success);
-
-        std::ofstream fileout("/tmp/btOptimizedBvh");
-        fileout.write(buffer, ssize);
-        fileout.close();
-
-        btAlignedFree(buffer);
-         */
+        if (!cache_file.empty())
+            saveBvh(cache_file, bhv_triangle_mesh->getOptimizedBvh());
     }
 
     m_collision_shape = bhv_triangle_mesh;
@@ -177,16 +278,16 @@ void TriangleMesh::createCollisionShape(bool create_collision_object, const char
  *  for height of terrain detection).
  *  \param friction Friction to be used for this TriangleMesh.
  *  \param flags Additional collision flags (default 0).
- *  \param serializedBhv if non-NULL, the bhv is deserialized instead of
- *                       being calculated on the fly
+ *  \param bvh_cache_name If non-NULL, the BVH is cached in a file whose
+ *         name starts with this name, see createCollisionShape().
  */
 void TriangleMesh::createPhysicalBody(float friction,
                                       btCollisionObject::CollisionFlags flags,
-                                      const char* serializedBhv)
+                                      const char* bvh_cache_name)
 {
     // We need the collision shape, but not the collision object (since
     // this will be created when the dynamics body is anyway).
-    createCollisionShape(/*create_collision_object*/false, serializedBhv);
+    createCollisionShape(/*create_collision_object*/false, bvh_cache_name);
     btTransform startTransform;
     startTransform.setIdentity();
     m_motion_state = new btDefaultMotionState(startTransform);
@@ -229,6 +330,13 @@ void TriangleMesh::removeAll()
     }
     delete m_collision_shape;
     m_collision_shape = NULL;
+    // A BVH loaded from the cache is not owned by the collision shape
+    if (m_bvh_buffer)
+    {
+        ((btOptimizedBvh*)m_bvh_buffer)->~btOptimizedBvh();
+        btAlignedFree(m_bvh_buffer);
+        m_bvh_buffer = NULL;
+    }
 }   // removeAll
 
 // -----------------------------------------------------------------------------
@@ -318,19 +426,156 @@ bool TriangleMesh::castRay(const btVector3 &from, const btVector3 &to,
                            btVector3 *xyz, const Material **material,
                            btVector3 *normal, bool interpolate_normal) const
 {
-    if(!m_collision_shape)
+    Ray ray;
+    ray.m_from = from;
+    ray.m_to   = to;
+    RayHit hit;
+    castRays(&ray, &hit, 1, normal && interpolate_normal);
+    if(hit.hasHit())
     {
-        *material=NULL;
-        return false;
+        *xyz      = hit.m_xyz;
+        *material = hit.m_material;
+        if(normal)
+        {
+            *normal = hit.m_normal;
+            normal->normalize();
+        }
     }
+    else
+    {
+        *material = NULL;
+        if(normal)
+            normal->setValue(0, 1, 0);
+    }
+    return hit.hasHit();
+}   // castRay
 
-    btTransform trans_from;
-    trans_from.setIdentity();
-    trans_from.setOrigin(from);
+// ----------------------------------------------------------------------------
+namespace
+{
+    /** Keeps the closest hit of one ray of a batched raycast. Additionally
+     *  it stores the bounding box of the part of the ray that can still
+     *  result in a closer hit, so that most triangles can be rejected
+     *  without a ray/triangle intersection test. */
+    class BatchedRayCallback : public btTriangleRaycastCallback
+    {
+    public:
+        /** Index of the closest triangle hit so far, or -1. */
+        int       m_triangle_index;
+        /** The normal (in local coordinates) of the closest hit. */
+        btVector3 m_normal;
+        btVector3 m_aabb_min, m_aabb_max;
+        // --------------------------------------------------------------------
+        BatchedRayCallback()
+                         : btTriangleRaycastCallback(btVector3(0, 0, 0),
+                                                     btVector3(0, 0, 0))
+        {
+            m_triangle_index = -1;
+        }   // BatchedRayCallback
+        // --------------------------------------------------------------------
+        /** Sets the ray to cast (in the local coordinates of the mesh). */
+        void init(const btVector3 &from, const btVector3 &to)
+        {
+            m_from           = from;
+            m_to             = to;
+            m_hitFraction    = 1.0f;
+            m_triangle_index = -1;
+            m_aabb_min = from;
+            m_aabb_min.setMin(to);
+            m_aabb_max = from;
+            m_aabb_max.setMax(to);
+        }   // init
+        // --------------------------------------------------------------------
+        virtual btScalar reportHit(const btVector3 &normal,
+                                   btScalar fraction, int part, int index)
+        {
+            m_triangle_index = index;
+            m_normal         = normal;
+            btVector3 hit(0, 0, 0);
+            hit.setInterpolate3(m_from, m_to, fraction);
+            m_aabb_min = m_from;
+            m_aabb_min.setMin(hit);
+            m_aabb_max = m_from;
+            m_aabb_max.setMax(hit);
+            return fraction;
+        }   // reportHit
+    };   // BatchedRayCallback
+
+    // ========================================================================
+    /** Passes each triangle found in the BVH to all rays of the batch whose
+     *  bounding box overlaps the triangle. */
+    class BatchedTriangleCallback : public btTriangleCallback
+    {
+    private:
+        BatchedRayCallback *m_rays;
+        unsigned int        m_count;
+    public:
+        BatchedTriangleCallback(BatchedRayCallback *rays, unsigned int count)
+        {
+            m_rays  = rays;
+            m_count = count;
+        }   // BatchedTriangleCallback
+        // --------------------------------------------------------------------
+        virtual void processTriangle(btVector3 *triangle, int part, int index)
+        {
+            btVector3 tri_min = triangle[0], tri_max = triangle[0];
+            tri_min.setMin(triangle[1]);
+            tri_max.setMax(triangle[1]);
+            tri_min.setMin(triangle[2]);
+            tri_max.setMax(triangle[2]);
+            for(unsigned int i = 0; i < m_count; i++)
+            {
+                BatchedRayCallback &ray = m_rays[i];
+                if(TestAabbAgainstAabb2(tri_min, tri_max,
+                                        ray.m_aabb_min, ray.m_aabb_max))
+                    ray.processTriangle(triangle, part, index);
+            }
+        }   // processTriangle
+    };   // BatchedTriangleCallback
+}   // namespace
+
+// ----------------------------------------------------------------------------
+/** Casts a set of rays against this mesh. The BVH of the mesh is only
+ *  traversed once for all rays (using the bounding box of all rays), so
+ *  this is intended for rays that are close to each other, e.g. the rays
+ *  of the wheels of a kart. The result of each ray is identical to the
+ *  result of castRay(), except that an interpolated normal is not
+ *  normalized (which is what the kart raycaster uses).
+ *  \param rays The rays to cast.
+ *  \param hits On return the result for each ray.
+ *  \param count Number of rays.
+ *  \param interpolate_normal If true, the returned normals are interpolated
+ *         based on the three normals of the triangle that was hit.
+ *  \return Number of rays that hit a triangle.
+ */
+unsigned int TriangleMesh::castRays(const Ray *rays, RayHit *hits,
+                                    unsigned int count,
+                                    bool interpolate_normal) const
+{
+    // Larger sets of rays are split, which avoids allocating memory for
+    // the callbacks.
+    const unsigned int MAX_BATCH_SIZE = 8;
+    if(count > MAX_BATCH_SIZE)
+    {
+        unsigned int num_hits = castRays(rays, hits, MAX_BATCH_SIZE,
+                                         interpolate_normal);
+        return num_hits + castRays(rays + MAX_BATCH_SIZE,
+                                   hits + MAX_BATCH_SIZE,
+                                   count - MAX_BATCH_SIZE,
+                                   interpolate_normal);
+    }
 
-    btTransform trans_to;
-    trans_to.setIdentity();
-    trans_to.setOrigin(to);
+    for(unsigned int i = 0; i < count; i++)
+    {
+        hits[i].m_material       = NULL;
+        hits[i].m_triangle_index = -1;
+        hits[i].m_fraction       = 1.0f;
+    }
+    if(!m_collision_shape || count == 0)
+        return 0;
+    assert(m_collision_shape->getShapeType()==TRIANGLE_MESH_SHAPE_PROXYTYPE);
+    const btBvhTriangleMeshShape *shape =
+        static_cast<const btBvhTriangleMeshShape*>(m_collision_shape);
 
     btTransform world_trans;
     // If there is a body, take the current transform from the body.
@@ -338,69 +583,70 @@ bool TriangleMesh::castRay(const btVector3 &from, const btVector3 &to,
         world_trans = m_body->getWorldTransform();
     else
         world_trans.setIdentity();
+    const btTransform world_to_local = world_trans.inverse();
 
-    btCollisionWorld::ClosestRayResultCallback result(from, to);
-
-    /** A special ray result class that stores the index of the triangle
-     *  that was hit. */
-    class MaterialRayResult : public btCollisionWorld::ClosestRayResultCallback
+    BatchedRayCallback callbacks[MAX_BATCH_SIZE];
+    btVector3 aabb_min, aabb_max;
+    for(unsigned int i = 0; i < count; i++)
     {
-    public:
-        /** Stores the index of the triangle that was hit. */
-        int m_index;
-        // --------------------------------------------------------------------
-        MaterialRayResult(const btVector3 &p1, const btVector3 &p2,
-                          const TriangleMesh *me)
-                        : btCollisionWorld::ClosestRayResultCallback(p1,p2)
+        callbacks[i].init(world_to_local*rays[i].m_from,
+                          world_to_local*rays[i].m_to);
+        if(i == 0)
         {
-            m_index = -1;;
-        }   // MaterialRayResult
-        // --------------------------------------------------------------------
-        virtual btScalar addSingleResult(btCollisionWorld::LocalRayResult& rayResult,
-                                         bool normalInWorldSpace)
-        {
-            m_index = rayResult.m_localShapeInfo->m_triangleIndex;
-            return btCollisionWorld::ClosestRayResultCallback
-                    ::addSingleResult(rayResult, normalInWorldSpace);
-        }   // AddSingleResult
-        // --------------------------------------------------------------------
-    };   // myCollision
-
-    MaterialRayResult ray_callback(from, to, this);
-
-    // If this is a rigid body, m_collision_object is NULL, and the
-    // rigid body is the actual collision object.
-    btCollisionWorld::rayTestSingle(trans_from, trans_to,
-                                    m_collision_object ? m_collision_object : m_body,
-                                    m_collision_shape, world_trans,
-                                    ray_callback);
-    // Get the index of the triangle hit
-    int index = ray_callback.m_index;
-    if(ray_callback.hasHit())
-    {
-        *xyz      = ray_callback.m_hitPointWorld;
-        xyz->setW(0.0f);
-        *material = m_triangleIndex2Material[index];
-
-        if(normal)
+            aabb_min = callbacks[i].m_aabb_min;
+            aabb_max = callbacks[i].m_aabb_max;
+        }
+        else
         {
-            // If requested interpolate the normal. I.e. instead of using
-            // the normal of the triangle interpolate the normal at the
-            // hit position based on the three normals of the triangle.
-            if(interpolate_normal)
-                *normal = getInterpolatedNormal(ray_callback.m_index,
-                                                ray_callback.m_hitPointWorld);
-            else
-                *normal = ray_callback.m_hitNormalWorld;
-            normal->normalize();
+            aabb_min.setMin(callbacks[i].m_aabb_min);
+            aabb_max.setMax(callbacks[i].m_aabb_max);
         }
     }
+
+    if(count == 1)
+    {
+        // A single ray is better tested against the BVH nodes directly.
+        // performRaycast is not declared const in bullet, even though it
+        // does not modify the shape.
+        const_cast<btBvhTriangleMeshShape*>(shape)
+            ->performRaycast(&callbacks[0], callbacks[0].m_from,
+                             callbacks[0].m_to);
+    }
     else
     {
-        *material = NULL;
-        if(normal)
-            normal->setValue(0, 1, 0);
+        BatchedTriangleCallback batch(callbacks, count);
+        shape->processAllTriangles(&batch, aabb_min, aabb_max);
     }
-    return ray_callback.hasHit();
 
-}   // castRay
+    unsigned int num_hits = 0;
+    for(unsigned int i = 0; i < count; i++)
+    {
+        const BatchedRayCallback &callback = callbacks[i];
+        if(callback.m_triangle_index < 0)
+            continue;
+        num_hits++;
+        RayHit &hit = hits[i];
+        hit.m_triangle_index = callback.m_triangle_index;
+        hit.m_fraction       = callback.m_hitFraction;
+        hit.m_material       = m_triangleIndex2Material[hit.m_triangle_index];
+        btVector3 hit_point;
+        hit_point.setInterpolate3(rays[i].m_from, rays[i].m_to,
+                                  callback.m_hitFraction);
+        // If requested interpolate the normal. I.e. instead of using
+        // the normal of the triangle interpolate the normal at the
+        // hit position based on the three normals of the triangle.
+        // Like the kart raycaster the interpolated normal is not
+        // normalized, so the suspension behaves the same as before.
+        if(interpolate_normal)
+            hit.m_normal = getInterpolatedNormal(hit.m_triangle_index,
+                                                 hit_point);
+        else
+        {
+            hit.m_normal = world_trans.getBasis()*callback.m_normal;
+            hit.m_normal.normalize();
+        }
+        hit.m_xyz = hit_point;
+        hit.m_xyz.setW(0.0f);
+    }
+    return num_hits;
+}   // castRays
@@ -19,6 +19,7 @@
 #ifndef HEADER_TRIANGLE_MESH_HPP
 #define HEADER_TRIANGLE_MESH_HPP
 
+#include <string>
 #include <vector>
 #include "btBulletDynamicsCommon.h"
 
@@ -57,6 +58,20 @@ private:
      *  to the current transform of the body. */
     bool m_can_be_transformed;
 
+    /** If the BVH was loaded from a cache file, this is the memory it
+     *  was loaded into (the BVH object is created in place in this
+     *  buffer), otherwise NULL. */
+    void                        *m_bvh_buffer;
+
+    /** True if the BVH of the last created collision shape was loaded from
+     *  the cache. */
+    bool                         m_bvh_from_cache;
+
+    std::string getBvhCacheFile(const std::string &name) const;
+    btOptimizedBvh* loadBvh(const std::string &cache_file);
+    void        saveBvh(const std::string &cache_file,
+                        const btOptimizedBvh *bvh) const;
+
 public:
     class RigidBodyTriangleMesh : public btRigidBody
     {
@@ -70,19 +85,49 @@ public:
         }   // RigidBodyTriangleMesh
     };
 
+    /** A ray for castRays(), in world coordinates. */
+    struct Ray
+    {
+        btVector3 m_from;
+        btVector3 m_to;
+    };   // Ray
+
+    /** The result of one ray of castRays(). */
+    struct RayHit
+    {
+        /** The hit point in world coordinates, only set if a triangle
+         *  was hit. */
+        btVector3       m_xyz;
+        /** The (optionally interpolated) normal at the hit point, only set
+         *  if a triangle was hit. An interpolated normal is not
+         *  normalized. */
+        btVector3       m_normal;
+        /** The material of the triangle hit, or NULL. */
+        const Material *m_material;
+        /** Index of the triangle hit, or -1 if nothing was hit. */
+        int             m_triangle_index;
+        /** Fraction of the ray at which the triangle was hit (1 if no
+         *  triangle was hit). */
+        btScalar        m_fraction;
+        // --------------------------------------------------------------------
+        bool hasHit() const { return m_triangle_index >= 0; }
+    };   // RayHit
+
          TriangleMesh(bool can_be_transformed);
         ~TriangleMesh();
     void addTriangle(const btVector3 &t1, const btVector3 &t2,
                      const btVector3 &t3, const btVector3 &n1,
                      const btVector3 &n2, const btVector3 &n3,
                      const Material* m);
-    void createCollisionShape(bool create_collision_object=true, const char* serialized_bhv=NULL);
+    void createCollisionShape(bool create_collision_object=true,
+                              const char* bvh_cache_name=NULL);
     void createPhysicalBody(float friction,
                             btCollisionObject::CollisionFlags flags=
                                (btCollisionObject::CollisionFlags)0,
-                            const char* serializedBhv = NULL);
+                            const char* bvh_cache_name = NULL);
     void removeAll();
     void removeCollisionObject();
+    uint64_t getMeshHash() const;
     btVector3 getInterpolatedNormal(unsigned int index,
                                     const btVector3 &position) const;
     // ------------------------------------------------------------------------
@@ -101,6 +146,12 @@ public:
     }
     const btRigidBody *getBody() const { return m_body; }
     // ------------------------------------------------------------------------
+    btRigidBody *getBody() { return m_body; }
+    // ------------------------------------------------------------------------
+    /** Returns true if the BVH of the collision shape was loaded from the
+     *  cache instead of being built. */
+    bool isBvhFromCache() const { return m_bvh_from_cache; }
+    // ------------------------------------------------------------------------
     const Material* getMaterial(int n) const
                                           {return m_triangleIndex2Material[n];}
     // ------------------------------------------------------------------------
@@ -113,6 +164,9 @@ public:
                  btVector3 *xyz, const Material **material,
                  btVector3 *normal=NULL, bool interpolate_normal=false) const;
     // ------------------------------------------------------------------------
+    unsigned int castRays(const Ray *rays, RayHit *hits, unsigned int count,
+                          bool interpolate_normal=false) const;
+    // ------------------------------------------------------------------------
     /** Returns the points of the 'indx' triangle.
      *  \param indx Index of the triangle to get.
      *  \param p1,p2,p3 On return the three points of the triangle. */
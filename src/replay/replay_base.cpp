@@ -18,6 +18,168 @@
 #include "replay/replay_base.hpp"
 
 #include "io/file_manager.hpp"
+#include "io/mapped_file.hpp"
+#include "utils/log.hpp"
+#include "utils/string_utils.hpp"
+
+#include <cinttypes>
+#include <cmath>
+#include <string.h>
+
+// ============================================================================
+// Helper functions for the binary replay format. All values are stored in
+// little endian. Most values are quantized to integers and stored as
+// variable length integers, typically as difference to the previous event,
+// which results in much smaller files than the text format.
+namespace BinaryReplay
+{
+    /** Magic bytes at the start of a binary replay file. Text replays
+     *  start with "version:", so they can't be confused. */
+    const char MAGIC[4] = { 'S', 'T', 'K', 'R' };
+
+    /** Size of magic, version and header size at the start of the file. */
+    const size_t PREFIX_SIZE = 12;
+
+    /** Scale factors used to quantize the floating point values. */
+    const double TIME_SCALE     = 10000.0;
+    const double POSITION_SCALE = 1000.0;
+    const double ROTATION_SCALE = 32767.0;
+    const double SPEED_SCALE    = 1000.0;
+    const double STEER_SCALE    = 10000.0;
+    const double SUSPENSION_SCALE = 10000.0;
+    const double NITRO_SCALE    = 1000.0;
+    const double DISTANCE_SCALE = 1000.0;
+
+    // ------------------------------------------------------------------------
+    int64_t quantize(float f, double scale)
+    {
+        return (int64_t)llround((double)f * scale);
+    }   // quantize
+    // ------------------------------------------------------------------------
+    void writeUInt(std::string *out, uint64_t v)
+    {
+        while (v >= 0x80)
+        {
+            out->push_back((char)((v & 0x7f) | 0x80));
+            v >>= 7;
+        }
+        out->push_back((char)v);
+    }   // writeUInt
+    // ------------------------------------------------------------------------
+    /** Writes a signed value using zigzag encoding, so that small negative
+     *  values only need a few bytes. */
+    void writeInt(std::string *out, int64_t v)
+    {
+        writeUInt(out, ((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+    }   // writeInt
+    // ------------------------------------------------------------------------
+    void writeFixed(std::string *out, uint64_t v, int num_bytes)
+    {
+        for (int i = 0; i < num_bytes; i++)
+            out->push_back((char)((v >> (8 * i)) & 0xff));
+    }   // writeFixed
+    // ------------------------------------------------------------------------
+    void writeFloat(std::string *out, float f)
+    {
+        uint32_t u;
+        memcpy(&u, &f, sizeof(u));
+        writeFixed(out, u, 4);
+    }   // writeFloat
+    // ------------------------------------------------------------------------
+    void writeString(std::string *out, const std::string &s)
+    {
+        writeUInt(out, s.size());
+        out->append(s);
+    }   // writeString
+
+    // ========================================================================
+    /** Reads the values written by the functions above. Reading behind the
+     *  end of the data returns 0 and sets an error flag. */
+    class Reader
+    {
+    private:
+        const uint8_t *m_data;
+        const uint8_t *m_end;
+        bool           m_ok;
+    public:
+        Reader(const uint8_t *data, const uint8_t *end)
+            : m_data(data), m_end(end), m_ok(true) {}
+        // --------------------------------------------------------------------
+        bool ok() const { return m_ok; }
+        // --------------------------------------------------------------------
+        const uint8_t *getPosition() const { return m_data; }
+        // --------------------------------------------------------------------
+        uint64_t readUInt()
+        {
+            uint64_t v = 0;
+            for (int shift = 0; shift < 64; shift += 7)
+            {
+                if (m_data >= m_end)
+                    break;
+                uint8_t c = *m_data++;
+                v |= (uint64_t)(c & 0x7f) << shift;
+                if ((c & 0x80) == 0)
+                    return v;
+            }
+            m_ok = false;
+            return 0;
+        }   // readUInt
+        // --------------------------------------------------------------------
+        int64_t readInt()
+        {
+            uint64_t v = readUInt();
+            return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+        }   // readInt
+        // --------------------------------------------------------------------
+        uint64_t readFixed(int num_bytes)
+        {
+            if (m_end - m_data < num_bytes)
+            {
+                m_ok = false;
+                m_data = m_end;
+                return 0;
+            }
+            uint64_t v = 0;
+            for (int i = 0; i < num_bytes; i++)
+                v |= (uint64_t)(*m_data++) << (8 * i);
+            return v;
+        }   // readFixed
+        // --------------------------------------------------------------------
+        float readFloat()
+        {
+            uint32_t u = (uint32_t)readFixed(4);
+            float f;
+            memcpy(&f, &u, sizeof(f));
+            return f;
+        }   // readFloat
+        // --------------------------------------------------------------------
+        std::string readString()
+        {
+            uint64_t size = readUInt();
+            if (!m_ok || (uint64_t)(m_end - m_data) < size)
+            {
+                m_ok = false;
+                m_data = m_end;
+                return "";
+            }
+            std::string s((const char*)m_data, (size_t)size);
+            m_data += size;
+            return s;
+        }   // readString
+        // --------------------------------------------------------------------
+        /** Skips the specified number of bytes. */
+        void skip(uint64_t n)
+        {
+            if ((uint64_t)(m_end - m_data) < n)
+            {
+                m_ok = false;
+                m_data = m_end;
+                return;
+            }
+            m_data += n;
+        }   // skip
+    };   // Reader
+}   // namespace BinaryReplay
 
 // -----------------------------------------------------------------------------
 ReplayBase::ReplayBase()
@@ -33,7 +195,7 @@ FILE* ReplayBase::openReplayFile(bool writeable, bool full_path, int replay_file
 {
     FILE *fd = fopen(full_path ? getReplayFilename(replay_file_number).c_str() :
         (file_manager->getReplayDir() + getReplayFilename(replay_file_number)).c_str(),
-        writeable ? "w" : "r");
+        writeable ? "wb" : "r");
     if (!fd)
     {
         return NULL;
@@ -41,3 +203,852 @@ FILE* ReplayBase::openReplayFile(bool writeable, bool full_path, int replay_file
     return fd;
 
 }   // openReplayFile
+
+// ----------------------------------------------------------------------------
+/** Returns true if the data is the start of a binary replay file.
+ *  \param data Start of the file.
+ *  \param size Number of bytes available.
+ */
+bool ReplayBase::isBinaryReplay(const uint8_t *data, size_t size)
+{
+    return size >= sizeof(BinaryReplay::MAGIC) &&
+           memcmp(data, BinaryReplay::MAGIC, sizeof(BinaryReplay::MAGIC)) == 0;
+}   // isBinaryReplay
+
+// ----------------------------------------------------------------------------
+/** Writes the header of a binary replay file. The header starts with its
+ *  size, so that a reader can load only the header.
+ *  \param out The header is appended to this string.
+ *  \param h The header information to write.
+ */
+void ReplayBase::writeBinaryHeader(std::string *out, const ReplayHeader &h)
+{
+    using namespace BinaryReplay;
+    const size_t start = out->size();
+    out->append(MAGIC, sizeof(MAGIC));
+    writeFixed(out, getCurrentReplayVersion(), 4);
+    // Placeholder for the header size
+    writeFixed(out, 0, 4);
+
+    writeString(out, StringUtils::wideToUtf8(h.m_stk_version));
+    writeUInt(out, h.m_kart_list.size());
+    for (unsigned int i = 0; i < h.m_kart_list.size(); i++)
+    {
+        writeString(out, h.m_kart_list[i]);
+        writeString(out, StringUtils::wideToUtf8(h.m_name_list[i]));
+        writeFloat(out, h.m_kart_color[i]);
+    }
+    writeUInt(out, h.m_reverse ? 1 : 0);
+    writeUInt(out, h.m_difficulty);
+    writeString(out, h.m_minor_mode);
+    writeString(out, h.m_track_name);
+    writeUInt(out, h.m_laps);
+    writeFloat(out, h.m_min_time);
+    writeFixed(out, h.m_replay_uid, 8);
+
+    uint32_t size = (uint32_t)(out->size() - start);
+    for (int i = 0; i < 4; i++)
+        (*out)[start + 8 + i] = (char)((size >> (8 * i)) & 0xff);
+}   // writeBinaryHeader
+
+// ----------------------------------------------------------------------------
+/** Reads the header of a binary replay file.
+ *  \param data Start of the replay file.
+ *  \param size Number of bytes available, which must include the header.
+ *  \param h On return the header information.
+ *  \param header_size On return the size of the header, i.e. the offset
+ *         of the kart data.
+ *  \return True if the header was read successfully.
+ */
+bool ReplayBase::readBinaryHeader(const uint8_t *data, size_t size,
+                                  ReplayHeader *h, size_t *header_size)
+{
+    using namespace BinaryReplay;
+    if (!isBinaryReplay(data, size) || size < PREFIX_SIZE)
+        return false;
+    Reader prefix(data + sizeof(MAGIC), data + PREFIX_SIZE);
+    h->m_replay_version = (unsigned int)prefix.readFixed(4);
+    *header_size        = (size_t)prefix.readFixed(4);
+    if (h->m_replay_version < FIRST_BINARY_REPLAY_VERSION ||
+        h->m_replay_version > getCurrentReplayVersion())
+    {
+        Log::warn("Replay", "Replay is version '%d'", h->m_replay_version);
+        Log::warn("Replay", "STK replay version is '%d'",
+                  getCurrentReplayVersion());
+        return false;
+    }
+    if (*header_size < PREFIX_SIZE || *header_size > size)
+    {
+        Log::warn("Replay", "Invalid header size in binary replay file.");
+        return false;
+    }
+
+    Reader r(data + PREFIX_SIZE, data + *header_size);
+    h->m_stk_version = StringUtils::utf8ToWide(r.readString());
+    uint64_t num_karts = r.readUInt();
+    if (num_karts > *header_size)
+        return false;
+    h->m_kart_list.clear();
+    h->m_name_list.clear();
+    h->m_kart_color.clear();
+    for (uint64_t i = 0; i < num_karts; i++)
+    {
+        h->m_kart_list.push_back(r.readString());
+        h->m_name_list.push_back(StringUtils::utf8ToWide(r.readString()));
+        h->m_kart_color.push_back(r.readFloat());
+    }
+    h->m_reverse    = r.readUInt() != 0;
+    h->m_difficulty = (unsigned int)r.readUInt();
+    h->m_minor_mode = r.readString();
+    h->m_track_name = r.readString();
+    h->m_laps       = (unsigned int)r.readUInt();
+    h->m_min_time   = r.readFloat();
+    h->m_replay_uid = r.readFixed(8);
+    if (!r.ok())
+    {
+        Log::warn("Replay", "Can't read header of binary replay file.");
+        return false;
+    }
+    return true;
+}   // readBinaryHeader
+
+// ----------------------------------------------------------------------------
+/** Reads only the header of a binary replay file, without reading any of
+ *  the kart data.
+ *  \param fd The file, positioned at the start.
+ *  \param h On return the header information.
+ *  \return True if the header was read successfully.
+ */
+bool ReplayBase::readBinaryHeader(FILE *fd, ReplayHeader *h)
+{
+    std::vector<uint8_t> data(BinaryReplay::PREFIX_SIZE);
+    if (fread(data.data(), 1, data.size(), fd) != data.size())
+        return false;
+    BinaryReplay::Reader prefix(data.data() + 8, data.data() + 12);
+    size_t header_size = (size_t)prefix.readFixed(4);
+    // Avoid allocating huge amounts of memory for corrupt files
+    if (header_size < data.size() || header_size > 1024 * 1024)
+        return false;
+    data.resize(header_size);
+    size_t n = header_size - BinaryReplay::PREFIX_SIZE;
+    if (fread(data.data() + BinaryReplay::PREFIX_SIZE, 1, n, fd) != n)
+        return false;
+    return readBinaryHeader(data.data(), data.size(), h, &header_size);
+}   // readBinaryHeader
+
+// ----------------------------------------------------------------------------
+/** Appends the events of one kart in binary format. Each event is stored
+ *  as the difference of the quantized values to the previous event.
+ *  \param out The data is appended to this string.
+ *  \param t, p, b, r Arrays with the events of the kart.
+ *  \param count Number of events.
+ */
+void ReplayBase::writeBinaryKartEvents(std::string *out,
+                                       const TransformEvent *t,
+                                       const PhysicInfo *p,
+                                       const BonusInfo *b,
+                                       const KartReplayEvent *r,
+                                       unsigned int count)
+{
+    using namespace BinaryReplay;
+    std::string data;
+    int64_t prev_time = 0, prev_speed = 0, prev_nitro = 0, prev_distance = 0;
+    int64_t prev_xyz[3]  = { 0, 0, 0 };
+    int64_t prev_rot[4]  = { 0, 0, 0, 0 };
+    int64_t prev_susp[4] = { 0, 0, 0, 0 };
+    for (unsigned int i = 0; i < count; i++)
+    {
+        int64_t time = quantize(t[i].m_time, TIME_SCALE);
+        writeInt(&data, time - prev_time);
+        prev_time = time;
+
+        const btVector3 &xyz = t[i].m_transform.getOrigin();
+        for (int j = 0; j < 3; j++)
+        {
+            int64_t v = quantize(xyz[j], POSITION_SCALE);
+            writeInt(&data, v - prev_xyz[j]);
+            prev_xyz[j] = v;
+        }
+        const btQuaternion q = t[i].m_transform.getRotation();
+        const float rot[4] = { q.getX(), q.getY(), q.getZ(), q.getW() };
+        for (int j = 0; j < 4; j++)
+        {
+            int64_t v = quantize(rot[j], ROTATION_SCALE);
+            writeInt(&data, v - prev_rot[j]);
+            prev_rot[j] = v;
+        }
+
+        int64_t speed = quantize(p[i].m_speed, SPEED_SCALE);
+        writeInt(&data, speed - prev_speed);
+        prev_speed = speed;
+        writeInt(&data, quantize(p[i].m_steer, STEER_SCALE));
+        for (int j = 0; j < 4; j++)
+        {
+            int64_t v = quantize(p[i].m_suspension_length[j],
+                                 SUSPENSION_SCALE);
+            writeInt(&data, v - prev_susp[j]);
+            prev_susp[j] = v;
+        }
+        writeInt(&data, p[i].m_skidding_state);
+
+        writeInt(&data, b[i].m_attachment);
+        int64_t nitro = quantize(b[i].m_nitro_amount, NITRO_SCALE);
+        writeInt(&data, nitro - prev_nitro);
+        prev_nitro = nitro;
+        writeInt(&data, b[i].m_item_amount);
+        writeInt(&data, b[i].m_item_type);
+        writeInt(&data, b[i].m_special_value);
+
+        int64_t distance = quantize(r[i].m_distance, DISTANCE_SCALE);
+        writeInt(&data, distance - prev_distance);
+        prev_distance = distance;
+        writeInt(&data, r[i].m_nitro_usage);
+        writeInt(&data, r[i].m_skidding_effect);
+        writeUInt(&data, (r[i].m_zipper_usage ? 1 : 0) |
+                         (r[i].m_red_skidding ? 2 : 0) |
+                         (r[i].m_jumping      ? 4 : 0));
+    }   // for i < count
+    writeUInt(out, count);
+    writeUInt(out, data.size());
+    out->append(data);
+}   // writeBinaryKartEvents
+
+// ----------------------------------------------------------------------------
+/** Reads the events of one kart from a binary replay.
+ *  \param data Pointer to the start of the kart data, on return the start
+ *         of the next kart.
+ *  \param end End of the replay data.
+ *  \param events On return the events of the kart.
+ *  \return True if the data was read successfully.
+ */
+bool ReplayBase::readBinaryKartEvents(const uint8_t **data, const uint8_t *end,
+                                      KartEvents *events)
+{
+    using namespace BinaryReplay;
+    Reader header(*data, end);
+    uint64_t count = header.readUInt();
+    uint64_t size  = header.readUInt();
+    // Each event needs at least one byte per value
+    if (!header.ok() || size > (uint64_t)(end - header.getPosition()) ||
+        count > size)
+    {
+        Log::warn("Replay", "Invalid kart data in binary replay file.");
+        return false;
+    }
+    const uint8_t *start = header.getPosition();
+    *data = start + size;
+
+    Reader r(start, start + size);
+    events->m_transform_events.resize((size_t)count);
+    events->m_physic_info.resize((size_t)count);
+    events->m_bonus_info.resize((size_t)count);
+    events->m_kart_replay_event.resize((size_t)count);
+    int64_t time = 0, speed = 0, nitro = 0, distance = 0;
+    int64_t xyz[3]  = { 0, 0, 0 };
+    int64_t rot[4]  = { 0, 0, 0, 0 };
+    int64_t susp[4] = { 0, 0, 0, 0 };
+    for (uint64_t i = 0; i < count; i++)
+    {
+        TransformEvent  *t = &events->m_transform_events[(size_t)i];
+        PhysicInfo      *p = &events->m_physic_info[(size_t)i];
+        BonusInfo       *b = &events->m_bonus_info[(size_t)i];
+        KartReplayEvent *e = &events->m_kart_replay_event[(size_t)i];
+
+        time += r.readInt();
+        t->m_time = (float)(time / TIME_SCALE);
+        for (int j = 0; j < 3; j++)
+            xyz[j] += r.readInt();
+        for (int j = 0; j < 4; j++)
+            rot[j] += r.readInt();
+        btQuaternion q((float)(rot[0] / ROTATION_SCALE),
+                       (float)(rot[1] / ROTATION_SCALE),
+                       (float)(rot[2] / ROTATION_SCALE),
+                       (float)(rot[3] / ROTATION_SCALE));
+        // Quantization results in a slightly non-normalized quaternion
+        if (q.length2() > 0.0f)
+            q.normalize();
+        else
+            q = btQuaternion(0, 0, 0, 1);
+        t->m_transform = btTransform(q,
+            btVector3((float)(xyz[0] / POSITION_SCALE),
+                      (float)(xyz[1] / POSITION_SCALE),
+                      (float)(xyz[2] / POSITION_SCALE)));
+
+        speed += r.readInt();
+        p->m_speed = (float)(speed / SPEED_SCALE);
+        p->m_steer = (float)(r.readInt() / STEER_SCALE);
+        for (int j = 0; j < 4; j++)
+        {
+            susp[j] += r.readInt();
+            p->m_suspension_length[j] = (float)(susp[j] / SUSPENSION_SCALE);
+        }
+        p->m_skidding_state = (int)r.readInt();
+
+        b->m_attachment    = (int)r.readInt();
+        nitro             += r.readInt();
+        b->m_nitro_amount  = (float)(nitro / NITRO_SCALE);
+        b->m_item_amount   = (int)r.readInt();
+        b->m_item_type     = (int)r.readInt();
+        b->m_special_value = (int)r.readInt();
+
+        distance            += r.readInt();
+        e->m_distance        = (float)(distance / DISTANCE_SCALE);
+        e->m_nitro_usage     = (int)r.readInt();
+        e->m_skidding_effect = (int)r.readInt();
+        uint64_t flags       = r.readUInt();
+        e->m_zipper_usage    = (flags & 1) != 0;
+        e->m_red_skidding    = (flags & 2) != 0;
+        e->m_jumping         = (flags & 4) != 0;
+    }   // for i < count
+
+    if (!r.ok())
+    {
+        Log::warn("Replay", "Can't read kart data of binary replay file.");
+        return false;
+    }
+    return true;
+}   // readBinaryKartEvents
+
+// ----------------------------------------------------------------------------
+/** Reads the header of a text replay file (used up to replay version 4).
+ *  \param fd The file, positioned at the start.
+ *  \param h On return the header information.
+ *  \param call_index Used as UID for old replays that don't have one.
+ *  \return True if the header was read successfully.
+ */
+bool ReplayBase::readTextHeader(FILE *fd, ReplayHeader *h, int call_index)
+{
+    char s[1024], s1[1024];
+
+    if (fgets(s, 1023, fd) == NULL)
+        s[0] = 0;
+    unsigned int version;
+    if (sscanf(s,"version: %u", &version) != 1)
+    {
+        Log::warn("Replay", "No Version information "
+                  "found in replay file (bogus replay file).");
+        return false;
+    }
+    if (version >= FIRST_BINARY_REPLAY_VERSION ||
+        version < getMinSupportedReplayVersion() )
+    {
+        Log::warn("Replay", "Replay is version '%d'", version);
+        Log::warn("Replay", "STK replay version is '%d'", getCurrentReplayVersion());
+        Log::warn("Replay", "Minimum supported replay version is '%d'", getMinSupportedReplayVersion());
+        return false;
+    }
+    h->m_replay_version = version;
+
+    if (version >= 4)
+    {
+        fgets(s, 1023, fd);
+        if(sscanf(s, "stk_version: %s", s1) != 1)
+        {
+            Log::warn("Replay", "No STK release version found in replay file.");
+            return false;
+        }
+        h->m_stk_version = s1;
+    }
+    else
+        h->m_stk_version = "";
+
+    h->m_kart_list.clear();
+    h->m_name_list.clear();
+    h->m_kart_color.clear();
+    while(true)
+    {
+        if (fgets(s, 1023, fd) == NULL)
+        {
+            Log::warn("Replay", "Could not read ghost karts info!");
+            return false;
+        }
+        irr::core::stringc is_end(s);
+        is_end.trim();
+        if (is_end == "kart_list_end") break;
+        char display_name_encoded[1024];
+
+        int scanned = sscanf(s,"kart: %s %[^\n]", s1, display_name_encoded);
+        if (scanned < 1)
+        {
+            Log::warn("Replay", "Could not read ghost karts info!");
+            break;
+        }
+
+        h->m_kart_list.push_back(std::string(s1));
+        if (scanned == 2)
+        {
+            // If username of kart is present, use it
+            h->m_name_list.push_back(StringUtils::xmlDecode(std::string(display_name_encoded)));
+        } else
+        { // scanned == 1
+            // If username is not present, kart display name will default to kart name
+            // (see GhostController::getName)
+            h->m_name_list.push_back("");
+        }
+
+        // Read kart color data
+        if (version >= 4)
+        {
+            float f = 0;
+            fgets(s, 1023, fd);
+            if(sscanf(s, "kart_color: %f", &f) != 1)
+            {
+                Log::warn("Replay", "Kart color missing in replay file.");
+                return false;
+            }
+            h->m_kart_color.push_back(f);
+        }
+        else
+            h->m_kart_color.push_back(0.0f); // Use default kart color
+    }
+
+    int reverse = 0;
+    fgets(s, 1023, fd);
+    if(sscanf(s, "reverse: %d", &reverse) != 1)
+    {
+        Log::warn("Replay", "No reverse info found in replay file.");
+        return false;
+    }
+    h->m_reverse = reverse != 0;
+
+    fgets(s, 1023, fd);
+    if (sscanf(s, "difficulty: %u", &h->m_difficulty) != 1)
+    {
+        Log::warn("Replay", " No difficulty found in replay file.");
+        return false;
+    }
+
+    if (version >= 4)
+    {
+        fgets(s, 1023, fd);
+        if (sscanf(s, "mode: %s", s1) != 1)
+        {
+            Log::warn("Replay", "Replay mode not found in replay file.");
+            return false;
+        }
+        h->m_minor_mode = s1;
+    }
+    // Assume time-trial mode for old replays
+    else
+        h->m_minor_mode = "time-trial";
+
+    fgets(s, 1023, fd);
+    if (sscanf(s, "track: %s", s1) != 1)
+    {
+        Log::warn("Replay", "Track info not found in replay file.");
+        return false;
+    }
+    h->m_track_name = std::string(s1);
+
+    fgets(s, 1023, fd);
+    if (sscanf(s, "laps: %u", &h->m_laps) != 1)
+    {
+        Log::warn("Replay", "No number of laps found in replay file.");
+        return false;
+    }
+
+    fgets(s, 1023, fd);
+    if (sscanf(s, "min_time: %f", &h->m_min_time) != 1)
+    {
+        Log::warn("Replay", "Finish time not found in replay file.");
+        return false;
+    }
+
+    if (version >= 4)
+    {
+        fgets(s, 1023, fd);
+        if (sscanf(s, "replay_uid: %" PRIu64, &h->m_replay_uid) != 1)
+        {
+            Log::warn("Replay", "Replay UID not found in replay file.");
+            return false;
+        }
+    }
+    // No UID in old replay format
+    else
+        h->m_replay_uid = call_index;
+
+    return true;
+}   // readTextHeader
+
+// ----------------------------------------------------------------------------
+/** Reads all data from a text replay file for a specific kart.
+ *  \param fd The file, positioned after the header or the previous kart.
+ *  \param version Version of the replay file.
+ *  \param events On return the events of this kart.
+ *  \return False if there is no more kart data in the file.
+ */
+bool ReplayBase::readTextKartEvents(FILE *fd, unsigned int version,
+                                    KartEvents *events)
+{
+    char s[1024];
+
+    if (fgets(s, 1023, fd) == NULL)  // eof reached
+        return false;
+
+    unsigned int size;
+    if(sscanf(s,"size: %u",&size)!=1)
+    {
+        Log::warn("Replay", "Number of records not found in replay file.");
+        return false;
+    }
+
+    events->m_transform_events.clear();
+    events->m_physic_info.clear();
+    events->m_bonus_info.clear();
+    events->m_kart_replay_event.clear();
+    events->m_transform_events.reserve(size);
+    events->m_physic_info.reserve(size);
+    events->m_bonus_info.reserve(size);
+    events->m_kart_replay_event.reserve(size);
+
+    for(unsigned int i=0; i<size; i++)
+    {
+        if (fgets(s, 1023, fd) == NULL)
+            break;
+        float x, y, z, rx, ry, rz, rw, time, speed, steer, w1, w2, w3, w4, nitro_amount, distance;
+        int skidding_state, attachment, item_amount, item_type, special_value,
+            nitro, zipper, skidding, red_skidding, jumping;
+        int scanned;
+
+        // Up to STK 0.9.3 replays
+        if (version == 3)
+        {
+            scanned = sscanf(s, "%f  %f %f %f  %f %f %f %f  %f  %f  %f %f %f %f  %d %d %d %d %d\n",
+                &time,
+                &x, &y, &z,
+                &rx, &ry, &rz, &rw,
+                &speed, &steer, &w1, &w2, &w3, &w4,
+                &nitro, &zipper, &skidding, &red_skidding, &jumping
+                );
+            skidding_state = 0;   //not saved in version 3 replays
+            attachment     = 0;   //not saved in version 3 replays
+            nitro_amount   = 0;   //not saved in version 3 replays
+            item_amount    = 0;   //not saved in version 3 replays
+            item_type      = 0;   //not saved in version 3 replays
+            special_value  = 0;   //not saved in version 3 replays
+            distance       = 0.0f;//not saved in version 3 replays
+            if (scanned == 19)
+                scanned = 26;
+        }
+        //version 4 replays (STK 0.9.4 and higher)
+        else
+        {
+            scanned = sscanf(s, "%f  %f %f %f  %f %f %f %f  %f  %f  %f %f %f %f %d  %d %f %d %d %d  %f %d %d %d %d %d\n",
+                &time,
+                &x, &y, &z,
+                &rx, &ry, &rz, &rw,
+                &speed, &steer, &w1, &w2, &w3, &w4, &skidding_state,
+                &attachment, &nitro_amount, &item_amount, &item_type, &special_value,
+                &distance, &nitro, &zipper, &skidding, &red_skidding, &jumping
+                );
+        }
+
+        if (scanned != 26)
+        {
+            // Invalid record found
+            // ---------------------
+            Log::warn("Replay", "Can't read replay data line %d:", i);
+            Log::warn("Replay", "%s", s);
+            Log::warn("Replay", "Ignored.");
+            continue;
+        }
+
+        TransformEvent te;
+        PhysicInfo pi             = {0};
+        BonusInfo bi              = {0};
+        KartReplayEvent kre       = {0};
+
+        te.m_time                 = time;
+        te.m_transform            = btTransform(btQuaternion(rx, ry, rz, rw),
+                                                btVector3(x, y, z));
+        pi.m_speed                = speed;
+        pi.m_steer                = steer;
+        pi.m_suspension_length[0] = w1;
+        pi.m_suspension_length[1] = w2;
+        pi.m_suspension_length[2] = w3;
+        pi.m_suspension_length[3] = w4;
+        pi.m_skidding_state       = skidding_state;
+        bi.m_attachment           = attachment;
+        bi.m_nitro_amount         = nitro_amount;
+        bi.m_item_amount          = item_amount;
+        bi.m_item_type            = item_type;
+        bi.m_special_value        = special_value;
+        kre.m_distance            = distance;
+        kre.m_nitro_usage         = nitro;
+        kre.m_zipper_usage        = zipper!=0;
+        kre.m_skidding_effect     = skidding;
+        kre.m_red_skidding        = red_skidding!=0;
+        kre.m_jumping             = jumping != 0;
+        events->m_transform_events.push_back(te);
+        events->m_physic_info.push_back(pi);
+        events->m_bonus_info.push_back(bi);
+        events->m_kart_replay_event.push_back(kre);
+    }   // for i
+
+    return true;
+}   // readTextKartEvents
+
+// ----------------------------------------------------------------------------
+/** Reads a complete replay file, which can be in text or binary format.
+ *  Binary files are memory mapped.
+ *  \param filename Full path of the replay file.
+ *  \param h On return the header information.
+ *  \param events On return the events of all karts.
+ *  \return True if the file was read successfully.
+ */
+bool ReplayBase::readReplay(const std::string &filename, ReplayHeader *h,
+                            std::vector<KartEvents> *events)
+{
+    events->clear();
+    {
+        MappedFile file(filename);
+        if (!file.isValid())
+            return false;
+        if (isBinaryReplay(file.getData(), file.getSize()))
+        {
+            size_t header_size;
+            if (!readBinaryHeader(file.getData(), file.getSize(), h,
+                                  &header_size))
+            {
+                return false;
+            }
+            const uint8_t *data = file.getData() + header_size;
+            const uint8_t *end  = file.getData() + file.getSize();
+            events->resize(h->m_kart_list.size());
+            for (unsigned int i = 0; i < events->size(); i++)
+            {
+                if (!readBinaryKartEvents(&data, end, &(*events)[i]))
+                    return false;
+            }
+            return true;
+        }
+    }
+
+    FILE *fd = fopen(filename.c_str(), "r");
+    if (!fd)
+        return false;
+    if (!readTextHeader(fd, h, 0))
+    {
+        fclose(fd);
+        return false;
+    }
+    KartEvents ke;
+    while (readTextKartEvents(fd, h->m_replay_version, &ke))
+        events->push_back(ke);
+    fclose(fd);
+    return true;
+}   // readReplay
+
+// ----------------------------------------------------------------------------
+/** Saves a replay in binary format, e.g. to convert a text replay.
+ *  \param filename Full path of the file to write.
+ *  \param h Header information.
+ *  \param events The events of all karts.
+ *  \return True if the file was written successfully.
+ */
+bool ReplayBase::saveBinaryReplay(const std::string &filename,
+                                  const ReplayHeader &h,
+                                  const std::vector<KartEvents> &events)
+{
+    std::string data;
+    writeBinaryHeader(&data, h);
+    for (const KartEvents &ke : events)
+    {
+        writeBinaryKartEvents(&data, ke.m_transform_events.data(),
+                              ke.m_physic_info.data(), ke.m_bonus_info.data(),
+                              ke.m_kart_replay_event.data(),
+                              (unsigned int)ke.m_transform_events.size());
+    }
+    FILE *fd = fopen(filename.c_str(), "wb");
+    if (!fd)
+        return false;
+    bool ok = fwrite(data.data(), 1, data.size(), fd) == data.size();
+    ok = fclose(fd) == 0 && ok;
+    return ok;
+}   // saveBinaryReplay
+
+// ----------------------------------------------------------------------------
+/** Checks if the events of a kart read back from a binary replay match the
+ *  original events, allowing for the error caused by quantization.
+ *  \param orig The original events.
+ *  \param binary The events read back from the binary format.
+ *  \return True if both describe the same replay.
+ */
+bool ReplayBase::sameKartEvents(const KartEvents &orig,
+                                const KartEvents &binary)
+{
+    using namespace BinaryReplay;
+    const size_t count = orig.m_transform_events.size();
+    if (binary.m_transform_events.size()  != count ||
+        binary.m_physic_info.size()       != count ||
+        binary.m_bonus_info.size()        != count ||
+        binary.m_kart_replay_event.size() != count ||
+        orig.m_physic_info.size()         != count ||
+        orig.m_bonus_info.size()          != count ||
+        orig.m_kart_replay_event.size()   != count)
+        return false;
+
+    // Allow one quantization step, which also covers float rounding when
+    // the accumulated integer values are converted back
+    auto same = [](float a, float b, double scale)
+    {
+        return std::fabs((double)a - (double)b) <=
+               1.0 / scale + 1e-6 * std::fabs((double)a);
+    };
+    for (size_t i = 0; i < count; i++)
+    {
+        const TransformEvent &ta = orig.m_transform_events[i];
+        const TransformEvent &tb = binary.m_transform_events[i];
+        if (!same(ta.m_time, tb.m_time, TIME_SCALE))
+            return false;
+        for (int j = 0; j < 3; j++)
+        {
+            if (!same(ta.m_transform.getOrigin()[j],
+                      tb.m_transform.getOrigin()[j], POSITION_SCALE))
+                return false;
+        }
+        // The decoded quaternion is normalized again, which can move each
+        // component by a few more quantization steps
+        const btQuaternion qa = ta.m_transform.getRotation();
+        const btQuaternion qb = tb.m_transform.getRotation();
+        for (int j = 0; j < 4; j++)
+        {
+            if (!same(qa[j], qb[j], ROTATION_SCALE / 4.0))
+                return false;
+        }
+
+        const PhysicInfo &pa = orig.m_physic_info[i];
+        const PhysicInfo &pb = binary.m_physic_info[i];
+        if (!same(pa.m_speed, pb.m_speed, SPEED_SCALE) ||
+            !same(pa.m_steer, pb.m_steer, STEER_SCALE) ||
+            pa.m_skidding_state != pb.m_skidding_state)
+            return false;
+        for (int j = 0; j < 4; j++)
+        {
+            if (!same(pa.m_suspension_length[j], pb.m_suspension_length[j],
+                      SUSPENSION_SCALE))
+                return false;
+        }
+
+        const BonusInfo &ba = orig.m_bonus_info[i];
+        const BonusInfo &bb = binary.m_bonus_info[i];
+        if (ba.m_attachment    != bb.m_attachment    ||
+            ba.m_item_amount   != bb.m_item_amount   ||
+            ba.m_item_type     != bb.m_item_type     ||
+            ba.m_special_value != bb.m_special_value ||
+            !same(ba.m_nitro_amount, bb.m_nitro_amount, NITRO_SCALE))
+            return false;
+
+        const KartReplayEvent &ea = orig.m_kart_replay_event[i];
+        const KartReplayEvent &eb = binary.m_kart_replay_event[i];
+        if (ea.m_nitro_usage     != eb.m_nitro_usage     ||
+            ea.m_skidding_effect != eb.m_skidding_effect ||
+            ea.m_zipper_usage    != eb.m_zipper_usage    ||
+            ea.m_red_skidding    != eb.m_red_skidding    ||
+            ea.m_jumping         != eb.m_jumping         ||
+            !same(ea.m_distance, eb.m_distance, DISTANCE_SCALE))
+            return false;
+    }   // for i < count
+    return true;
+}   // sameKartEvents
+
+// ----------------------------------------------------------------------------
+/** Unit testing function for the binary replay format.
+ */
+void ReplayBase::unitTesting()
+{
+    using namespace BinaryReplay;
+
+    // Variable length and zigzag encoded integers
+    const int64_t values[] = { 0, 1, -1, 63, -64, 64, -65, 127, 128, -129,
+                               300, -300, 16383, 16384, -16385,
+                               2147483647LL, -2147483648LL,
+                               INT64_MAX, INT64_MIN };
+    std::string data;
+    for (int64_t v : values)
+    {
+        writeInt(&data, v);
+        writeUInt(&data, (uint64_t)v);
+    }
+    // Small values must use a single byte
+    std::string small;
+    writeInt(&small, -64);
+    writeInt(&small, 63);
+    writeUInt(&small, 127);
+    assert(small.size() == 3);
+
+    Reader r((const uint8_t*)data.data(),
+             (const uint8_t*)data.data() + data.size());
+    for (unsigned int i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+    {
+        assert(r.readInt() == values[i]);
+        assert(r.readUInt() == (uint64_t)values[i]);
+    }
+    assert(r.ok());
+    assert(r.getPosition() == (const uint8_t*)data.data() + data.size());
+    // Reading behind the end must fail
+    r.readUInt();
+    assert(!r.ok());
+    // A truncated value must fail
+    Reader truncated((const uint8_t*)data.data(),
+                     (const uint8_t*)data.data() + 1);
+    truncated.readUInt();
+    truncated.readInt();
+    assert(!truncated.ok());
+
+    // Kart events with delta encoding and quantization
+    KartEvents orig;
+    for (int i = 0; i < 50; i++)
+    {
+        TransformEvent t;
+        t.m_time = i * 0.0333f;
+        btQuaternion q(btVector3(0.1f, 1.0f, -0.2f).normalized(),
+                       i * 0.37f - 3.0f);
+        t.m_transform = btTransform(q, btVector3(i * 1.2345f - 20.0f,
+                                                 -3.5f + 0.01f * i,
+                                                 100.0f - i * 2.7182f));
+        orig.m_transform_events.push_back(t);
+
+        PhysicInfo p;
+        p.m_speed = 25.0f - i * 0.77f;
+        p.m_steer = ((i % 7) - 3) * 0.123f;
+        for (int j = 0; j < 4; j++)
+            p.m_suspension_length[j] = 0.2f + 0.001f * i * (j + 1);
+        p.m_skidding_state = i % 3;
+        orig.m_physic_info.push_back(p);
+
+        BonusInfo b;
+        b.m_attachment    = i % 6;
+        b.m_nitro_amount  = 10.0f - i * 0.2f;
+        b.m_item_amount   = i % 4;
+        b.m_item_type     = i % 9;
+        b.m_special_value = -i;
+        orig.m_bonus_info.push_back(b);
+
+        KartReplayEvent e;
+        e.m_distance        = i * 12.345f;
+        e.m_nitro_usage     = i % 2;
+        e.m_zipper_usage    = i % 5 == 0;
+        e.m_skidding_effect = i % 4;
+        e.m_red_skidding    = i % 3 == 0;
+        e.m_jumping         = i % 7 == 0;
+        orig.m_kart_replay_event.push_back(e);
+    }
+    std::string kart_data;
+    writeBinaryKartEvents(&kart_data, orig.m_transform_events.data(),
+                          orig.m_physic_info.data(),
+                          orig.m_bonus_info.data(),
+                          orig.m_kart_replay_event.data(),
+                          (unsigned int)orig.m_transform_events.size());
+    KartEvents binary;
+    const uint8_t *start = (const uint8_t*)kart_data.data();
+    const uint8_t *end   = start + kart_data.size();
+    if (!readBinaryKartEvents(&start, end, &binary))
+        assert(false);
+    assert(start == end);
+    assert(sameKartEvents(orig, binary));
+
+    // A changed event must be detected
+    binary.m_transform_events[10].m_transform.getOrigin().setX(1000.0f);
+    assert(!sameKartEvents(orig, binary));
+}   // unitTesting
@@ -21,7 +21,9 @@
 
 #include "LinearMath/btTransform.h"
 #include "utils/no_copy.hpp"
+#include "utils/types.hpp"
 
+#include "irrString.h"
 #include <stdio.h>
 #include <string>
 #include <vector>
@@ -34,6 +36,26 @@ class ReplayBase : public NoCopy
     // Needs access to KartReplayEvent
     friend class GhostKart;
 
+public:
+    /** The information stored at the start of a replay file, which is all
+     *  that is needed to list a replay without loading all its data. */
+    class ReplayHeader
+    {
+    public:
+        std::string                      m_track_name;
+        std::string                      m_minor_mode;
+        irr::core::stringw               m_stk_version;
+        std::vector<std::string>         m_kart_list;
+        std::vector<irr::core::stringw>  m_name_list;
+        std::vector<float>               m_kart_color; //no sorting for this
+        bool                             m_reverse;
+        unsigned int                     m_difficulty;
+        unsigned int                     m_laps;
+        unsigned int                     m_replay_version; //no sorting for this
+        uint64_t                         m_replay_uid; //no sorting for this
+        float                            m_min_time;
+    };   // ReplayHeader
+
 protected:
     /** Stores a transform event, i.e. a position and rotation of a kart
      *  at a certain time. */
@@ -97,22 +119,60 @@ protected:
         bool        m_jumping;
     };   // KartReplayEvent
 
+    // ------------------------------------------------------------------------
+    /** All events of one kart. */
+    struct KartEvents
+    {
+        std::vector<TransformEvent>  m_transform_events;
+        std::vector<PhysicInfo>      m_physic_info;
+        std::vector<BonusInfo>       m_bonus_info;
+        std::vector<KartReplayEvent> m_kart_replay_event;
+    };   // KartEvents
+
+    /** First replay version that uses the binary format. */
+    static const unsigned int FIRST_BINARY_REPLAY_VERSION = 5;
+
     // ------------------------------------------------------------------------
     FILE *openReplayFile(bool writeable, bool full_path = false, int replay_file_number=1);
     // ------------------------------------------------------------------------
+    static bool isBinaryReplay(const uint8_t *data, size_t size);
+    static void writeBinaryHeader(std::string *out, const ReplayHeader &h);
+    static bool readBinaryHeader(const uint8_t *data, size_t size,
+                                 ReplayHeader *h, size_t *header_size);
+    static bool readBinaryHeader(FILE *fd, ReplayHeader *h);
+    static void writeBinaryKartEvents(std::string *out,
+                                      const TransformEvent *t,
+                                      const PhysicInfo *p,
+                                      const BonusInfo *b,
+                                      const KartReplayEvent *r,
+                                      unsigned int count);
+    static bool readBinaryKartEvents(const uint8_t **data, const uint8_t *end,
+                                     KartEvents *events);
+    static bool readTextHeader(FILE *fd, ReplayHeader *h, int call_index);
+    static bool readTextKartEvents(FILE *fd, unsigned int version,
+                                   KartEvents *events);
+    static bool readReplay(const std::string &filename, ReplayHeader *h,
+                           std::vector<KartEvents> *events);
+    static bool saveBinaryReplay(const std::string &filename,
+                                 const ReplayHeader &h,
+                                 const std::vector<KartEvents> &events);
+    static bool sameKartEvents(const KartEvents &orig,
+                               const KartEvents &binary);
+    // ------------------------------------------------------------------------
     /** Returns the filename that was opened. */
     virtual const std::string& getReplayFilename(int replay_file_number = 1) const = 0;
     // ------------------------------------------------------------------------
     /** Returns the version number of the replay file recorderd by this executable.
      *  This is also used as a maximum supported version by this exexcutable. */
-    unsigned int getCurrentReplayVersion() const { return 4; }
+    static unsigned int getCurrentReplayVersion() { return 5; }
 
     // ------------------------------------------------------------------------
     /** This is used to check that a loaded replay file can still
      *  be understood by this executable. */
-    unsigned int getMinSupportedReplayVersion() const { return 3; }
+    static unsigned int getMinSupportedReplayVersion() { return 3; }
 
 public:
+    static void unitTesting();
              ReplayBase();
     virtual ~ReplayBase() {};
 };   // ReplayBase
@@ -20,12 +20,14 @@
 
 #include "config/stk_config.hpp"
 #include "io/file_manager.hpp"
+#include "io/mapped_file.hpp"
 #include "karts/ghost_kart.hpp"
 #include "karts/controller/ghost_controller.hpp"
 #include "modes/world.hpp"
 #include "race/race_manager.hpp"
 #include "tracks/track.hpp"
 #include "tracks/track_manager.hpp"
+#include "utils/time.hpp"
 
 #include <irrlicht.h>
 #include <stdio.h>
@@ -102,13 +104,20 @@ void ReplayPlay::loadAllReplayFile()
 }   // loadAllReplayFile
 
 //-----------------------------------------------------------------------------
+/** Reads the header of a replay file (text or binary) and adds the replay
+ *  to the list of available replays. The kart data is only read when the
+ *  replay is loaded, and for binary replays it is not read at all here.
+ *  \param fn Name of the replay file.
+ *  \param custom_replay True if fn is a full path.
+ *  \param call_index Used as UID of old replays which don't have one.
+ *  \return True if the replay was added.
+ */
 bool ReplayPlay::addReplayFile(const std::string& fn, bool custom_replay, int call_index)
 {
-
-    char s[1024], s1[1024];
     if (StringUtils::getExtension(fn) != "replay") return false;
-    FILE *fd = fopen(custom_replay ? fn.c_str() :
-        (file_manager->getReplayDir() + fn).c_str(), "r");
+    const std::string full_path = custom_replay
+                                ? fn : file_manager->getReplayDir() + fn;
+    FILE *fd = fopen(full_path.c_str(), "rb");
     if (fd == NULL) return false;
     ReplayData rd;
 
@@ -116,175 +125,43 @@ bool ReplayPlay::addReplayFile(const std::string& fn, bool custom_replay, int ca
     rd.m_custom_replay_file = custom_replay;
     rd.m_filename = fn;
 
-    fgets(s, 1023, fd);
-    unsigned int version;
-    if (sscanf(s,"version: %u", &version) != 1)
-    {
-        Log::warn("Replay", "No Version information "
-                  "found in replay file (bogus replay file).");
-        fclose(fd);
-        return false;
-    }
-    if (version > getCurrentReplayVersion() ||
-        version < getMinSupportedReplayVersion() )
+    uint8_t magic[4];
+    bool is_binary = fread(magic, 1, 4, fd) == 4 && isBinaryReplay(magic, 4);
+    bool ok;
+    if (is_binary)
     {
-        Log::warn("Replay", "Replay is version '%d'", version);
-        Log::warn("Replay", "STK replay version is '%d'", getCurrentReplayVersion());
-        Log::warn("Replay", "Minimum supported replay version is '%d'", getMinSupportedReplayVersion());
-        Log::warn("Replay", "Skipped '%s'", fn.c_str());
-        fclose(fd);
-        return false;
-    }
-        rd.m_replay_version = version;
-
-    if (version >= 4)
-    {
-        fgets(s, 1023, fd);
-        if(sscanf(s, "stk_version: %s", s1) != 1)
-        {
-            Log::warn("Replay", "No STK release version found in replay file.");
-            fclose(fd);
-            return false;
-        }
-        rd.m_stk_version = s1;
+        fseek(fd, 0, SEEK_SET);
+        ok = readBinaryHeader(fd, &rd);
     }
     else
-        rd.m_stk_version = "";
-
-    while(true)
     {
-        fgets(s, 1023, fd);
-        core::stringc is_end(s);
-        is_end.trim();
-        if (is_end == "kart_list_end") break;
-        char s1[1024];
-        char display_name_encoded[1024];
-
-        int scanned = sscanf(s,"kart: %s %[^\n]", s1, display_name_encoded);
-        if (scanned < 1)
-        {
-            Log::warn("Replay", "Could not read ghost karts info!");
-            break;
-        }
-
-        rd.m_kart_list.push_back(std::string(s1));
-        if (scanned == 2)
-        {
-            // If username of kart is present, use it
-            rd.m_name_list.push_back(StringUtils::xmlDecode(std::string(display_name_encoded)));
-            if (rd.m_name_list.size() == 1)
-            {
-                // First user is the game master and the "owner" of this replay file
-                rd.m_user_name = rd.m_name_list[0];
-            }
-        } else
-        { // scanned == 1
-            // If username is not present, kart display name will default to kart name
-            // (see GhostController::getName)
-            rd.m_name_list.push_back("");
-        }
-
-        // Read kart color data
-        if (version >= 4)
-        {
-            float f = 0;
-            fgets(s, 1023, fd);
-            if(sscanf(s, "kart_color: %f", &f) != 1)
-            {
-                Log::warn("Replay", "Kart color missing in replay file.");
-                fclose(fd);
-                return false;
-            }
-            rd.m_kart_color.push_back(f);
-        }
-        else
-            rd.m_kart_color.push_back(0.0f); // Use default kart color
-    }
-
-    int reverse = 0;
-    fgets(s, 1023, fd);
-    if(sscanf(s, "reverse: %d", &reverse) != 1)
-    {
-        Log::warn("Replay", "No reverse info found in replay file.");
+        // Reopen in text mode to handle line endings correctly
         fclose(fd);
-        return false;
+        fd = fopen(full_path.c_str(), "r");
+        if (fd == NULL) return false;
+        ok = readTextHeader(fd, &rd, call_index);
     }
-    rd.m_reverse = reverse != 0;
-
-    fgets(s, 1023, fd);
-    if (sscanf(s, "difficulty: %u", &rd.m_difficulty) != 1)
+    fclose(fd);
+    if (!ok)
     {
-        Log::warn("Replay", " No difficulty found in replay file.");
-        fclose(fd);
+        Log::warn("Replay", "Skipped '%s'", fn.c_str());
         return false;
     }
 
-    if (version >= 4)
-    {
-        fgets(s, 1023, fd);
-        if (sscanf(s, "mode: %s", s1) != 1)
-        {
-            Log::warn("Replay", "Replay mode not found in replay file.");
-            fclose(fd);
-            return false;
-        }
-        rd.m_minor_mode = s1;
-    }
-    // Assume time-trial mode for old replays
-    else
-        rd.m_minor_mode = "time-trial";
-
+    // First user is the game master and the "owner" of this replay file
+    if (!rd.m_name_list.empty())
+        rd.m_user_name = rd.m_name_list[0];
 
-    fgets(s, 1023, fd);
-    if (sscanf(s, "track: %s", s1) != 1)
-    {
-        Log::warn("Replay", "Track info not found in replay file.");
-        fclose(fd);
-        return false;
-    }
-    rd.m_track_name = std::string(s1);
     Track* t = track_manager->getTrack(rd.m_track_name);
     if (t == NULL)
     {
         Log::warn("Replay", "Track '%s' used in replay not found in STK!",
         rd.m_track_name.c_str());
-        fclose(fd);
         return false;
     }
 
     rd.m_track = t;
 
-    fgets(s, 1023, fd);
-    if (sscanf(s, "laps: %u", &rd.m_laps) != 1)
-    {
-        Log::warn("Replay", "No number of laps found in replay file.");
-        fclose(fd);
-        return false;
-    }
-
-    fgets(s, 1023, fd);
-    if (sscanf(s, "min_time: %f", &rd.m_min_time) != 1)
-    {
-        Log::warn("Replay", "Finish time not found in replay file.");
-        fclose(fd);
-        return false;
-    }
-
-    if (version >= 4)
-    {
-        fgets(s, 1023, fd);
-        if (sscanf(s, "replay_uid: %" PRIu64, &rd.m_replay_uid) != 1)
-        {
-            Log::warn("Replay", "Replay UID not found in replay file.");
-            fclose(fd);
-            return false;
-        }
-    }
-    // No UID in old replay format
-    else
-        rd.m_replay_uid = call_index;
-
-    fclose(fd);
     m_replay_file_list.push_back(rd);
 
     assert(m_replay_file_list.size() > 0);
@@ -312,15 +189,20 @@ void ReplayPlay::load()
 //-----------------------------------------------------------------------------
 void ReplayPlay::loadFile(bool second_replay)
 {
-    char s[1024];
-
     int replay_index = second_replay ? m_second_replay_file : m_current_replay_file;
     int replay_file_number = second_replay ? 2 : 1;
 
-    FILE *fd = openReplayFile(/*writeable*/false,
-            m_replay_file_list.at(replay_index).m_custom_replay_file, replay_file_number);
+    const ReplayData &rd = m_replay_file_list.at(replay_index);
+    const std::string full_path = rd.m_custom_replay_file
+        ? getReplayFilename(replay_file_number)
+        : file_manager->getReplayDir() + getReplayFilename(replay_file_number);
+
+    Log::info("Replay", "Reading replay file '%s'.", 
+               getReplayFilename(replay_file_number).c_str());
 
-    if(!fd)
+    ReplayHeader header;
+    std::vector<KartEvents> events;
+    if (!readReplay(full_path, &header, &events))
     {
         Log::error("Replay", "Can't read '%s', ghost replay disabled.",
                getReplayFilename(replay_file_number).c_str());
@@ -328,38 +210,21 @@ void ReplayPlay::loadFile(bool second_replay)
         return;
     }
 
-    Log::info("Replay", "Reading replay file '%s'.", 
-               getReplayFilename(replay_file_number).c_str());
-
-    ReplayData &rd = m_replay_file_list[replay_index];
-    unsigned int num_kart = (unsigned int)m_replay_file_list.at(replay_index)
-                                                            .m_kart_list.size();
-    unsigned int lines_to_skip = (rd.m_replay_version == 3) ? 7 : 10;
-    lines_to_skip += (rd.m_replay_version == 3) ? num_kart : 2*num_kart;
-
-    for (unsigned int i = 0; i < lines_to_skip; i++)
-        fgets(s, 1023, fd);
-
-    // eof actually doesn't trigger here, since it requires first to try
-    // reading behind eof, but still it's clearer this way.
-    while(!feof(fd))
-    {
-        if(fgets(s, 1023, fd)==NULL)  // eof reached
-            break;
-        readKartData(fd, s, second_replay);
-    }
-
-    fclose(fd);
+    // Ignore any additional kart data that has no entry in the header
+    if (events.size() > rd.m_kart_list.size())
+        events.resize(rd.m_kart_list.size());
+    for (const KartEvents &ke : events)
+        addGhostKart(ke, second_replay);
 }   // loadFile
 
 //-----------------------------------------------------------------------------
-/** Reads all data from a replay file for a specific kart.
- *  \param fd The file descriptor from which to read.
+/** Creates a ghost kart for the next kart of a replay file and adds all
+ *  events to it.
+ *  \param events The events of the kart.
+ *  \param second_replay True if this kart is from the second replay.
  */
-void ReplayPlay::readKartData(FILE *fd, char *next_line, bool second_replay)
+void ReplayPlay::addGhostKart(const KartEvents &events, bool second_replay)
 {
-    char s[1024];
-
     int replay_index = second_replay ? m_second_replay_file
                                      : m_current_replay_file;
 
@@ -379,120 +244,159 @@ void ReplayPlay::readKartData(FILE *fd, char *next_line, bool second_replay)
                                                  rd.m_name_list[kart_num-first_loaded_f_num]);
     getGhostKart(kart_num)->setController(controller);
 
-    unsigned int size;
-    if(sscanf(next_line,"size: %u",&size)!=1)
-        Log::fatal("Replay", "Number of records not found in replay file "
-            "for kart %d.", kart_num);
+    for (unsigned int i = 0; i < events.m_transform_events.size(); i++)
+    {
+        m_ghost_karts[kart_num]->addReplayEvent(
+            events.m_transform_events[i].m_time,
+            events.m_transform_events[i].m_transform,
+            events.m_physic_info[i], events.m_bonus_info[i],
+            events.m_kart_replay_event[i]);
+    }
+}   // addGhostKart
 
-    for(unsigned int i=0; i<size; i++)
+//-----------------------------------------------------------------------------
+/** Converts a replay file to the binary format. The file is replaced only
+ *  if the conversion was successful.
+ *  \param filename Full path of the replay file.
+ *  \return True if the file was converted.
+ */
+bool ReplayPlay::convertReplay(const std::string &filename)
+{
+    ReplayHeader header;
+    std::vector<KartEvents> events;
+    if (!readReplay(filename, &header, &events))
     {
-        fgets(s, 1023, fd);
-        float x, y, z, rx, ry, rz, rw, time, speed, steer, w1, w2, w3, w4, nitro_amount, distance;
-        int skidding_state, attachment, item_amount, item_type, special_value,
-            nitro, zipper, skidding, red_skidding, jumping;
+        Log::error("Replay", "Can't read replay '%s'.", filename.c_str());
+        return false;
+    }
+    if (header.m_replay_version >= FIRST_BINARY_REPLAY_VERSION)
+    {
+        Log::info("Replay", "'%s' is already a binary replay.",
+                  filename.c_str());
+        return true;
+    }
 
-        // Check for EV_TRANSFORM event:
-        // -----------------------------
+    // Write to a temporary file first, so the original file is not lost
+    // if anything goes wrong.
+    const std::string tmp = filename + ".tmp";
+    if (!saveBinaryReplay(tmp, header, events))
+    {
+        Log::error("Replay", "Can't write '%s'.", tmp.c_str());
+        file_manager->removeFile(tmp);
+        return false;
+    }
+    // Only replace the original if the converted replay reads back the
+    // same, apart from the error caused by quantization
+    ReplayHeader check_header;
+    std::vector<KartEvents> check_events;
+    bool same = readReplay(tmp, &check_header, &check_events) &&
+                check_events.size() == events.size() &&
+                check_header.m_kart_list == header.m_kart_list &&
+                check_header.m_track_name == header.m_track_name &&
+                check_header.m_laps == header.m_laps &&
+                check_header.m_replay_uid == header.m_replay_uid;
+    for (unsigned int i = 0; same && i < events.size(); i++)
+        same = sameKartEvents(events[i], check_events[i]);
+    if (!same)
+    {
+        Log::error("Replay", "Verifying converted replay '%s' failed.",
+                   filename.c_str());
+        file_manager->removeFile(tmp);
+        return false;
+    }
 
-        // Up to STK 0.9.3 replays
-        if (rd.m_replay_version == 3)
+    // Keep the original until the converted file is in place
+    const std::string backup = filename + ".bak";
+    file_manager->removeFile(backup);
+    if (rename(filename.c_str(), backup.c_str()) != 0)
+    {
+        Log::error("Replay", "Can't rename '%s' to '%s'.", filename.c_str(),
+                   backup.c_str());
+        file_manager->removeFile(tmp);
+        return false;
+    }
+    if (rename(tmp.c_str(), filename.c_str()) != 0)
+    {
+        Log::error("Replay", "Can't rename '%s' to '%s'.", tmp.c_str(),
+                   filename.c_str());
+        rename(backup.c_str(), filename.c_str());
+        file_manager->removeFile(tmp);
+        return false;
+    }
+    file_manager->removeFile(backup);
+    Log::info("Replay", "Converted '%s' from version %d to binary version "
+              "%d.", filename.c_str(), header.m_replay_version,
+              getCurrentReplayVersion());
+    return true;
+}   // convertReplay
+
+//-----------------------------------------------------------------------------
+/** Measures the time to load all replays in a directory in their current
+ *  format and in the binary format, and compares the file sizes. The
+ *  binary data is only created in memory, no files are modified.
+ *  \param dir The directory with the replays to test.
+ */
+void ReplayPlay::benchmarkReplays(const std::string &dir)
+{
+    std::set<std::string> files;
+    file_manager->listFiles(files, dir, /*is_full_path*/ false);
+    const std::string tmp = file_manager->getCachedDataDir()
+                          + "replay-benchmark.replay";
+
+    double orig_time = 0, binary_time = 0, header_time = 0;
+    uint64_t orig_size = 0, binary_size = 0;
+    unsigned int count = 0;
+    for (const std::string &f : files)
+    {
+        if (StringUtils::getExtension(f) != "replay") continue;
+        const std::string full_path = dir + "/" + f;
+
+        ReplayHeader header;
+        std::vector<KartEvents> events;
+        double start = StkTime::getRealTime();
+        if (!readReplay(full_path, &header, &events))
+        {
+            Log::warn("Replay", "Skipping '%s'.", f.c_str());
+            continue;
+        }
+        orig_time += StkTime::getRealTime() - start;
+        orig_size += MappedFile(full_path).getSize();
+
+        if (!saveBinaryReplay(tmp, header, events))
         {
-            if(sscanf(s, "%f  %f %f %f  %f %f %f %f  %f  %f  %f %f %f %f  %d %d %d %d %d\n",
-                &time,
-                &x, &y, &z,
-                &rx, &ry, &rz, &rw,
-                &speed, &steer, &w1, &w2, &w3, &w4,
-                &nitro, &zipper, &skidding, &red_skidding, &jumping
-                )==19)
-            {
-                btQuaternion q(rx, ry, rz, rw);
-                btVector3 xyz(x, y, z);
-                PhysicInfo pi             = {0};
-                BonusInfo bi              = {0};
-                KartReplayEvent kre       = {0};
-
-                pi.m_speed                = speed;
-                pi.m_steer                = steer;
-                pi.m_suspension_length[0] = w1;
-                pi.m_suspension_length[1] = w2;
-                pi.m_suspension_length[2] = w3;
-                pi.m_suspension_length[3] = w4;
-                pi.m_skidding_state       = 0;    //not saved in version 3 replays
-                bi.m_attachment           = 0;    //not saved in version 3 replays
-                bi.m_nitro_amount         = 0;    //not saved in version 3 replays
-                bi.m_item_amount          = 0;    //not saved in version 3 replays
-                bi.m_item_type            = 0;    //not saved in version 3 replays
-                bi.m_special_value        = 0;    //not saved in version 3 replays
-                kre.m_distance            = 0.0f; //not saved in version 3 replays
-                kre.m_nitro_usage         = nitro;
-                kre.m_zipper_usage        = zipper!=0;
-                kre.m_skidding_effect     = skidding;
-                kre.m_red_skidding        = red_skidding!=0;
-                kre.m_jumping             = jumping != 0;
-                m_ghost_karts[kart_num]->addReplayEvent(time,
-                    btTransform(q, xyz), pi, bi, kre);
-            }
-            else
-            {
-                // Invalid record found
-                // ---------------------
-                Log::warn("Replay", "Can't read replay data line %d:", i);
-                Log::warn("Replay", "%s", s);
-                Log::warn("Replay", "Ignored.");
-            }
+            Log::error("Replay", "Can't write '%s'.", tmp.c_str());
+            break;
         }
+        binary_size += MappedFile(tmp).getSize();
 
-        //version 4 replays (STK 0.9.4 and higher)
-        else
+        start = StkTime::getRealTime();
+        if (!readReplay(tmp, &header, &events))
         {
-            if(sscanf(s, "%f  %f %f %f  %f %f %f %f  %f  %f  %f %f %f %f %d  %d %f %d %d %d  %f %d %d %d %d %d\n",
-                &time,
-                &x, &y, &z,
-                &rx, &ry, &rz, &rw,
-                &speed, &steer, &w1, &w2, &w3, &w4, &skidding_state,
-                &attachment, &nitro_amount, &item_amount, &item_type, &special_value,
-                &distance, &nitro, &zipper, &skidding, &red_skidding, &jumping
-                )==26)
-            {
-                btQuaternion q(rx, ry, rz, rw);
-                btVector3 xyz(x, y, z);
-                PhysicInfo pi             = {0};
-                BonusInfo bi              = {0};
-                KartReplayEvent kre       = {0};
-
-                pi.m_speed                = speed;
-                pi.m_steer                = steer;
-                pi.m_suspension_length[0] = w1;
-                pi.m_suspension_length[1] = w2;
-                pi.m_suspension_length[2] = w3;
-                pi.m_suspension_length[3] = w4;
-                pi.m_skidding_state       = skidding_state;
-                bi.m_attachment           = attachment;
-                bi.m_nitro_amount         = nitro_amount;
-                bi.m_item_amount          = item_amount;
-                bi.m_item_type            = item_type;
-                bi.m_special_value        = special_value;
-                kre.m_distance            = distance;
-                kre.m_nitro_usage         = nitro;
-                kre.m_zipper_usage        = zipper!=0;
-                kre.m_skidding_effect     = skidding;
-                kre.m_red_skidding        = red_skidding!=0;
-                kre.m_jumping             = jumping != 0;
-                m_ghost_karts[kart_num]->addReplayEvent(time,
-                    btTransform(q, xyz), pi, bi, kre);
-            }
-            else
-            {
-                // Invalid record found
-                // ---------------------
-                Log::warn("Replay", "Can't read replay data line %d:", i);
-                Log::warn("Replay", "%s", s);
-                Log::warn("Replay", "Ignored.");
-            }
+            Log::error("Replay", "Can't read converted '%s'.", f.c_str());
+            continue;
         }
-    }   // for i
+        binary_time += StkTime::getRealTime() - start;
 
-}   // readKartData
+        start = StkTime::getRealTime();
+        FILE *fd = fopen(tmp.c_str(), "rb");
+        if (fd)
+        {
+            readBinaryHeader(fd, &header);
+            fclose(fd);
+        }
+        header_time += StkTime::getRealTime() - start;
+        count++;
+    }
+    file_manager->removeFile(tmp);
+
+    Log::info("Replay", "Benchmarked %d replays in '%s':", count,
+              dir.c_str());
+    Log::info("Replay", "Original:    %f s, %" PRIu64 " bytes.",
+              orig_time, orig_size);
+    Log::info("Replay", "Binary:      %f s, %" PRIu64 " bytes.",
+              binary_time, binary_size);
+    Log::info("Replay", "Header only: %f s.", header_time);
+}   // benchmarkReplays
 
 //-----------------------------------------------------------------------------
 /** call getReplayIdByUID and set the current replay file to the first one
@@ -19,6 +19,7 @@
 #include <assert.h>
 #include <angelscript.h>
 #include "io/file_manager.hpp"
+#include "io/mapped_file.hpp"
 #include "karts/kart.hpp"
 #include "modes/world.hpp"
 #include "scriptengine/aswrappedcall.hpp"
@@ -37,8 +38,13 @@
 #include "states_screens/dialogs/tutorial_message_dialog.hpp"
 #include "tracks/track_object_manager.hpp"
 #include "tracks/track.hpp"
+#include "utils/constants.hpp"
 #include "utils/profiler.hpp"
+#include "utils/time.hpp"
 
+#include <iomanip>
+#include <sstream>
+#include <stdio.h>
 
 using namespace Scripting;
 
@@ -46,6 +52,65 @@ namespace Scripting
 {
     const char* MODULE_ID_MAIN_SCRIPT_FILE = "main";
 
+    /** Increase this if the format of the byte code cache files changes. */
+    const uint32_t BYTE_CODE_CACHE_VERSION = 1;
+
+    const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+
+    // ------------------------------------------------------------------------
+    /** Adds data to a 64 bit FNV-1a hash. */
+    uint64_t hashData(uint64_t hash, const void* data, size_t size)
+    {
+        const uint8_t* p = (const uint8_t*)data;
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= p[i];
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }   // hashData
+
+    // ------------------------------------------------------------------------
+    /** Collects the byte code saved by AngelScript in memory. */
+    class ByteCodeWriter : public asIBinaryStream
+    {
+    public:
+        std::vector<uint8_t> m_data;
+        virtual int Read(void* ptr, asUINT size) { return -1; }
+        virtual int Write(const void* ptr, asUINT size)
+        {
+            const uint8_t* p = (const uint8_t*)ptr;
+            m_data.insert(m_data.end(), p, p + size);
+            return 0;
+        }
+    };   // ByteCodeWriter
+
+    // ------------------------------------------------------------------------
+    /** Passes byte code from memory to AngelScript. */
+    class ByteCodeReader : public asIBinaryStream
+    {
+    private:
+        const uint8_t* m_data;
+        size_t m_size;
+        size_t m_position;
+    public:
+        ByteCodeReader(const uint8_t* data, size_t size)
+        {
+            m_data     = data;
+            m_size     = size;
+            m_position = 0;
+        }
+        virtual int Read(void* ptr, asUINT size)
+        {
+            if (m_position + size > m_size)
+                return -1;
+            memcpy(ptr, m_data + m_position, size);
+            m_position += size;
+            return 0;
+        }
+        virtual int Write(const void* ptr, asUINT size) { return -1; }
+    };   // ByteCodeReader
+
     void AngelScript_ErrorCallback (const asSMessageInfo *msg, void *param)
     {
         const char *type = "ERR ";
@@ -71,6 +136,15 @@ namespace Scripting
         // The script compiler will write any compiler messages to the callback.
         m_engine->SetMessageCallback(asFUNCTION(AngelScript_ErrorCallback), 0, asCALL_CDECL);
 
+        // Reuse contexts instead of creating one for each script call
+        m_engine->SetContextCallbacks(requestContext, returnContext, this);
+        m_generation        = 1;
+        m_scripts_hash      = FNV_OFFSET_BASIS;
+        m_num_calls         = 0;
+        m_call_time         = 0.0;
+        m_build_time        = 0.0;
+        m_loaded_from_cache = false;
+
         // Configure the script engine with all the functions, 
         // and variables that the script should be able to use.
         configureEngine(m_engine);
@@ -81,9 +155,39 @@ namespace Scripting
         // Release the engine
         m_pending_timeouts.clearAndDeleteAll();
         m_engine->DiscardModule(MODULE_ID_MAIN_SCRIPT_FILE);
+        for (asIScriptContext* ctx : m_context_pool)
+            ctx->Release();
+        m_context_pool.clear();
         m_engine->Release();
     }
 
+    //-----------------------------------------------------------------------------
+    /** Called by AngelScript (and by this class) when a context is needed.
+     *  Returns an unused context from the pool, or creates a new one.
+     */
+    asIScriptContext* ScriptEngine::requestContext(asIScriptEngine* engine,
+                                                   void* param)
+    {
+        ScriptEngine* script_engine = (ScriptEngine*)param;
+        if (script_engine->m_context_pool.empty())
+            return engine->CreateContext();
+        asIScriptContext* ctx = script_engine->m_context_pool.back();
+        script_engine->m_context_pool.pop_back();
+        return ctx;
+    }   // requestContext
+
+    //-----------------------------------------------------------------------------
+    /** Called when a context is not needed anymore, puts it back into the
+     *  pool.
+     */
+    void ScriptEngine::returnContext(asIScriptEngine* engine,
+                                     asIScriptContext* ctx, void* param)
+    {
+        ScriptEngine* script_engine = (ScriptEngine*)param;
+        ctx->Unprepare();
+        script_engine->m_context_pool.push_back(ctx);
+    }   // returnContext
+
 
 
     /** Get Script By it's file name
@@ -135,7 +239,7 @@ namespace Scripting
             return;
         }
 
-        asIScriptContext *ctx = m_engine->CreateContext();
+        asIScriptContext *ctx = m_engine->RequestContext();
         if (ctx == NULL)
         {
             Log::error("Scripting", "evalScript: Failed to create the context.");
@@ -147,7 +251,7 @@ namespace Scripting
         if (r < 0)
         {
             Log::error("Scripting", "evalScript: Failed to prepare the context.");
-            ctx->Release();
+            m_engine->ReturnContext(ctx);
             return;
         }
 
@@ -170,7 +274,7 @@ namespace Scripting
             }
         }
 
-        ctx->Release();
+        m_engine->ReturnContext(ctx);
         func->Release();
     }
 
@@ -178,7 +282,7 @@ namespace Scripting
 
     void ScriptEngine::runDelegate(asIScriptFunction* delegate)
     {
-        asIScriptContext *ctx = m_engine->CreateContext();
+        asIScriptContext *ctx = m_engine->RequestContext();
         if (ctx == NULL)
         {
             Log::error("Scripting", "runMethod: Failed to create the context.");
@@ -190,7 +294,7 @@ namespace Scripting
         if (r < 0)
         {
             Log::error("Scripting", "runMethod: Failed to prepare the context.");
-            ctx->Release();
+            m_engine->ReturnContext(ctx);
             return;
         }
 
@@ -215,7 +319,7 @@ namespace Scripting
             }
         }
 
-        ctx->Release();
+        m_engine->ReturnContext(ctx);
     }
 
     //-----------------------------------------------------------------------------
@@ -272,7 +376,8 @@ namespace Scripting
     /** runs the specified script
     *  \param string scriptName = name of script to run
     */
-    void ScriptEngine::runFunction(bool warn_if_not_found, std::string function_name)
+    void ScriptEngine::runFunction(bool warn_if_not_found,
+                                   const std::string& function_name)
     {
         std::function<void(asIScriptContext*)> callback;
         std::function<void(asIScriptContext*)> get_return_value;
@@ -281,8 +386,9 @@ namespace Scripting
 
     //-----------------------------------------------------------------------------
 
-    void ScriptEngine::runFunction(bool warn_if_not_found, std::string function_name,
-        std::function<void(asIScriptContext*)> callback)
+    void ScriptEngine::runFunction(bool warn_if_not_found,
+        const std::string& function_name,
+        const std::function<void(asIScriptContext*)>& callback)
     {
         std::function<void(asIScriptContext*)> get_return_value;
         runFunction(warn_if_not_found, function_name, callback, get_return_value);
@@ -293,64 +399,107 @@ namespace Scripting
     /** runs the specified script
     *  \param string scriptName = name of script to run
     */
-    void ScriptEngine::runFunction(bool warn_if_not_found, std::string function_name,
-        std::function<void(asIScriptContext*)> callback,
-        std::function<void(asIScriptContext*)> get_return_value)
+    void ScriptEngine::runFunction(bool warn_if_not_found,
+        const std::string& function_name,
+        const std::function<void(asIScriptContext*)>& callback,
+        const std::function<void(asIScriptContext*)>& get_return_value)
     {
-        int r; //int for error checking
+        asIScriptFunction *func = getFunction(warn_if_not_found, function_name);
+        if (func != NULL)
+            executeFunction(func, callback, get_return_value);
+    }
 
-        asIScriptFunction *func;
+    //-----------------------------------------------------------------------------
+    /** Runs a script function which is looked up only once, see
+     *  ScriptFunction. This should be used for functions which are called
+     *  often, e.g. collision callbacks.
+     *  \param function The function to run.
+     *  \param callback Called to set the arguments of the function.
+     */
+    void ScriptEngine::runFunction(bool warn_if_not_found,
+        ScriptFunction& function,
+        const std::function<void(asIScriptContext*)>& callback)
+    {
+        if (function.m_generation != m_generation)
+        {
+            function.m_function = getFunction(warn_if_not_found,
+                                              function.m_declaration);
+            function.m_generation = m_generation;
+        }
+        else if (function.m_function == NULL && warn_if_not_found)
+        {
+            Log::warn("Scripting", "Scripting function was not found : %s",
+                      function.m_declaration.c_str());
+        }
+        if (function.m_function == NULL)
+            return;
+
+        std::function<void(asIScriptContext*)> get_return_value;
+        executeFunction(function.m_function, callback, get_return_value);
+    }
 
-        // TODO: allow splitting in multiple files
-        std::string script_filename = "scripting.as";
+    //-----------------------------------------------------------------------------
+    /** Returns the script function with the given declaration, or NULL if it
+     *  does not exist. The result is cached till cleanupCache is called.
+     *  \param function_name Declaration of the function.
+     */
+    asIScriptFunction* ScriptEngine::getFunction(bool warn_if_not_found,
+                                              const std::string& function_name)
+    {
         auto cached_function = m_functions_cache.find(function_name);
-        if (cached_function == m_functions_cache.end())
+        if (cached_function != m_functions_cache.end())
         {
-            // Find the function for the function we want to execute.
-            //      This is how you call a normal function with arguments
-            //      asIScriptFunction *func = engine->GetModule(0)->GetFunctionByDecl("void func(arg1Type, arg2Type)");
-            asIScriptModule* module = m_engine->GetModule(MODULE_ID_MAIN_SCRIPT_FILE);
-
-            if (module == NULL)
-            {
-                if (warn_if_not_found)
-                    Log::warn("Scripting", "Scripting function was not found : %s (module not found)", function_name.c_str());
-                else
-                    Log::debug("Scripting", "Scripting function was not found : %s (module not found)", function_name.c_str());
-                m_functions_cache[function_name] = NULL; // remember that this function is unavailable
-                return;
-            }
+            // Script present in cache
+            if (cached_function->second == NULL && warn_if_not_found)
+                Log::warn("Scripting", "Scripting function was not found : %s", function_name.c_str());
+            return cached_function->second;
+        }
 
-            func = module->GetFunctionByDecl(function_name.c_str());
-            
-            if (func == NULL)
-            {
-                if (warn_if_not_found)
-                    Log::warn("Scripting", "Scripting function was not found : %s", function_name.c_str());
-                else
-                    Log::debug("Scripting", "Scripting function was not found : %s", function_name.c_str());
-                m_functions_cache[function_name] = NULL; // remember that this function is unavailable
-                return;
-            }
+        // Find the function for the function we want to execute.
+        //      This is how you call a normal function with arguments
+        //      asIScriptFunction *func = engine->GetModule(0)->GetFunctionByDecl("void func(arg1Type, arg2Type)");
+        asIScriptModule* module = m_engine->GetModule(MODULE_ID_MAIN_SCRIPT_FILE);
 
-            m_functions_cache[function_name] = func;
-            func->AddRef();
-        }
-        else
+        if (module == NULL)
         {
-            // Script present in cache
-            func = cached_function->second;
+            if (warn_if_not_found)
+                Log::warn("Scripting", "Scripting function was not found : %s (module not found)", function_name.c_str());
+            else
+                Log::debug("Scripting", "Scripting function was not found : %s (module not found)", function_name.c_str());
+            m_functions_cache[function_name] = NULL; // remember that this function is unavailable
+            return NULL;
         }
 
+        asIScriptFunction *func = module->GetFunctionByDecl(function_name.c_str());
+
         if (func == NULL)
         {
             if (warn_if_not_found)
                 Log::warn("Scripting", "Scripting function was not found : %s", function_name.c_str());
-            return; // function unavailable
+            else
+                Log::debug("Scripting", "Scripting function was not found : %s", function_name.c_str());
+            m_functions_cache[function_name] = NULL; // remember that this function is unavailable
+            return NULL;
         }
 
-        // Create a context that will execute the script.
-        asIScriptContext *ctx = m_engine->CreateContext();
+        m_functions_cache[function_name] = func;
+        func->AddRef();
+        return func;
+    }   // getFunction
+
+    //-----------------------------------------------------------------------------
+    /** Executes a script function using a pooled context.
+     *  \param callback If set, called to set the arguments.
+     *  \param get_return_value If set, called to get the return value.
+     */
+    void ScriptEngine::executeFunction(asIScriptFunction* func,
+        const std::function<void(asIScriptContext*)>& callback,
+        const std::function<void(asIScriptContext*)>& get_return_value)
+    {
+        const double start = StkTime::getRealTime();
+
+        // Get a context that will execute the script.
+        asIScriptContext *ctx = m_engine->RequestContext();
         if (ctx == NULL)
         {
             Log::error("Scripting", "Failed to create the context.");
@@ -363,11 +512,11 @@ namespace Scripting
         // executed. Note, that if because we intend to execute the same function 
         // several times, we will store the function returned by 
         // GetFunctionByDecl(), so that this relatively slow call can be skipped.
-        r = ctx->Prepare(func);
+        int r = ctx->Prepare(func);
         if (r < 0)
         {
             Log::error("Scripting", "Failed to prepare the context.");
-            ctx->Release();
+            m_engine->ReturnContext(ctx);
             //m_engine->Release();
             return;
         }
@@ -415,9 +564,12 @@ namespace Scripting
                 get_return_value(ctx);
         }
 
-        // We must release the contexts when no longer using them
-        ctx->Release();
-    }
+        // The context is put back into the pool to be reused
+        m_engine->ReturnContext(ctx);
+
+        m_num_calls++;
+        m_call_time += StkTime::getRealTime() - start;
+    }   // executeFunction
 
     //-----------------------------------------------------------------------------
 
@@ -430,8 +582,24 @@ namespace Scripting
         }
         m_functions_cache.clear();
         m_engine->DiscardModule(MODULE_ID_MAIN_SCRIPT_FILE);
+        m_generation++;
     }
 
+    //-----------------------------------------------------------------------------
+    /** Prints how many script functions were run, the time needed for them,
+     *  and the time needed to compile or load the scripts of the track. Used
+     *  by the headless AI benchmarks.
+     */
+    void ScriptEngine::logStatistics() const
+    {
+        Log::verbose("Scripting profiling", "Script calls: %u, time %f ms, "
+            "%f us per call", m_num_calls, m_call_time * 1000.0,
+            m_num_calls > 0 ? m_call_time * 1000000.0 / m_num_calls : 0.0);
+        Log::verbose("Scripting profiling", "Scripts %s in %f ms",
+            m_loaded_from_cache ? "loaded from byte code cache" : "compiled",
+            m_build_time * 1000.0);
+    }   // logStatistics
+
     //-----------------------------------------------------------------------------
     /** Configures the script engine by binding functions, enums
     *  \param asIScriptEngine engine = engine to configure
@@ -463,9 +631,18 @@ namespace Scripting
 
     //-----------------------------------------------------------------------------
 
+    /** Adds a script file to the scripts to compile. The scripts are only
+     *  compiled (or loaded from the byte code cache) in compileLoadedScripts.
+     *  \param script_path Full path of the script file.
+     *  \param clear_previous If the previously added scripts are removed.
+     */
     bool ScriptEngine::loadScript(std::string script_path, bool clear_previous)
     {
-        int r;
+        if (clear_previous)
+        {
+            m_script_sections.clear();
+            m_scripts_hash = FNV_OFFSET_BASIS;
+        }
 
         std::string script = getScript(script_path);
         if (script.size() == 0)
@@ -474,44 +651,70 @@ namespace Scripting
             return false;
         }
 
-        // Add the script sections that will be compiled into executable code.
         // If we want to combine more than one file into the same script, then 
         // we can call AddScriptSection() several times for the same module and
-        // the script engine will treat them all as if they were one. The script
-        // section name, will allow us to localize any errors in the script code.
-        asIScriptModule *mod = m_engine->GetModule(MODULE_ID_MAIN_SCRIPT_FILE,
-            clear_previous ? asGM_ALWAYS_CREATE : asGM_CREATE_IF_NOT_EXISTS);
-        r = mod->AddScriptSection("script", &script[0], script.size());
-        if (r < 0)
-        {
-            Log::error("Scripting", "AddScriptSection() failed");
-            return false;
-        }
-    
+        // the script engine will treat them all as if they were one. The
+        // sections are added in compileLoadedScripts, so they are not needed
+        // if the byte code is cached.
+        m_scripts_hash = hashData(m_scripts_hash, script.data(), script.size());
+        m_script_sections.push_back(script);
         return true;
     }
 
     //-----------------------------------------------------------------------------
-
+    /** Compiles all scripts added by loadScript. If the same scripts were
+     *  compiled before, the byte code is loaded from a cache file instead.
+     */
     bool ScriptEngine::compileLoadedScripts()
     {
+        const double start = StkTime::getRealTime();
         int r;
-        asIScriptModule *mod = m_engine->GetModule(MODULE_ID_MAIN_SCRIPT_FILE, asGM_CREATE_IF_NOT_EXISTS);
+        asIScriptModule *mod = m_engine->GetModule(MODULE_ID_MAIN_SCRIPT_FILE, asGM_ALWAYS_CREATE);
+        m_generation++;
 
-        // Compile the script. If there are any compiler messages they will
-        // be written to the message stream that we set right after creating the 
-        // script engine. If there are no errors, and no warnings, nothing will
-        // be written to the stream.
-        r = mod->Build();
-        if (r < 0)
+        std::string cache_file;
+        if (!m_script_sections.empty())
+            cache_file = getByteCodeCacheFile();
+        m_loaded_from_cache = !cache_file.empty() &&
+                              loadByteCode(mod, cache_file);
+
+        bool ok = true;
+        if (!m_loaded_from_cache)
         {
-            Log::error("Scripting", "Build() failed");
-            return false;
-        }
+            // Add the script sections that will be compiled into executable
+            // code. The script section name, will allow us to localize any
+            // errors in the script code.
+            for (const std::string& script : m_script_sections)
+            {
+                r = mod->AddScriptSection("script", script.data(),
+                                          script.size());
+                if (r < 0)
+                {
+                    Log::error("Scripting", "AddScriptSection() failed");
+                    ok = false;
+                    break;
+                }
+            }
 
-        // The engine doesn't keep a copy of the script sections after Build() has
-        // returned. So if the script needs to be recompiled, then all the script
-        // sections must be added again.
+            // Compile the script. If there are any compiler messages they will
+            // be written to the message stream that we set right after creating the 
+            // script engine. If there are no errors, and no warnings, nothing will
+            // be written to the stream.
+            if (ok)
+            {
+                r = mod->Build();
+                if (r < 0)
+                {
+                    Log::error("Scripting", "Build() failed");
+                    ok = false;
+                }
+            }
+            if (ok && !cache_file.empty())
+                saveByteCode(mod, cache_file);
+        }
+        m_script_sections.clear();
+        m_scripts_hash = FNV_OFFSET_BASIS;
+        m_build_time = StkTime::getRealTime() - start;
 
         // If we want to have several scripts executing at different times but 
         // that have no direct relation with each other, then we can compile them
@@ -519,9 +722,88 @@ namespace Scripting
         // scope, so function names, and global variables will not conflict with
         // each other.
 
-        return true;
+        return ok;
     }
 
+    //-----------------------------------------------------------------------------
+    /** Returns the name of the file to cache the byte code of the added
+     *  scripts in. Besides the scripts it depends on the STK and AngelScript
+     *  versions and the registered application interface, since the byte
+     *  code refers to it.
+     */
+    std::string ScriptEngine::getByteCodeCacheFile() const
+    {
+        uint64_t hash = m_scripts_hash;
+        hash = hashData(hash, STK_VERSION, strlen(STK_VERSION));
+        const uint32_t config[] =
+        {
+            ANGELSCRIPT_VERSION, (uint32_t)sizeof(void*),
+            m_engine->GetGlobalFunctionCount(),
+            m_engine->GetGlobalPropertyCount(),
+            m_engine->GetObjectTypeCount(),
+            m_engine->GetEnumCount()
+        };
+        hash = hashData(hash, config, sizeof(config));
+        std::ostringstream file;
+        file << file_manager->getCachedDataDir() << "script-" << std::hex
+             << std::setw(16) << std::setfill('0') << hash << ".bin";
+        return file.str();
+    }   // getByteCodeCacheFile
+
+    //-----------------------------------------------------------------------------
+    /** Loads the byte code of the scripts from a cache file.
+     *  \param module The module to load the byte code into.
+     *  \param cache_file Name of the cache file.
+     *  \return False if the file does not exist or could not be loaded.
+     */
+    bool ScriptEngine::loadByteCode(asIScriptModule* module,
+                                    const std::string& cache_file)
+    {
+        MappedFile file(cache_file);
+        if (!file.isValid())
+            return false;
+
+        // Version, size of byte code
+        uint32_t header[2];
+        bool ok = file.getSize() >= sizeof(header);
+        if (ok)
+        {
+            memcpy(header, file.getData(), sizeof(header));
+            ok = header[0] == BYTE_CODE_CACHE_VERSION &&
+                 file.getSize() == sizeof(header) + header[1];
+        }
+        if (ok)
+        {
+            ByteCodeReader reader(file.getData() + sizeof(header), header[1]);
+            ok = module->LoadByteCode(&reader) >= 0;
+        }
+        if (!ok)
+        {
+            Log::warn("Scripting", "Ignoring invalid byte code cache file "
+                      "'%s'.", cache_file.c_str());
+        }
+        return ok;
+    }   // loadByteCode
+
+    //-----------------------------------------------------------------------------
+    /** Saves the byte code of a compiled module to a cache file.
+     *  \param module The compiled module.
+     *  \param cache_file Name of the cache file.
+     */
+    void ScriptEngine::saveByteCode(asIScriptModule* module,
+                                    const std::string& cache_file) const
+    {
+        ByteCodeWriter writer;
+        if (module->SaveByteCode(&writer) < 0)
+            return;
+
+        const uint32_t header[2] = { BYTE_CODE_CACHE_VERSION,
+                                     (uint32_t)writer.m_data.size() };
+        std::string data((const char*)header, sizeof(header));
+        data.append((const char*)writer.m_data.data(), writer.m_data.size());
+        file_manager->writeCacheFileAtomically(cache_file, data);
+    }   // saveByteCode
+
     //-----------------------------------------------------------------------------
 
     PendingTimeout::PendingTimeout(double time, asIScriptFunction* callback_delegate) 
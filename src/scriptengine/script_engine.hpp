@@ -19,6 +19,7 @@
 #ifndef HEADER_SCRIPT_ENGINE_HPP
 #define HEADER_SCRIPT_ENGINE_HPP
 
+#include "scriptengine/script_function.hpp"
 #include "scriptengine/script_utils.hpp"
 #include "utils/no_copy.hpp"
 #include "utils/ptr_vector.hpp"
@@ -27,7 +28,9 @@
 #include <angelscript.h>
 #include <functional>
 #include <map>
+#include <stdint.h>
 #include <string>
+#include <vector>
 
 class TrackObjectPresentation;
 
@@ -67,12 +70,17 @@ namespace Scripting
     public:
 
 
-        void runFunction(bool warn_if_not_found, std::string function_name);
-        void runFunction(bool warn_if_not_found, std::string function_name,
-            std::function<void(asIScriptContext*)> callback);
-        void runFunction(bool warn_if_not_found, std::string function_name,
-            std::function<void(asIScriptContext*)> callback,
-            std::function<void(asIScriptContext*)> get_return_value);
+        void runFunction(bool warn_if_not_found,
+            const std::string& function_name);
+        void runFunction(bool warn_if_not_found,
+            const std::string& function_name,
+            const std::function<void(asIScriptContext*)>& callback);
+        void runFunction(bool warn_if_not_found,
+            const std::string& function_name,
+            const std::function<void(asIScriptContext*)>& callback,
+            const std::function<void(asIScriptContext*)>& get_return_value);
+        void runFunction(bool warn_if_not_found, ScriptFunction& function,
+            const std::function<void(asIScriptContext*)>& callback);
         void runDelegate(asIScriptFunction* delegate_fn);
         void evalScript(std::string script_fragment);
         void cleanupCache();
@@ -85,13 +93,48 @@ namespace Scripting
         void update(float dt);
 
         asIScriptEngine* getEngine() { return m_engine; }
+        void logStatistics() const;
 
     private:
         asIScriptEngine *m_engine;
         std::map<std::string, asIScriptFunction*> m_functions_cache;
         PtrVector<PendingTimeout> m_pending_timeouts;
 
+        /** Unused script contexts. Creating a context is expensive, and
+         *  scripts are run e.g. for each kart-kart collision. */
+        std::vector<asIScriptContext*> m_context_pool;
+
+        /** Increased whenever the scripts are compiled or discarded, so
+         *  that ScriptFunction handles know they need to be resolved again. */
+        unsigned m_generation;
+
+        /** The content of all script files added since the last
+         *  compilation, and their hash used to find the cached byte code. */
+        std::vector<std::string> m_script_sections;
+        uint64_t m_scripts_hash;
+
+        /** Number of script functions run and the time needed for them,
+         *  and the time needed to compile (or load) the scripts. */
+        unsigned m_num_calls;
+        double   m_call_time;
+        double   m_build_time;
+        bool     m_loaded_from_cache;
+
         void configureEngine(asIScriptEngine *engine);
+        asIScriptFunction* getFunction(bool warn_if_not_found,
+                                       const std::string& function_name);
+        void executeFunction(asIScriptFunction* func,
+            const std::function<void(asIScriptContext*)>& callback,
+            const std::function<void(asIScriptContext*)>& get_return_value);
+        std::string getByteCodeCacheFile() const;
+        bool loadByteCode(asIScriptModule* module,
+                          const std::string& cache_file);
+        void saveByteCode(asIScriptModule* module,
+                          const std::string& cache_file) const;
+        static asIScriptContext* requestContext(asIScriptEngine* engine,
+                                                void* param);
+        static void returnContext(asIScriptEngine* engine,
+                                  asIScriptContext* ctx, void* param);
     };   // class ScriptEngine
 
 }
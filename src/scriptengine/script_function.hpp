@@ -0,0 +1,63 @@
+//
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2019  SuperTuxKart Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_SCRIPT_FUNCTION_HPP
+#define HEADER_SCRIPT_FUNCTION_HPP
+
+#include <string>
+
+class asIScriptFunction;
+
+namespace Scripting
+{
+    /** A handle to a script function that is called often (e.g. a collision
+     *  callback). The function is looked up by its declaration only once,
+     *  and again only after the scripts were reloaded, which avoids building
+     *  the declaration string and searching for it on each call.
+     */
+    class ScriptFunction
+    {
+    private:
+        friend class ScriptEngine;
+
+        /** Declaration of the function, e.g. "void onStart()". */
+        std::string m_declaration;
+
+        /** The resolved function, NULL if it does not exist. The reference
+         *  is owned by the function cache of the script engine. */
+        asIScriptFunction* m_function;
+
+        /** The script generation the function was resolved for, 0 if it was
+         *  not resolved yet. */
+        unsigned m_generation;
+
+    public:
+        ScriptFunction(const std::string& declaration = "")
+        {
+            m_declaration = declaration;
+            m_function    = NULL;
+            m_generation  = 0;
+        }   // ScriptFunction
+        // --------------------------------------------------------------------
+        /** Returns true if no function declaration is set. */
+        bool empty() const { return m_declaration.empty(); }
+        // --------------------------------------------------------------------
+        const std::string& getDeclaration() const { return m_declaration; }
+    };   // class ScriptFunction
+}
+#endif
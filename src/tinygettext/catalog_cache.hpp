@@ -0,0 +1,50 @@
+//  tinygettext - A gettext replacement that works directly on .po files
+//  Copyright (C) 2009-2015 Ingo Ruhnke <grumbel@gmx.de>
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 2
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_TINYGETTEXT_CATALOG_CACHE_HPP
+#define HEADER_TINYGETTEXT_CATALOG_CACHE_HPP
+
+#ifndef SERVER_ONLY
+
+#include <string>
+
+namespace tinygettext {
+
+class Dictionary;
+
+/** Allows the application to store the content of parsed .po files, so
+    that they don't need to be parsed again the next time. */
+class CatalogCache
+{
+public:
+  virtual ~CatalogCache() {}
+
+  /** Fill the empty dictionary \a dict with the cached content of
+      \a pofile. Returns false if there is no valid cache for the file, in
+      which case \a dict must not be modified. */
+  virtual bool load(const std::string& pofile, Dictionary& dict) =0;
+
+  /** Store \a dict, which contains the parsed content of \a pofile */
+  virtual void save(const std::string& pofile, Dictionary& dict) =0;
+};
+
+} // namespace tinygettext
+
+#endif
+
+/* EOF */
+#endif
@@ -51,7 +51,7 @@ Dictionary::set_plural_forms(const PluralForms& plural_forms_)
   plural_forms = plural_forms_;
 }
 
-PluralForms
+const PluralForms&
 Dictionary::get_plural_forms() const
 {
   return plural_forms;
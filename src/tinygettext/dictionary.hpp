@@ -58,7 +58,7 @@ public:
   std::string get_charset() const;
 
   void set_plural_forms(const PluralForms&);
-  PluralForms get_plural_forms() const;
+  const PluralForms& get_plural_forms() const;
 
 
   /** Translate the string \a msgid. */
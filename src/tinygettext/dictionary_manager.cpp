@@ -28,6 +28,7 @@
 #include <fstream>
 #include <algorithm>
 
+#include "catalog_cache.hpp"
 #include "po_parser.hpp"
 #include "stk_file_system.hpp"
 
@@ -49,7 +50,8 @@ DictionaryManager::DictionaryManager(const std::string& charset_) :
   current_language(),
   current_dict(0),
   empty_dict(),
-  filesystem(new StkFileSystem)
+  filesystem(new StkFileSystem),
+  catalog_cache()
 {
 #ifdef DEBUG
     m_magic_number = 0xD1C70471;
@@ -156,23 +158,22 @@ DictionaryManager::get_dictionary(const Language& language)
       if (!best_filename.empty())
       {
         std::string pofile = *p + "/" + best_filename;
-        try
+        if (catalog_cache.get())
         {
-          std::unique_ptr<std::istream> in = filesystem->open_file(pofile);
-          if (!in.get())
+          // Use a separate dictionary, so that only the content of this
+          // file is cached
+          Dictionary po_dict(charset);
+          if (!catalog_cache->load(pofile, po_dict))
           {
-              Log::error("tinygettext", "error: failure opening: '%s'.",
-                         pofile.c_str());
-          }
-          else
-          {
-            POParser::parse(pofile, *in, *dict);
+            if (!parse_po_file(pofile, po_dict))
+              continue;
+            catalog_cache->save(pofile, po_dict);
           }
+          merge_dictionary(po_dict, *dict);
         }
-        catch(std::exception& e)
+        else
         {
-          Log::error("tinygettext", "error: failure parsing: '%s'.", pofile.c_str());
-          Log::error("tinygettext", "%s", e.what());
+          parse_po_file(pofile, *dict);
         }
       }
     }
@@ -259,6 +260,57 @@ DictionaryManager::set_filesystem(std::unique_ptr<FileSystem> filesystem_)
 {
   filesystem = std::move(filesystem_);
 }
+
+void
+DictionaryManager::set_catalog_cache(std::unique_ptr<CatalogCache> catalog_cache_)
+{
+  catalog_cache = std::move(catalog_cache_);
+}
+
+bool
+DictionaryManager::parse_po_file(const std::string& pofile, Dictionary& dict)
+{
+  try
+  {
+    std::unique_ptr<std::istream> in = filesystem->open_file(pofile);
+    if (!in.get())
+    {
+        Log::error("tinygettext", "error: failure opening: '%s'.",
+                   pofile.c_str());
+        return false;
+    }
+    POParser::parse(pofile, *in, dict);
+    return true;
+  }
+  catch(std::exception& e)
+  {
+    Log::error("tinygettext", "error: failure parsing: '%s'.", pofile.c_str());
+    Log::error("tinygettext", "%s", e.what());
+    return false;
+  }
+}
+
+void
+DictionaryManager::merge_dictionary(Dictionary& from, Dictionary& to)
+{
+  if (!to.get_plural_forms())
+  {
+    to.set_plural_forms(from.get_plural_forms());
+  }
+  else if (from.get_plural_forms() &&
+           to.get_plural_forms() != from.get_plural_forms())
+  {
+    Log::warn("tinygettext", "Plural-Forms missmatch between .po file and dictionary");
+  }
+
+  from.foreach([&to](const std::string& msgid,
+                     const std::vector<std::string>& msgstrs)
+               { to.add_translation(msgid, "", msgstrs); });
+  from.foreach_ctxt([&to](const std::string& msgctxt,
+                          const std::string& msgid,
+                          const std::vector<std::string>& msgstrs)
+                    { to.add_translation(msgctxt, msgid, "", msgstrs); });
+}
 // ----------------------------------------------------------------------------
 /** This function converts a .po filename (e.g. zh_TW.po) into a language
  *  specification (zh_TW). On case insensitive file systems (think windows)
@@ -31,6 +31,7 @@
 
 namespace tinygettext {
 
+class CatalogCache;
 class FileSystem;
 
 /** Manager class for dictionaries, you give it a bunch of directories
@@ -54,8 +55,11 @@ private:
   Dictionary  empty_dict;
 
   std::unique_ptr<FileSystem> filesystem;
+  std::unique_ptr<CatalogCache> catalog_cache;
 
   void clear_cache();
+  bool parse_po_file(const std::string& pofile, Dictionary& dict);
+  void merge_dictionary(Dictionary& from, Dictionary& to);
 
 #ifdef DEBUG
     unsigned int m_magic_number;
@@ -92,6 +96,9 @@ public:
   std::set<Language> get_languages();
 
   void set_filesystem(std::unique_ptr<FileSystem> filesystem);
+
+  /** Set a cache for the content of parsed .po files */
+  void set_catalog_cache(std::unique_ptr<CatalogCache> catalog_cache);
   std::string convertFilename2Language(const std::string &s_in) const;
 
 
@@ -31,6 +31,9 @@ class PluralForms
 private:
   unsigned int nplural;
   PluralFunc   plural;
+  /** The Plural-Forms header (without spaces) this was created from, so
+      that it can be stored and parsed again later */
+  std::string  str;
 
 public:
   static PluralForms from_string(const std::string& str);
@@ -46,6 +49,7 @@ public:
   {}
 
   unsigned int get_nplural() const { return nplural; }
+  const std::string& get_string() const { return str; }
   unsigned int get_plural(int n) const { if (plural) return plural(n); else return 0; }
 
   bool operator==(const PluralForms& other) { return nplural == other.nplural && plural == other.plural; }
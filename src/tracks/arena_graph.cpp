@@ -26,19 +26,35 @@
 #include "tracks/track.hpp"
 #include "tracks/track_manager.hpp"
 #include "utils/log.hpp"
+#include "utils/time.hpp"
+#include "utils/vs.hpp"
 
 #include <algorithm>
+#include <atomic>
+#include <iomanip>
 #include <queue>
+#include <sstream>
+#include <thread>
+
+/** Version of the cache file format, increase if the format or the way the
+ *  shortest paths are computed changes. */
+static const uint32_t CACHE_VERSION = 1;
 
 // -----------------------------------------------------------------------------
 ArenaGraph::ArenaGraph(const std::string &navmesh, const XMLNode *node)
           : Graph()
 {
     loadNavmesh(navmesh);
-    buildGraph();
-    // Compute shortest distance from all nodes
-    for (unsigned int i = 0; i < getNumNodes(); i++)
-        computeDijkstra(i);
+    buildSpatialIndex();
+    // The shortest paths only depend on the navmesh, so they are cached
+    const std::string cache_file = getCacheFile(navmesh);
+    if (cache_file.empty() || !loadCache(cache_file))
+    {
+        buildGraph();
+        computeAllDijkstra();
+        if (!cache_file.empty())
+            saveCache(cache_file);
+    }
 
     setNearbyNodesOfAllNodes();
     if (node && race_manager->getMinorMode() == RaceManager::MINOR_MODE_SOCCER)
@@ -179,31 +195,28 @@ void ArenaGraph::buildGraph()
 {
     const unsigned int n_nodes = getNumNodes();
 
-    m_distance_matrix = std::vector<std::vector<float>>
-        (n_nodes, std::vector<float>(n_nodes, 9999.9f));
+    m_distance_matrix.assign(n_nodes * n_nodes, 9999.9f);
     for (unsigned int i = 0; i < n_nodes; i++)
     {
         ArenaNode* cur_node = getNode(i);
         for (const int& adjacent : cur_node->getAdjacentNodes())
         {
-            Vec3 diff = getNode(adjacent)->getCenter() - cur_node->getCenter();
-            float distance = diff.length();
-            m_distance_matrix[i][adjacent] = distance;
+            m_distance_matrix[i * n_nodes + adjacent] =
+                getEdgeLength(i, adjacent);
         }
-        m_distance_matrix[i][i] = 0.0f;
+        m_distance_matrix[i * n_nodes + i] = 0.0f;
     }
 
     // Allocate and initialise the previous node data structure:
-    m_parent_node = std::vector<std::vector<int16_t>>
-        (n_nodes, std::vector<int16_t>(n_nodes, Graph::UNKNOWN_SECTOR));
+    m_parent_node.assign(n_nodes * n_nodes, Graph::UNKNOWN_SECTOR);
     for (unsigned int i = 0; i < n_nodes; i++)
     {
         for (unsigned int j = 0; j < n_nodes; j++)
         {
-            if (i == j || m_distance_matrix[i][j] >= 9899.9f)
-                m_parent_node[i][j] = -1;
+            if (i == j || m_distance_matrix[i * n_nodes + j] >= 9899.9f)
+                m_parent_node[i * n_nodes + j] = -1;
             else
-                m_parent_node[i][j] = i;
+                m_parent_node[i * n_nodes + j] = i;
         }   // for j
     }   // for i
 
@@ -216,6 +229,8 @@ void ArenaGraph::buildGraph()
  *  source to j and m_parent_node[source][j] stores the last vertex visited on
  *  the shortest path from i to j before visiting j. Suppose the shortest path
  *  from i to j is i->......->k->j  then m_parent_node[i][j] = k
+ *  Only the row of source is modified (edge lengths are computed from the
+ *  nodes), so this can be called for different sources in parallel.
  */
 void ArenaGraph::computeDijkstra(int source)
 {
@@ -235,6 +250,8 @@ void ArenaGraph::computeDijkstra(int source)
     IndDistPair begin(source, 0.0f);
     queue.push(begin);
     const unsigned int n = getNumNodes();
+    float* distance = &m_distance_matrix[source * n];
+    int16_t* parent = &m_parent_node[source * n];
     std::vector<bool> visited;
     visited.resize(n, false);
     while (!queue.empty())
@@ -252,11 +269,11 @@ void ArenaGraph::computeDijkstra(int source)
             if (visited[adjacent]) continue;
 
             float new_dist =
-                current.second + m_distance_matrix[cur_index][adjacent];
-            if (new_dist < m_distance_matrix[source][adjacent])
+                current.second + getEdgeLength(cur_index, adjacent);
+            if (new_dist < distance[adjacent])
             {
-                m_distance_matrix[source][adjacent] = new_dist;
-                m_parent_node[source][adjacent] = cur_index;
+                distance[adjacent] = new_dist;
+                parent[adjacent] = cur_index;
             }
             IndDistPair pair(adjacent, new_dist);
             queue.push(pair);
@@ -264,6 +281,50 @@ void ArenaGraph::computeDijkstra(int source)
     }
 }   // computeDijkstra
 
+// ----------------------------------------------------------------------------
+/** Computes the shortest paths from all nodes, using one thread for each
+ *  CPU core.
+ */
+void ArenaGraph::computeAllDijkstra()
+{
+    const unsigned int n = getNumNodes();
+    unsigned int num_threads = std::thread::hardware_concurrency();
+    if (num_threads == 0)
+        num_threads = 2;
+    // Not worth starting threads for small navmeshes
+    if (n < 64)
+        num_threads = 1;
+
+    std::atomic<unsigned int> next_source(0);
+    auto compute = [this, n, &next_source]()
+    {
+        unsigned int source;
+        while ((source = next_source.fetch_add(1)) < n)
+            computeDijkstra(source);
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned int i = 1; i < num_threads; i++)
+    {
+        threads.emplace_back([compute]()
+            {
+                VS::setThreadName("ArenaGraph");
+                compute();
+            });
+    }
+    compute();
+    for (std::thread& t : threads)
+        t.join();
+}   // computeAllDijkstra
+
+// ----------------------------------------------------------------------------
+/** Returns the length of the edge between two adjacent nodes. */
+float ArenaGraph::getEdgeLength(int from, int to) const
+{
+    return (m_all_nodes[to]->getCenter() -
+            m_all_nodes[from]->getCenter()).length();
+}   // getEdgeLength
+
 // ----------------------------------------------------------------------------
 /** THIS FUNCTION IS ONLY USED FOR UNIT-TESTING, to verify that the new
  *  Dijkstra algorithm gives the same results.
@@ -284,12 +345,14 @@ void ArenaGraph::computeFloydWarshall()
         {
             for (unsigned int j = 0; j < n; j++)
             {
-                if ((m_distance_matrix[i][k] + m_distance_matrix[k][j]) <
-                    m_distance_matrix[i][j])
+                if ((m_distance_matrix[i * n + k] +
+                     m_distance_matrix[k * n + j]) <
+                     m_distance_matrix[i * n + j])
                 {
-                    m_distance_matrix[i][j] =
-                        m_distance_matrix[i][k] + m_distance_matrix[k][j];
-                    m_parent_node[i][j] = m_parent_node[k][j];
+                    m_distance_matrix[i * n + j] =
+                        m_distance_matrix[i * n + k] +
+                        m_distance_matrix[k * n + j];
+                    m_parent_node[i * n + j] = m_parent_node[k * n + j];
                 }
             }
         }
@@ -297,6 +360,69 @@ void ArenaGraph::computeFloydWarshall()
 
 }   // computeFloydWarshall
 
+// ----------------------------------------------------------------------------
+/** Returns the name of the file to cache the shortest paths of a navmesh in,
+ *  which depends on the content of the navmesh, or an empty string if the
+ *  navmesh can not be read.
+ */
+std::string ArenaGraph::getCacheFile(const std::string &navmesh)
+{
+    uint64_t hash;
+    if (!file_manager->getFileHash(navmesh, &hash))
+        return "";
+    std::ostringstream name;
+    name << file_manager->getCachedDataDir() << "navmesh-" << std::hex
+         << std::setw(16) << std::setfill('0') << hash << ".bin";
+    return name.str();
+}   // getCacheFile
+
+// ----------------------------------------------------------------------------
+/** Loads the distance and parent matrix from a cache file.
+ *  \return False if the file does not exist or does not match the navmesh.
+ */
+bool ArenaGraph::loadCache(const std::string &cache_file)
+{
+    FILE *f = fopen(cache_file.c_str(), "rb");
+    if (!f) return false;
+
+    const size_t n = getNumNodes();
+    uint32_t header[2];
+    bool ok = fread(header, sizeof(uint32_t), 2, f) == 2 &&
+              header[0] == CACHE_VERSION && header[1] == n;
+    if (ok)
+    {
+        m_distance_matrix.resize(n * n);
+        m_parent_node.resize(n * n);
+        ok = fread(m_distance_matrix.data(), sizeof(float), n * n, f) ==
+             n * n &&
+             fread(m_parent_node.data(), sizeof(int16_t), n * n, f) == n * n &&
+             fgetc(f) == EOF;
+    }
+    fclose(f);
+    if (!ok)
+    {
+        Log::warn("ArenaGraph", "Ignoring invalid cache file '%s'.",
+                  cache_file.c_str());
+        m_distance_matrix.clear();
+        m_parent_node.clear();
+    }
+    return ok;
+}   // loadCache
+
+// ----------------------------------------------------------------------------
+/** Saves the distance and parent matrix to a cache file.
+ */
+void ArenaGraph::saveCache(const std::string &cache_file) const
+{
+    const size_t n = getNumNodes();
+    const uint32_t header[2] = { CACHE_VERSION, (uint32_t)n };
+    std::string data((const char*)header, sizeof(header));
+    data.append((const char*)m_distance_matrix.data(),
+                n * n * sizeof(float));
+    data.append((const char*)m_parent_node.data(), n * n * sizeof(int16_t));
+    file_manager->writeCacheFileAtomically(cache_file, data);
+}   // saveCache
+
 // -----------------------------------------------------------------------------
 void ArenaGraph::loadGoalNodes(const XMLNode *node)
 {
@@ -341,7 +467,8 @@ void ArenaGraph::setNearbyNodesOfAllNodes()
         // Get the distance to all nodes at i
         ArenaNode* cur_node = getNode(i);
         std::vector<int> nearby_nodes;
-        std::vector<float> dist = m_distance_matrix[i];
+        std::vector<float> dist(m_distance_matrix.begin() + i * getNumNodes(),
+            m_distance_matrix.begin() + (i + 1) * getNumNodes());
 
         // Skip the same node
         dist[i] = 999999.0f;
@@ -363,13 +490,14 @@ void ArenaGraph::setNearbyNodesOfAllNodes()
  *  std::vector (in reverse order). Used only for unit testing.
  */
 std::vector<int16_t> ArenaGraph::getPathFromTo(int from, int to,
-                      const std::vector< std::vector< int16_t > >& parent_node)
+                                        const std::vector<int16_t>& parent_node,
+                                        unsigned int n)
 {
     std::vector<int16_t> path;
     path.push_back(to);
     while(from!=to)
     {
-        to = parent_node[from][to];
+        to = parent_node[from * n + to];
         path.push_back(to);
     }
     return path;
@@ -380,12 +508,15 @@ std::vector<int16_t> ArenaGraph::getPathFromTo(int from, int to,
  *  Instead of using hand-tuned test cases we use the tested, verified and
  *  easier to understand Floyd-Warshall algorithm to compute the distances,
  *  and check if the (significanty faster) Dijkstra algorithm gives the same
- *  results. For now we use the cave mesh as test case.
+ *  results. The results computed in parallel and loaded from the cache file
+ *  must be identical to running Dijkstra for each node one after another.
+ *  For now we use the cave mesh as test case.
  */
 void ArenaGraph::unitTesting()
 {
     Track *track = track_manager->getTrack("cave");
     std::string navmesh_file_name=track->getTrackFile("navmesh.xml");
+    file_manager->removeFile(getCacheFile(navmesh_file_name));
 
     double s = StkTime::getRealTime();
     ArenaGraph* ag = new ArenaGraph(navmesh_file_name);
@@ -393,8 +524,23 @@ void ArenaGraph::unitTesting()
     Log::error("Time", "Dijkstra       %lf", e-s);
 
     // Save the Dijkstra results
-    std::vector< std::vector< float > > distance_matrix = ag->m_distance_matrix;
-    std::vector< std::vector< int16_t > > parent_node = ag->m_parent_node;
+    std::vector<float> distance_matrix = ag->m_distance_matrix;
+    std::vector<int16_t> parent_node = ag->m_parent_node;
+
+    // Now the results must be loaded from the cache file
+    s = StkTime::getRealTime();
+    ArenaGraph* cached_ag = new ArenaGraph(navmesh_file_name);
+    e = StkTime::getRealTime();
+    Log::error("Time", "Cached         %lf", e-s);
+    assert(cached_ag->m_distance_matrix == distance_matrix);
+    assert(cached_ag->m_parent_node == parent_node);
+    delete cached_ag;
+
+    ag->buildGraph();
+    for (unsigned int i = 0; i < ag->getNumNodes(); i++)
+        ag->computeDijkstra(i);
+    assert(ag->m_distance_matrix == distance_matrix);
+    assert(ag->m_parent_node == parent_node);
     ag->buildGraph();
 
     // Now compute results with Floyd-Warshall
@@ -404,15 +550,17 @@ void ArenaGraph::unitTesting()
     Log::error("Time", "Floyd-Warshall %lf", e-s);
 
     int error_count = 0;
-    for(unsigned int i=0; i<ag->m_distance_matrix.size(); i++)
+    const unsigned int n = ag->getNumNodes();
+    for(unsigned int i=0; i<n; i++)
     {
-        for(unsigned int j=0; j<ag->m_distance_matrix[i].size(); j++)
+        for(unsigned int j=0; j<n; j++)
         {
-            if(ag->m_distance_matrix[i][j] - distance_matrix[i][j] > 0.001f)
+            if(ag->m_distance_matrix[i*n+j] - distance_matrix[i*n+j] > 0.001f)
             {
                 Log::error("ArenaGraph",
                            "Incorrect distance %d, %d: Dijkstra: %f F.W.: %f",
-                           i, j, distance_matrix[i][j], ag->m_distance_matrix[i][j]);
+                           i, j, distance_matrix[i*n+j],
+                           ag->m_distance_matrix[i*n+j]);
                 error_count++;
             }    // if distance is too different
 
@@ -424,16 +572,16 @@ void ArenaGraph::unitTesting()
             // debugging in the feature
 #undef TEST_PARENT_POLY_EVEN_THOUGH_MANY_FALSE_POSITIVES
 #ifdef TEST_PARENT_POLY_EVEN_THOUGH_MANY_FALSE_POSITIVES
-            if(ag->m_parent_node[i][j] != parent_node[i][j])
+            if(ag->m_parent_node[i*n+j] != parent_node[i*n+j])
             {
                 error_count++;
-                std::vector<int16_t> dijkstra_path = getPathFromTo(i, j, parent_node);
-                std::vector<int16_t> floyd_path = getPathFromTo(i, j, ag->m_parent_node);
+                std::vector<int16_t> dijkstra_path = getPathFromTo(i, j, parent_node, n);
+                std::vector<int16_t> floyd_path = getPathFromTo(i, j, ag->m_parent_node, n);
                 if(dijkstra_path.size()!=floyd_path.size())
                 {
                     Log::error("ArenaGraph",
                                "Incorrect path length %d, %d: Dijkstra: %d F.W.: %d",
-                               i, j, parent_node[i][j], ag->m_parent_node[i][j]);
+                               i, j, parent_node[i*n+j], ag->m_parent_node[i*n+j]);
                     continue;
                 }
                 Log::error("ArenaGraph", "Path problems from %d to %d:",
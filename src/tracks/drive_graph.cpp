@@ -156,6 +156,7 @@ void DriveGraph::load(const std::string &quad_file_name,
             max_height_testing);
     }
     delete quad;
+    buildSpatialIndex();
 
     const XMLNode *xml = file_manager->createXMLTree(filename);
 
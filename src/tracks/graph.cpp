@@ -32,11 +32,17 @@
 #include "tracks/drive_node_3d.hpp"
 #include "tracks/track.hpp"
 #include "utils/log.hpp"
+#include "utils/time.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <random>
 
 const int Graph::UNKNOWN_SECTOR = -1;
 const float Graph::MIN_HEIGHT_TESTING = -1.0f;
 const float Graph::MAX_HEIGHT_TESTING = 5.0f;
 Graph *Graph::m_graph = NULL;
+bool Graph::m_benchmark_lookups = false;
 // -----------------------------------------------------------------------------
 Graph::Graph()
 {
@@ -48,6 +54,10 @@ Graph::Graph()
     m_bb_min      = Vec3( 99999,  99999,  99999);
     m_bb_max      = Vec3(-99999, -99999, -99999);
     memset(m_bb_nodes, 0, 4 * sizeof(int));
+    m_grid_min_x = m_grid_min_z = 0.0f;
+    m_grid_cell_size = 1.0f;
+    m_grid_width = m_grid_height = 0;
+    m_use_spatial_index = true;
 }  // Graph
 
 // -----------------------------------------------------------------------------
@@ -632,6 +642,34 @@ void Graph::findRoadSector(const Vec3& xyz, int *sector,
                             ? (unsigned int)all_sectors->size()
                             : (unsigned int)m_all_nodes.size();
     *sector = UNKNOWN_SECTOR;
+
+    if (!all_sectors && m_use_spatial_index && !m_grid_cell_start.empty())
+    {
+        // Only test the quads in the grid cell of xyz. If quads overlap,
+        // use the same one the linear search below would find first, i.e.
+        // the first one after the previous sector.
+        const float x = xyz.getX(), z = xyz.getZ();
+        if (x < m_grid_min_x || z < m_grid_min_z ||
+            x >= m_grid_min_x + m_grid_width  * m_grid_cell_size ||
+            z >= m_grid_min_z + m_grid_height * m_grid_cell_size)
+            return;
+        const int n = (int)m_all_nodes.size();
+        const unsigned int cell = getGridZ(z) * m_grid_width + getGridX(x);
+        int min_order = n;
+        for (unsigned int i = m_grid_cell_start[cell];
+             i < m_grid_cell_start[cell + 1]; i++)
+        {
+            const int quad = m_grid_quads[i];
+            const int order = (quad - indx - 1 + 2 * n) % n;
+            if (order < min_order &&
+                getQuad(quad)->pointInside(xyz, ignore_vertical))
+            {
+                min_order = order;
+                *sector   = quad;
+            }
+        }
+        return;
+    }   // if use spatial index
     for(unsigned int i=0; i<max_count; i++)
     {
         if(all_sectors)
@@ -705,6 +743,15 @@ int Graph::findOutOfRoadSector(const Vec3& xyz, const int curr_sector,
         if(current_sector<0) current_sector += getNumNodes();
     }
 
+    if (!all_sectors && m_use_spatial_index && !m_grid_cell_start.empty())
+    {
+        // Same order as the linear search below, which starts testing after
+        // current_sector, is used to decide between quads with equal distance.
+        const int n     = (int)getNumNodes();
+        const int first = ((current_sector + 1) % n + n) % n;
+        return findOutOfRoadSectorInGrid(xyz, first, ignore_vertical);
+    }
+
     int   min_sector = UNKNOWN_SECTOR;
     float min_dist_2 = 999999.0f*999999.0f;
 
@@ -762,6 +809,122 @@ int Graph::findOutOfRoadSector(const Vec3& xyz, const int curr_sector,
     return min_sector;
 }   // findOutOfRoadSector
 
+//-----------------------------------------------------------------------------
+/** Implementation of findOutOfRoadSector if all quads are to be tested,
+ *  using the grid: the cells are tested in rings of increasing size around
+ *  xyz, until no quad outside of the tested cells can be closer than the
+ *  closest quad found so far. It returns the same quad as the linear search.
+ *  \param xyz Position for which the sector should be determined.
+ *  \param first The quad the linear search would test first, used to
+ *         decide between quads with the same distance.
+ *  \param ignore_vertical If the height condition should not be tested.
+ */
+int Graph::findOutOfRoadSectorInGrid(const Vec3& xyz, int first,
+                                     bool ignore_vertical) const
+{
+    const int n = (int)getNumNodes();
+    // The closest quad that fulfills the height condition (phase 0 of the
+    // linear search), and the closest quad independent of height (phase 1).
+    int   min_sector = UNKNOWN_SECTOR, any_sector = UNKNOWN_SECTOR;
+    float min_dist_2 = 999999.0f*999999.0f, any_dist_2 = min_dist_2;
+    int   min_order  = -1, any_order = -1;
+
+    auto test_cell = [&](int gx, int gz)
+    {
+        const unsigned int cell = gz * m_grid_width + gx;
+        for (unsigned int i = m_grid_cell_start[cell];
+             i < m_grid_cell_start[cell + 1]; i++)
+        {
+            const int quad = m_grid_quads[i];
+            const Quad* q = m_all_nodes[quad];
+            if (q->isIgnored())
+                continue;
+            const float dist_2 = q->getDistance2FromPoint(xyz);
+            const int order = (quad - first + n) % n;
+            if (dist_2 < any_dist_2 ||
+                (dist_2 == any_dist_2 && order < any_order))
+            {
+                any_dist_2 = dist_2;
+                any_sector = quad;
+                any_order  = order;
+            }
+            if (dist_2 < min_dist_2 ||
+                (dist_2 == min_dist_2 && order < min_order))
+            {
+                float dist = xyz.getY() - q->getMinHeight();
+                if ((dist < 5.0f && dist > -1.0f) || q->is3DQuad() ||
+                    ignore_vertical)
+                {
+                    min_dist_2 = dist_2;
+                    min_sector = quad;
+                    min_order  = order;
+                }
+            }
+        }
+    };   // test_cell
+
+    const int cx = getGridX(xyz.getX());
+    const int cz = getGridZ(xyz.getZ());
+    for (int r = 0; ; r++)
+    {
+        const int x0 = cx - r, x1 = cx + r, z0 = cz - r, z1 = cz + r;
+        for (int gz = std::max(z0, 0);
+             gz <= std::min(z1, m_grid_height - 1); gz++)
+        {
+            if (gz == z0 || gz == z1)
+            {
+                for (int gx = std::max(x0, 0);
+                     gx <= std::min(x1, m_grid_width - 1); gx++)
+                    test_cell(gx, gz);
+            }
+            else
+            {
+                if (x0 >= 0)
+                    test_cell(x0, gz);
+                if (x1 < m_grid_width)
+                    test_cell(x1, gz);
+            }
+        }
+        if (x0 <= 0 && z0 <= 0 &&
+            x1 >= m_grid_width - 1 && z1 >= m_grid_height - 1)
+            break;
+        if (min_sector == UNKNOWN_SECTOR)
+            continue;
+
+        // All quads not tested so far are outside of the tested cells, so
+        // their distance is at least the distance to the border of the cells
+        float border = std::numeric_limits<float>::max();
+        if (x0 > 0)
+        {
+            border = std::min(border,
+                xyz.getX() - (m_grid_min_x + x0 * m_grid_cell_size));
+        }
+        if (x1 < m_grid_width - 1)
+        {
+            border = std::min(border,
+                m_grid_min_x + (x1 + 1) * m_grid_cell_size - xyz.getX());
+        }
+        if (z0 > 0)
+        {
+            border = std::min(border,
+                xyz.getZ() - (m_grid_min_z + z0 * m_grid_cell_size));
+        }
+        if (z1 < m_grid_height - 1)
+        {
+            border = std::min(border,
+                m_grid_min_z + (z1 + 1) * m_grid_cell_size - xyz.getZ());
+        }
+        if (min_dist_2 < border * border)
+            break;
+    }   // for r
+
+    if (min_sector != UNKNOWN_SECTOR)
+        return min_sector;
+    if (any_sector == UNKNOWN_SECTOR)
+        Log::info("Graph", "unknown sector found.");
+    return any_sector;
+}   // findOutOfRoadSectorInGrid
+
 //-----------------------------------------------------------------------------
 void Graph::loadBoundingBoxNodes()
 {
@@ -774,3 +937,176 @@ void Graph::loadBoundingBoxNodes()
     m_bb_nodes[3] = findOutOfRoadSector(Vec3(m_bb_max.x(), 0, m_bb_max.z()),
         -1/*curr_sector*/, NULL/*all_sectors*/, true/*ignore_vertical*/);
 }   // loadBoundingBoxNodes
+
+//-----------------------------------------------------------------------------
+/** Builds the grid used by findRoadSector and findOutOfRoadSector. Each quad
+ *  is added to all cells overlapped by its 2d bounding box (including the
+ *  box used by 3d quads in pointInside). The cell size is the average quad
+ *  size, so usually only very few quads need to be tested for a cell.
+ */
+void Graph::buildSpatialIndex()
+{
+    m_grid_cell_start.clear();
+    m_grid_quads.clear();
+    m_grid_width = m_grid_height = 0;
+    const unsigned int n = getNumNodes();
+    if (n == 0)
+        return;
+
+    std::vector<Vec3> quad_min(n), quad_max(n);
+    Vec3 grid_min = (*m_all_nodes[0])[0];
+    Vec3 grid_max = grid_min;
+    float total_size = 0.0f;
+    for (unsigned int i = 0; i < n; i++)
+    {
+        const Quad* q = m_all_nodes[i];
+        quad_min[i] = quad_max[i] = (*q)[0];
+        for (unsigned int j = 0; j < 4; j++)
+        {
+            // 3d quads test a box from 1 below to 5 above the quad
+            const Vec3 high = (*q)[j] + 5.0f * q->getNormal();
+            const Vec3 low  = (*q)[j] - 1.0f * q->getNormal();
+            quad_min[i].min(high);
+            quad_min[i].min(low);
+            quad_max[i].max(high);
+            quad_max[i].max(low);
+        }
+        quad_min[i] -= Vec3(0.01f);
+        quad_max[i] += Vec3(0.01f);
+        grid_min.min(quad_min[i]);
+        grid_max.max(quad_max[i]);
+        total_size += std::max(quad_max[i].getX() - quad_min[i].getX(),
+                               quad_max[i].getZ() - quad_min[i].getZ());
+    }
+
+    m_grid_min_x     = grid_min.getX();
+    m_grid_min_z     = grid_min.getZ();
+    m_grid_cell_size = std::max(total_size / n, 1.0f);
+    do
+    {
+        m_grid_width  = (int)((grid_max.getX() - m_grid_min_x) /
+                              m_grid_cell_size) + 1;
+        m_grid_height = (int)((grid_max.getZ() - m_grid_min_z) /
+                              m_grid_cell_size) + 1;
+        // Avoid huge grids for tracks with few but far away quads
+        if (m_grid_width * m_grid_height <= 256 * 256)
+            break;
+        m_grid_cell_size *= 2.0f;
+    } while (true);
+
+    // First count the number of quads in each cell, then fill them in
+    const unsigned int num_cells = m_grid_width * m_grid_height;
+    m_grid_cell_start.resize(num_cells + 1, 0);
+    for (unsigned int i = 0; i < n; i++)
+    {
+        for (int gz = getGridZ(quad_min[i].getZ());
+             gz <= getGridZ(quad_max[i].getZ()); gz++)
+        {
+            for (int gx = getGridX(quad_min[i].getX());
+                 gx <= getGridX(quad_max[i].getX()); gx++)
+                m_grid_cell_start[gz * m_grid_width + gx + 1]++;
+        }
+    }
+    for (unsigned int i = 0; i < num_cells; i++)
+        m_grid_cell_start[i + 1] += m_grid_cell_start[i];
+
+    m_grid_quads.resize(m_grid_cell_start[num_cells]);
+    std::vector<unsigned int> next(m_grid_cell_start.begin(),
+                                   m_grid_cell_start.end() - 1);
+    for (unsigned int i = 0; i < n; i++)
+    {
+        for (int gz = getGridZ(quad_min[i].getZ());
+             gz <= getGridZ(quad_max[i].getZ()); gz++)
+        {
+            for (int gx = getGridX(quad_min[i].getX());
+                 gx <= getGridX(quad_max[i].getX()); gx++)
+                m_grid_quads[next[gz * m_grid_width + gx]++] = i;
+        }
+    }
+    Log::debug("Graph", "Spatial index with %dx%d cells of size %f for %d "
+               "quads, %d entries.", m_grid_width, m_grid_height,
+               m_grid_cell_size, n, (int)m_grid_quads.size());
+
+    if (m_benchmark_lookups)
+        benchmarkLookups();
+}   // buildSpatialIndex
+
+//-----------------------------------------------------------------------------
+/** Compares the speed of findRoadSector and findOutOfRoadSector with and
+ *  without the grid, and checks that both give the same results. The
+ *  positions used follow the quads in order like a kart driving along the
+ *  track, with random offsets so that some are off the road or above it.
+ */
+void Graph::benchmarkLookups()
+{
+    std::mt19937 random(42);
+    std::uniform_real_distribution<float> offset(-1.0f, 1.0f);
+    std::vector<Vec3> positions;
+    for (unsigned int i = 0; i < getNumNodes(); i++)
+    {
+        const Quad* q = m_all_nodes[i];
+        const float size = ((*q)[2] - (*q)[0]).length() * 0.5f;
+        for (unsigned int j = 0; j < 8; j++)
+        {
+            positions.push_back(q->getCenter() +
+                Vec3(offset(random) * size, 1.0f + offset(random) * 2.0f,
+                     offset(random) * size));
+        }
+    }
+
+    const unsigned int rounds = 10;
+    std::vector<int> road_sectors[2], out_sectors[2];
+    double road_time[2], out_time[2];
+    for (unsigned int mode = 0; mode < 2; mode++)
+    {
+        m_use_spatial_index = mode == 1;
+        road_sectors[mode].resize(positions.size());
+        out_sectors[mode].resize(positions.size());
+        double start = StkTime::getRealTime();
+        for (unsigned int r = 0; r < rounds; r++)
+        {
+            int sector = UNKNOWN_SECTOR;
+            for (unsigned int i = 0; i < positions.size(); i++)
+            {
+                findRoadSector(positions[i], &sector);
+                road_sectors[mode][i] = sector;
+                // Continue with the previous sector as a kart would do
+                if (sector == UNKNOWN_SECTOR && i > 0)
+                    sector = road_sectors[mode][i - 1];
+            }
+        }
+        road_time[mode] = StkTime::getRealTime() - start;
+
+        start = StkTime::getRealTime();
+        for (unsigned int r = 0; r < rounds; r++)
+        {
+            for (unsigned int i = 0; i < positions.size(); i++)
+            {
+                out_sectors[mode][i] = findOutOfRoadSector(positions[i],
+                    i > 0 ? out_sectors[mode][i - 1] : UNKNOWN_SECTOR);
+            }
+        }
+        out_time[mode] = StkTime::getRealTime() - start;
+    }
+    m_use_spatial_index = true;
+
+    unsigned int mismatches = 0;
+    for (unsigned int i = 0; i < positions.size(); i++)
+    {
+        if (road_sectors[0][i] != road_sectors[1][i] ||
+            out_sectors[0][i] != out_sectors[1][i])
+            mismatches++;
+    }
+    const double lookups = double(positions.size() * rounds);
+    Log::info("Graph", "findRoadSector: %.0f lookups/s linear, %.0f "
+              "lookups/s with grid.", lookups / road_time[0],
+              lookups / road_time[1]);
+    Log::info("Graph", "findOutOfRoadSector: %.0f lookups/s linear, %.0f "
+              "lookups/s with grid.", lookups / out_time[0],
+              lookups / out_time[1]);
+    if (mismatches > 0)
+    {
+        Log::error("Graph", "%d of %d lookups differ between linear search "
+                   "and grid.", mismatches, (int)positions.size());
+    }
+}   // benchmarkLookups
@@ -24,6 +24,7 @@
 
 #include <dimension2d.h>
 
+#include <cmath>
 #include <memory>
 #include <string>
 #include <vector>
@@ -66,6 +67,8 @@ protected:
     // ------------------------------------------------------------------------
     /** Map 4 bounding box points to 4 closest graph nodes. */
     void loadBoundingBoxNodes();
+    // ------------------------------------------------------------------------
+    void buildSpatialIndex();
 
 private:
     /** The 2d bounding box, used for hashing. */
@@ -90,6 +93,29 @@ private:
     /** The render target used for drawing the minimap. */
     std::unique_ptr<RenderTarget> m_render_target;
 
+    /** A uniform 2d grid (in the x/z plane) over all quads, used to speed up
+     *  findRoadSector and findOutOfRoadSector. The indices of all quads
+     *  overlapping cell i are stored (sorted) in m_grid_quads, starting at
+     *  m_grid_cell_start[i] up to (excluding) m_grid_cell_start[i+1]. */
+    std::vector<unsigned int> m_grid_cell_start;
+    std::vector<int> m_grid_quads;
+
+    /** Minimum x and z coordinate of the grid. */
+    float m_grid_min_x, m_grid_min_z;
+
+    /** Size of a (square) grid cell. */
+    float m_grid_cell_size;
+
+    /** Number of grid cells in x and z direction. */
+    int m_grid_width, m_grid_height;
+
+    /** If the grid should be used, can be disabled to compare against the
+     *  linear search. */
+    bool m_use_spatial_index;
+
+    /** If the lookup benchmark should be run when loading a graph. */
+    static bool m_benchmark_lookups;
+
     // ------------------------------------------------------------------------
     void createMesh(bool show_invisible=true,
                     bool enable_transparency=false,
@@ -106,6 +132,27 @@ private:
     virtual bool hasLapLine() const = 0;
     // ------------------------------------------------------------------------
     virtual void differentNodeColor(int n, video::SColor* c) const = 0;
+    // ------------------------------------------------------------------------
+    /** Returns the grid cell in x direction for a x coordinate, which is
+     *  clamped to the grid. */
+    int getGridX(float x) const
+    {
+        int cell = (int)floorf((x - m_grid_min_x) / m_grid_cell_size);
+        return cell < 0 ? 0 : cell >= m_grid_width ? m_grid_width - 1 : cell;
+    }   // getGridX
+    // ------------------------------------------------------------------------
+    /** Returns the grid cell in z direction for a z coordinate, which is
+     *  clamped to the grid. */
+    int getGridZ(float z) const
+    {
+        int cell = (int)floorf((z - m_grid_min_z) / m_grid_cell_size);
+        return cell < 0 ? 0 : cell >= m_grid_height ? m_grid_height - 1 : cell;
+    }   // getGridZ
+    // ------------------------------------------------------------------------
+    int findOutOfRoadSectorInGrid(const Vec3& xyz, int first,
+                                  bool ignore_vertical) const;
+    // ------------------------------------------------------------------------
+    void benchmarkLookups();
 
 public:
     static const int UNKNOWN_SECTOR;
@@ -167,6 +214,10 @@ public:
                             std::vector<int> *all_sectors = NULL,
                             bool ignore_vertical = false) const;
     // ------------------------------------------------------------------------
+    /** Runs a lookup benchmark of findRoadSector and findOutOfRoadSector
+     *  each time a graph is loaded. */
+    static void enableLookupBenchmark()          { m_benchmark_lookups = true; }
+    // ------------------------------------------------------------------------
     const Vec3& getBBMin() const                           { return m_bb_min; }
     // ------------------------------------------------------------------------
     const Vec3& getBBMax() const                           { return m_bb_max; }
@@ -70,13 +70,17 @@
 #include "tracks/drive_graph.hpp"
 #include "tracks/drive_node.hpp"
 #include "tracks/model_definition_loader.hpp"
+#include "tracks/quad.hpp"
 #include "tracks/track_manager.hpp"
 #include "tracks/track_object_manager.hpp"
 #include "utils/constants.hpp"
 #include "utils/log.hpp"
 #include "utils/mini_glm.hpp"
+#include "utils/profiler.hpp"
 #include "utils/string_utils.hpp"
+#include "utils/time.hpp"
 #include "utils/translation.hpp"
+#include "utils/worker_pool.hpp"
 
 #include <IBillboardTextSceneNode.h>
 #include <ILightSceneNode.h>
@@ -86,7 +90,9 @@
 #include <ISceneManager.h>
 #include <SMeshBuffer.h>
 
+#include <iomanip>
 #include <iostream>
+#include <random>
 #include <stdexcept>
 #include <sstream>
 #include <wchar.h>
@@ -97,6 +103,7 @@ using namespace irr;
 const float Track::NOHIT               = -99999.9f;
 bool        Track::m_dont_load_navmesh = false;
 Track      *Track::m_current_track = NULL;
+bool        Track::m_benchmark_raycasts = false;
 
 // ----------------------------------------------------------------------------
 Track::Track(const std::string &filename)
@@ -307,6 +314,7 @@ void Track::cleanup()
 
     Graph::destroy();
     ItemManager::destroy();
+    m_height_map.clear();
 #ifndef SERVER_ONLY
     if (CVS->isGLSL())
     {
@@ -886,8 +894,20 @@ void Track::createPhysicsModel(unsigned int main_track_count)
         convertTrackToBullet(m_all_nodes[i]);
         uploadNodeVertexBuffer(m_all_nodes[i]);
     }
-    m_track_mesh->createPhysicalBody(m_friction);
-    m_gfx_effect_mesh->createCollisionShape();
+    // Building the BVH for the whole track takes a significant part of the
+    // loading time, so it is cached (keyed by the mesh content).
+    PROFILER_PUSH_CPU_MARKER("Track BVH", 0x80, 0x40, 0x00);
+    double start = StkTime::getRealTime();
+    m_track_mesh->createPhysicalBody(m_friction,
+                                     (btCollisionObject::CollisionFlags)0,
+                                     ("track-" + m_ident).c_str());
+    m_gfx_effect_mesh->createCollisionShape(/*create_collision_object*/true,
+                                            ("gfx-" + m_ident).c_str());
+    PROFILER_POP_CPU_MARKER();
+    Log::info("track", "Track BVH %s in %f ms.",
+              m_track_mesh->isBvhFromCache() ? "loaded from cache (warm)"
+                                             : "built (cold cache)",
+              (StkTime::getRealTime() - start) * 1000.0);
 }   // createPhysicsModel
 
 // -----------------------------------------------------------------------------
@@ -1459,6 +1479,140 @@ void Track::freeCachedMeshVertexBuffer()
     }
 }   // freeCachedMeshVertexBuffer
 
+// ----------------------------------------------------------------------------
+/** Compares casting the wheel rays of a kart one by one with bullet (which
+ *  is what the kart raycaster did before rays were batched) with casting
+ *  them as one batch against the track mesh, and prints the number of rays
+ *  per second for both. The rays are cast from random positions above the
+ *  quads of the graph. Enabled with --raycast-benchmark.
+ */
+void Track::benchmarkRaycasts() const
+{
+    if (!Graph::get() || !m_track_mesh)
+        return;
+
+    const unsigned int num_wheels = 4;
+    std::mt19937 random(42);
+    std::uniform_real_distribution<float> offset(-1.0f, 1.0f);
+    AlignedArray<TriangleMesh::Ray> rays;
+    for (unsigned int i = 0; i < Graph::get()->getNumNodes(); i++)
+    {
+        const Quad* q = Graph::get()->getQuad(i);
+        const float size = ((*q)[2] - (*q)[0]).length() * 0.5f;
+        const Vec3 &normal = q->getNormal();
+        for (unsigned int j = 0; j < 8; j++)
+        {
+            Vec3 center = q->getCenter() +
+                Vec3(offset(random) * size, 0, offset(random) * size) +
+                normal * (0.5f + offset(random) * 0.3f);
+            for (unsigned int w = 0; w < num_wheels; w++)
+            {
+                TriangleMesh::Ray ray;
+                ray.m_from = center + Vec3(w & 1 ? 0.4f : -0.4f, 0,
+                                           w & 2 ? 0.6f : -0.6f);
+                ray.m_to   = ray.m_from - normal;
+                rays.push_back(ray);
+            }
+        }
+    }
+    if (rays.empty())
+        return;
+
+    /** Stores the index of the triangle hit by a bullet raycast. */
+    class IndexRayResult : public btCollisionWorld::ClosestRayResultCallback
+    {
+    public:
+        int m_index;
+        // --------------------------------------------------------------------
+        IndexRayResult(const btVector3 &from, const btVector3 &to)
+            : btCollisionWorld::ClosestRayResultCallback(from, to)
+        {
+            m_index = -1;
+        }   // IndexRayResult
+        // --------------------------------------------------------------------
+        virtual btScalar addSingleResult(
+                              btCollisionWorld::LocalRayResult& ray_result,
+                              bool normal_in_world_space)
+        {
+            m_index = ray_result.m_localShapeInfo->m_triangleIndex;
+            return btCollisionWorld::ClosestRayResultCallback
+                   ::addSingleResult(ray_result, normal_in_world_space);
+        }   // addSingleResult
+    };   // IndexRayResult
+
+    const btRigidBody *body = m_track_mesh->getBody();
+    if (!body)
+        return;
+    btTransform world_trans = body->getWorldTransform();
+
+    const unsigned int rounds = 10;
+    AlignedArray<TriangleMesh::RayHit> single(rays.size());
+    AlignedArray<TriangleMesh::RayHit> batched(rays.size());
+    double start = StkTime::getRealTime();
+    for (unsigned int r = 0; r < rounds; r++)
+    {
+        for (unsigned int i = 0; i < rays.size(); i++)
+        {
+            btTransform from, to;
+            from.setIdentity();
+            from.setOrigin(rays[i].m_from);
+            to.setIdentity();
+            to.setOrigin(rays[i].m_to);
+            IndexRayResult callback(rays[i].m_from, rays[i].m_to);
+            btCollisionWorld::rayTestSingle(from, to,
+                                            const_cast<btRigidBody*>(body),
+                                            body->getCollisionShape(),
+                                            world_trans, callback);
+            TriangleMesh::RayHit &hit = single[i];
+            hit.m_triangle_index = callback.hasHit() ? callback.m_index : -1;
+            hit.m_fraction       = callback.m_closestHitFraction;
+            if (hit.hasHit())
+            {
+                hit.m_normal = m_track_mesh->getInterpolatedNormal(
+                    callback.m_index, callback.m_hitPointWorld);
+            }
+        }
+    }
+    const double single_time = StkTime::getRealTime() - start;
+
+    start = StkTime::getRealTime();
+    for (unsigned int r = 0; r < rounds; r++)
+    {
+        for (unsigned int i = 0; i < rays.size(); i += num_wheels)
+        {
+            m_track_mesh->castRays(&rays[i], &batched[i], num_wheels,
+                                   true);
+        }
+    }
+    const double batched_time = StkTime::getRealTime() - start;
+
+    // Different triangles can be hit if a ray hits an edge, so only
+    // compare the normal if the same triangle was hit.
+    unsigned int mismatches = 0;
+    for (unsigned int i = 0; i < rays.size(); i++)
+    {
+        if (single[i].hasHit() != batched[i].hasHit())
+            mismatches++;
+        else if (!single[i].hasHit())
+            continue;
+        else if (std::fabs(single[i].m_fraction - batched[i].m_fraction)
+                 > 1e-5f)
+            mismatches++;
+        else if (single[i].m_triangle_index == batched[i].m_triangle_index &&
+                 (single[i].m_normal - batched[i].m_normal).length2() > 1e-8f)
+            mismatches++;
+    }
+    const double num_rays = double(rays.size() * rounds);
+    Log::info("Track", "Raycasts: %.0f rays/s with bullet, %.0f rays/s in "
+              "batches of %d.", num_rays / single_time,
+              num_rays / batched_time, num_wheels);
+    if (mismatches > 0)
+    {
+        Log::error("Track", "%d of %d raycasts differ between bullet and "
+                   "batched raycasts.", mismatches, (int)rays.size());
+    }
+}   // benchmarkRaycasts
+
 // ----------------------------------------------------------------------------
 /** Handles animated textures.
  *  \param node The scene node for which animated textures are handled.
@@ -1731,6 +1885,8 @@ static void recursiveUpdatePhysics(std::vector<TrackObject*>& tos)
 void Track::loadTrackModel(bool reverse_track, unsigned int mode_id)
 {
     assert(!m_current_track);
+    double start = StkTime::getRealTime();
+    const uint64_t indexed_lookups = file_manager->getNumIndexedLookups();
 
     // Use m_filename to also get the path, not only the identifier
     STKTexManager::getInstance()
@@ -2124,6 +2280,9 @@ void Track::loadTrackModel(bool reverse_track, unsigned int mode_id)
     if (UserConfigParams::m_track_debug && Graph::get() && !m_is_cutscene)
         Graph::get()->createDebugMesh();
 
+    if (m_benchmark_raycasts && !m_is_cutscene)
+        benchmarkRaycasts();
+
     // Only print warning if not in battle mode, since battle tracks don't have
     // any quads or check lines.
     if (CheckManager::get()->getCheckStructureCount()==0  &&
@@ -2172,6 +2331,11 @@ void Track::loadTrackModel(bool reverse_track, unsigned int mode_id)
         m_spherical_harmonics_textures.clear();
     }
 #endif   // !SERVER_ONLY
+    Log::info("Track", "Track '%s' loaded in %f ms, %llu file system "
+              "queries avoided by the search path index.", m_ident.c_str(),
+              (StkTime::getRealTime() - start) * 1000.0,
+              (unsigned long long)(file_manager->getNumIndexedLookups()
+                                   - indexed_lookups));
 }   // loadTrackModel
 
 //-----------------------------------------------------------------------------
@@ -2604,41 +2768,84 @@ void Track::itemCommand(const XMLNode *node)
 
 // ----------------------------------------------------------------------------
 
-std::vector< std::vector<float> > Track::buildHeightMap()
+/** Returns a height map of the track: the height of the track mesh on a
+ *  HEIGHT_MAP_RESOLUTION x HEIGHT_MAP_RESOLUTION grid covering the track's
+ *  bounding box, stored row major with x as the row. Points where no
+ *  triangle is hit get the minimum height of the track. The height map is
+ *  computed only once per track, and it is cached on disk, keyed by the
+ *  content of the track mesh.
+ */
+const std::vector<float>& Track::buildHeightMap()
 {
-    std::vector< std::vector<float> > out(HEIGHT_MAP_RESOLUTION);
-
-    float x = m_aabb_min.getX();
-    const float x_len = m_aabb_max.getX() - m_aabb_min.getX();
-    const float z_len = m_aabb_max.getZ() - m_aabb_min.getZ();
-
-    const float x_step = x_len/HEIGHT_MAP_RESOLUTION;
-    const float z_step = z_len/HEIGHT_MAP_RESOLUTION;
-
-    btVector3 hitpoint;
-    const Material* material;
-    btVector3 normal;
-
-    for (int i=0; i<HEIGHT_MAP_RESOLUTION; i++)
-    {
-        out[i].resize(HEIGHT_MAP_RESOLUTION);
-        float z = m_aabb_min.getZ();
-
-        for (int j=0; j<HEIGHT_MAP_RESOLUTION; j++)
+    if (!m_height_map.empty())
+        return m_height_map;
+
+    // The grid position is part of the key, since the bounding box also
+    // depends on objects that are not part of the track mesh.
+    const float header[7] = { (float)HEIGHT_MAP_RESOLUTION,
+                              m_aabb_min.getX(), m_aabb_min.getY(),
+                              m_aabb_min.getZ(), m_aabb_max.getX(),
+                              m_aabb_max.getY(), m_aabb_max.getZ() };
+    std::ostringstream name;
+    name << file_manager->getCachedDataDir() << "heightmap-" << m_ident
+         << "-" << std::hex << std::setw(16) << std::setfill('0')
+         << m_track_mesh->getMeshHash() << ".bin";
+    const std::string cache_file = name.str();
+    const size_t n = HEIGHT_MAP_RESOLUTION * HEIGHT_MAP_RESOLUTION;
+
+    FILE *f = fopen(cache_file.c_str(), "rb");
+    if (f)
+    {
+        float file_header[7];
+        m_height_map.resize(n);
+        bool ok = fread(file_header, sizeof(float), 7, f) == 7 &&
+                  memcmp(file_header, header, sizeof(header)) == 0 &&
+                  fread(m_height_map.data(), sizeof(float), n, f) == n &&
+                  fgetc(f) == EOF;
+        fclose(f);
+        if (ok)
+            return m_height_map;
+        Log::warn("Track", "Ignoring invalid height map cache file '%s'.",
+                  cache_file.c_str());
+    }
+
+    double start = StkTime::getRealTime();
+    m_height_map.resize(n);
+    const float x_step = (m_aabb_max.getX() - m_aabb_min.getX())
+                       / HEIGHT_MAP_RESOLUTION;
+    const float z_step = (m_aabb_max.getZ() - m_aabb_min.getZ())
+                       / HEIGHT_MAP_RESOLUTION;
+
+    // Ray casts only read the track mesh, so each row can be computed
+    // independently.
+    WorkerPool pool(WorkerPool::getDefaultNumThreads(), "HeightMap");
+    pool.run(HEIGHT_MAP_RESOLUTION, [this, x_step, z_step](unsigned i)
+    {
+        btVector3 hitpoint;
+        const Material* material;
+        btVector3 normal;
+        const float x = m_aabb_min.getX() + i * x_step;
+        for (int j = 0; j < HEIGHT_MAP_RESOLUTION; j++)
         {
+            const float z = m_aabb_min.getZ() + j * z_step;
             btVector3 pos(x, 100.0f, z);
             btVector3 to = pos;
             to.setY(-100000.f);
 
-            m_track_mesh->castRay(pos, to, &hitpoint, &material, &normal);
-            z += z_step;
-
-            out[i][j] = hitpoint.getY();
+            bool hit = m_track_mesh->castRay(pos, to, &hitpoint, &material,
+                                             &normal);
+            m_height_map[i * HEIGHT_MAP_RESOLUTION + j] =
+                hit ? hitpoint.getY() : m_aabb_min.getY();
         }   // j<HEIGHT_MAP_RESOLUTION
-        x += x_step;
-    }
-
-    return out;
+    });
+    Log::info("Track", "Height map computed in %f ms with %u thread(s).",
+              (StkTime::getRealTime() - start) * 1000.0,
+              pool.getNumThreads());
+
+    std::string data((const char*)header, sizeof(header));
+    data.append((const char*)m_height_map.data(), n * sizeof(float));
+    file_manager->writeCacheFileAtomically(cache_file, data);
+    return m_height_map;
 }   // buildHeightMap
 
 // ----------------------------------------------------------------------------
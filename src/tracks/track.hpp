@@ -100,6 +100,9 @@ private:
      *  NULL otherwise. */
     static Track *m_current_track;
 
+    /** True if the raycast benchmark should be run after loading a track. */
+    static bool m_benchmark_raycasts;
+
 #ifdef DEBUG
     unsigned int             m_magic_number;
 #endif
@@ -196,6 +199,9 @@ private:
      *  allowing the kart to drive in/partly under water), but the
      *  actual surface position is needed for the water splash effect. */
     TriangleMesh*            m_gfx_effect_mesh;
+    /** Heights of the track on a HEIGHT_MAP_RESOLUTION^2 grid (row major,
+     *  x is the row), used by weather particles. Computed on first use. */
+    std::vector<float>       m_height_map;
     /** Minimum coordinates of this track. */
     Vec3                     m_aabb_min;
     /** Maximum coordinates of this track. */
@@ -401,12 +407,16 @@ private:
     void loadCurves(const XMLNode &node);
     void handleSky(const XMLNode &root, const std::string &filename);
     void freeCachedMeshVertexBuffer();
+    void benchmarkRaycasts() const;
 public:
 
     /** Static function to get the current track. NULL if no current
      *  track is defined (i.e. no race is active atm) */
     static Track* getCurrentTrack() { return m_current_track;  }
     // ------------------------------------------------------------------------
+    /** Compare single and batched raycasts each time a track is loaded. */
+    static void enableRaycastBenchmark() { m_benchmark_raycasts = true; }
+    // ------------------------------------------------------------------------
     void handleAnimatedTextures(scene::ISceneNode *node, const XMLNode &xml);
 
     /** Flag to avoid loading navmeshes (useful to speedup debugging: e.g.
@@ -445,7 +455,7 @@ public:
                                         unsigned int mode_id=0);
     bool findGround(AbstractKart *kart);
 
-    std::vector< std::vector<float> > buildHeightMap();
+    const std::vector<float>& buildHeightMap();
     void               drawMiniMap(const core::rect<s32>& dest_rect) const;
     // ------------------------------------------------------------------------
     /** Returns true if this track has an arena mode. */
@@ -557,6 +567,8 @@ public:
     // ------------------------------------------------------------------------
     /** Returns the triangle mesh for this track. */
     const TriangleMesh *getPtrTriangleMesh() const { return m_track_mesh; }
+    // ------------------------------------------------------------------------
+    TriangleMesh *getPtrTriangleMesh() { return m_track_mesh; }
     const TriangleMesh& getTriangleMesh() const {return *m_track_mesh; }
     // ------------------------------------------------------------------------
     /** Returns the graphical effect mesh for this track. */
@@ -36,10 +36,14 @@
 #include "scriptengine/script_engine.hpp"
 #include "tracks/track.hpp"
 #include "tracks/model_definition_loader.hpp"
+#include "tracks/track_object_manager.hpp"
 
 #include <IAnimatedMeshSceneNode.h>
 #include <ISceneManager.h>
 
+#include <algorithm>
+#include <cmath>
+
 /** A track object: any additional object on the track. This object implements
  *  a graphics-only representation, i.e. there is no physical representation.
  *  Derived classes can implement a physical representation (see
@@ -78,6 +82,7 @@ TrackObject::TrackObject(const core::vector3df& xyz, const core::vector3df& hpr,
     m_interaction     = interaction;
     m_presentation    = presentation;
     m_is_driveable    = false;
+    m_in_driveable_index = false;
     m_soccer_ball     = false;
     m_initially_visible = false;
     m_type            = "";
@@ -123,6 +128,7 @@ void TrackObject::init(const XMLNode &xml_node, scene::ISceneNode* parent,
     xml_node.get("lod_group", &m_lod_group);
 
     m_is_driveable = false;
+    m_in_driveable_index = false;
     xml_node.get("driveable", &m_is_driveable);
 
     bool lod_instance = false;
@@ -551,6 +557,87 @@ void TrackObject::update(float dt)
     if (m_animator) m_animator->updateWithWorldTicks(true/*has_physics*/);
 }   // update
 
+// ----------------------------------------------------------------------------
+/** Returns true if update() does anything for this object. Objects for
+ *  which this is false are not updated by the track object manager.
+ */
+bool TrackObject::needsUpdate() const
+{
+    if (m_presentation && m_presentation->needsUpdate())
+        return true;
+    if (m_physical_object && m_physical_object->isDynamic())
+        return true;
+    // Animations of objects with physics are updated once per time step,
+    // all other animations once per frame (see updateWithWorldTicks).
+    return m_animator && m_physical_object;
+}   // needsUpdate
+
+// ----------------------------------------------------------------------------
+/** Returns true if updateGraphics() does anything for this object.
+ */
+bool TrackObject::needsUpdateGraphics() const
+{
+    if (m_presentation && m_presentation->needsUpdateGraphics())
+        return true;
+    if (m_physical_object && m_physical_object->isDynamic())
+        return true;
+    return m_animator && !m_physical_object;
+}   // needsUpdateGraphics
+
+// ----------------------------------------------------------------------------
+/** Returns true if the only thing updated by update() is a dynamic body
+ *  which is asleep and did not move since the last update.
+ */
+bool TrackObject::canSkipUpdate() const
+{
+    return !m_animator && m_physical_object &&
+           m_physical_object->canSkipUpdate() &&
+           !(m_presentation && m_presentation->needsUpdate());
+}   // canSkipUpdate
+
+// ----------------------------------------------------------------------------
+/** Returns true if the only thing updated by updateGraphics() is a dynamic
+ *  body which is asleep and did not move since the last update.
+ */
+bool TrackObject::canSkipUpdateGraphics() const
+{
+    return !m_animator && m_physical_object &&
+           m_physical_object->canSkipUpdateGraphics() &&
+           !(m_presentation && m_presentation->needsUpdateGraphics());
+}   // canSkipUpdateGraphics
+
+// ----------------------------------------------------------------------------
+/** If updateGraphics() of this object only evaluates a curve based
+ *  animation of a mesh, returns the radius of the mesh around its position,
+ *  otherwise -1. Such animations only depend on the world time, so they
+ *  can be updated less often while the object is far away from all cameras
+ *  without changing how they look once they are close again.
+ */
+float TrackObject::getGraphicalAnimationRadius()
+{
+    if (!m_animator || m_physical_object || !m_children.empty() ||
+        !m_movable_children.empty())
+        return -1.0f;
+    if (!getPresentation<TrackObjectPresentationMesh>() &&
+        !getPresentation<TrackObjectPresentationLOD>())
+        return -1.0f;
+    scene::ISceneNode* node =
+        getPresentation<TrackObjectPresentationSceneNode>()->getNode();
+    // Other scene nodes might be attached to the mesh
+    if (!node || m_presentation->needsUpdateGraphics() ||
+        (getPresentation<TrackObjectPresentationMesh>() &&
+         !node->getChildren().empty()))
+        return -1.0f;
+
+    node->updateAbsolutePosition();
+    const core::aabbox3df& box = node->getBoundingBox();
+    core::vector3df extent(std::max(fabsf(box.MinEdge.X), fabsf(box.MaxEdge.X)),
+                           std::max(fabsf(box.MinEdge.Y), fabsf(box.MaxEdge.Y)),
+                           std::max(fabsf(box.MinEdge.Z), fabsf(box.MaxEdge.Z)));
+    const core::vector3df scale = node->getAbsoluteTransformation().getScale();
+    return (extent * scale).getLength();
+}   // getGraphicalAnimationRadius
+
 // ----------------------------------------------------------------------------
 /** Does a raycast against the track object. The object must have a physical
  *  object.
@@ -603,6 +690,14 @@ void TrackObject::movePhysicalBodyToGraphicalNode(const core::vector3df& xyz,
     // get the absolute transform from the presentation object (as set in
     // the line before), since xyz etc here are only relative to a
     // potential parent scene node.
+    // The object was only added to the spatial index of driveable objects
+    // since it was not expected to move
+    if (m_in_driveable_index && Track::getCurrentTrack())
+    {
+        Track::getCurrentTrack()->getTrackObjectManager()
+                                ->removeFromDriveableIndex(this);
+    }
+
     TrackObjectPresentationSceneNode *tops =
         dynamic_cast<TrackObjectPresentationSceneNode*>(m_presentation);
     if (tops)
@@ -99,6 +99,10 @@ protected:
 
     std::string                     m_visibility_condition;
 
+    /** True if this object is in the spatial index of driveable objects
+     *  of the track object manager, which assumes that it does not move. */
+    bool                           m_in_driveable_index;
+
     void init(const XMLNode &xml_node, scene::ISceneNode* parent,
         ModelDefinitionLoader& model_def_loader,
         TrackObject* parent_library);
@@ -119,6 +123,11 @@ public:
     virtual      ~TrackObject();
     virtual void update(float dt);
     virtual void updateGraphics(float dt);
+    bool         needsUpdate() const;
+    bool         needsUpdateGraphics() const;
+    bool         canSkipUpdate() const;
+    bool         canSkipUpdateGraphics() const;
+    float        getGraphicalAnimationRadius();
     void move(const core::vector3df& xyz, const core::vector3df& hpr,
               const core::vector3df& scale, bool updateRigidBody,
               bool isAbsoluteCoord);
@@ -237,6 +246,10 @@ public:
     /** Returns if a kart can drive on this object. */
     bool isDriveable() const { return m_is_driveable; }
     // ------------------------------------------------------------------------
+    /** Called by the track object manager when this object is added to or
+     *  removed from its spatial index of driveable objects. */
+    void setInDriveableIndex(bool val)          { m_in_driveable_index = val; }
+    // ------------------------------------------------------------------------
     /** Used along the "extract movable nodes out of library objects" hack, used
       * to still preserve the parent-child relationship
       */
@@ -21,19 +21,43 @@
 #include "animations/ipo.hpp"
 #include "animations/three_d_animation.hpp"
 #include "config/stk_config.hpp"
+#include "graphics/camera.hpp"
 #include "graphics/lod_node.hpp"
 #include "graphics/material_manager.hpp"
 #include "io/xml_node.hpp"
 #include "network/network_config.hpp"
 #include "physics/physical_object.hpp"
+#include "tracks/graph.hpp"
+#include "tracks/quad.hpp"
 #include "tracks/track_object.hpp"
 #include "utils/log.hpp"
+#include "utils/time.hpp"
 
+#include <ICameraSceneNode.h>
 #include <IMeshSceneNode.h>
 #include <ISceneManager.h>
 
+#include <algorithm>
+#include <random>
+
+bool        TrackObjectManager::m_benchmark          = false;
+const float TrackObjectManager::DRIVEABLE_CELL_SIZE = 20.0f;
+
+/** Far away objects with a graphical animation are only updated in every
+ *  n-th frame, so that they are updated soon enough once they come close. */
+static const unsigned int FAR_OBJECT_UPDATE_FRAMES = 8;
+
+/** Driveable objects covering more cells than this are not added to the
+ *  grid, but tested by each raycast. */
+static const unsigned int MAX_DRIVEABLE_OBJECT_CELLS = 1024;
+
+/** Raycasts that cover more cells than this test all driveable objects. */
+static const unsigned int MAX_RAY_CELLS = 64;
+
 TrackObjectManager::TrackObjectManager()
 {
+    m_graphics_frame        = 0;
+    m_driveable_index_valid = false;
 }   // TrackObjectManager
 
 // ----------------------------------------------------------------------------
@@ -53,8 +77,12 @@ void TrackObjectManager::add(const XMLNode &xml_node, scene::ISceneNode* parent,
     {
         TrackObject *obj = new TrackObject(xml_node, parent, model_def_loader, parent_library);
         m_all_objects.push_back(obj);
+        addToActivityLists(obj);
         if(obj->isDriveable())
+        {
             m_driveable_objects.push_back(obj);
+            m_driveable_index_valid = false;
+        }
     }
     catch (std::exception& e)
     {
@@ -100,8 +128,103 @@ void TrackObjectManager::init()
             moveable_objects++;
         }
     }
+    buildDriveableIndex();
+    if (m_benchmark)
+        benchmark();
 }   // init
 
+// ----------------------------------------------------------------------------
+/** Adds an object to the lists of objects that need to be updated once per
+ *  time step or once per frame. Objects for which the updates do nothing
+ *  are not added to either list.
+ *  \param object The object to add.
+ */
+void TrackObjectManager::addToActivityLists(TrackObject* object)
+{
+    if (object->needsUpdate())
+        m_update_objects.push_back(object);
+    if (object->needsUpdateGraphics())
+    {
+        m_graphics_objects.push_back(
+            std::make_pair(object, object->getGraphicalAnimationRadius()));
+    }
+}   // addToActivityLists
+
+// ----------------------------------------------------------------------------
+/** Builds the grid of driveable objects used by castRay. Objects that can
+ *  move, because they are animated or have a dynamic body, are tested by
+ *  each raycast instead.
+ */
+void TrackObjectManager::buildDriveableIndex()
+{
+    m_driveable_cells.clear();
+    m_unindexed_driveable_objects.clear();
+    for (unsigned int i = 0; i < m_driveable_objects.size(); i++)
+    {
+        TrackObject* curr = m_driveable_objects.get(i);
+        curr->setInDriveableIndex(false);
+        PhysicalObject* po = curr->getPhysicalObject();
+        if (!po || po->isDynamic() || curr->getAnimator())
+        {
+            m_unindexed_driveable_objects.push_back(i);
+            continue;
+        }
+        // Kinematic bodies get their transform from the motion state in the
+        // next physics step, so use it in case a script moved the object
+        btRigidBody* body = po->getBody();
+        btTransform transform = body->getWorldTransform();
+        if (body->getMotionState())
+            body->getMotionState()->getWorldTransform(transform);
+        btVector3 min, max;
+        body->getCollisionShape()->getAabb(transform, min, max);
+        const float num_x = (max.getX() - min.getX()) / DRIVEABLE_CELL_SIZE;
+        const float num_z = (max.getZ() - min.getZ()) / DRIVEABLE_CELL_SIZE;
+        if ((num_x + 2.0f) * (num_z + 2.0f) > MAX_DRIVEABLE_OBJECT_CELLS)
+        {
+            m_unindexed_driveable_objects.push_back(i);
+            continue;
+        }
+        const int x1 = getCellIndex(max.getX());
+        const int z1 = getCellIndex(max.getZ());
+        for (int x = getCellIndex(min.getX()); x <= x1; x++)
+        {
+            for (int z = getCellIndex(min.getZ()); z <= z1; z++)
+                m_driveable_cells[getCellKey(x, z)].push_back(i);
+        }
+        curr->setInDriveableIndex(true);
+    }
+    m_driveable_index_valid = true;
+}   // buildDriveableIndex
+
+// ----------------------------------------------------------------------------
+/** Removes a driveable object from the grid used by castRay, so that it is
+ *  tested by each raycast. This is called when an object that was not
+ *  expected to move is moved, e.g. by a script.
+ *  \param object The object that was moved.
+ */
+void TrackObjectManager::removeFromDriveableIndex(TrackObject* object)
+{
+    object->setInDriveableIndex(false);
+    unsigned int index = 0;
+    while (index < m_driveable_objects.size() &&
+           m_driveable_objects.get(index) != object)
+        index++;
+    if (index == m_driveable_objects.size())
+        return;
+
+    for (auto& cell : m_driveable_cells)
+    {
+        std::vector<unsigned int>& objects = cell.second;
+        auto it = std::lower_bound(objects.begin(), objects.end(), index);
+        if (it != objects.end() && *it == index)
+            objects.erase(it);
+    }
+    auto it = std::lower_bound(m_unindexed_driveable_objects.begin(),
+                               m_unindexed_driveable_objects.end(), index);
+    if (it == m_unindexed_driveable_objects.end() || *it != index)
+        m_unindexed_driveable_objects.insert(it, index);
+}   // removeFromDriveableIndex
+
 // ----------------------------------------------------------------------------
 /** Initialises all track objects.
  */
@@ -175,10 +298,42 @@ void TrackObjectManager::handleExplosion(const Vec3 &pos, const PhysicalObject *
  */
 void TrackObjectManager::updateGraphics(float dt)
 {
-    TrackObject* curr;
-    for_in(curr, m_all_objects)
+    m_graphics_frame++;
+
+    // Objects beyond the far plane of all cameras can't be seen
+    std::vector<std::pair<core::vector3df, float> > cameras;
+    cameras.reserve(Camera::getNumCameras());
+    for (unsigned int i = 0; i < Camera::getNumCameras(); i++)
     {
-        curr->updateGraphics(dt);
+        const scene::ICameraSceneNode* camera =
+            Camera::getCamera(i)->getCameraSceneNode();
+        cameras.push_back(std::make_pair(camera->getAbsolutePosition(),
+                                         camera->getFarValue()));
+    }
+
+    for (unsigned int i = 0; i < m_graphics_objects.size(); i++)
+    {
+        TrackObject* curr = m_graphics_objects[i].first;
+        const float radius = m_graphics_objects[i].second;
+        if (radius >= 0.0f && !cameras.empty() &&
+            (m_graphics_frame + i) % FAR_OBJECT_UPDATE_FRAMES != 0)
+        {
+            const core::vector3df xyz = curr->getAbsolutePosition();
+            bool is_far = true;
+            for (unsigned int j = 0; j < cameras.size(); j++)
+            {
+                const float d = cameras[j].second + radius;
+                if (xyz.getDistanceFromSQ(cameras[j].first) < d * d)
+                {
+                    is_far = false;
+                    break;
+                }
+            }
+            if (is_far)
+                continue;
+        }
+        if (!curr->canSkipUpdateGraphics())
+            curr->updateGraphics(dt);
     }
 }   // updateGraphics
 
@@ -188,10 +343,11 @@ void TrackObjectManager::updateGraphics(float dt)
  */
 void TrackObjectManager::update(float dt)
 {
-    TrackObject* curr;
-    for_in (curr, m_all_objects)
+    for (TrackObject* curr : m_update_objects)
     {
-        curr->update(dt);
+        // Sleeping bodies are skipped until bullet wakes them up again
+        if (!curr->canSkipUpdate())
+            curr->update(dt);
     }
 }   // update
 
@@ -227,37 +383,252 @@ void TrackObjectManager::castRay(const btVector3 &from,
     {
         distance = hit_point->distance(from);
     }
-    for (const TrackObject* curr : m_driveable_objects)
+
+    const float min_x = std::min(from.getX(), to.getX());
+    const float max_x = std::max(from.getX(), to.getX());
+    const float min_z = std::min(from.getZ(), to.getZ());
+    const float max_z = std::max(from.getZ(), to.getZ());
+    const float num_cells = ((max_x - min_x) / DRIVEABLE_CELL_SIZE + 2.0f) *
+                            ((max_z - min_z) / DRIVEABLE_CELL_SIZE + 2.0f);
+    if (!m_driveable_index_valid || num_cells > MAX_RAY_CELLS)
     {
-        if (!curr->isEnabled())
+        for (const TrackObject* curr : m_driveable_objects)
         {
-            // For example jumping pad in cocoa temple
-            continue;
+            castRay(curr, from, to, &distance, hit_point, material, normal,
+                    interpolate_normal);
         }
-        btVector3 new_hit_point;
-        const Material *new_material;
-        btVector3 new_normal;
-        if(curr->castRay(from, to, &new_hit_point, &new_material, &new_normal,
-                      interpolate_normal))
+        return;
+    }
+
+    const int x0 = getCellIndex(min_x), x1 = getCellIndex(max_x);
+    const int z0 = getCellIndex(min_z), z1 = getCellIndex(max_z);
+    if (x0 == x1 && z0 == z1)
+    {
+        // Most rays (e.g. of the wheels) are inside of one cell. Merge the
+        // objects of that cell with the unindexed ones, so that all objects
+        // are tested in the order of m_driveable_objects.
+        static const std::vector<unsigned int> no_objects;
+        auto cell = m_driveable_cells.find(getCellKey(x0, z0));
+        const std::vector<unsigned int>& in_cell =
+            cell == m_driveable_cells.end() ? no_objects : cell->second;
+        const std::vector<unsigned int>& unindexed =
+            m_unindexed_driveable_objects;
+        unsigned int i = 0, j = 0;
+        while (i < in_cell.size() || j < unindexed.size())
         {
-            float new_distance = new_hit_point.distance(from);
-            // If the new hit is closer than the current hit, save
-            // the data.
-            if (new_distance < distance)
+            unsigned int index;
+            if (j == unindexed.size() ||
+                (i < in_cell.size() && in_cell[i] < unindexed[j]))
+                index = in_cell[i++];
+            else
+                index = unindexed[j++];
+            castRay(m_driveable_objects.get(index), from, to, &distance,
+                    hit_point, material, normal, interpolate_normal);
+        }
+        return;
+    }
+
+    std::vector<unsigned int> candidates = m_unindexed_driveable_objects;
+    for (int x = x0; x <= x1; x++)
+    {
+        for (int z = z0; z <= z1; z++)
+        {
+            auto cell = m_driveable_cells.find(getCellKey(x, z));
+            if (cell != m_driveable_cells.end())
             {
-                *material  = new_material;
-                *hit_point = new_hit_point;
-                *normal    = new_normal;
-                distance   = new_distance;
-            }   // if new_distance < distance
-        }   // if hit
-    }   // for all track objects.
+                candidates.insert(candidates.end(), cell->second.begin(),
+                                  cell->second.end());
+            }
+        }
+    }
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()),
+                     candidates.end());
+    for (unsigned int index : candidates)
+    {
+        castRay(m_driveable_objects.get(index), from, to, &distance,
+                hit_point, material, normal, interpolate_normal);
+    }
 }   // castRay
 
+// ----------------------------------------------------------------------------
+/** Does a raycast against one driveable object, and updates the hit data
+ *  if the object is hit closer than the current hit.
+ *  \param object The object to test.
+ *  \param from/to The from and to position for the raycast.
+ *  \param distance Distance of the current hit, updated on a closer hit.
+ *  \param hit_point, material, normal The data of the closest hit.
+ *  \param interpolate_normal If true, the returned normal is interpolated.
+ */
+void TrackObjectManager::castRay(const TrackObject* object,
+                                 const btVector3 &from, const btVector3 &to,
+                                 float *distance, btVector3 *hit_point,
+                                 const Material **material, btVector3 *normal,
+                                 bool interpolate_normal) const
+{
+    if (!object->isEnabled())
+    {
+        // For example jumping pad in cocoa temple
+        return;
+    }
+    btVector3 new_hit_point;
+    const Material *new_material;
+    btVector3 new_normal;
+    if(object->castRay(from, to, &new_hit_point, &new_material, &new_normal,
+                       interpolate_normal))
+    {
+        float new_distance = new_hit_point.distance(from);
+        // If the new hit is closer than the current hit, save
+        // the data.
+        if (new_distance < *distance)
+        {
+            *material  = new_material;
+            *hit_point = new_hit_point;
+            *normal    = new_normal;
+            *distance  = new_distance;
+        }   // if new_distance < distance
+    }   // if hit
+}   // castRay
+
+// ----------------------------------------------------------------------------
+/** Compares the scheduled updates and the indexed raycasts with updating and
+ *  testing all objects, and prints the results. Enabled with
+ *  --track-object-benchmark.
+ */
+void TrackObjectManager::benchmark()
+{
+    unsigned int far_objects = 0;
+    for (auto& p : m_graphics_objects)
+    {
+        if (p.second >= 0.0f)
+            far_objects++;
+    }
+    Log::info("TrackObjectManager", "%d objects: %d updated per time step, "
+              "%d per frame (%d of them less often when far away), %d of %d "
+              "driveable objects in the raycast grid.",
+              m_all_objects.size(), (int)m_update_objects.size(),
+              (int)m_graphics_objects.size(), far_objects,
+              m_driveable_objects.size() -
+              (int)m_unindexed_driveable_objects.size(),
+              m_driveable_objects.size());
+
+    // The updates of objects that are not in the activity lists do nothing,
+    // so they can be called here without side effects. This is the time
+    // that is saved per time step and frame.
+    std::vector<TrackObject*> no_update, no_graphics_update;
+    for (TrackObject* curr : m_all_objects)
+    {
+        if (!curr->needsUpdate())
+            no_update.push_back(curr);
+        if (!curr->needsUpdateGraphics())
+            no_graphics_update.push_back(curr);
+    }
+    const unsigned int rounds = 1000;
+    double start = StkTime::getRealTime();
+    for (unsigned int r = 0; r < rounds; r++)
+    {
+        for (TrackObject* curr : no_update)
+            curr->update(0.0f);
+        for (TrackObject* curr : no_graphics_update)
+            curr->updateGraphics(0.0f);
+    }
+    const double skipped_time = StkTime::getRealTime() - start;
+    Log::info("TrackObjectManager", "Skipped updates would take %.2f us per "
+              "time step and frame.", skipped_time / rounds * 1.0e6);
+
+    if (m_driveable_objects.size() == 0)
+        return;
+
+    // Vertical rays above the quads of the graph and above each driveable
+    // object, similar to the rays of the wheels.
+    std::mt19937 random(42);
+    std::uniform_real_distribution<float> offset(0.0f, 1.0f);
+    std::vector<std::pair<btVector3, btVector3> > rays;
+    for (unsigned int i = 0; Graph::get() && i < Graph::get()->getNumNodes();
+         i++)
+    {
+        const Quad* q = Graph::get()->getQuad(i);
+        const Vec3 &normal = q->getNormal();
+        for (unsigned int j = 0; j < 4; j++)
+        {
+            const Vec3 from = (*q)[j] + ((*q)[(j + 2) % 4] - (*q)[j]) *
+                              offset(random) + normal;
+            rays.push_back(std::make_pair(from, from - normal * 2.0f));
+        }
+    }
+    for (TrackObject* curr : m_driveable_objects)
+    {
+        if (!curr->getPhysicalObject())
+            continue;
+        btVector3 min, max;
+        curr->getPhysicalObject()->getBody()->getAabb(min, max);
+        for (unsigned int j = 0; j < 16; j++)
+        {
+            const btVector3 from(min.getX() + (max.getX() - min.getX()) *
+                                 offset(random), max.getY() + 1.0f,
+                                 min.getZ() + (max.getZ() - min.getZ()) *
+                                 offset(random));
+            rays.push_back(std::make_pair(from,
+                btVector3(from.getX(), min.getY() - 1.0f, from.getZ())));
+        }
+    }
+
+    const unsigned int ray_rounds = 10;
+    std::vector<const Material*> all_materials(rays.size()),
+                                 indexed_materials(rays.size());
+    std::vector<btVector3> all_hits(rays.size()), indexed_hits(rays.size());
+    btVector3 normal;
+    start = StkTime::getRealTime();
+    for (unsigned int r = 0; r < ray_rounds; r++)
+    {
+        for (unsigned int i = 0; i < rays.size(); i++)
+        {
+            float distance = 9999.9f;
+            all_materials[i] = NULL;
+            for (const TrackObject* curr : m_driveable_objects)
+            {
+                castRay(curr, rays[i].first, rays[i].second, &distance,
+                        &all_hits[i], &all_materials[i], &normal, true);
+            }
+        }
+    }
+    const double all_time = StkTime::getRealTime() - start;
+
+    start = StkTime::getRealTime();
+    for (unsigned int r = 0; r < ray_rounds; r++)
+    {
+        for (unsigned int i = 0; i < rays.size(); i++)
+        {
+            indexed_materials[i] = NULL;
+            castRay(rays[i].first, rays[i].second, &indexed_hits[i],
+                    &indexed_materials[i], &normal, true);
+        }
+    }
+    const double indexed_time = StkTime::getRealTime() - start;
+
+    unsigned int mismatches = 0;
+    for (unsigned int i = 0; i < rays.size(); i++)
+    {
+        if (all_materials[i] != indexed_materials[i] ||
+            (all_materials[i] && all_hits[i] != indexed_hits[i]))
+            mismatches++;
+    }
+    const double num_rays = double(rays.size() * ray_rounds);
+    Log::info("TrackObjectManager", "Raycasts: %.0f rays/s testing all "
+              "driveable objects, %.0f rays/s using the grid.",
+              num_rays / all_time, num_rays / indexed_time);
+    if (mismatches > 0)
+    {
+        Log::error("TrackObjectManager", "%d of %d raycasts differ when "
+                   "using the grid.", mismatches, (int)rays.size());
+    }
+}   // benchmark
+
 // ----------------------------------------------------------------------------
 void TrackObjectManager::insertObject(TrackObject* object)
 {
     m_all_objects.push_back(object);
+    addToActivityLists(object);
 }
 
 // ----------------------------------------------------------------------------
@@ -268,5 +639,38 @@ void TrackObjectManager::insertObject(TrackObject* object)
 void TrackObjectManager::removeObject(TrackObject* obj)
 {
     m_all_objects.remove(obj);
+    m_update_objects.erase(std::remove(m_update_objects.begin(),
+                                       m_update_objects.end(), obj),
+                           m_update_objects.end());
+    for (unsigned int i = 0; i < m_graphics_objects.size(); i++)
+    {
+        if (m_graphics_objects[i].first == obj)
+        {
+            m_graphics_objects.erase(m_graphics_objects.begin() + i);
+            break;
+        }
+    }
+    for (unsigned int index = 0; index < m_driveable_objects.size(); index++)
+    {
+        if (m_driveable_objects.get(index) != obj)
+            continue;
+        // Remove the index of the object from the grid, and shift the
+        // indices of all following objects
+        m_driveable_objects.remove(obj);
+        auto remove_index = [index](std::vector<unsigned int>* objects)
+        {
+            objects->erase(std::remove(objects->begin(), objects->end(),
+                                       index), objects->end());
+            for (unsigned int& i : *objects)
+            {
+                if (i > index)
+                    i--;
+            }
+        };
+        for (auto& cell : m_driveable_cells)
+            remove_index(&cell.second);
+        remove_index(&m_unindexed_driveable_objects);
+        break;
+    }
     delete obj;
 }   // removeObject
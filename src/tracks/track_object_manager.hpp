@@ -22,15 +22,19 @@
 #include "physics/physical_object.hpp"
 #include "tracks/track_object.hpp"
 #include "utils/ptr_vector.hpp"
+#include "utils/types.hpp"
 
 class Track;
 class Vec3;
 class XMLNode;
 class LODNode;
 
+#include <cmath>
 #include <map>
 #include <vector>
 #include <string>
+#include <unordered_map>
+#include <utility>
 
 /**
   * \ingroup tracks
@@ -51,6 +55,66 @@ protected:
     /** A second list which holds all objects that karts can drive on. */
     PtrVector<TrackObject, REF> m_driveable_objects;
 
+    /** The objects for which update() must be called once per time step, in
+     *  the same order as in m_all_objects. Objects for which update() does
+     *  nothing (e.g. static meshes) are not in this list, so the result of
+     *  a race does not change. */
+    std::vector<TrackObject*> m_update_objects;
+
+    /** The objects for which updateGraphics() must be called once per frame,
+     *  in the same order as in m_all_objects. The second value is the radius
+     *  of an object whose updates can be delayed while it is far away from
+     *  all cameras (see TrackObject::getGraphicalAnimationRadius), or a
+     *  negative value if it must be updated in each frame. */
+    std::vector<std::pair<TrackObject*, float> > m_graphics_objects;
+
+    /** Counts the calls to updateGraphics(), used to spread the updates of
+     *  far away objects over several frames. */
+    unsigned int m_graphics_frame;
+
+    /** A uniform grid in the x/z plane over all driveable objects that do
+     *  not move, used to find the objects a raycast can hit. Each cell list
+     *  contains indices into m_driveable_objects in increasing order, so the
+     *  objects are tested in the same order as in m_driveable_objects. The
+     *  key is computed by getCellKey. */
+    std::unordered_map<uint64_t, std::vector<unsigned int> > m_driveable_cells;
+
+    /** Indices of all driveable objects that are not in m_driveable_cells
+     *  (e.g. animated objects), in increasing order. They are tested by
+     *  each raycast. */
+    std::vector<unsigned int> m_unindexed_driveable_objects;
+
+    /** True if m_driveable_cells contains all driveable objects that can be
+     *  indexed. It is built once all objects are loaded. */
+    bool m_driveable_index_valid;
+
+    /** True if the benchmark should be run after loading a track. */
+    static bool m_benchmark;
+
+    /** Size of a cell in m_driveable_cells. */
+    static const float DRIVEABLE_CELL_SIZE;
+
+    void addToActivityLists(TrackObject* object);
+    void buildDriveableIndex();
+    void castRay(const TrackObject* object, const btVector3 &from,
+                 const btVector3 &to, float *distance, btVector3 *hit_point,
+                 const Material **material, btVector3 *normal,
+                 bool interpolate_normal) const;
+    void benchmark();
+    // ------------------------------------------------------------------------
+    /** Returns the index of the grid cell containing the given coordinate.
+     */
+    static int getCellIndex(float f)
+    {
+        return (int)floorf(f / DRIVEABLE_CELL_SIZE);
+    }   // getCellIndex
+    // ------------------------------------------------------------------------
+    /** Returns the key used in m_driveable_cells for the given cell. */
+    static uint64_t getCellKey(int x, int z)
+    {
+        return ((uint64_t)(uint32_t)x << 32) | (uint64_t)(uint32_t)z;
+    }   // getCellKey
+
 public:
          TrackObjectManager();
         ~TrackObjectManager();
@@ -72,10 +136,16 @@ public:
 
     void removeObject(TrackObject* who);
 
+    void removeFromDriveableIndex(TrackObject* object);
+
     TrackObject* getTrackObject(const std::string& libraryInstance, const std::string& name);
 
           PtrVector<TrackObject>& getObjects()       { return m_all_objects; }
     const PtrVector<TrackObject>& getObjects() const { return m_all_objects; }
+    // ------------------------------------------------------------------------
+    /** Compare the scheduled updates and indexed raycasts with updating and
+     *  testing all objects each time a track is loaded. */
+    static void enableBenchmark() { m_benchmark = true; }
 
 };   // class TrackObjectManager
 
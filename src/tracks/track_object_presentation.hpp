@@ -89,6 +89,15 @@ public:
     }
     virtual void updateGraphics(float dt) {}
     virtual void update(float dt) {}
+    // ------------------------------------------------------------------------
+    /** Returns true if update() does anything for this presentation, i.e. if
+     *  it must be called once per time step. */
+    virtual bool needsUpdate() const { return false; }
+    // ------------------------------------------------------------------------
+    /** Returns true if updateGraphics() does anything for this presentation,
+     *  i.e. if it must be called once per frame. */
+    virtual bool needsUpdateGraphics() const { return false; }
+    // ------------------------------------------------------------------------
     virtual void move(const core::vector3df& xyz, const core::vector3df& hpr,
         const core::vector3df& scale, bool isAbsoluteCoord) {}
 
@@ -196,6 +205,7 @@ public:
         ModelDefinitionLoader& model_def_loader);
     virtual ~TrackObjectPresentationLibraryNode();
     virtual void update(float dt) OVERRIDE;
+    virtual bool needsUpdate() const OVERRIDE { return true; }
     virtual void reset() OVERRIDE
     {
         m_reset_executed = false;
@@ -292,6 +302,7 @@ public:
     virtual ~TrackObjectPresentationSound();
     virtual void onTriggerItemApproached() OVERRIDE;
     virtual void updateGraphics(float dt) OVERRIDE;
+    virtual bool needsUpdateGraphics() const OVERRIDE { return true; }
     virtual void move(const core::vector3df& xyz, const core::vector3df& hpr,
         const core::vector3df& scale, bool isAbsoluteCoord) OVERRIDE;
     void triggerSound(bool loop);
@@ -322,6 +333,8 @@ public:
                                      scene::ISceneNode* parent);
     virtual ~TrackObjectPresentationBillboard();
     virtual void updateGraphics(float dt) OVERRIDE;
+    virtual bool needsUpdateGraphics() const OVERRIDE
+                                               { return m_fade_out_when_close; }
 };   // TrackObjectPresentationBillboard
 
 
@@ -344,6 +357,7 @@ public:
     virtual ~TrackObjectPresentationParticles();
 
     virtual void updateGraphics(float dt) OVERRIDE;
+    virtual bool needsUpdateGraphics() const OVERRIDE { return true; }
     void triggerParticles();
     void stop();
     void stopIn(double delay);
@@ -408,6 +422,8 @@ public:
     /** Reset the trigger (i.e. sets it to active again). */
     virtual void reset() OVERRIDE                { m_reenable_timeout = 0.0f; }
     // ------------------------------------------------------------------------
+    virtual bool needsUpdate() const OVERRIDE { return true; }
+    // ------------------------------------------------------------------------
     virtual void update(float dt) OVERRIDE
     {
         if (m_reenable_timeout < 900000.0f)
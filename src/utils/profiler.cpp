@@ -30,6 +30,7 @@
 #include "utils/vs.hpp"
 
 #include <algorithm>
+#include <stdarg.h>
 #include <fstream>
 #include <ostream>
 #include <stack>
@@ -75,6 +76,24 @@ Profiler profiler;
 #endif
 // --- End portable precise timer ---
 
+//-----------------------------------------------------------------------------
+/** Escapes a marker name so it can be written as a JSON string. */
+static std::string jsonEscape(const std::string &s)
+{
+    std::string out;
+    for (char c : s)
+    {
+        if (c == '"' || c == '\\')
+        {
+            out.push_back('\\');
+            out.push_back(c);
+        }
+        else if ((unsigned char)c >= 0x20)
+            out.push_back(c);
+    }
+    return out;
+}   // jsonEscape
+
 //-----------------------------------------------------------------------------
 Profiler::Profiler()
 {
@@ -89,11 +108,18 @@ Profiler::Profiler()
     m_current_frame       = 0;
     m_has_wrapped_around  = false;
     m_threads_used = 1;
+    m_trace_file          = NULL;
+    m_trace_start         = 0.0;
+    m_trace_duration      = 0.0;
+    m_trace_frame         = 0;
+    m_trace_first_event   = true;
+    m_tick_stats          = false;
 }   // Profile
 
 //-----------------------------------------------------------------------------
 Profiler::~Profiler()
 {
+    stopTrace();
 }   // ~Profiler
 
 //-----------------------------------------------------------------------------
@@ -102,6 +128,9 @@ Profiler::~Profiler()
  *  graphics). */
 void Profiler::init()
 {
+    // init() is also called when a trace is started
+    if (!m_all_threads_data.empty())
+        return;
     const int MAX_THREADS = 10;
     m_all_threads_data.resize(MAX_THREADS);
     m_thread_mapping.resize(MAX_THREADS);
@@ -131,46 +160,109 @@ int Profiler::getThreadID()
         i++;
     }   // for i <m_threads_used
 
-    assert(m_threads_used < (int)m_thread_mapping.size());
+    // Thread pools can use more threads than expected
+    if (m_threads_used >= (int)m_thread_mapping.size())
+    {
+        m_thread_mapping.resize(m_threads_used * 2);
+        m_all_threads_data.resize(m_threads_used * 2);
+    }
     m_thread_mapping[m_threads_used] = thread;
     m_threads_used++;
 
     return m_threads_used - 1;
 }   // getThreadID
 
+//-----------------------------------------------------------------------------
+/** Returns the id of a marker with the given name. A new id is assigned
+ *  if this name is used the first time. The id is used to push markers
+ *  without having to look up the name each time.
+ *  \param name Name of the marker.
+ *  \param colour Colour used in the on-screen display. Only the colour
+ *         specified the first time a name is used is kept.
+ */
+int Profiler::getMarkerID(const char* name, const video::SColor& colour)
+{
+    m_lock.lock();
+    std::map<std::string, int>::iterator i = m_marker_ids.find(name);
+    int id;
+    if (i != m_marker_ids.end())
+    {
+        id = i->second;
+    }
+    else
+    {
+        id = (int)m_marker_names.size();
+        m_marker_names.push_back(name);
+        m_marker_colours.push_back(colour);
+        m_marker_ids[name] = id;
+    }
+    m_lock.unlock();
+    return id;
+}   // getMarkerID
+
 //-----------------------------------------------------------------------------
 /// Push a new marker that starts now
 void Profiler::pushCPUMarker(const char* name, const video::SColor& colour)
 {
+    // Avoid the name lookup if the marker would be ignored anyway
+    if (!isTracing() && !m_tick_stats &&
+        (!UserConfigParams::m_profiler_enabled ||
+         m_freeze_state == FROZEN || m_freeze_state == WAITING_FOR_UNFREEZE))
+        return;
+    pushCPUMarker(getMarkerID(name, colour));
+}   // pushCPUMarker
+
+//-----------------------------------------------------------------------------
+/// Push a new marker that starts now
+void Profiler::pushCPUMarker(int marker_id)
+{
+    bool display = UserConfigParams::m_profiler_enabled &&
+                   m_freeze_state != FROZEN &&
+                   m_freeze_state != WAITING_FOR_UNFREEZE;
     // Don't do anything when disabled or frozen
-    if (!UserConfigParams::m_profiler_enabled ||
-         m_freeze_state == FROZEN || m_freeze_state == WAITING_FOR_UNFREEZE )
+    if (!display && !isTracing() && !m_tick_stats)
         return;
 
     // We need to look before getting the thread id (since this might
     // be a new thread which changes the structure).
     m_lock.lock();
     int thread_id = getThreadID();
-
     ThreadData &td = m_all_threads_data[thread_id];
-    AllEventData::iterator i = td.m_all_event_data.find(name);
-    double  start = getTimeMilliseconds() - m_time_last_sync;
-    if (i != td.m_all_event_data.end())
+    double now = getTimeMilliseconds();
+
+    if (m_trace_file)
     {
-        i->second.setStart(m_current_frame, start, (int)td.m_event_stack.size());
+        TraceEvent te;
+        te.m_time      = now - m_trace_start;
+        te.m_marker_id = marker_id;
+        td.m_trace_events.push_back(te);
+        td.m_trace_depth++;
     }
-    else
+
+    if (m_tick_stats && thread_id == 0)
+        m_tick_stats_stack.push_back(std::make_pair(marker_id, now));
+
+    if (!display)
+    {
+        m_lock.unlock();
+        return;
+    }
+
+    if (marker_id >= (int)td.m_all_event_data.size())
+        td.m_all_event_data.resize(m_marker_names.size());
+    EventData &ed = td.m_all_event_data[marker_id];
+    if (!ed.isUsed())
     {
-        EventData ed(colour, m_max_frames);
-        ed.setStart(m_current_frame, start, (int)td.m_event_stack.size());
-        td.m_all_event_data[name] = ed;
+        ed.init(m_max_frames);
         // Ordered headings is used to determine the order in which the
         // bar graph is drawn. Outer profiling events will be added first,
         // so they will be drawn first, which gives the proper nested
         // displayed of events.
-        td.m_ordered_headings.push_back(name);
+        td.m_ordered_headings.push_back(marker_id);
     }
-    td.m_event_stack.push_back(name);
+    ed.setStart(m_current_frame, now - m_time_last_sync,
+                (int)td.m_event_stack.size());
+    td.m_event_stack.push_back(marker_id);
     m_lock.unlock();
 }   // pushCPUMarker
 
@@ -178,9 +270,11 @@ void Profiler::pushCPUMarker(const char* name, const video::SColor& colour)
 /// Stop the last pushed marker
 void Profiler::popCPUMarker()
 {
+    bool display = UserConfigParams::m_profiler_enabled &&
+                   m_freeze_state != FROZEN &&
+                   m_freeze_state != WAITING_FOR_UNFREEZE;
     // Don't do anything when disabled or frozen
-    if( !UserConfigParams::m_profiler_enabled ||
-        m_freeze_state == FROZEN || m_freeze_state == WAITING_FOR_UNFREEZE )
+    if (!display && !isTracing() && !m_tick_stats)
         return;
     double now = getTimeMilliseconds();
 
@@ -188,24 +282,210 @@ void Profiler::popCPUMarker()
     int thread_id = getThreadID();
     ThreadData &td = m_all_threads_data[thread_id];
 
+    // Markers pushed before the trace was started are not in the trace.
+    if (m_trace_file && td.m_trace_depth > 0)
+    {
+        TraceEvent te;
+        te.m_time      = now - m_trace_start;
+        te.m_marker_id = -1;
+        td.m_trace_events.push_back(te);
+        td.m_trace_depth--;
+    }
+
+    // Markers pushed before the statistics were started are ignored, too.
+    if (m_tick_stats && thread_id == 0 && !m_tick_stats_stack.empty())
+    {
+        const std::pair<int, double> &marker = m_tick_stats_stack.back();
+        if (marker.first >= (int)m_tick_durations.size())
+            m_tick_durations.resize(m_marker_names.size(), -1.0);
+        double &duration = m_tick_durations[marker.first];
+        duration = std::max(duration, 0.0) + now - marker.second;
+        m_tick_stats_stack.pop_back();
+    }
+
     // When the profiler gets enabled (which happens in the middle of the
     // main loop), there can be some pops without matching pushes (for one
     // frame) - ignore those events.
-    if (td.m_event_stack.size() == 0)
+    if (!display || td.m_event_stack.size() == 0)
     {
         m_lock.unlock();
         return;
     }
 
-    assert(td.m_event_stack.size() > 0);
-
-    const std::string &name = td.m_event_stack.back();
-    td.m_all_event_data[name].setEnd(m_current_frame, now - m_time_last_sync);
+    int marker_id = td.m_event_stack.back();
+    td.m_all_event_data[marker_id].setEnd(m_current_frame,
+                                          now - m_time_last_sync);
 
     td.m_event_stack.pop_back();
     m_lock.unlock();
 }   // popCPUMarker
 
+//-----------------------------------------------------------------------------
+/** Starts writing all CPU markers to a trace file in the Chrome trace event
+ *  format, which can be loaded in chrome://tracing or in Perfetto. This
+ *  works independently of the on-screen profiler, so it can be used e.g.
+ *  on servers without graphics. The events are written to the file at each
+ *  frame sync.
+ *  \param seconds How long the trace should be recorded.
+ */
+void Profiler::startTrace(float seconds)
+{
+    if (isTracing())
+        return;
+    init();
+    m_trace_filename =
+        file_manager->getUserConfigFile(file_manager->getStdoutName())
+        + ".trace.json";
+    FILE *f = fopen(m_trace_filename.c_str(), "w");
+    if (!f)
+    {
+        Log::error("Profiler", "Can't open '%s' for writing.",
+                   m_trace_filename.c_str());
+        return;
+    }
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    m_lock.lock();
+    m_trace_first_event = true;
+    m_trace_frame       = 0;
+    m_trace_duration    = seconds * 1000.0;
+    m_trace_start       = getTimeMilliseconds();
+    m_trace_file        = f;
+    m_lock.unlock();
+    Log::info("Profiler", "Writing trace for %f seconds to '%s'.", seconds,
+              m_trace_filename.c_str());
+}   // startTrace
+
+//-----------------------------------------------------------------------------
+/** Writes one event to the trace file, adding the separator to the
+ *  previous event if necessary. Must be called with m_lock locked.
+ */
+void Profiler::writeTraceEvent(const char *format, ...)
+{
+    if (!m_trace_first_event)
+        fputs(",\n", m_trace_file);
+    m_trace_first_event = false;
+    va_list args;
+    va_start(args, format);
+    vfprintf(m_trace_file, format, args);
+    va_end(args);
+}   // writeTraceEvent
+
+//-----------------------------------------------------------------------------
+/** Writes all buffered trace events of all threads to the trace file, and
+ *  adds a frame boundary. Must be called with m_lock locked.
+ *  \param now The current time.
+ */
+void Profiler::flushTrace(double now)
+{
+    for (int i = 0; i < m_threads_used; i++)
+    {
+        ThreadData &td = m_all_threads_data[i];
+        for (const TraceEvent &te : td.m_trace_events)
+        {
+            // Time stamps in the trace file are in microseconds
+            if (te.m_marker_id >= 0)
+            {
+                std::string name =
+                    jsonEscape(m_marker_names[te.m_marker_id]);
+                writeTraceEvent("{\"name\":\"%s\",\"ph\":\"B\",\"pid\":1,"
+                                "\"tid\":%d,\"ts\":%.3f}", name.c_str(), i,
+                                te.m_time * 1000.0);
+            }
+            else
+            {
+                writeTraceEvent("{\"ph\":\"E\",\"pid\":1,\"tid\":%d,"
+                                "\"ts\":%.3f}", i, te.m_time * 1000.0);
+            }
+        }
+        td.m_trace_events.clear();
+    }
+    writeTraceEvent("{\"name\":\"Frame\",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,"
+                    "\"tid\":0,\"ts\":%.3f,\"args\":{\"frame\":%d}}",
+                    (now - m_trace_start) * 1000.0, m_trace_frame);
+    m_trace_frame++;
+}   // flushTrace
+
+//-----------------------------------------------------------------------------
+/** Closes all open markers in the trace and finishes the trace file. */
+void Profiler::stopTrace()
+{
+    if (!isTracing())
+        return;
+    double now = getTimeMilliseconds();
+    m_lock.lock();
+    flushTrace(now);
+    for (int i = 0; i < m_threads_used; i++)
+    {
+        ThreadData &td = m_all_threads_data[i];
+        for (; td.m_trace_depth > 0; td.m_trace_depth--)
+        {
+            writeTraceEvent("{\"ph\":\"E\",\"pid\":1,\"tid\":%d,"
+                            "\"ts\":%.3f}", i, (now - m_trace_start)*1000.0);
+        }
+        writeTraceEvent("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                        "\"tid\":%d,\"args\":{\"name\":\"%s\"}}", i,
+                        i == 0 ? "Main" : ("Thread " +
+                                           StringUtils::toString(i)).c_str());
+    }
+    fputs("\n]}\n", m_trace_file);
+    fclose(m_trace_file);
+    m_trace_file = NULL;
+    m_lock.unlock();
+    Log::info("Profiler", "Trace with %d frames written to '%s'.",
+              m_trace_frame, m_trace_filename.c_str());
+}   // stopTrace
+
+//-----------------------------------------------------------------------------
+/** Starts recording the time spent in each marker of the main thread in
+ *  each frame, so that statistics (e.g. percentiles) can be written with
+ *  writeTickStats. Like tracing, this works without the on-screen profiler,
+ *  e.g. for benchmarks without graphics.
+ */
+void Profiler::startTickStats()
+{
+    init();
+    m_lock.lock();
+    m_tick_stats = true;
+    m_tick_stats_stack.clear();
+    m_tick_durations.clear();
+    m_tick_samples.clear();
+    m_lock.unlock();
+}   // startTickStats
+
+//-----------------------------------------------------------------------------
+/** Writes the statistics of all markers recorded since startTickStats as
+ *  a JSON object, which maps each marker name to the number of frames it
+ *  was used in, and the mean, median, 99th percentile and maximum time
+ *  (in ms) per frame.
+ *  \param f The file to write to.
+ */
+void Profiler::writeTickStats(FILE *f)
+{
+    m_lock.lock();
+    fprintf(f, "{");
+    bool first = true;
+    for (unsigned int i = 0; i < m_tick_samples.size(); i++)
+    {
+        std::vector<float> &samples = m_tick_samples[i];
+        if (samples.empty())
+            continue;
+        std::sort(samples.begin(), samples.end());
+        double sum = 0.0;
+        for (float t : samples)
+            sum += t;
+        const size_t n = samples.size();
+        fprintf(f, "%s\n    \"%s\": {\"count\": %d, \"mean_ms\": %.4f, "
+                "\"p50_ms\": %.4f, \"p99_ms\": %.4f, \"max_ms\": %.4f}",
+                first ? "" : ",", jsonEscape(m_marker_names[i]).c_str(),
+                (int)n, sum / n, samples[(n - 1) / 2],
+                samples[std::min(n - 1, (size_t)(0.99 * n))], samples[n - 1]);
+        first = false;
+    }
+    fprintf(f, "\n  }");
+    m_lock.unlock();
+}   // writeTickStats
+
 //-----------------------------------------------------------------------------
 /** Switches the profiler either on or off.
  */
@@ -229,14 +509,43 @@ void Profiler::toggleStatus()
  */
 void Profiler::synchronizeFrame()
 {
-    // Don't do anything when frozen
-    if(!UserConfigParams::m_profiler_enabled || m_freeze_state == FROZEN)
-        return;
-
     // Avoid using several times getTimeMilliseconds(),
     // which would yield different results
     double now = getTimeMilliseconds();
 
+    if (isTracing())
+    {
+        if (now - m_trace_start >= m_trace_duration)
+        {
+            stopTrace();
+        }
+        else
+        {
+            m_lock.lock();
+            flushTrace(now);
+            m_lock.unlock();
+        }
+    }
+
+    if (m_tick_stats)
+    {
+        m_lock.lock();
+        if (m_tick_samples.size() < m_tick_durations.size())
+            m_tick_samples.resize(m_tick_durations.size());
+        for (unsigned int i = 0; i < m_tick_durations.size(); i++)
+        {
+            if (m_tick_durations[i] < 0.0)
+                continue;
+            m_tick_samples[i].push_back((float)m_tick_durations[i]);
+            m_tick_durations[i] = -1.0;
+        }
+        m_lock.unlock();
+    }
+
+    // Don't do anything when frozen
+    if(!UserConfigParams::m_profiler_enabled || m_freeze_state == FROZEN)
+        return;
+
     m_lock.lock();
     // Set index to next frame
     int next_frame = m_current_frame+1;
@@ -269,10 +578,8 @@ void Profiler::synchronizeFrame()
         for (int i = 0; i < m_threads_used; i++)
         {
             ThreadData &td = m_all_threads_data[i];
-            AllEventData &aed = td.m_all_event_data;
-            AllEventData::iterator k;
-            for (k = aed.begin(); k != aed.end(); ++k)
-                k->second.getMarker(next_frame).clear();
+            for (int id : td.m_ordered_headings)
+                td.m_all_event_data[id].getMarker(next_frame).clear();
         }
     }   // is has wrapped around
 
@@ -328,11 +635,11 @@ void Profiler::draw()
     // threads might have 'unfinished' events, or multiple identical events
     // in this frame (i.e. start time would be incorrect).
     int thread_id = getThreadID();
-    AllEventData &aed = m_all_threads_data[thread_id].m_all_event_data;
-    AllEventData::iterator j;
-    for (j = aed.begin(); j != aed.end(); ++j)
+    const ThreadData &main_td = m_all_threads_data[thread_id];
+    for (int id : main_td.m_ordered_headings)
     {
-        const Marker &marker = j->second.getMarker(indx);
+        const Marker &marker =
+            main_td.m_all_event_data[id].getMarker(indx);
         start = std::min(start, marker.getStart());
         end = std::max(end, marker.getEnd());
     }   // for j in events
@@ -344,7 +651,7 @@ void Profiler::draw()
     // Get the mouse pos
     core::vector2di mouse_pos = GUIEngine::EventHandler::get()->getMousePos();
 
-    std::stack<AllEventData::iterator> hovered_markers;
+    std::stack<std::pair<int, const Marker*> > hovered_markers;
     for (int i = 0; i < m_threads_used; i++)
     {
         ThreadData &td = m_all_threads_data[i];
@@ -357,8 +664,8 @@ void Profiler::draw()
         double start_xpos = 0;
         for(int k=0; k<(int)td.m_ordered_headings.size(); k++)
         {
-            AllEventData::iterator j = aed.find(td.m_ordered_headings[k]);
-            const Marker &marker = j->second.getMarker(indx);
+            int id = td.m_ordered_headings[k];
+            const Marker &marker = aed[id].getMarker(indx);
             if (i == thread_id)
                 start_xpos = factor*marker.getStart();
             core::rect<s32> pos((s32)(x_offset + start_xpos),
@@ -373,11 +680,11 @@ void Profiler::draw()
             pos.UpperLeftCorner.Y  += 2 * (int)marker.getLayer();
             pos.LowerRightCorner.Y -= 2 * (int)marker.getLayer();
 
-            GL32_draw2DRectangle(j->second.getColour(), pos);
+            GL32_draw2DRectangle(m_marker_colours[id], pos);
             // If the mouse cursor is over the marker, get its information
             if (pos.isPointInside(mouse_pos))
             {
-                hovered_markers.push(j);
+                hovered_markers.push(std::make_pair(id, &marker));
             }
 
         }   // for j in AllEventdata
@@ -453,11 +760,10 @@ void Profiler::draw()
         core::stringw text;
         while(!hovered_markers.empty())
         {
-            AllEventData::iterator j = hovered_markers.top();
-            const Marker &marker = j->second.getMarker(indx);
+            const Marker &marker = *hovered_markers.top().second;
             std::ostringstream oss;
             oss.precision(4);
-            oss << j->first << " [" << (marker.getDuration()) << " ms / ";
+            oss << m_marker_names[hovered_markers.top().first] << " [" << (marker.getDuration()) << " ms / ";
             oss.precision(3);
             oss << marker.getDuration()*100.0 / duration << "%]" << std::endl;
             text += oss.str().c_str();
@@ -550,7 +856,8 @@ void Profiler::writeToFile()
         ThreadData &td = m_all_threads_data[thread_id];
         f << "#  ";
         for (unsigned int i = 0; i < td.m_ordered_headings.size(); i++)
-            f << "\"" << td.m_ordered_headings[i] << "(" << i+1 <<")\"   ";
+            f << "\"" << m_marker_names[td.m_ordered_headings[i]] << "("
+              << i+1 <<")\"   ";
         f << std::endl;
         int start = m_has_wrapped_around ? m_current_frame + 1 : 0;
         if (start > m_max_frames) start -= m_max_frames;
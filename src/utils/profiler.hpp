@@ -24,6 +24,7 @@
 #include <pthread.h>
 
 #include <assert.h>
+#include <stdio.h>
 #include <iostream>
 #include <list>
 #include <map>
@@ -31,6 +32,7 @@
 #include <stack>
 #include <streambuf>
 #include <string>
+#include <utility>
 #include <vector>
 
 enum QueryPerf
@@ -69,7 +71,17 @@ double getTimeMilliseconds();
 #define ENABLE_PROFILER
 
 #ifdef ENABLE_PROFILER
-    #define PROFILER_PUSH_CPU_MARKER(name, r, g, b) \
+    // The name must be a constant string: it is converted to a marker id
+    // only once. Use PROFILER_PUSH_CPU_DYNAMIC_MARKER for names that change.
+    #define PROFILER_PUSH_CPU_MARKER(name, r, g, b)                         \
+        do                                                                  \
+        {                                                                   \
+            static const int profiler_marker_id =                           \
+                profiler.getMarkerID(name, video::SColor(0xFF, r, g, b));   \
+            profiler.pushCPUMarker(profiler_marker_id);                     \
+        } while(0)
+
+    #define PROFILER_PUSH_CPU_DYNAMIC_MARKER(name, r, g, b) \
         profiler.pushCPUMarker(name, video::SColor(0xFF, r, g, b))
 
     #define PROFILER_POP_CPU_MARKER()  \
@@ -82,6 +94,7 @@ double getTimeMilliseconds();
         profiler.draw()
 #else
     #define PROFILER_PUSH_CPU_MARKER(name, r, g, b)
+    #define PROFILER_PUSH_CPU_DYNAMIC_MARKER(name, r, g, b)
     #define PROFILER_POP_CPU_MARKER()
     #define PROFILER_SYNC_FRAME()
     #define PROFILER_DRAW()
@@ -164,19 +177,17 @@ private:
     class EventData
     {
     private:
-        /** Colour to use in the on-screen display */
-        video::SColor m_colour;
-
         /** Vector of all buffered markers. */
         std::vector<Marker> m_all_markers;
 
     public:
         EventData() {}
-        EventData(video::SColor colour, int max_size)
-        {
-            m_all_markers.resize(max_size);
-            m_colour = colour;
-        }   // EventData
+        // --------------------------------------------------------------------
+        /** Allocates the buffer when this event is used the first time. */
+        void init(int max_size) { m_all_markers.resize(max_size); }
+        // --------------------------------------------------------------------
+        /** Returns true if this event was used in this thread. */
+        bool isUsed() const { return !m_all_markers.empty(); }
         // --------------------------------------------------------------------
         /** Records the start of an event for a given frame. */
         void setStart(size_t frame, double start, int layer)
@@ -195,27 +206,42 @@ private:
         const Marker& getMarker(int n) const { return m_all_markers[n]; }
         Marker& getMarker(int n) { return m_all_markers[n]; }
         // --------------------------------------------------------------------
-        /** Returns the colour for this event. */
-        video::SColor getColour() const { return m_colour;  }
-        // --------------------------------------------------------------------
     };   // EventData
 
     // ========================================================================
-    /** The mapping of event names to the corresponding EventData. */
-    typedef std::map<std::string, EventData> AllEventData;
+    /** The EventData of all markers, indexed by marker id. */
+    typedef std::vector<EventData> AllEventData;
+    // ========================================================================
+    /** A begin or end event recorded for the trace file. */
+    struct TraceEvent
+    {
+        /** Time in ms since the trace was started. */
+        double m_time;
+        /** The marker id for begin events, -1 for end events. */
+        int    m_marker_id;
+    };   // TraceEvent
     // ========================================================================
     struct ThreadData
     {
-        /** Stack of events to detect nesting. */
-        std::vector< std::string > m_event_stack;
+        /** Stack of marker ids to detect nesting. */
+        std::vector<int> m_event_stack;
 
-        /** This stores the event names in the order in which they occur.
+        /** This stores the marker ids in the order in which they occur.
         *  This means that 'outer' events occur here before any child
         *  events. This list is then used to determine the order in which the
         *  bar graphs are drawn, which results in the proper nesting of events.*/
-        std::vector<std::string> m_ordered_headings;
+        std::vector<int> m_ordered_headings;
 
         AllEventData m_all_event_data;
+
+        /** Trace events of this thread since the last frame sync. */
+        std::vector<TraceEvent> m_trace_events;
+
+        /** Number of markers pushed in this thread since the trace
+         *  started that are not yet popped. */
+        int m_trace_depth;
+
+        ThreadData() : m_trace_depth(0) {}
     };   // class ThreadData
 
     // ========================================================================
@@ -256,10 +282,51 @@ private:
     /** Time between now and last sync, used to scale the GUI bar. */
     double m_time_between_sync;
 
-    /** List of all event names. This list is sorted to make sure
-     *  if the circular buffer is dumped more than once the order
-     *  of events remains the same. */
-    std::vector<std::string> m_all_event_names;
+    /** The names of all markers, indexed by marker id. */
+    std::vector<std::string> m_marker_names;
+
+    /** The colours of all markers used in the on-screen display, indexed
+     *  by marker id. */
+    std::vector<video::SColor> m_marker_colours;
+
+    /** Maps marker names to marker ids. Only used when a marker is
+     *  registered, not when it is pushed. */
+    std::map<std::string, int> m_marker_ids;
+
+    /** The file the trace is written to, or NULL if no trace is active. */
+    FILE *m_trace_file;
+
+    /** Name of the trace file. */
+    std::string m_trace_filename;
+
+    /** Time (in ms) the trace was started. */
+    double m_trace_start;
+
+    /** How long (in ms) the trace should be recorded. */
+    double m_trace_duration;
+
+    /** Number of frames in the trace. */
+    int m_trace_frame;
+
+    /** True until the first event was written (used to write the commas
+     *  between events). */
+    bool m_trace_first_event;
+
+    /** True if the time of each marker of the main thread is recorded for
+     *  each frame to compute statistics (see startTickStats). */
+    bool m_tick_stats;
+
+    /** Marker ids and start times of the currently pushed markers of the
+     *  main thread, used for the tick statistics. */
+    std::vector<std::pair<int, double> > m_tick_stats_stack;
+
+    /** Time (in ms) spent in each marker in the current frame, indexed by
+     *  marker id. Negative if the marker was not used in this frame. */
+    std::vector<double> m_tick_durations;
+
+    /** The times (in ms) of each marker in all frames, indexed by marker
+     *  id. */
+    std::vector<std::vector<float> > m_tick_samples;
 
     // Handling freeze/unfreeze by clicking on the display
     enum FreezeState
@@ -275,14 +342,23 @@ private:
 private:
     int  getThreadID();
     void drawBackground();
+    void writeTraceEvent(const char *format, ...);
+    void flushTrace(double now);
 
 public:
              Profiler();
     virtual ~Profiler();
     void     init();
+    int      getMarkerID(const char* name,
+                         const video::SColor& colour=video::SColor());
+    void     pushCPUMarker(int marker_id);
     void     pushCPUMarker(const char* name="N/A",
                            const video::SColor& color=video::SColor());
     void     popCPUMarker();
+    void     startTrace(float seconds);
+    void     stopTrace();
+    void     startTickStats();
+    void     writeTickStats(FILE *f);
     void     toggleStatus(); 
     void     synchronizeFrame();
     void     draw();
@@ -291,6 +367,12 @@ public:
 
     // ------------------------------------------------------------------------
     bool isFrozen() const { return m_freeze_state == FROZEN; }
+    // ------------------------------------------------------------------------
+    /** Returns true if a trace is currently being written. */
+    bool isTracing() const { return m_trace_file != NULL; }
+    // ------------------------------------------------------------------------
+    /** Returns true if tick statistics are being recorded. */
+    bool isRecordingTickStats() const { return m_tick_stats; }
 
 };
 
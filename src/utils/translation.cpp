@@ -34,7 +34,9 @@
 #include <cstring>
 #include <cwchar>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
 #include <thread>
 
 #if ENABLE_BIDI
@@ -43,6 +45,8 @@
 
 #include "config/user_config.hpp"
 #include "io/file_manager.hpp"
+#include "io/mapped_file.hpp"
+#include "tinygettext/catalog_cache.hpp"
 #include "utils/constants.hpp"
 #include "utils/log.hpp"
 
@@ -63,7 +67,6 @@ Translations* translations = NULL;
 #endif
 
 #ifndef SERVER_ONLY
-const bool REMOVE_BOM = false;
 using namespace tinygettext;
 /** The list of available languages; this is global so that it is cached (and remains
     even if the translations object is deleted and re-created) */
@@ -76,6 +79,234 @@ const LanguageList* Translations::getLanguageList() const
 {
     return &g_language_list;
 }
+
+// ----------------------------------------------------------------------------
+namespace
+{
+    /** Version of the catalog cache files, must be increased if the format
+     *  changes. */
+    const uint32_t CATALOG_CACHE_VERSION = 1;
+
+    // ------------------------------------------------------------------------
+    /** Reads the values of a catalog cache file, and keeps track if all
+     *  reads were inside of the file. */
+    class CatalogReader
+    {
+    private:
+        const uint8_t *m_data;
+        size_t         m_size;
+        size_t         m_pos;
+        bool           m_ok;
+    public:
+        CatalogReader(const uint8_t *data, size_t size)
+        {
+            m_data = data;
+            m_size = size;
+            m_pos  = 0;
+            m_ok   = true;
+        }   // CatalogReader
+        // --------------------------------------------------------------------
+        uint32_t readUInt32()
+        {
+            uint32_t value = 0;
+            if (!m_ok || m_size - m_pos < sizeof(value))
+            {
+                m_ok = false;
+                return 0;
+            }
+            memcpy(&value, m_data + m_pos, sizeof(value));
+            m_pos += sizeof(value);
+            return value;
+        }   // readUInt32
+        // --------------------------------------------------------------------
+        std::string readString()
+        {
+            const uint32_t length = readUInt32();
+            if (!m_ok || m_size - m_pos < length)
+            {
+                m_ok = false;
+                return "";
+            }
+            std::string s((const char*)m_data + m_pos, length);
+            m_pos += length;
+            return s;
+        }   // readString
+        // --------------------------------------------------------------------
+        void readStrings(std::vector<std::string> *strings)
+        {
+            const uint32_t count = readUInt32();
+            // Each string needs at least 4 bytes, which avoids allocating
+            // huge vectors for invalid files.
+            if (!m_ok || (m_size - m_pos) / 4 < count)
+            {
+                m_ok = false;
+                return;
+            }
+            strings->resize(count);
+            for (uint32_t i = 0; i < count; i++)
+                (*strings)[i] = readString();
+        }   // readStrings
+        // --------------------------------------------------------------------
+        /** True if all reads were successful and the whole file was read. */
+        bool isValid() const { return m_ok && m_pos == m_size; }
+        // --------------------------------------------------------------------
+        bool ok() const { return m_ok; }
+    };   // CatalogReader
+
+    // ------------------------------------------------------------------------
+    void writeUInt32(std::string *out, uint32_t value)
+    {
+        out->append((const char*)&value, sizeof(value));
+    }   // writeUInt32
+    // ------------------------------------------------------------------------
+    void writeString(std::string *out, const std::string &s)
+    {
+        writeUInt32(out, (uint32_t)s.size());
+        out->append(s);
+    }   // writeString
+    // ------------------------------------------------------------------------
+    void writeStrings(std::string *out, const std::vector<std::string> &strings)
+    {
+        writeUInt32(out, (uint32_t)strings.size());
+        for (unsigned int i = 0; i < strings.size(); i++)
+            writeString(out, strings[i]);
+    }   // writeStrings
+
+    // ========================================================================
+    /** Caches the content of parsed .po files in the cached data directory,
+     *  which makes loading a language much faster. The name of a cache file
+     *  depends on the content of its .po file, so an updated translation is
+     *  parsed again.
+     */
+    class StkCatalogCache : public CatalogCache
+    {
+    private:
+        /** Returns the name of the cache file for a .po file, or an empty
+         *  string if the .po file can not be read. */
+        std::string getCacheFile(const std::string &pofile) const
+        {
+            uint64_t hash;
+            if (!file_manager->getFileHash(pofile, &hash))
+                return "";
+            std::ostringstream name;
+            name << file_manager->getCachedDataDir() << "po-"
+                 << StringUtils::removeExtension(
+                                             StringUtils::getBasename(pofile))
+                 << "-" << std::hex << std::setw(16) << std::setfill('0')
+                 << hash << ".bin";
+            return name.str();
+        }   // getCacheFile
+
+    public:
+        // --------------------------------------------------------------------
+        virtual bool load(const std::string &pofile, Dictionary &dict)
+        {
+            const std::string cache_file = getCacheFile(pofile);
+            if (cache_file.empty())
+                return false;
+            MappedFile file(cache_file);
+            if (!file.isValid())
+                return false;
+
+            // Read everything first, so that an invalid file does not leave
+            // a partly filled dictionary.
+            CatalogReader reader(file.getData(), file.getSize());
+            bool ok = reader.readUInt32() == CATALOG_CACHE_VERSION;
+            const std::string plural_string = reader.readString();
+            PluralForms plural_forms;
+            if (ok && !plural_string.empty())
+            {
+                plural_forms = PluralForms::from_string(plural_string);
+                ok = plural_forms;
+            }
+
+            struct Entry
+            {
+                std::string              m_msgctxt;
+                std::string              m_msgid;
+                std::vector<std::string> m_msgstrs;
+            };
+            std::vector<Entry> entries;
+            const uint32_t num_entries = reader.readUInt32();
+            for (uint32_t i = 0; ok && reader.ok() && i < num_entries; i++)
+            {
+                entries.emplace_back();
+                entries.back().m_msgid = reader.readString();
+                reader.readStrings(&entries.back().m_msgstrs);
+            }
+            const size_t num_no_ctxt = entries.size();
+            const uint32_t num_ctxt_entries = reader.readUInt32();
+            for (uint32_t i = 0; ok && reader.ok() && i < num_ctxt_entries;
+                 i++)
+            {
+                entries.emplace_back();
+                entries.back().m_msgctxt = reader.readString();
+                entries.back().m_msgid   = reader.readString();
+                reader.readStrings(&entries.back().m_msgstrs);
+            }
+            if (!ok || !reader.isValid())
+            {
+                Log::warn("Translation", "Ignoring invalid catalog cache "
+                          "file '%s'.", cache_file.c_str());
+                return false;
+            }
+
+            if (plural_forms)
+                dict.set_plural_forms(plural_forms);
+            for (size_t i = 0; i < entries.size(); i++)
+            {
+                if (i < num_no_ctxt)
+                    dict.add_translation(entries[i].m_msgid, "",
+                                         entries[i].m_msgstrs);
+                else
+                    dict.add_translation(entries[i].m_msgctxt,
+                                         entries[i].m_msgid, "",
+                                         entries[i].m_msgstrs);
+            }
+            return true;
+        }   // load
+
+        // --------------------------------------------------------------------
+        virtual void save(const std::string &pofile, Dictionary &dict)
+        {
+            const std::string cache_file = getCacheFile(pofile);
+            if (cache_file.empty())
+                return;
+
+            std::string data;
+            writeUInt32(&data, CATALOG_CACHE_VERSION);
+            writeString(&data, dict.get_plural_forms().get_string());
+
+            uint32_t num_entries = 0;
+            dict.foreach([&num_entries](const std::string&,
+                                        const std::vector<std::string>&)
+                         { num_entries++; });
+            writeUInt32(&data, num_entries);
+            dict.foreach([&data](const std::string &msgid,
+                                 const std::vector<std::string> &msgstrs)
+                         {
+                             writeString(&data, msgid);
+                             writeStrings(&data, msgstrs);
+                         });
+
+            uint32_t num_ctxt_entries = 0;
+            dict.foreach_ctxt([&num_ctxt_entries](const std::string&,
+                                                  const std::string&,
+                                                  const std::vector<std::string>&)
+                              { num_ctxt_entries++; });
+            writeUInt32(&data, num_ctxt_entries);
+            dict.foreach_ctxt([&data](const std::string &msgctxt,
+                                      const std::string &msgid,
+                                      const std::vector<std::string> &msgstrs)
+                              {
+                                  writeString(&data, msgctxt);
+                                  writeString(&data, msgid);
+                                  writeStrings(&data, msgstrs);
+                              });
+            file_manager->writeCacheFileAtomically(cache_file, data);
+        }   // save
+    };   // StkCatalogCache
+}   // namespace
 #endif
 
 // ----------------------------------------------------------------------------
@@ -181,6 +412,9 @@ wchar_t* fromFribidiChar(const FriBidiChar* str)
 Translations::Translations() //: m_dictionary_manager("UTF-16")
 {
 #ifndef SERVER_ONLY
+    m_cache = NULL;
+    m_dictionary_manager.set_catalog_cache(
+        std::unique_ptr<CatalogCache>(new StkCatalogCache()));
     m_dictionary_manager.add_directory(
                         file_manager->getAsset(FileManager::TRANSLATION,""));
 
@@ -425,6 +659,7 @@ Translations::Translations() //: m_dictionary_manager("UTF-16")
     m_rtl = true;
 #endif
 
+    initCache();
 #endif
 }   // Translations
 
@@ -432,8 +667,251 @@ Translations::Translations() //: m_dictionary_manager("UTF-16")
 
 Translations::~Translations()
 {
+#ifndef SERVER_ONLY
+    for (uint64_t i = 0; i <= m_cache_mask; i++)
+        delete m_cache[i].load(std::memory_order_relaxed);
+    delete[] m_cache;
+#endif
 }   // ~Translations
 
+#ifndef SERVER_ONLY
+// ----------------------------------------------------------------------------
+/** The key of a translation in the cache: the UTF-8 message id, prefixed by
+ *  the context (if any). Short keys are built in a fixed buffer, so looking
+ *  up a translation does not allocate memory.
+ */
+class Translations::CacheKey
+{
+private:
+    char        m_buffer[256];
+    /** Used instead of m_buffer for long keys. */
+    std::string m_long_key;
+    size_t      m_length;
+    uint64_t    m_hash;
+
+public:
+    CacheKey(const char* context)
+    {
+        m_length = 0;
+        m_hash   = 14695981039346656037ULL;
+        if (context)
+        {
+            append(context);
+            // Same separator as used by gettext
+            append('\004');
+        }
+    }   // CacheKey
+    // ------------------------------------------------------------------------
+    void append(char c)
+    {
+        if (m_length < sizeof(m_buffer))
+            m_buffer[m_length] = c;
+        else
+        {
+            if (m_length == sizeof(m_buffer))
+                m_long_key.assign(m_buffer, m_length);
+            m_long_key.push_back(c);
+        }
+        m_length++;
+        m_hash ^= (unsigned char)c;
+        m_hash *= 1099511628211ULL;
+    }   // append(char)
+    // ------------------------------------------------------------------------
+    void append(const char* s)
+    {
+        for (; *s; s++)
+            append(*s);
+    }   // append(const char*)
+    // ------------------------------------------------------------------------
+    /** Appends a wide string encoded as UTF-8. */
+    void append(const wchar_t* s)
+    {
+        for (; *s; s++)
+        {
+            uint32_t c = (uint32_t)s[0];
+            // Combine UTF-16 surrogate pairs (if wchar_t is 16 bit)
+            if (c >= 0xD800 && c <= 0xDBFF && (uint32_t)s[1] >= 0xDC00 &&
+                (uint32_t)s[1] <= 0xDFFF)
+            {
+                c = 0x10000 + ((c - 0xD800) << 10) + ((uint32_t)s[1] - 0xDC00);
+                s++;
+            }
+            if (c < 0x80)
+                append((char)c);
+            else if (c < 0x800)
+            {
+                append((char)(0xC0 | (c >> 6)));
+                append((char)(0x80 | (c & 0x3F)));
+            }
+            else if (c < 0x10000)
+            {
+                append((char)(0xE0 | (c >> 12)));
+                append((char)(0x80 | ((c >> 6) & 0x3F)));
+                append((char)(0x80 | (c & 0x3F)));
+            }
+            else
+            {
+                append((char)(0xF0 | (c >> 18)));
+                append((char)(0x80 | ((c >> 12) & 0x3F)));
+                append((char)(0x80 | ((c >> 6) & 0x3F)));
+                append((char)(0x80 | (c & 0x3F)));
+            }
+        }
+    }   // append(const wchar_t*)
+    // ------------------------------------------------------------------------
+    /** Appends the part of a plural key which depends on the count: the
+     *  translation only depends on the plural form selected by the count,
+     *  and (if the string is not translated) on whether the count is 1.
+     *  \param form The plural form selected by the count.
+     *  \param num The count. */
+    void appendPluralCount(unsigned int form, int num)
+    {
+        append('\0');
+        append((char)form);
+        append(num == 1 ? '1' : 'n');
+    }   // appendPluralCount
+    // ------------------------------------------------------------------------
+    const char* getData() const
+    {
+        return m_length <= sizeof(m_buffer) ? m_buffer : m_long_key.data();
+    }   // getData
+    // ------------------------------------------------------------------------
+    size_t   getLength() const { return m_length; }
+    // ------------------------------------------------------------------------
+    uint64_t getHash() const { return m_hash; }
+    // ------------------------------------------------------------------------
+    /** Returns true if the cached translation has this key. */
+    bool matches(const CachedTranslation *t) const
+    {
+        return t->m_hash == m_hash && t->m_key.size() == m_length &&
+               memcmp(t->m_key.data(), getData(), m_length) == 0;
+    }   // matches
+};   // CacheKey
+
+// ----------------------------------------------------------------------------
+/** Creates the translation cache, and adds all translations of the current
+ *  dictionary to it.
+ */
+void Translations::initCache()
+{
+    unsigned int num_entries = 0;
+    m_dictionary.foreach([&num_entries](const std::string&,
+                                        const std::vector<std::string>&)
+                         { num_entries++; });
+    m_dictionary.foreach_ctxt([&num_entries](const std::string&,
+                                             const std::string&,
+                                             const std::vector<std::string>&)
+                              { num_entries++; });
+
+    // Leave enough room for strings which are not in the dictionary, and
+    // keep the load factor (which is limited to 1/2) low.
+    uint64_t size = 8192;
+    while (size < 4 * (uint64_t)num_entries)
+        size *= 2;
+    m_cache      = new std::atomic<CachedTranslation*>[size];
+    m_cache_mask = size - 1;
+    m_cache_size = 0;
+    for (uint64_t i = 0; i < size; i++)
+        m_cache[i].store(NULL, std::memory_order_relaxed);
+
+    m_dictionary.foreach([this](const std::string& msgid,
+                                const std::vector<std::string>&)
+    {
+        CacheKey key(NULL);
+        key.append(msgid.c_str());
+        addCached(key, m_dictionary.translate(msgid));
+    });
+    m_dictionary.foreach_ctxt([this](const std::string& msgctxt,
+                                     const std::string& msgid,
+                                     const std::vector<std::string>&)
+    {
+        CacheKey key(msgctxt.c_str());
+        key.append(msgid.c_str());
+        addCached(key, m_dictionary.translate_ctxt(msgctxt, msgid));
+    });
+}   // initCache
+
+// ----------------------------------------------------------------------------
+/** Returns the cached translation with the given key, or NULL if the key
+ *  is not in the cache. This can be called from any thread without a lock.
+ */
+const Translations::CachedTranslation*
+                        Translations::findCached(const CacheKey &key) const
+{
+    // Since the load factor is limited, there is always an empty slot
+    for (uint64_t i = key.getHash(); ; i++)
+    {
+        const CachedTranslation *t =
+            m_cache[i & m_cache_mask].load(std::memory_order_acquire);
+        if (!t)
+            return NULL;
+        if (key.matches(t))
+            return t;
+    }
+}   // findCached
+
+// ----------------------------------------------------------------------------
+/** Adds a translation to the cache. If another thread added the same key in
+ *  the meantime, the existing translation is returned.
+ *  \param key The key of the translation.
+ *  \param translation The (UTF-8) translation.
+ *  \return The cached translation, or NULL if the cache is full.
+ */
+const Translations::CachedTranslation*
+                    Translations::addCached(const CacheKey &key,
+                                            const std::string &translation)
+{
+    if (m_cache_size.fetch_add(1) >= (m_cache_mask + 1) / 2)
+    {
+        m_cache_size.fetch_sub(1);
+        return NULL;
+    }
+
+    CachedTranslation *entry = new CachedTranslation();
+    entry->m_key.assign(key.getData(), key.getLength());
+    entry->m_hash        = key.getHash();
+    entry->m_translation = StringUtils::utf8ToWide(translation);
+    for (uint64_t i = key.getHash(); ; i++)
+    {
+        std::atomic<CachedTranslation*> &slot = m_cache[i & m_cache_mask];
+        CachedTranslation *current = NULL;
+        if (slot.compare_exchange_strong(current, entry,
+                                         std::memory_order_acq_rel,
+                                         std::memory_order_acquire))
+            return entry;
+        if (key.matches(current))
+        {
+            delete entry;
+            m_cache_size.fetch_sub(1);
+            return current;
+        }
+    }
+}   // addCached
+
+// ----------------------------------------------------------------------------
+/** Returns the wide string of a translation which was not found in the
+ *  cache, and adds it to the cache.
+ *  \param key The key of the translation.
+ *  \param translation The (UTF-8) translation.
+ */
+const wchar_t* Translations::getTranslation(const CacheKey &key,
+                                            const std::string &translation)
+{
+    const CachedTranslation *t = addCached(key, translation);
+    if (t)
+        return t->m_translation.c_str();
+
+    // The cache is full, use a buffer for each thread instead (which is
+    // valid until the next call from the same thread).
+    std::lock_guard<std::mutex> lock(m_gettext_mutex);
+    static std::map<std::thread::id, core::stringw> original_tw;
+    core::stringw &buffer = original_tw[std::this_thread::get_id()];
+    buffer = StringUtils::utf8ToWide(translation);
+    return buffer.c_str();
+}   // getTranslation
+#endif
+
+
 // ----------------------------------------------------------------------------
 
 const wchar_t* Translations::fribidize(const wchar_t* in_ptr)
@@ -517,8 +995,24 @@ bool Translations::isRTLText(const wchar_t *in_ptr)
  */
 const wchar_t* Translations::w_gettext(const wchar_t* original, const char* context)
 {
+#ifdef SERVER_ONLY
     std::string in = StringUtils::wideToUtf8(original);
     return w_gettext(in.c_str(), context);
+#else
+    if (original[0] == L'\0') return L"";
+
+    CacheKey key(context);
+    key.append(original);
+    const CachedTranslation *t = findCached(key);
+    if (t)
+        return t->m_translation.c_str();
+
+    // Only convert the string if it is not cached yet
+    std::string in = StringUtils::wideToUtf8(original);
+    return getTranslation(key, context == NULL ?
+                               m_dictionary.translate(in) :
+                               m_dictionary.translate_ctxt(context, in));
+#endif
 }
 
 /**
@@ -541,18 +1035,13 @@ const wchar_t* Translations::w_gettext(const char* original, const char* context
     Log::info("Translations", "Translating %s", original);
 #endif
 
-    const std::string& original_t = (context == NULL ?
+    CacheKey key(context);
+    key.append(original);
+    const CachedTranslation *t = findCached(key);
+    const wchar_t* out_ptr = t ? t->m_translation.c_str()
+                               : getTranslation(key, context == NULL ?
                                      m_dictionary.translate(original) :
                                      m_dictionary.translate_ctxt(context, original));
-    // print
-    //for (int n=0;; n+=4)
-    std::lock_guard<std::mutex> lock(m_gettext_mutex);
-
-    static std::map<std::thread::id, core::stringw> original_tw;
-    original_tw[std::this_thread::get_id()] = StringUtils::utf8ToWide(original_t);
-
-    const wchar_t* out_ptr = original_tw.at(std::this_thread::get_id()).c_str();
-    if (REMOVE_BOM) out_ptr++;
 
 #if TRANSLATE_VERBOSE
     std::wcout << L"  translation : " << out_ptr << std::endl;
@@ -571,9 +1060,28 @@ const wchar_t* Translations::w_gettext(const char* original, const char* context
  */
 const wchar_t* Translations::w_ngettext(const wchar_t* singular, const wchar_t* plural, int num, const char* context)
 {
+#ifdef SERVER_ONLY
     std::string in = StringUtils::wideToUtf8(singular);
     std::string in2 = StringUtils::wideToUtf8(plural);
     return w_ngettext(in.c_str(), in2.c_str(), num, context);
+#else
+    CacheKey key(context);
+    key.append(singular);
+    key.append('\0');
+    key.append(plural);
+    key.appendPluralCount(m_dictionary.get_plural_forms().get_plural(num),
+                          num);
+    const CachedTranslation *t = findCached(key);
+    if (t)
+        return t->m_translation.c_str();
+
+    // Only convert the strings if they are not cached yet
+    std::string in = StringUtils::wideToUtf8(singular);
+    std::string in2 = StringUtils::wideToUtf8(plural);
+    return getTranslation(key, context == NULL ?
+                          m_dictionary.translate_plural(in, in2, num) :
+                          m_dictionary.translate_ctxt_plural(context, in, in2, num));
+#endif
 }
 
 /**
@@ -592,18 +1100,18 @@ const wchar_t* Translations::w_ngettext(const char* singular, const char* plural
 
 #else
 
-    const std::string& res = (context == NULL ?
+    CacheKey key(context);
+    key.append(singular);
+    key.append('\0');
+    key.append(plural);
+    key.appendPluralCount(m_dictionary.get_plural_forms().get_plural(num),
+                          num);
+    const CachedTranslation *t = findCached(key);
+    const wchar_t* out_ptr = t ? t->m_translation.c_str()
+                               : getTranslation(key, context == NULL ?
                               m_dictionary.translate_plural(singular, plural, num) :
                               m_dictionary.translate_ctxt_plural(context, singular, plural, num));
 
-    std::lock_guard<std::mutex> lock(m_ngettext_mutex);
-
-    static std::map<std::thread::id, core::stringw> str_buffer;
-    str_buffer[std::this_thread::get_id()] = StringUtils::utf8ToWide(res);
-
-    const wchar_t* out_ptr = str_buffer.at(std::this_thread::get_id()).c_str();
-    if (REMOVE_BOM) out_ptr++;
-
 #if TRANSLATE_VERBOSE
     std::wcout << L"  translation : " << out_ptr << std::endl;
 #endif
@@ -20,6 +20,7 @@
 #define TRANSLATION_HPP
 
 #include <irrString.h>
+#include <atomic>
 #include <map>
 #include <mutex>
 #include <set>
@@ -61,7 +62,39 @@ private:
 
     std::string m_current_language_name;
     std::string m_current_language_name_code;
-    std::mutex m_fribidized_mutex, m_gettext_mutex, m_ngettext_mutex;
+    std::mutex m_fribidized_mutex, m_gettext_mutex;
+
+    class CacheKey;
+
+    /** A translation that was decoded to a wide string. */
+    struct CachedTranslation
+    {
+        /** The key: the (UTF-8) message id, prefixed by the context. */
+        std::string        m_key;
+        uint64_t           m_hash;
+        irr::core::stringw m_translation;
+    };
+
+    /** Hash table (with open addressing) of all decoded translations. The
+     *  translations of the dictionary are added when the language is
+     *  loaded, other strings when they are requested the first time. A slot
+     *  is set once with compare-and-swap and then never changed until this
+     *  object is deleted, so lookups need no lock, and the returned strings
+     *  stay valid. */
+    std::atomic<CachedTranslation*> *m_cache;
+
+    /** Number of slots in m_cache minus 1 (the size is a power of 2). */
+    uint64_t                  m_cache_mask;
+
+    /** Number of used slots in m_cache. */
+    std::atomic<unsigned int> m_cache_size;
+
+    void initCache();
+    const CachedTranslation* findCached(const CacheKey &key) const;
+    const CachedTranslation* addCached(const CacheKey &key,
+                                       const std::string &translation);
+    const wchar_t* getTranslation(const CacheKey &key,
+                                  const std::string &translation);
 #endif
 
 public:
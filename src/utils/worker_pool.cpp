@@ -0,0 +1,147 @@
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2019 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#include "utils/worker_pool.hpp"
+
+#include "utils/string_utils.hpp"
+#include "utils/vs.hpp"
+
+#include <assert.h>
+
+// ----------------------------------------------------------------------------
+/** Creates the worker threads.
+ *  \param num_threads Total number of threads to use including the thread
+ *         calling run(), so num_threads-1 worker threads are started.
+ *  \param name Short name used to name the worker threads for debugging.
+ */
+WorkerPool::WorkerPool(unsigned num_threads, const std::string &name)
+{
+    m_job          = NULL;
+    m_num_indices  = 0;
+    m_next_index.store(0);
+    m_generation   = 0;
+    m_busy_workers = 0;
+    m_exit         = false;
+    for (unsigned i = 1; i < num_threads; i++)
+    {
+        m_threads.emplace_back(std::bind(&WorkerPool::workerLoop, this, i,
+                                         name));
+    }
+}   // WorkerPool
+
+// ----------------------------------------------------------------------------
+/** Stops and joins all worker threads. */
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_exit = true;
+    }
+    m_start_cv.notify_all();
+    for (std::thread &t : m_threads)
+        t.join();
+}   // ~WorkerPool
+
+// ----------------------------------------------------------------------------
+/** Returns the number of threads to use by default: one per core, but at
+ *  most 8, since the jobs done by STK are small.
+ */
+unsigned WorkerPool::getDefaultNumThreads()
+{
+    unsigned n = std::thread::hardware_concurrency();
+    if (n == 0)
+        n = 1;
+    return n > 8 ? 8 : n;
+}   // getDefaultNumThreads
+
+// ----------------------------------------------------------------------------
+/** Processes indices of the current job till no more are left. */
+void WorkerPool::workOnJob()
+{
+    while (true)
+    {
+        unsigned i = m_next_index.fetch_add(1);
+        if (i >= m_num_indices)
+            return;
+        (*m_job)(i);
+    }
+}   // workOnJob
+
+// ----------------------------------------------------------------------------
+/** The main loop of each worker thread: waits for a new job, then takes
+ *  part in processing it.
+ */
+void WorkerPool::workerLoop(unsigned id, const std::string &name)
+{
+    VS::setThreadName((name + StringUtils::toString(id)).c_str());
+    unsigned last_generation = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> ul(m_mutex);
+            m_start_cv.wait(ul, [this, last_generation]
+                {
+                    return m_exit || m_generation != last_generation;
+                });
+            if (m_exit)
+                return;
+            last_generation = m_generation;
+        }
+        workOnJob();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_busy_workers--;
+            if (m_busy_workers == 0)
+                m_done_cv.notify_one();
+        }
+    }
+}   // workerLoop
+
+// ----------------------------------------------------------------------------
+/** Calls job(i) for all i in [0, num_indices), distributed over all
+ *  threads of this pool. The order in which the indices are processed is
+ *  undefined, so each job must only write data that belongs to its index.
+ *  This function returns once all jobs are finished.
+ *  \param num_indices Number of times job is called.
+ *  \param job The function to call.
+ */
+void WorkerPool::run(unsigned num_indices,
+                     const std::function<void(unsigned)> &job)
+{
+    if (m_threads.empty() || num_indices < 2)
+    {
+        for (unsigned i = 0; i < num_indices; i++)
+            job(i);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        assert(m_busy_workers == 0);
+        m_job          = &job;
+        m_num_indices  = num_indices;
+        m_next_index.store(0);
+        m_busy_workers = (unsigned)m_threads.size();
+        m_generation++;
+    }
+    m_start_cv.notify_all();
+    workOnJob();
+
+    std::unique_lock<std::mutex> ul(m_mutex);
+    m_done_cv.wait(ul, [this] { return m_busy_workers == 0; });
+    m_job = NULL;
+}   // run
@@ -0,0 +1,88 @@
+//  SuperTuxKart - a fun racing game with go-kart
+//  Copyright (C) 2019 SuperTuxKart-Team
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 3
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+#ifndef HEADER_WORKER_POOL_HPP
+#define HEADER_WORKER_POOL_HPP
+
+#include "utils/no_copy.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/** A small pool of persistent worker threads, used to run a number of
+ *  independent jobs in parallel, e.g. once per time step. Starting new
+ *  threads for each time step would be too expensive. The calling thread
+ *  takes part in the work, and run() only returns once all jobs are done.
+ *  \ingroup utils
+ */
+class WorkerPool : public NoCopy
+{
+private:
+    /** The worker threads (not including the calling thread). */
+    std::vector<std::thread> m_threads;
+
+    /** Protects the job data and is used with the condition variables. */
+    std::mutex m_mutex;
+
+    /** Signals the workers that a new job is available or that the pool
+     *  is shutting down. */
+    std::condition_variable m_start_cv;
+
+    /** Signals run() that all workers are finished with the current job. */
+    std::condition_variable m_done_cv;
+
+    /** The function to execute for each index. */
+    const std::function<void(unsigned)> *m_job;
+
+    /** Number of indices of the current job. */
+    unsigned m_num_indices;
+
+    /** The next index to be processed. */
+    std::atomic<unsigned> m_next_index;
+
+    /** Increased for each job, so workers can detect a new job. */
+    unsigned m_generation;
+
+    /** Number of workers still working on the current job. */
+    unsigned m_busy_workers;
+
+    /** Set to stop all worker threads. */
+    bool m_exit;
+
+    void workOnJob();
+    void workerLoop(unsigned id, const std::string &name);
+
+public:
+             WorkerPool(unsigned num_threads, const std::string &name);
+            ~WorkerPool();
+    void     run(unsigned num_indices,
+                 const std::function<void(unsigned)> &job);
+    static unsigned getDefaultNumThreads();
+    // ------------------------------------------------------------------------
+    /** Returns the number of threads used, including the calling thread. */
+    unsigned getNumThreads() const
+    {
+        return (unsigned)m_threads.size() + 1;
+    }   // getNumThreads
+};   // WorkerPool
+
+#endif
@@ -0,0 +1,74 @@
+#!/bin/bash
+#
+# Runs a fixed set of AI races without graphics and writes the benchmark
+# results (time step statistics of the profiler markers and the race
+# result) of each race as JSON to the output directory. Since the races
+# use a fixed seed and time step, each race must give the same result as
+# recorded in the reference file, otherwise the script fails.
+#
+# Usage: benchmark.sh path/to/supertuxkart [output_dir] [--record]
+#   --record  (Re)creates the reference file, e.g. after intended changes
+#             to the AI or physics.
+
+if [ -z "$1" ]; then
+    echo "Usage: $0 path/to/supertuxkart [output_dir] [--record]"
+    exit 1
+fi
+
+stk=$1
+out=${2:-benchmark}
+if [ "$out" == "--record" ]; then
+    out=benchmark
+fi
+record=0
+for arg in "$@"; do
+    if [ "$arg" == "--record" ]; then
+        record=1
+    fi
+done
+
+tracks="lighthouse zengarden snowmountain hacienda"
+num_karts="4 8 16 32"
+difficulties="0 1 2 3"
+laps=2
+seed=1234
+reference=$(dirname "$0")/benchmark_results.txt
+
+if [ ! -f "$reference" ]; then
+    echo "No reference file $reference found, recording results."
+    record=1
+fi
+if [ $record == 1 ]; then
+    rm -f "$reference"
+fi
+
+mkdir -p "$out"
+failed=0
+for track in $tracks; do
+    for karts in $num_karts; do
+        for difficulty in $difficulties; do
+            name=$track-$karts-$difficulty
+            echo "Running $name"
+            expected=""
+            if [ $record == 0 ]; then
+                expected=$(grep "^$name " "$reference" | cut -d' ' -f2)
+            fi
+            $stk --log=0 --no-graphics --no-sound --seed=$seed \
+                 --track=$track --numkarts=$karts --difficulty=$difficulty \
+                 --profile-laps=$laps --benchmark="$out/$name.json" \
+                 ${expected:+--benchmark-result=$expected} \
+                 > "$out/stdout.$name" 2>&1
+            if [ $? != 0 ]; then
+                echo "  FAILED, see $out/stdout.$name"
+                failed=1
+            fi
+            if [ $record == 1 ]; then
+                hash=$(sed -n 's/.*"result_hash": "\([0-9a-f]*\)".*/\1/p' \
+                           "$out/$name.json")
+                echo "$name $hash" >> "$reference"
+            fi
+        done
+    done
+done
+
+exit $failed